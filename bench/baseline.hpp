@@ -0,0 +1,223 @@
+#pragma once
+
+// repeated trials and baselines. the driver runs each workload --trials
+// times and sums every metric up as a mean with a 95% confidence interval;
+// --save_baseline=NAME keeps that summary, and --baseline=NAME compares a
+// later run with it metric by metric.
+//
+// a metric regresses when it moved the wrong way by more than
+// --regress_pct percent and the move is significant: the 95% interval of
+// the difference of the means (welch) excludes zero. the unit says which
+// way is wrong: rates and speedups should rise, times should fall. a metric
+// in any other unit that moves as far is reported as changed instead. with
+// a single trial on either side there is no spread to test against, and
+// the threshold alone decides.
+//
+// summaries are tab-separated text, a header and then one metric per line,
+// so a baseline file is also the machine-readable report (--output), and a
+// report can be kept as a baseline by copying it.
+
+#include "bench.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace dsa::bench {
+
+// two-sided 95% quantile of student's t with df degrees of freedom.
+inline double t95(double df) {
+    static const double table[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                   2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                   2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    if (df < 1) return 0;
+    auto i = static_cast<std::size_t>(df);
+    return i <= 30 ? table[i - 1] : 1.96 + 2.4 / df;
+}
+
+struct summary {
+    std::string workload;
+    std::string name;
+    std::string unit;
+    std::size_t trials = 0;
+    double mean = 0;
+    double stddev = 0;
+
+    // half-width of the 95% confidence interval of the mean.
+    double ci95() const {
+        return trials < 2 ? 0 : t95(static_cast<double>(trials - 1)) * stddev / std::sqrt(static_cast<double>(trials));
+    }
+};
+
+// +1 when a higher value is better, -1 when a lower one is, 0 when the unit
+// does not say.
+inline int better(const std::string& unit) {
+    if (unit == "x" || (unit.size() > 2 && unit.compare(unit.size() - 2, 2, "/s") == 0)) return 1;
+    if (unit == "ns" || unit == "us" || unit == "ms" || unit == "s") return -1;
+    return 0;
+}
+
+// the metrics of every trial of one workload, in the order they first
+// appeared.
+class trial_set {
+public:
+    void add(const report& r) {
+        for (const metric& m : r.metrics()) {
+            auto [it, fresh] = index_.emplace(m.name, samples_.size());
+            if (fresh) samples_.push_back({m.name, m.unit, {}});
+            samples_[it->second].values.push_back(m.value);
+        }
+    }
+
+    std::vector<summary> summarise(const std::string& workload) const {
+        std::vector<summary> out;
+        for (const series& s : samples_) {
+            summary m{workload, s.name, s.unit, s.values.size()};
+            for (double v : s.values) m.mean += v;
+            m.mean /= static_cast<double>(m.trials);
+            if (m.trials > 1) {
+                double ss = 0;
+                for (double v : s.values) ss += (v - m.mean) * (v - m.mean);
+                m.stddev = std::sqrt(ss / static_cast<double>(m.trials - 1));
+            }
+            out.push_back(std::move(m));
+        }
+        return out;
+    }
+
+private:
+    struct series {
+        std::string name;
+        std::string unit;
+        std::vector<double> values;
+    };
+
+    std::vector<series> samples_;
+    std::map<std::string, std::size_t> index_;
+};
+
+enum class verdict { same, improved, regressed, changed, added };
+
+inline const char* verdict_name(verdict v) {
+    static const char* names[] = {"ok", "improved", "regressed", "changed", "new"};
+    return names[static_cast<unsigned>(v)];
+}
+
+struct comparison {
+    const summary* base = nullptr; // null for a metric the baseline lacks
+    double change_pct = 0;         // of the baseline mean
+    double diff_ci95 = 0;          // half-width for the difference of the means; 0 untested
+    verdict result = verdict::added;
+};
+
+inline comparison compare(const summary& now, const summary* base, double threshold_pct) {
+    comparison c;
+    c.base = base;
+    if (!base) return c;
+    double diff = now.mean - base->mean;
+    c.change_pct = base->mean != 0 ? 100.0 * diff / std::fabs(base->mean) : (diff != 0 ? 100.0 : 0.0);
+    bool significant = true;
+    if (now.trials > 1 && base->trials > 1) {
+        double va = now.stddev * now.stddev / static_cast<double>(now.trials);
+        double vb = base->stddev * base->stddev / static_cast<double>(base->trials);
+        double se = std::sqrt(va + vb);
+        // welch-satterthwaite degrees of freedom.
+        double df = se > 0 ? (va + vb) * (va + vb) /
+                                 (va * va / static_cast<double>(now.trials - 1) + vb * vb / static_cast<double>(base->trials - 1))
+                           : 1e9;
+        c.diff_ci95 = t95(df) * se;
+        significant = std::fabs(diff) > c.diff_ci95;
+    }
+    c.result = verdict::same;
+    if (!significant || std::fabs(c.change_pct) <= threshold_pct) return c;
+    int dir = better(now.unit);
+    if (!dir) c.result = verdict::changed;
+    else c.result = (diff > 0) == (dir > 0) ? verdict::improved : verdict::regressed;
+    return c;
+}
+
+// a baseline file: the run's options as comment lines, a header, then the
+// summaries.
+struct baseline {
+    std::vector<std::string> options; // --key=value as given
+    std::vector<summary> metrics;
+
+    const summary* find(const std::string& workload, const std::string& name) const {
+        for (const summary& m : metrics)
+            if (m.workload == workload && m.name == name) return &m;
+        return nullptr;
+    }
+};
+
+inline const char* summary_header = "workload\tmetric\tunit\ttrials\tmean\tstddev\tci95";
+
+inline std::string format_number(double v) {
+    char buf[32];
+    std::snprintf(buf, sizeof buf, "%.9g", v);
+    return buf;
+}
+
+inline std::string format_summary(const summary& m) {
+    return m.workload + '\t' + m.name + '\t' + m.unit + '\t' + std::to_string(m.trials) + '\t' + format_number(m.mean) +
+           '\t' + format_number(m.stddev) + '\t' + format_number(m.ci95());
+}
+
+// reads a file written by write_summaries, ignoring any comparison columns
+// after the summary's own.
+inline baseline read_baseline(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) throw std::runtime_error("cannot read baseline " + path);
+    baseline b;
+    std::string line;
+    bool header = false;
+    while (std::getline(in, line)) {
+        if (line.empty()) continue;
+        if (line[0] == '#') {
+            if (line.rfind("# --", 0) == 0) b.options.push_back(line.substr(2));
+            continue;
+        }
+        if (!header) {
+            if (line.rfind(summary_header, 0) != 0) throw std::runtime_error("not a benchmark summary: " + path);
+            header = true;
+            continue;
+        }
+        std::vector<std::string> f;
+        std::istringstream fields(line);
+        for (std::string s; std::getline(fields, s, '\t');) f.push_back(s);
+        if (f.size() < 6) throw std::runtime_error("bad line in " + path + ": " + line);
+        summary m{f[0], f[1], f[2], static_cast<std::size_t>(std::stoull(f[3])), std::stod(f[4]), std::stod(f[5])};
+        b.metrics.push_back(std::move(m));
+    }
+    if (!header) throw std::runtime_error("not a benchmark summary: " + path);
+    return b;
+}
+
+// writes the summaries, and when a baseline was given the comparison with
+// it: the baseline's trials, mean and interval, the change in percent, the
+// interval of the difference and the verdict.
+inline void write_summaries(const std::string& path, const std::vector<std::string>& options,
+                            const std::vector<summary>& metrics, const std::vector<comparison>* against) {
+    std::ofstream out(path, std::ios::trunc);
+    out << "# dsa_bench summary\n";
+    for (const std::string& o : options) out << "# " << o << "\n";
+    out << summary_header;
+    if (against) out << "\tbase_trials\tbase_mean\tbase_ci95\tchange_pct\tdiff_ci95\tverdict";
+    out << "\n";
+    for (std::size_t i = 0; i < metrics.size(); ++i) {
+        out << format_summary(metrics[i]);
+        if (against) {
+            const comparison& c = (*against)[i];
+            if (c.base)
+                out << '\t' << c.base->trials << '\t' << format_number(c.base->mean) << '\t' << format_number(c.base->ci95())
+                    << '\t' << format_number(c.change_pct) << '\t' << format_number(c.diff_ci95);
+            else out << "\t\t\t\t\t";
+            out << '\t' << verdict_name(c.result);
+        }
+        out << "\n";
+    }
+    out.flush();
+    if (!out) throw std::runtime_error("cannot write " + path);
+}
+
+} // namespace dsa::bench
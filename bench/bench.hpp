@@ -0,0 +1,240 @@
+#pragma once
+
+// benchmark driver framework. workloads, env kinds and store kinds register
+// themselves from their own translation units, so any workload runs against
+// any env and any backend:
+//
+//   dsa_bench --env=sim --sim.profile=hdd --store=bitcask --workload=kv.*
+
+#include "perf.hpp"
+
+#include <dsa/env.hpp>
+#include <dsa/histogram.hpp>
+#include <dsa/lock.hpp>
+#include <dsa/store.hpp>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dsa::bench {
+
+// --key=value pairs from the command line.
+class options {
+public:
+    void set(std::string key, std::string value) { kv_[std::move(key)] = std::move(value); }
+    bool has(const std::string& key) const { return kv_.count(key) != 0; }
+
+    std::string str(const std::string& key, const std::string& def = "") const {
+        auto it = kv_.find(key);
+        return it == kv_.end() ? def : it->second;
+    }
+
+    // integers accept a k / m / g suffix meaning 10^3 / 10^6 / 10^9.
+    std::uint64_t u64(const std::string& key, std::uint64_t def) const {
+        auto it = kv_.find(key);
+        if (it == kv_.end()) return def;
+        std::size_t end = 0;
+        std::uint64_t v = std::stoull(it->second, &end);
+        std::string suffix = it->second.substr(end);
+        if (suffix == "k") v *= 1'000;
+        else if (suffix == "m") v *= 1'000'000;
+        else if (suffix == "g") v *= 1'000'000'000;
+        else if (!suffix.empty()) throw std::invalid_argument("bad integer for --" + key + ": " + it->second);
+        return v;
+    }
+
+    double f64(const std::string& key, double def) const {
+        auto it = kv_.find(key);
+        return it == kv_.end() ? def : std::stod(it->second);
+    }
+
+    const std::map<std::string, std::string>& all() const { return kv_; }
+
+private:
+    std::map<std::string, std::string> kv_;
+};
+
+struct metric {
+    std::string name;
+    double value;
+    std::string unit;
+};
+
+class report {
+public:
+    void add(std::string name, double value, std::string unit = "") {
+        metrics_.push_back({std::move(name), value, std::move(unit)});
+    }
+
+    // hardware counters for begin_phase; the driver attaches them when it
+    // could open any.
+    void attach(const perf_counters* counters) { counters_ = counters; }
+
+    // marks the start of a measured phase, so the next add_ops also reports
+    // the phase's hardware counters per operation.
+    void begin_phase() {
+        if (!counters_) return;
+        phase_ = counters_->read();
+        in_phase_ = true;
+    }
+
+    // count, throughput over elapsed_ns and the usual latency percentiles.
+    void add_ops(const std::string& prefix, const histogram& h, std::uint64_t elapsed_ns) {
+        add(prefix + ".ops", static_cast<double>(h.count()));
+        if (elapsed_ns) add(prefix + ".throughput", static_cast<double>(h.count()) * 1e9 / static_cast<double>(elapsed_ns), "ops/s");
+        add_latency(prefix, h);
+        if (in_phase_) {
+            in_phase_ = false;
+            if (h.count()) add_counters(prefix, phase_, counters_->read(), static_cast<double>(h.count()));
+        }
+    }
+
+    // counter deltas between two reads, per op when ops is not 1, and the
+    // instructions per cycle.
+    void add_counters(const std::string& prefix, const perf_counters::values& from, const perf_counters::values& to, double ops) {
+        const char* per = ops == 1 ? "" : "_per_op";
+        for (unsigned i = 0; i < perf_counters::count; ++i)
+            if (counters_->has(i)) add(prefix + "." + perf_counters::name(i) + per, (to[i] - from[i]) / ops);
+        if (counters_->has(0) && counters_->has(1) && to[0] > from[0]) add(prefix + ".ipc", (to[1] - from[1]) / (to[0] - from[0]));
+    }
+
+    void add_latency(const std::string& prefix, const histogram& h) {
+        add(prefix + ".mean", h.mean() / 1e3, "us");
+        add(prefix + ".p50", static_cast<double>(h.percentile(50)) / 1e3, "us");
+        add(prefix + ".p99", static_cast<double>(h.percentile(99)) / 1e3, "us");
+        add(prefix + ".p999", static_cast<double>(h.percentile(99.9)) / 1e3, "us");
+        add(prefix + ".max", static_cast<double>(h.max()) / 1e3, "us");
+    }
+
+    // how often a lock made its takers wait, and for how long; hold times
+    // are sampled.
+    void add_lock(const std::string& prefix, const lock_stats& s) {
+        add(prefix + ".acquisitions", static_cast<double>(s.acquisitions));
+        if (!s.acquisitions) return;
+        add(prefix + ".contended", 100.0 * static_cast<double>(s.contended) / static_cast<double>(s.acquisitions), "%");
+        add(prefix + ".parked", static_cast<double>(s.parked));
+        add(prefix + ".wait_total", static_cast<double>(s.wait_ns) / 1e6, "ms");
+        add(prefix + ".wait_p99", static_cast<double>(s.wait.percentile(99)) / 1e3, "us");
+        add(prefix + ".hold_p50", static_cast<double>(s.hold.percentile(50)) / 1e3, "us");
+        add(prefix + ".hold_p99", static_cast<double>(s.hold.percentile(99)) / 1e3, "us");
+    }
+
+    const std::vector<metric>& metrics() const { return metrics_; }
+
+private:
+    std::vector<metric> metrics_;
+    const perf_counters* counters_ = nullptr;
+    perf_counters::values phase_{};
+    bool in_phase_ = false;
+};
+
+struct context {
+    env& fs;
+    std::string dir; // scratch directory owned by this run, empty on entry
+    const options& opts;
+    report& out;
+};
+
+using workload_fn = void (*)(context&);
+
+struct workload {
+    std::string name;
+    std::string help;
+    workload_fn run;
+};
+
+inline std::vector<workload>& workloads() {
+    static std::vector<workload> w;
+    return w;
+}
+
+struct register_workload {
+    register_workload(std::string name, std::string help, workload_fn run) {
+        workloads().push_back({std::move(name), std::move(help), run});
+    }
+};
+
+using env_factory = std::unique_ptr<env> (*)(const options&);
+
+struct env_kind {
+    std::string name;
+    std::string help;
+    env_factory make;
+    // whether the env keeps files on the real filesystem, so the driver
+    // knows to clean scratch directories up.
+    bool on_disk;
+};
+
+inline std::vector<env_kind>& env_kinds() {
+    static std::vector<env_kind> k;
+    return k;
+}
+
+struct register_env {
+    register_env(std::string name, std::string help, env_factory make, bool on_disk) {
+        env_kinds().push_back({std::move(name), std::move(help), make, on_disk});
+    }
+};
+
+inline const env_kind& find_env_kind(const std::string& name) {
+    for (const env_kind& k : env_kinds())
+        if (k.name == name) return k;
+    throw std::invalid_argument("unknown env: " + name);
+}
+
+using store_factory = std::unique_ptr<store> (*)(env&, const std::string& dir, const options&);
+using store_describer = void (*)(store&, report&);
+
+struct store_kind {
+    std::string name;
+    std::string help;
+    store_factory open;
+    // adds backend-specific metrics after a workload; may be null.
+    store_describer describe;
+};
+
+inline std::vector<store_kind>& store_kinds() {
+    static std::vector<store_kind> k;
+    return k;
+}
+
+struct register_store {
+    register_store(std::string name, std::string help, store_factory open, store_describer describe = nullptr) {
+        store_kinds().push_back({std::move(name), std::move(help), open, describe});
+    }
+};
+
+inline const store_kind& find_store_kind(const std::string& name) {
+    for (const store_kind& k : store_kinds())
+        if (k.name == name) return k;
+    throw std::invalid_argument("unknown store: " + name);
+}
+
+// opens the backend picked with --store in the run's scratch directory.
+inline std::unique_ptr<store> open_store(context& c) {
+    return find_store_kind(c.opts.str("store", "bitcask")).open(c.fs, join_path(c.dir, "store"), c.opts);
+}
+
+inline void describe_store(context& c, store& s) {
+    const store_kind& k = find_store_kind(c.opts.str("store", "bitcask"));
+    if (k.describe) k.describe(s, c.out);
+}
+
+// runs fn(thread_index) on n threads and merges the histograms they return.
+template <class Fn>
+histogram run_threads(unsigned n, Fn fn) {
+    std::vector<histogram> parts(n);
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < n; ++t) threads.emplace_back([&, t] { parts[t] = fn(t); });
+    for (std::thread& t : threads) t.join();
+    histogram all;
+    for (const histogram& h : parts) all.merge(h);
+    return all;
+}
+
+} // namespace dsa::bench
@@ -0,0 +1,234 @@
+// workloads using bptree_store beyond the kv interface.
+
+#include "bench.hpp"
+#include "keygen.hpp"
+
+#include <dsa/bptree.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace dsa::bench {
+namespace {
+
+bptree_store& as_bptree(store& s, const char* workload) {
+    auto* b = dynamic_cast<bptree_store*>(&s);
+    if (!b) throw std::invalid_argument(std::string(workload) + " needs --store=bptree");
+    return *b;
+}
+
+// like kv.read_scaling, but each get is a zero-copy view into the mapping,
+// and optionally one thread keeps committing overwrites meanwhile.
+void view_scaling(context& c) {
+    std::uint64_t keys = c.opts.u64("keys", 100'000);
+    std::uint64_t ops = c.opts.u64("ops", 200'000);
+    std::size_t key_size = c.opts.u64("key_size", 16);
+    std::size_t value_size = c.opts.u64("value_size", 100);
+    auto max_threads = static_cast<unsigned>(c.opts.u64("max_threads", std::max(1u, std::thread::hardware_concurrency())));
+    bool writer = c.opts.u64("writer", 0) != 0;
+    auto s = open_store(c);
+    bptree_store& b = as_bptree(*s, "bptree.view_scaling");
+
+    rng r(c.opts.u64("seed", 1));
+    std::string value = make_value(r, value_size);
+    for (std::uint64_t i = 0; i < keys;) {
+        bptree_store::write_txn t = b.begin_write();
+        for (std::uint64_t end = std::min(keys, i + 1000); i < end; ++i) t.put(make_key(i, key_size), value);
+        t.commit();
+    }
+
+    for (unsigned threads = 1;; threads = std::min(threads * 2, max_threads)) {
+        std::atomic<unsigned> running{threads};
+        std::uint64_t commits = 0;
+        std::thread w;
+        if (writer) {
+            w = std::thread([&] {
+                rng wr(c.opts.u64("seed", 1) + 1000);
+                while (running.load(std::memory_order_relaxed)) {
+                    b.put(make_key(wr.uniform(keys), key_size), value);
+                    ++commits;
+                }
+            });
+        }
+        std::uint64_t begin = c.fs.now_ns();
+        histogram lat = run_threads(threads, [&](unsigned t) {
+            rng tr(c.opts.u64("seed", 1) + 1 + t);
+            histogram h;
+            std::uint64_t bytes = 0;
+            for (std::uint64_t i = 0; i < ops; ++i) {
+                std::string key = make_key(tr.uniform(keys), key_size);
+                std::uint64_t t0 = c.fs.now_ns();
+                bptree_store::read_txn txn = b.begin_read();
+                std::string_view v;
+                if (!txn.get(key, v)) throw std::logic_error("bptree.view_scaling: missing key " + key);
+                bytes += v.size();
+                h.record(c.fs.now_ns() - t0);
+            }
+            running.fetch_sub(1, std::memory_order_relaxed);
+            if (bytes != ops * value_size) throw std::logic_error("bptree.view_scaling: wrong value size");
+            return h;
+        });
+        std::uint64_t elapsed = c.fs.now_ns() - begin;
+        if (writer) w.join();
+        c.out.add_ops("view.t" + std::to_string(threads), lat, elapsed);
+        if (writer) c.out.add("commits.t" + std::to_string(threads), static_cast<double>(commits) * 1e9 / static_cast<double>(elapsed), "ops/s");
+        if (threads == max_threads) break;
+    }
+    describe_store(c, *s);
+}
+
+// full ordered scans through a cursor.
+void scan(context& c) {
+    std::uint64_t keys = c.opts.u64("keys", 100'000);
+    std::size_t key_size = c.opts.u64("key_size", 16);
+    std::size_t value_size = c.opts.u64("value_size", 100);
+    std::uint64_t rounds = c.opts.u64("rounds", 10);
+    auto s = open_store(c);
+    bptree_store& b = as_bptree(*s, "bptree.scan");
+
+    rng r(c.opts.u64("seed", 1));
+    std::string value = make_value(r, value_size);
+    bptree_store::write_txn t = b.begin_write();
+    for (std::uint64_t i = 0; i < keys; ++i) t.put(make_key(r.uniform(keys), key_size), value);
+    t.commit();
+
+    histogram lat;
+    std::uint64_t seen = 0;
+    c.out.begin_phase();
+    std::uint64_t begin = c.fs.now_ns();
+    for (std::uint64_t k = 0; k < rounds; ++k) {
+        std::uint64_t t0 = c.fs.now_ns();
+        bptree_store::read_txn txn = b.begin_read();
+        for (auto cur = txn.first(); cur.valid(); cur.next()) ++seen;
+        lat.record(c.fs.now_ns() - t0);
+    }
+    std::uint64_t elapsed = c.fs.now_ns() - begin;
+    c.out.add_ops("scan", lat, elapsed);
+    c.out.add("scan.entries", static_cast<double>(seen) * 1e9 / static_cast<double>(elapsed), "ops/s");
+    describe_store(c, *s);
+}
+
+// approximate_count and approximate_size of random key ranges against an
+// exact cursor scan of each, with the cost of both.
+void estimate(context& c) {
+    std::uint64_t keys = c.opts.u64("keys", 1'000'000);
+    std::uint64_t queries = c.opts.u64("queries", 1'000);
+    std::size_t key_size = c.opts.u64("key_size", 16);
+    std::size_t max_value = std::max<std::uint64_t>(1, c.opts.u64("value_size", 100) * 2);
+    auto s = open_store(c);
+    bptree_store& b = as_bptree(*s, "bptree.estimate");
+
+    rng r(c.opts.u64("seed", 1));
+    std::string value = make_value(r, max_value);
+    for (std::uint64_t i = 0; i < keys;) {
+        bptree_store::write_txn t = b.begin_write();
+        for (std::uint64_t end = std::min(keys, i + 10'000); i < end; ++i)
+            t.put(make_key(r.uniform(keys * 4), key_size), std::string_view(value).substr(0, r.uniform(max_value)));
+        t.commit();
+    }
+
+    histogram approx_lat, scan_lat;
+    double count_err = 0, size_err = 0, count_worst = 0;
+    std::uint64_t measured = 0;
+    bptree_store::read_txn txn = b.begin_read();
+    for (std::uint64_t q = 0; q < queries; ++q) {
+        std::uint64_t x = r.uniform(keys * 4), y = r.uniform(keys * 4);
+        std::string lo = make_key(std::min(x, y), key_size), hi = make_key(std::max(x, y), key_size);
+        std::uint64_t t = c.fs.now_ns();
+        std::uint64_t n = txn.approximate_count(lo, hi), bytes = txn.approximate_size(lo, hi);
+        approx_lat.record(c.fs.now_ns() - t);
+        t = c.fs.now_ns();
+        std::uint64_t exact_n = 0, exact_bytes = 0;
+        for (auto cur = txn.seek(lo); cur.valid() && cur.key() < hi; cur.next()) {
+            ++exact_n;
+            exact_bytes += cur.key().size() + cur.value().size();
+        }
+        scan_lat.record(c.fs.now_ns() - t);
+        // tiny ranges would swamp the mean with relative error on a handful
+        // of keys; they are exact within a leaf anyway.
+        if (exact_n < 1000) continue;
+        double e = std::abs(static_cast<double>(n) - static_cast<double>(exact_n)) / static_cast<double>(exact_n);
+        count_err += e;
+        count_worst = std::max(count_worst, e);
+        size_err += std::abs(static_cast<double>(bytes) - static_cast<double>(exact_bytes)) / static_cast<double>(exact_bytes);
+        ++measured;
+    }
+    c.out.add_latency("approximate", approx_lat);
+    c.out.add_latency("scan", scan_lat);
+    if (measured) {
+        c.out.add("count.mean_error", 100 * count_err / static_cast<double>(measured), "%");
+        c.out.add("count.max_error", 100 * count_worst, "%");
+        c.out.add("size.mean_error", 100 * size_err / static_cast<double>(measured), "%");
+    }
+    describe_store(c, *s);
+}
+
+// one snapshot split into as many ranges as threads, each scanned by its
+// own thread, at 1, 2, 4, ... --max_threads threads.
+void parallel_scan(context& c) {
+    std::uint64_t keys = c.opts.u64("keys", 1'000'000);
+    std::size_t key_size = c.opts.u64("key_size", 16);
+    std::size_t value_size = c.opts.u64("value_size", 100);
+    std::uint64_t rounds = c.opts.u64("rounds", 5);
+    auto max_threads = static_cast<unsigned>(c.opts.u64("max_threads", std::max(1u, std::thread::hardware_concurrency())));
+    auto s = open_store(c);
+    bptree_store& b = as_bptree(*s, "bptree.parallel_scan");
+
+    rng r(c.opts.u64("seed", 1));
+    std::string value = make_value(r, value_size);
+    for (std::uint64_t i = 0; i < keys;) {
+        bptree_store::write_txn t = b.begin_write();
+        for (std::uint64_t end = std::min(keys, i + 10'000); i < end; ++i) t.put(make_key(r.uniform(keys * 4), key_size), value);
+        t.commit();
+    }
+
+    for (unsigned threads = 1;; threads = std::min(threads * 2, max_threads)) {
+        histogram lat;
+        double largest = 0;
+        std::uint64_t parts = 0, begin = c.fs.now_ns();
+        for (std::uint64_t k = 0; k < rounds; ++k) {
+            std::uint64_t t0 = c.fs.now_ns();
+            bptree_store::read_txn txn = b.begin_read();
+            std::vector<bptree_store::cursor> ranges = txn.partition({}, {}, threads);
+            std::vector<std::uint64_t> seen(ranges.size());
+            run_threads(static_cast<unsigned>(ranges.size()), [&](unsigned t) {
+                std::uint64_t bytes = 0;
+                for (auto& cur = ranges[t]; cur.valid(); cur.next()) {
+                    ++seen[t];
+                    bytes += cur.value().size();
+                }
+                if (bytes != seen[t] * value_size) throw std::logic_error("bptree.parallel_scan: wrong value size");
+                return histogram();
+            });
+            lat.record(c.fs.now_ns() - t0);
+            std::uint64_t total = 0;
+            for (std::uint64_t n : seen) total += n;
+            if (total != txn.entries()) throw std::logic_error("bptree.parallel_scan: partitions miss keys");
+            double even = static_cast<double>(total) / static_cast<double>(seen.size());
+            largest = std::max(largest, static_cast<double>(*std::max_element(seen.begin(), seen.end())) / even);
+            parts = seen.size();
+        }
+        std::uint64_t elapsed = c.fs.now_ns() - begin;
+        std::string prefix = "scan.t" + std::to_string(threads);
+        c.out.add_latency(prefix, lat);
+        c.out.add(prefix + ".entries", static_cast<double>(b.stats().entries * rounds) * 1e9 / static_cast<double>(elapsed), "ops/s");
+        c.out.add(prefix + ".ranges", static_cast<double>(parts));
+        // size of the largest range against an even share, worst round.
+        c.out.add(prefix + ".imbalance", 100 * largest, "%");
+        if (threads == max_threads) break;
+    }
+    describe_store(c, *s);
+}
+
+register_workload w1("bptree.view_scaling",
+                     "zero-copy gets at 1, 2, 4, ... --max_threads threads, --writer=1 adds a committing writer; --store=bptree",
+                     view_scaling);
+register_workload w2("bptree.scan", "--rounds full cursor scans over --keys random keys; --store=bptree", scan);
+register_workload w3("bptree.estimate",
+                     "--queries random ranges: approximate_count/size against exact scans, error and cost; --store=bptree",
+                     estimate);
+register_workload w4("bptree.parallel_scan",
+                     "full scans of one snapshot split over 1, 2, 4, ... --max_threads threads; --store=bptree", parallel_scan);
+
+} // namespace
+} // namespace dsa::bench
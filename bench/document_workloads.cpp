@@ -0,0 +1,219 @@
+// binary documents against json text: reading one field, scanning with a
+// projection and updating one field, through a --store.
+
+#include "bench.hpp"
+#include "keygen.hpp"
+
+#include <dsa/document.hpp>
+
+#include <cstdio>
+
+namespace dsa::bench {
+namespace {
+
+std::string field_name(std::size_t i) {
+    return (i < 10 ? "field0" : "field") + std::to_string(i);
+}
+
+// field i of a document is an int, a double or a string by i mod 3.
+document_builder& fill(document_builder& b, rng& r, std::size_t fields, std::size_t string_size) {
+    for (std::size_t i = 0; i < fields; ++i) {
+        if (i % 3 == 0) b.set(field_name(i), field_value::int64(static_cast<std::int64_t>(r.uniform(1'000'000))));
+        else if (i % 3 == 1) b.set(field_name(i), field_value::float64(static_cast<double>(r.uniform(1'000'000)) / 100));
+        else b.set(field_name(i), field_value::string(make_value(r, string_size)));
+    }
+    return b;
+}
+
+// the same document as a flat json object.
+std::string to_json(const document_view& d) {
+    std::string out = "{";
+    for (std::size_t i = 0; i < d.size(); ++i) {
+        field f = d.at(i);
+        if (i) out += ',';
+        out += '"';
+        out.append(f.name);
+        out += "\":";
+        char num[32];
+        switch (f.type) {
+        case field_type::int64: out += std::to_string(f.as_int()); break;
+        case field_type::float64:
+            std::snprintf(num, sizeof num, "%.17g", f.as_double());
+            out += num;
+            break;
+        case field_type::string:
+            out += '"';
+            out.append(f.as_string());
+            out += '"';
+            break;
+        case field_type::boolean: out += f.as_bool() ? "true" : "false"; break;
+        default: out += "null";
+        }
+    }
+    return out + "}";
+}
+
+// what reading a json value costs today: the whole object parsed into
+// name/value pairs before any field is looked at. handles the flat objects
+// to_json writes: no escapes, no nesting.
+using json_object = std::vector<std::pair<std::string, std::string>>;
+
+void parse_json(std::string_view s, json_object& out) {
+    out.clear();
+    std::size_t p = 1;
+    auto bad = [&] { return std::logic_error("doc: bad json at " + std::to_string(p)); };
+    if (s.empty() || s[0] != '{') throw bad();
+    while (p < s.size() && s[p] != '}') {
+        if (s[p] == ',') ++p;
+        if (s[p] != '"') throw bad();
+        std::size_t end = s.find('"', p + 1);
+        if (end == std::string_view::npos || end + 1 >= s.size() || s[end + 1] != ':') throw bad();
+        std::string name(s.substr(p + 1, end - p - 1));
+        p = end + 2;
+        if (s[p] == '"') {
+            end = s.find('"', p + 1);
+            if (end == std::string_view::npos) throw bad();
+            out.emplace_back(std::move(name), std::string(s.substr(p + 1, end - p - 1)));
+            p = end + 1;
+        } else {
+            end = s.find_first_of(",}", p);
+            if (end == std::string_view::npos) throw bad();
+            out.emplace_back(std::move(name), std::string(s.substr(p, end - p)));
+            p = end;
+        }
+    }
+}
+
+const std::string* json_field(const json_object& o, const std::string& name) {
+    for (const auto& [k, v] : o)
+        if (k == name) return &v;
+    return nullptr;
+}
+
+std::string write_json(const json_object& o) {
+    std::string out = "{";
+    for (const auto& [k, v] : o) {
+        if (out.size() > 1) out += ',';
+        out += '"' + k + "\":";
+        bool number = !v.empty() && (v[0] == '-' || (v[0] >= '0' && v[0] <= '9'));
+        out += number || v == "true" || v == "false" || v == "null" ? v : '"' + v + '"';
+    }
+    return out + "}";
+}
+
+// loads --docs documents of --fields fields (strings of --string_size
+// bytes) into --store, each as binary and as json. then reads --ops random
+// single fields, scans every document projecting --project of its fields,
+// and updates --updates random int fields in place. reports latency or
+// throughput for both encodings and their sizes.
+void fields(context& c) {
+    std::uint64_t docs = c.opts.u64("docs", 100'000);
+    std::size_t nfields = c.opts.u64("fields", 20);
+    std::size_t string_size = c.opts.u64("string_size", 16);
+    std::uint64_t ops = c.opts.u64("ops", 200'000);
+    std::uint64_t updates = c.opts.u64("updates", 100'000);
+    std::size_t nproject = std::min<std::size_t>(c.opts.u64("project", 3), nfields);
+    if (!nfields) throw std::invalid_argument("doc.fields needs --fields > 0");
+    auto s = open_store(c);
+
+    rng r(c.opts.u64("seed", 1));
+    double binary_bytes = 0, json_bytes = 0;
+    for (std::uint64_t i = 0; i < docs; ++i) {
+        document_builder b;
+        std::string bin = fill(b, r, nfields, string_size).finish();
+        std::string json = to_json(document_view(bin));
+        binary_bytes += static_cast<double>(bin.size());
+        json_bytes += static_cast<double>(json.size());
+        s->put("b" + make_key(i), bin);
+        s->put("j" + make_key(i), json);
+    }
+    c.out.add("binary.bytes_per_doc", binary_bytes / static_cast<double>(docs), "B");
+    c.out.add("json.bytes_per_doc", json_bytes / static_cast<double>(docs), "B");
+
+    std::vector<std::string> names;
+    for (std::size_t i = 0; i < nfields; ++i) names.push_back(field_name(i));
+    std::string value;
+    json_object parsed;
+    std::uint64_t sink = 0;
+
+    // one field of a random document: the get, then finding the field.
+    for (bool binary : {true, false}) {
+        rng fr(c.opts.u64("seed", 1) + 1);
+        histogram lat;
+        c.out.begin_phase();
+        std::uint64_t begin = c.fs.now_ns();
+        for (std::uint64_t i = 0; i < ops; ++i) {
+            std::string key = (binary ? "b" : "j") + make_key(fr.uniform(docs));
+            const std::string& name = names[fr.uniform(nfields)];
+            std::uint64_t t0 = c.fs.now_ns();
+            if (!s->get(key, value)) throw std::logic_error("doc.fields: missing " + key);
+            if (binary) {
+                sink += document_view(value).find(name)->raw.size();
+            } else {
+                parse_json(value, parsed);
+                sink += json_field(parsed, name)->size();
+            }
+            lat.record(c.fs.now_ns() - t0);
+        }
+        c.out.add_ops(binary ? "binary.field" : "json.field", lat, c.fs.now_ns() - begin);
+    }
+
+    // every document in key order, keeping --project evenly spaced fields.
+    std::vector<std::string> wanted;
+    for (std::size_t i = 0; i < nproject; ++i) wanted.push_back(names[i * nfields / nproject]);
+    projection proj(wanted);
+    double rates[2] = {};
+    for (bool binary : {true, false}) {
+        c.out.begin_phase();
+        std::uint64_t begin = c.fs.now_ns();
+        for (std::uint64_t i = 0; i < docs; ++i) {
+            if (!s->get((binary ? "b" : "j") + make_key(i), value)) throw std::logic_error("doc.fields: missing document");
+            if (binary) {
+                proj.each(document_view(value), [&](std::size_t, const field& f) { sink += f.raw.size(); });
+            } else {
+                parse_json(value, parsed);
+                for (const std::string& w : wanted) sink += json_field(parsed, w)->size();
+            }
+        }
+        double rate = static_cast<double>(docs) * 1e9 / static_cast<double>(c.fs.now_ns() - begin);
+        rates[binary ? 0 : 1] = rate;
+        c.out.add(binary ? "binary.scan_project" : "json.scan_project", rate, "docs/s");
+    }
+    c.out.add("scan.speedup", rates[0] / rates[1], "x");
+
+    // read-modify-write of one int field.
+    for (bool binary : {true, false}) {
+        rng ur(c.opts.u64("seed", 1) + 2);
+        histogram lat;
+        c.out.begin_phase();
+        std::uint64_t begin = c.fs.now_ns();
+        for (std::uint64_t i = 0; i < updates; ++i) {
+            std::string key = (binary ? "b" : "j") + make_key(ur.uniform(docs));
+            const std::string& name = names[3 * ur.uniform((nfields + 2) / 3)];
+            auto v = static_cast<std::int64_t>(ur.uniform(1'000'000));
+            std::uint64_t t0 = c.fs.now_ns();
+            if (!s->get(key, value)) throw std::logic_error("doc.fields: missing " + key);
+            if (binary) {
+                update_field(value, name, field_value::int64(v));
+            } else {
+                parse_json(value, parsed);
+                for (auto& [k, old] : parsed)
+                    if (k == name) old = std::to_string(v);
+                value = write_json(parsed);
+            }
+            s->put(key, value);
+            lat.record(c.fs.now_ns() - t0);
+        }
+        c.out.add_ops(binary ? "binary.update" : "json.update", lat, c.fs.now_ns() - begin);
+    }
+    if (!sink) throw std::logic_error("doc.fields: read nothing");
+    describe_store(c, *s);
+}
+
+register_workload w1("doc.fields",
+                     "--docs documents of --fields fields as binary documents and as json in --store: --ops single-field reads, "
+                     "a scan projecting --project fields, --updates one-field updates",
+                     fields);
+
+} // namespace
+} // namespace dsa::bench
@@ -0,0 +1,77 @@
+// workloads using ehash_store beyond the kv interface.
+
+#include "bench.hpp"
+#include "keygen.hpp"
+
+#include <dsa/ehash.hpp>
+#include <dsa/hash.hpp>
+
+#include <algorithm>
+
+namespace dsa::bench {
+namespace {
+
+ehash_store& as_ehash(store& s, const char* workload) {
+    auto* h = dynamic_cast<ehash_store*>(&s);
+    if (!h) throw std::invalid_argument(std::string(workload) + " needs --store=ehash");
+    return *h;
+}
+
+// inserts --keys random keys in --steps equal steps, reporting insert
+// throughput and the directory size at each, then times random lookups and
+// how many bucket reads they cost.
+void growth(context& c) {
+    std::uint64_t keys = c.opts.u64("keys", 1'000'000);
+    std::uint64_t steps = std::max<std::uint64_t>(1, c.opts.u64("steps", 10));
+    std::uint64_t ops = c.opts.u64("ops", 100'000);
+    std::size_t key_size = c.opts.u64("key_size", 16);
+    std::size_t value_size = c.opts.u64("value_size", 100);
+    auto s = open_store(c);
+    ehash_store& h = as_ehash(*s, "ehash.growth");
+
+    rng r(c.opts.u64("seed", 1));
+    std::string value = make_value(r, value_size);
+    for (std::uint64_t step = 0; step < steps; ++step) {
+        ehash_stats before = h.stats();
+        histogram lat;
+        std::uint64_t begin = c.fs.now_ns();
+        for (std::uint64_t i = keys * step / steps, end = keys * (step + 1) / steps; i < end; ++i) {
+            std::string key = make_key(hash64(i) % (keys * 10), key_size);
+            std::uint64_t t = c.fs.now_ns();
+            s->put(key, value);
+            lat.record(c.fs.now_ns() - t);
+        }
+        std::uint64_t elapsed = c.fs.now_ns() - begin;
+        ehash_stats after = h.stats();
+        std::string prefix = "put.s" + std::to_string(step);
+        c.out.add(prefix + ".throughput", static_cast<double>(lat.count()) * 1e9 / static_cast<double>(elapsed), "ops/s");
+        c.out.add(prefix + ".p99", static_cast<double>(lat.percentile(99)) / 1e3, "us");
+        c.out.add(prefix + ".max", static_cast<double>(lat.max()) / 1e3, "us");
+        c.out.add(prefix + ".splits", static_cast<double>(after.splits - before.splits));
+        c.out.add(prefix + ".global_depth", static_cast<double>(after.global_depth));
+    }
+    s->sync();
+
+    ehash_stats before = h.stats();
+    histogram lat;
+    std::string got;
+    c.out.begin_phase();
+    std::uint64_t begin = c.fs.now_ns();
+    for (std::uint64_t i = 0; i < ops; ++i) {
+        std::string key = make_key(hash64(r.uniform(keys)) % (keys * 10), key_size);
+        std::uint64_t t = c.fs.now_ns();
+        if (!s->get(key, got)) throw std::logic_error("ehash.growth: missing key " + key);
+        lat.record(c.fs.now_ns() - t);
+    }
+    c.out.add_ops("get", lat, c.fs.now_ns() - begin);
+    c.out.add("get.bucket_reads_per_op", static_cast<double>(h.stats().bucket_reads - before.bucket_reads) / static_cast<double>(ops));
+    describe_store(c, *s);
+}
+
+register_workload w1("ehash.growth",
+                     "--keys inserts in --steps steps with per-step throughput and directory depth, then --ops gets "
+                     "with bucket reads per get; --store=ehash",
+                     growth);
+
+} // namespace
+} // namespace dsa::bench
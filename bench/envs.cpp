@@ -0,0 +1,80 @@
+#include "bench.hpp"
+
+#include <dsa/env_mem.hpp>
+#include <dsa/env_posix.hpp>
+#include <dsa/sim_env.hpp>
+
+#include <sstream>
+
+namespace dsa::bench {
+namespace {
+
+std::unique_ptr<env> make_posix(const options&) { return std::make_unique<posix_env>(); }
+
+std::unique_ptr<env> make_mem(const options&) { return std::make_unique<mem_env>(); }
+
+device_profile sim_profile(const options& o) {
+    std::string name = o.str("sim.profile", "sata_ssd");
+    device_profile p;
+    if (name == "hdd") p = device_profile::hdd();
+    else if (name == "sata_ssd") p = device_profile::sata_ssd();
+    else if (name == "network_disk") p = device_profile::network_disk();
+    else if (name != "none") throw std::invalid_argument("unknown --sim.profile: " + name);
+
+    p.read_latency_ns = o.u64("sim.read_latency_us", p.read_latency_ns / 1000) * 1000;
+    p.write_latency_ns = o.u64("sim.write_latency_us", p.write_latency_ns / 1000) * 1000;
+    p.latency_jitter_ns = o.u64("sim.jitter_us", p.latency_jitter_ns / 1000) * 1000;
+    p.read_bandwidth = o.u64("sim.read_mbps", p.read_bandwidth >> 20) << 20;
+    p.write_bandwidth = o.u64("sim.write_mbps", p.write_bandwidth >> 20) << 20;
+    p.iops = o.u64("sim.iops", p.iops);
+    p.fsync_ns = o.u64("sim.fsync_us", p.fsync_ns / 1000) * 1000;
+    p.seed = o.u64("sim.seed", p.seed);
+    return p;
+}
+
+// --sim.stall=at_ms:duration_ms[:period_ms],...
+std::vector<device_stall> sim_stalls(const options& o) {
+    std::vector<device_stall> stalls;
+    std::istringstream list(o.str("sim.stall"));
+    for (std::string item; std::getline(list, item, ',');) {
+        std::istringstream fields(item);
+        std::uint64_t v[3] = {0, 0, 0};
+        std::string f;
+        for (int i = 0; i < 3 && std::getline(fields, f, ':'); ++i) v[i] = std::stoull(f) * 1'000'000;
+        stalls.push_back({v[0], v[1], v[2]});
+    }
+    return stalls;
+}
+
+// sim_env that owns the env it sits in front of.
+struct sim_base_holder {
+    std::unique_ptr<env> base;
+};
+
+class owning_sim_env : private sim_base_holder, public sim_env {
+public:
+    owning_sim_env(std::unique_ptr<env> base, device_profile p, sim_clock c)
+        : sim_base_holder{std::move(base)}, sim_env(*sim_base_holder::base, p, c) {}
+};
+
+std::unique_ptr<env> make_sim(const options& o) {
+    std::string base = o.str("sim.base", "posix");
+    if (base == "sim") throw std::invalid_argument("--sim.base cannot be sim");
+    std::string clock = o.str("sim.clock", "real");
+    if (clock != "real" && clock != "virtual") throw std::invalid_argument("unknown --sim.clock: " + clock);
+    auto e = std::make_unique<owning_sim_env>(find_env_kind(base).make(o), sim_profile(o),
+                                              clock == "virtual" ? sim_clock::virtual_time : sim_clock::real);
+    for (const device_stall& s : sim_stalls(o)) e->add_stall(s);
+    return e;
+}
+
+register_env posix_kind("posix", "real filesystem", make_posix, true);
+register_env mem_kind("mem", "files in ram, no kernel i/o; isolates cpu cost", make_mem, false);
+register_env sim_kind("sim",
+                      "simulated device in front of --sim.base=posix|mem; --sim.profile=hdd|sata_ssd|network_disk|none, "
+                      "--sim.{read,write}_latency_us, --sim.jitter_us, --sim.{read,write}_mbps, --sim.iops, "
+                      "--sim.fsync_us, --sim.seed, --sim.clock=real|virtual, --sim.stall=at_ms:dur_ms[:period_ms],...",
+                      make_sim, true);
+
+} // namespace
+} // namespace dsa::bench
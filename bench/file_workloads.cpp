@@ -0,0 +1,117 @@
+// raw file workloads: what the env itself delivers, before any engine.
+
+#include "bench.hpp"
+#include "keygen.hpp"
+
+#include <dsa/crc32c.hpp>
+#include <dsa/reader.hpp>
+
+namespace dsa::bench {
+namespace {
+
+void seq_write(context& c) {
+    std::uint64_t ops = c.opts.u64("ops", 10'000);
+    std::size_t block = c.opts.u64("block_size", 4096);
+    std::uint64_t sync_every = c.opts.u64("sync_every", 0);
+    rng r(c.opts.u64("seed", 1));
+    std::string buf = make_value(r, block);
+
+    auto f = c.fs.open(join_path(c.dir, "seq"), open_mode::truncate);
+    histogram lat;
+    c.out.begin_phase();
+    std::uint64_t begin = c.fs.now_ns();
+    for (std::uint64_t i = 0; i < ops; ++i) {
+        std::uint64_t t = c.fs.now_ns();
+        f->append(buf);
+        if (sync_every && (i + 1) % sync_every == 0) f->sync();
+        lat.record(c.fs.now_ns() - t);
+    }
+    f->sync();
+    std::uint64_t elapsed = c.fs.now_ns() - begin;
+    c.out.add_ops("append", lat, elapsed);
+    c.out.add("bandwidth", static_cast<double>(ops * block) / (1 << 20) * 1e9 / static_cast<double>(elapsed), "MiB/s");
+}
+
+void rand_read(context& c) {
+    std::uint64_t ops = c.opts.u64("ops", 10'000);
+    std::uint64_t blocks = c.opts.u64("blocks", 16'384);
+    std::size_t block = c.opts.u64("block_size", 4096);
+    rng r(c.opts.u64("seed", 1));
+
+    auto f = c.fs.open(join_path(c.dir, "rand"), open_mode::truncate);
+    std::string fill = make_value(r, block * 64);
+    for (std::uint64_t b = 0; b < blocks; b += 64) f->append(fill);
+    f->sync();
+
+    std::string buf(block, '\0');
+    histogram lat;
+    c.out.begin_phase();
+    std::uint64_t begin = c.fs.now_ns();
+    for (std::uint64_t i = 0; i < ops; ++i) {
+        std::uint64_t t = c.fs.now_ns();
+        f->read(r.uniform(blocks) * block, buf.data(), block);
+        lat.record(c.fs.now_ns() - t);
+    }
+    c.out.add_ops("read", lat, c.fs.now_ns() - begin);
+}
+
+// small appends each followed by a sync, the shape of a write-ahead log.
+void append_sync(context& c) {
+    std::uint64_t ops = c.opts.u64("ops", 2'000);
+    std::size_t record = c.opts.u64("value_size", 128);
+    rng r(c.opts.u64("seed", 1));
+    std::string buf = make_value(r, record);
+
+    auto f = c.fs.open(join_path(c.dir, "log"), open_mode::truncate);
+    histogram lat;
+    c.out.begin_phase();
+    std::uint64_t begin = c.fs.now_ns();
+    for (std::uint64_t i = 0; i < ops; ++i) {
+        std::uint64_t t = c.fs.now_ns();
+        f->append(buf);
+        f->sync();
+        lat.record(c.fs.now_ns() - t);
+    }
+    c.out.add_ops("commit", lat, c.fs.now_ns() - begin);
+}
+
+// a record-at-a-time scan through sequential_reader, checksumming each
+// --value_size record --passes times as a stand-in for parsing, once with
+// reads on the scanning thread and once with async read ahead.
+void seq_scan(context& c) {
+    std::uint64_t file_size = c.opts.u64("file_size", 256u << 20);
+    std::size_t record = std::max<std::uint64_t>(1, c.opts.u64("value_size", 4096));
+    std::uint64_t passes = c.opts.u64("passes", 4);
+    std::size_t window = c.opts.u64("window", 1 << 20);
+    rng r(c.opts.u64("seed", 1));
+
+    auto f = c.fs.open(join_path(c.dir, "scan"), open_mode::truncate);
+    std::string fill = make_value(r, 1 << 20);
+    for (std::uint64_t n = 0; n < file_size; n += fill.size()) f->append(fill);
+    f->sync();
+    std::uint64_t size = f->size();
+
+    for (bool async : {false, true}) {
+        std::uint64_t begin = c.fs.now_ns();
+        std::uint32_t sum = 0;
+        sequential_reader in(*f, window, async);
+        for (std::uint64_t off = 0; off < size; off += record) {
+            std::string_view rec = in.read(off, record);
+            for (std::uint64_t p = 0; p < passes; ++p) sum ^= crc32c(rec);
+        }
+        std::uint64_t elapsed = c.fs.now_ns() - begin;
+        if (sum == 1) c.out.add("unlikely", 0); // keeps the checksums live
+        c.out.add(async ? "scan.async" : "scan.sync", static_cast<double>(size) / (1 << 20) * 1e9 / static_cast<double>(elapsed), "MiB/s");
+    }
+}
+
+register_workload w1("file.seq_write", "sequential appends of --block_size; --sync_every=N", seq_write);
+register_workload w2("file.rand_read", "random block reads over --blocks blocks of --block_size", rand_read);
+register_workload w3("file.append_sync", "--value_size appends each followed by sync", append_sync);
+register_workload w4("file.seq_scan",
+                     "scan of --file_size in --value_size records, --passes checksums each, sync reads then async read ahead; "
+                     "--window",
+                     seq_scan);
+
+} // namespace
+} // namespace dsa::bench
@@ -0,0 +1,168 @@
+// the fixed-width stores in fixed.hpp against the generic byte-string
+// backends holding the same id → struct data.
+
+#include "bench.hpp"
+#include "keygen.hpp"
+
+#include <dsa/bptree.hpp>
+#include <dsa/fixed.hpp>
+#include <dsa/hash.hpp>
+#include <dsa/mem_store.hpp>
+
+#include <cstring>
+
+namespace dsa::bench {
+namespace {
+
+// a typical fixed-size row: 48 bytes.
+struct row {
+    std::uint64_t owner;
+    std::uint64_t created_ns;
+    double balance;
+    std::uint32_t flags;
+    std::uint32_t version;
+    char region[16];
+};
+
+row make_row(std::uint64_t i) {
+    row r{};
+    r.owner = i * 7;
+    r.created_ns = i * 1'000'003;
+    r.balance = static_cast<double>(i) / 3;
+    r.version = 1;
+    std::memcpy(r.region, "eu-west-1", 9);
+    return r;
+}
+
+// the generic path stores the same bytes: the id big-endian, so byte order
+// is numeric order, and the row as is.
+std::string id_key(std::uint64_t id) {
+    char b[8];
+    for (int i = 0; i < 8; ++i) b[i] = static_cast<char>(id >> (56 - 8 * i));
+    return std::string(b, 8);
+}
+
+std::string_view row_bytes(const row& r) { return std::string_view(reinterpret_cast<const char*>(&r), sizeof r); }
+
+// scattered ids, so neither path gets sequential inserts for free.
+std::uint64_t id_of(std::uint64_t i) { return hash64(i); }
+
+struct timings {
+    double put = 0, get = 0, scan = 0; // ops/s
+};
+
+double rate(std::uint64_t n, std::uint64_t ns) { return ns ? static_cast<double>(n) * 1e9 / static_cast<double>(ns) : 0; }
+
+void add(report& out, const std::string& prefix, const timings& t, double bytes, std::uint64_t keys) {
+    out.add(prefix + ".put", t.put, "ops/s");
+    out.add(prefix + ".get", t.get, "ops/s");
+    if (t.scan) out.add(prefix + ".scan", t.scan, "keys/s");
+    out.add(prefix + ".bytes_per_entry", bytes / static_cast<double>(keys), "B");
+}
+
+// --keys rows of 48 bytes under scattered uint64 ids, then --ops random
+// gets, through the fixed stores and through mem_store (hash) and
+// bptree_store (ordered, on --env) with the same bytes; the ordered pair
+// also scans --scan_len rows from --scans random ids. reports ops/s and
+// memory per entry for each, and the speedups.
+void compare(context& c) {
+    std::uint64_t keys = c.opts.u64("keys", 1'000'000);
+    std::uint64_t ops = c.opts.u64("ops", 2'000'000);
+    std::uint64_t scans = c.opts.u64("scans", 10'000);
+    std::uint64_t scan_len = c.opts.u64("scan_len", 100);
+    rng r(c.opts.u64("seed", 1));
+    std::vector<std::uint64_t> probes(ops);
+    for (std::uint64_t& p : probes) p = id_of(r.uniform(keys));
+    std::uint64_t checksum = 0;
+
+    auto time = [&](auto&& fn) {
+        std::uint64_t t0 = c.fs.now_ns();
+        fn();
+        return c.fs.now_ns() - t0;
+    };
+
+    timings fh, mh;
+    fixed_hash_store<row> fixed_hash;
+    fh.put = rate(keys, time([&] {
+                      for (std::uint64_t i = 0; i < keys; ++i) fixed_hash.put(id_of(i), make_row(i));
+                  }));
+    fh.get = rate(ops, time([&] {
+                      row v;
+                      for (std::uint64_t id : probes) checksum += fixed_hash.get(id, v) ? v.version : 0;
+                  }));
+    add(c.out, "hash.fixed", fh, static_cast<double>(fixed_hash.memory_bytes()), keys);
+
+    mem_store generic_hash;
+    mh.put = rate(keys, time([&] {
+                      for (std::uint64_t i = 0; i < keys; ++i) {
+                          row v = make_row(i);
+                          generic_hash.put(id_key(id_of(i)), row_bytes(v));
+                      }
+                  }));
+    mh.get = rate(ops, time([&] {
+                      std::string v;
+                      for (std::uint64_t id : probes) checksum += generic_hash.get(id_key(id), v) ? v.size() : 0;
+                  }));
+    add(c.out, "hash.generic", mh, static_cast<double>(generic_hash.stats().bytes), keys);
+    c.out.add("hash.get_speedup", fh.get / mh.get, "x");
+
+    timings ft, bt;
+    fixed_tree_store<row> fixed_tree;
+    ft.put = rate(keys, time([&] {
+                      for (std::uint64_t i = 0; i < keys; ++i) fixed_tree.put(id_of(i), make_row(i));
+                  }));
+    ft.get = rate(ops, time([&] {
+                      row v;
+                      for (std::uint64_t id : probes) checksum += fixed_tree.get(id, v) ? v.version : 0;
+                  }));
+    ft.scan = rate(scans * scan_len, time([&] {
+                       for (std::uint64_t s = 0; s < scans; ++s) {
+                           std::uint64_t n = 0;
+                           fixed_tree.scan(probes[s % ops], ~0ull, [&](std::uint64_t, const row& v) {
+                               checksum += v.version;
+                               return ++n < scan_len;
+                           });
+                       }
+                   }));
+    add(c.out, "tree.fixed", ft, static_cast<double>(fixed_tree.memory_bytes()), keys);
+
+    bptree_options bo;
+    bo.sync_commits = false;
+    bptree_store tree(c.fs, join_path(c.dir, "bptree"), bo);
+    bt.put = rate(keys, time([&] {
+                      for (std::uint64_t i = 0; i < keys;) {
+                          bptree_store::write_txn t = tree.begin_write();
+                          for (std::uint64_t end = std::min(keys, i + 1000); i < end; ++i) {
+                              row v = make_row(i);
+                              t.put(id_key(id_of(i)), row_bytes(v));
+                          }
+                          t.commit();
+                      }
+                  }));
+    bt.get = rate(ops, time([&] {
+                      bptree_store::read_txn t = tree.begin_read();
+                      std::string_view v;
+                      for (std::uint64_t id : probes) checksum += t.get(id_key(id), v) ? v.size() : 0;
+                  }));
+    bt.scan = rate(scans * scan_len, time([&] {
+                       bptree_store::read_txn t = tree.begin_read();
+                       for (std::uint64_t s = 0; s < scans; ++s) {
+                           std::uint64_t n = 0;
+                           for (auto cur = t.seek(id_key(probes[s % ops])); cur.valid() && n < scan_len; cur.next(), ++n)
+                               checksum += cur.value().size();
+                       }
+                   }));
+    bptree_stats st = tree.stats();
+    add(c.out, "tree.generic", bt, static_cast<double>((st.pages - st.free_pages) * bo.page_size), keys);
+    c.out.add("tree.get_speedup", ft.get / bt.get, "x");
+    c.out.add("tree.scan_speedup", ft.scan / bt.scan, "x");
+    if (!checksum) throw std::logic_error("fixed.compare: no lookup found anything");
+}
+
+register_workload w1("fixed.compare",
+                     "--keys 48-byte rows under uint64 ids: fixed_hash/fixed_tree against mem_store/bptree on the same bytes; "
+                     "put/get ops/s, --scans of --scan_len rows, memory per entry",
+                     compare);
+
+} // namespace
+} // namespace dsa::bench
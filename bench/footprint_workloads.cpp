@@ -0,0 +1,238 @@
+// memory per key: the same keys loaded into each backend, measured from the
+// outside.
+
+#include "bench.hpp"
+#include "keygen.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <malloc.h>
+#include <numeric>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace dsa::bench {
+namespace {
+
+// what the process holds, as the kernel and the allocator see it. only
+// resident pages count as memory: a store may reserve far more address
+// space than it touches, as the mem env's files do.
+struct usage {
+    double rss_anon = 0; // resident anonymous memory, B
+    double mapped = 0;   // resident pages of the store's own mapped files, B
+    double heap = 0;     // bytes malloc has handed out and not got back, touched or not
+};
+
+// dir is the store's directory as the kernel names it, or empty where its
+// files are not on disk. the process's own binary and libraries fault in
+// pages while a store loads; they are not the store's, so only mappings
+// from under dir are counted.
+usage measure(const std::string& dir) {
+    usage u;
+    std::ifstream status("/proc/self/status");
+    for (std::string line; std::getline(status, line);) {
+        double kb = 0;
+        if (std::sscanf(line.c_str(), "RssAnon: %lf kB", &kb) == 1) u.rss_anon = kb * 1024;
+    }
+    if (!dir.empty()) {
+        // a mapping's header line starts with its address in lower case
+        // hex; the fields under it start with a capital.
+        std::ifstream smaps("/proc/self/smaps");
+        bool ours = false;
+        for (std::string line; std::getline(smaps, line);) {
+            double kb = 0;
+            if (!line.empty() && ((line[0] >= '0' && line[0] <= '9') || (line[0] >= 'a' && line[0] <= 'f'))) {
+                std::size_t path = line.find('/');
+                ours = path != std::string::npos && line.compare(path, dir.size() + 1, dir + "/") == 0;
+            } else if (ours && std::sscanf(line.c_str(), "Rss: %lf kB", &kb) == 1) {
+                u.mapped += kb * 1024;
+            }
+        }
+    }
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 mi = mallinfo2();
+    u.heap = static_cast<double>(mi.uordblks + mi.hblkhd);
+#endif
+    return u;
+}
+
+double available_bytes() {
+    std::ifstream meminfo("/proc/meminfo");
+    for (std::string line; std::getline(meminfo, line);) {
+        double kb = 0;
+        if (std::sscanf(line.c_str(), "MemAvailable: %lf kB", &kb) == 1) return kb * 1024;
+    }
+    return 0;
+}
+
+std::vector<std::string> split(const std::string& spec) {
+    std::vector<std::string> out;
+    std::size_t pos = 0;
+    while (pos <= spec.size()) {
+        std::size_t comma = spec.find(',', pos);
+        out.push_back(spec.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos));
+        if (comma == std::string::npos) break;
+        pos = comma + 1;
+    }
+    return out;
+}
+
+// a comma list of counts with the usual suffixes.
+std::vector<std::uint64_t> counts(const std::string& spec) {
+    std::vector<std::uint64_t> out;
+    for (const std::string& s : split(spec)) {
+        options one;
+        one.set("n", s);
+        out.push_back(one.u64("n", 0));
+    }
+    return out;
+}
+
+std::string label(std::uint64_t n) {
+    if (n % 1'000'000'000 == 0) return std::to_string(n / 1'000'000'000) + "g";
+    if (n % 1'000'000 == 0) return std::to_string(n / 1'000'000) + "m";
+    if (n % 1'000 == 0) return std::to_string(n / 1'000) + "k";
+    return std::to_string(n);
+}
+
+// a size drawn uniformly from mean * (1 ± spread).
+std::size_t draw(rng& r, std::size_t mean, double spread) {
+    if (spread <= 0) return mean;
+    double lo = static_cast<double>(mean) * (1 - spread), hi = static_cast<double>(mean) * (1 + spread);
+    return static_cast<std::size_t>(lo + r.unit() * (hi - lo) + 0.5);
+}
+
+// what one child reports back.
+struct point {
+    usage empty, loaded; // after opening the store, and after loading it
+    usage before;        // before opening it
+    double raw = 0;      // key and value bytes loaded
+    double load_ns = 0;
+};
+
+// runs in a forked child, so every backend starts from the same clean heap
+// and nothing it leaves behind is charged to the next.
+point load(context& c, const store_kind& kind, std::uint64_t n, const std::string& dir) {
+    std::size_t key_size = c.opts.u64("key_size", 16);
+    std::size_t value_size = c.opts.u64("value_size", 100);
+    double key_spread = c.opts.f64("key_spread", 0);
+    double value_spread = c.opts.f64("value_spread", 0);
+
+    // the mem env's files are anonymous memory, and no path under an
+    // in-memory dir resolves on disk.
+    char real[PATH_MAX];
+    std::string on_disk = realpath(dir.c_str(), real) ? real : "";
+    point p;
+    p.before = measure(on_disk);
+    std::unique_ptr<store> s = kind.open(c.fs, dir, c.opts);
+    p.empty = measure(on_disk);
+
+    // keys go in in a scattered order, as they would in service: id i is
+    // loaded at position (i * a) mod n for some a coprime to n.
+    std::uint64_t a = 0x9e3779b97f4a7c15ull % (n ? n : 1) | 1;
+    while (std::gcd(a, n) != 1) a += 2;
+    rng r(c.opts.u64("seed", 1));
+    std::string value;
+    std::uint64_t t0 = c.fs.now_ns();
+    for (std::uint64_t i = 0; i < n; ++i) {
+        __extension__ using u128 = unsigned __int128;
+        std::uint64_t id = static_cast<std::uint64_t>(static_cast<u128>(i) * a % n);
+        std::string key = make_key(id, std::max<std::size_t>(draw(r, key_size, key_spread), 8));
+        value = make_value(r, draw(r, value_size, value_spread));
+        s->put(key, value);
+        p.raw += static_cast<double>(key.size() + value.size());
+    }
+    s->sync();
+    p.load_ns = static_cast<double>(c.fs.now_ns() - t0);
+    p.loaded = measure(on_disk);
+    return p;
+}
+
+bool run_child(context& c, const store_kind& kind, std::uint64_t n, const std::string& dir, point& out) {
+    int fds[2];
+    if (pipe(fds) != 0) throw std::runtime_error("footprint: pipe failed");
+    std::fflush(nullptr);
+    pid_t pid = fork();
+    if (pid < 0) throw std::runtime_error("footprint: fork failed");
+    if (pid == 0) {
+        close(fds[0]);
+        int code = 0;
+        try {
+            point p = load(c, kind, n, dir);
+            code = write(fds[1], &p, sizeof p) == static_cast<ssize_t>(sizeof p) ? 0 : 1;
+        } catch (const std::exception& ex) {
+            std::fprintf(stderr, "footprint: %s: %s\n", kind.name.c_str(), ex.what());
+            code = 1;
+        }
+        _exit(code);
+    }
+    close(fds[1]);
+    std::size_t got = 0;
+    while (got < sizeof out) {
+        ssize_t r = read(fds[0], reinterpret_cast<char*>(&out) + got, sizeof out - got);
+        if (r <= 0) break;
+        got += static_cast<std::size_t>(r);
+    }
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return got == sizeof out && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// loads each of --points keys (1m,10m,100m) into each of --stores (every
+// single-engine kind) with keys of --key_size and values of --value_size
+// bytes, each spread uniformly by ± --key_spread / --value_spread of
+// itself, in a fresh process per store and point. reports per key the
+// resident anonymous memory, the resident pages of the store's mapped
+// files, the heap bytes the allocator has handed out, and the overhead:
+// resident memory plus mapped pages, beyond the key and value bytes
+// themselves. backends that read files through the page cache come out
+// below the raw size; that is the point of them. a point whose raw bytes
+// exceed half the memory available (--max_raw_bytes) is skipped and
+// reported as such.
+void footprint(context& c) {
+    std::vector<std::uint64_t> points = counts(c.opts.str("points", "1m,10m,100m"));
+    std::vector<std::string> kinds = split(c.opts.str("stores", "mem,bitcask,hlog,bptree,ehash,tiered"));
+    double budget = c.opts.f64("max_raw_bytes", available_bytes() / 2);
+    double raw_per_key = static_cast<double>(c.opts.u64("key_size", 16) + c.opts.u64("value_size", 100));
+
+    for (const std::string& name : kinds) {
+        const store_kind& kind = find_store_kind(name);
+        for (std::uint64_t n : points) {
+            std::string prefix = name + "." + label(n);
+            if (budget > 0 && raw_per_key * static_cast<double>(n) > budget) {
+                c.out.add(prefix + ".skipped", 1);
+                continue;
+            }
+            point p;
+            std::string dir = join_path(c.dir, prefix);
+            c.fs.create_dir(dir);
+            if (!run_child(c, kind, n, dir, p)) {
+                c.out.add(prefix + ".failed", 1);
+                continue;
+            }
+            auto per_key = [&](double bytes) { return n ? bytes / static_cast<double>(n) : 0; };
+            double rss = p.loaded.rss_anon - p.before.rss_anon;
+            double heap = p.loaded.heap - p.before.heap;
+            double mapped = p.loaded.mapped - p.before.mapped;
+            c.out.add(prefix + ".empty_rss", p.empty.rss_anon - p.before.rss_anon, "B");
+            c.out.add(prefix + ".rss_per_key", per_key(rss), "B");
+            c.out.add(prefix + ".mapped_per_key", per_key(mapped), "B");
+            if (p.loaded.heap) c.out.add(prefix + ".heap_per_key", per_key(heap), "B");
+            c.out.add(prefix + ".raw_per_key", per_key(p.raw), "B");
+            c.out.add(prefix + ".overhead_per_key", per_key(rss + mapped - p.raw), "B");
+            c.out.add(prefix + ".load", p.load_ns ? static_cast<double>(n) * 1e9 / p.load_ns : 0, "ops/s");
+        }
+    }
+}
+
+register_workload w1("footprint.keys",
+                     "--points keys (1m,10m,100m) of --key_size/--value_size bytes (± --key_spread/--value_spread) into "
+                     "each of --stores, one process each; resident, mapped and heap bytes per key and overhead beyond the raw bytes",
+                     footprint);
+
+} // namespace
+} // namespace dsa::bench
@@ -0,0 +1,194 @@
+// graph workloads: neighbor scans and breadth-first search over a
+// power-law graph, in packed adjacency blocks and as one store entry per
+// edge.
+
+#include "bench.hpp"
+#include "keygen.hpp"
+
+#include <dsa/graph.hpp>
+
+#include <algorithm>
+
+namespace dsa::bench {
+namespace {
+
+struct graph_params {
+    std::uint64_t vertices;
+    std::uint64_t edges;
+    double theta;
+    std::uint64_t batch;
+    std::uint64_t seed;
+};
+
+graph_params params(const options& o) {
+    return {o.u64("vertices", 100'000), o.u64("edges", 1'000'000), o.f64("theta", 0.8), o.u64("batch", 10'000), o.u64("seed", 1)};
+}
+
+// edges with both ends drawn zipf(--theta) over the vertices, so degrees
+// follow a power law: a few hubs and a long tail of vertices with a
+// handful of neighbors, the shape of a social graph. self-loops are
+// dropped; repeats are left to the stores to ignore.
+std::vector<edge> make_edges(const graph_params& p) {
+    zipf dist(p.vertices, p.theta);
+    rng r(p.seed);
+    std::vector<edge> out;
+    out.reserve(p.edges);
+    while (out.size() < p.edges) {
+        edge e{dist.next(r), dist.next(r)};
+        if (e.from != e.to) out.push_back(e);
+    }
+    return out;
+}
+
+// the per-edge layout the graph replaces: vertex v's degree under "v" and
+// its i-th neighbor under "v/i".
+std::string degree_key(std::uint64_t v) { return make_key(v, 12); }
+std::string edge_key(std::uint64_t v, std::uint64_t i) { return make_key(v, 12) + "/" + make_key(i, 8); }
+
+std::uint64_t as_u64(const std::string& s) { return std::stoull(s); }
+
+class kv_adjacency {
+public:
+    explicit kv_adjacency(store& s) : s_(s) {}
+
+    void add(const std::vector<edge>& sorted_unique) {
+        for (std::size_t i = 0; i < sorted_unique.size();) {
+            std::uint64_t v = sorted_unique[i].from, n = degree(v);
+            for (; i < sorted_unique.size() && sorted_unique[i].from == v; ++i) s_.put(edge_key(v, n++), std::to_string(sorted_unique[i].to));
+            s_.put(degree_key(v), std::to_string(n));
+        }
+    }
+
+    std::uint64_t degree(std::uint64_t v) {
+        return s_.get(degree_key(v), buf_) ? as_u64(buf_) : 0;
+    }
+
+    template <class Fn>
+    void for_each_neighbor(std::uint64_t v, Fn&& fn) {
+        std::uint64_t n = degree(v);
+        for (std::uint64_t i = 0; i < n; ++i) {
+            if (!s_.get(edge_key(v, i), buf_)) throw std::logic_error("graph.bfs: missing edge entry");
+            fn(as_u64(buf_));
+        }
+    }
+
+private:
+    store& s_;
+    std::string buf_;
+};
+
+// breadth-first search from source over every vertex reachable; returns
+// the edges examined and counts the vertices reached.
+template <class Adjacency>
+std::uint64_t bfs(Adjacency& adj, std::uint64_t vertices, std::uint64_t source, std::uint64_t& reached) {
+    std::vector<std::uint8_t> seen(vertices);
+    std::vector<std::uint64_t> frontier{source}, next;
+    seen[source] = 1;
+    reached = 1;
+    std::uint64_t edges = 0;
+    while (!frontier.empty()) {
+        next.clear();
+        for (std::uint64_t v : frontier) {
+            adj.for_each_neighbor(v, [&](std::uint64_t n) {
+                ++edges;
+                if (!seen[n]) {
+                    seen[n] = 1;
+                    next.push_back(n);
+                }
+            });
+        }
+        frontier.swap(next);
+        reached += frontier.size();
+    }
+    return edges;
+}
+
+// loads the edges in batches of --batch, then scans the neighborhoods of
+// --scans random vertices and runs --bfs_runs searches, each from the
+// source of a random edge. reports edges/s for each, against the same graph
+// kept as one --store entry per edge unless --kv=0.
+void run(context& c) {
+    graph_params p = params(c.opts);
+    std::uint64_t scans = c.opts.u64("scans", 100'000);
+    std::uint64_t runs = c.opts.u64("bfs_runs", 5);
+    std::vector<edge> edges = make_edges(p);
+
+    graph_options o;
+    o.block_edges = static_cast<std::uint32_t>(c.opts.u64("graph.block_edges", o.block_edges));
+    o.sync_writes = c.opts.u64("graph.sync_writes", o.sync_writes) != 0;
+    graph g(c.fs, join_path(c.dir, "graph"), o);
+
+    histogram lat;
+    c.out.begin_phase();
+    std::uint64_t begin = c.fs.now_ns();
+    for (std::size_t at = 0; at < edges.size(); at += p.batch) {
+        std::vector<edge> b(edges.begin() + static_cast<std::ptrdiff_t>(at),
+                            edges.begin() + static_cast<std::ptrdiff_t>(std::min<std::size_t>(at + p.batch, edges.size())));
+        std::uint64_t t0 = c.fs.now_ns();
+        g.add_edges(std::move(b));
+        lat.record(c.fs.now_ns() - t0);
+    }
+    std::uint64_t elapsed = c.fs.now_ns() - begin;
+    c.out.add_ops("graph.batch", lat, elapsed);
+    c.out.add("graph.load", static_cast<double>(edges.size()) * 1e9 / static_cast<double>(elapsed), "edges/s");
+
+    graph_stats st = g.stats();
+    c.out.add("graph.vertices", static_cast<double>(st.vertices));
+    c.out.add("graph.edges", static_cast<double>(st.edges));
+    c.out.add("graph.blocks", static_cast<double>(st.blocks));
+    c.out.add("graph.bytes_per_edge", static_cast<double>(st.block_bytes + 12 * st.blocks) / static_cast<double>(st.edges), "B");
+    std::uint64_t max_degree = 0;
+    for (std::uint64_t i = 0; i < p.vertices; ++i) max_degree = std::max(max_degree, g.degree(i));
+    c.out.add("graph.max_degree", static_cast<double>(max_degree));
+
+    // drawn once so both layouts do the same work.
+    rng r(p.seed + 1);
+    std::vector<std::uint64_t> scan_at(scans), sources(runs);
+    for (std::uint64_t& v : scan_at) v = r.uniform(p.vertices);
+    for (std::uint64_t& v : sources) v = edges[r.uniform(edges.size())].from;
+
+    auto measure = [&](const std::string& prefix, auto& adj) {
+        std::uint64_t seen = 0;
+        std::uint64_t t0 = c.fs.now_ns();
+        for (std::uint64_t v : scan_at) adj.for_each_neighbor(v, [&](std::uint64_t) { ++seen; });
+        std::uint64_t ns = c.fs.now_ns() - t0;
+        c.out.add(prefix + ".scan", static_cast<double>(scans) * 1e9 / static_cast<double>(ns), "vertices/s");
+        c.out.add(prefix + ".scan_edges", static_cast<double>(seen) * 1e9 / static_cast<double>(ns), "edges/s");
+
+        std::uint64_t examined = 0, reached = 0;
+        t0 = c.fs.now_ns();
+        for (std::uint64_t s : sources) {
+            std::uint64_t n = 0;
+            examined += bfs(adj, p.vertices, s, n);
+            reached += n;
+        }
+        ns = c.fs.now_ns() - t0;
+        c.out.add(prefix + ".bfs", static_cast<double>(examined) * 1e9 / static_cast<double>(ns), "edges/s");
+        c.out.add(prefix + ".bfs_reached", static_cast<double>(reached) / static_cast<double>(runs ? runs : 1));
+        return static_cast<double>(examined) * 1e9 / static_cast<double>(ns);
+    };
+    double packed = 0;
+    {
+        graph::view v = g.read();
+        packed = measure("graph", v);
+    }
+
+    if (!c.opts.u64("kv", 1)) return;
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    auto s = open_store(c);
+    kv_adjacency kv(*s);
+    begin = c.fs.now_ns();
+    kv.add(edges);
+    c.out.add("kv.load", static_cast<double>(edges.size()) * 1e9 / static_cast<double>(c.fs.now_ns() - begin), "edges/s");
+    double per_edge = measure("kv", kv);
+    c.out.add("bfs.speedup", packed / per_edge, "x");
+}
+
+register_workload w1("graph.traverse",
+                     "--edges zipf(--theta) edges over --vertices loaded in --batch batches, --scans neighbor scans and "
+                     "--bfs_runs full bfs; packed adjacency blocks (--graph.{block_edges,sync_writes}) against one --store entry per edge",
+                     run);
+
+} // namespace
+} // namespace dsa::bench
@@ -0,0 +1,43 @@
+// workloads using hlog_store beyond the kv interface.
+
+#include "bench.hpp"
+#include "keygen.hpp"
+
+#include <dsa/hlog.hpp>
+
+namespace dsa::bench {
+namespace {
+
+// read-modify-write counter increments on zipf-distributed keys.
+void add_zipf(context& c) {
+    std::uint64_t keys = c.opts.u64("keys", 100'000);
+    std::uint64_t ops = c.opts.u64("ops", 1'000'000);
+    std::size_t key_size = c.opts.u64("key_size", 16);
+    auto threads = static_cast<unsigned>(c.opts.u64("threads", 1));
+    zipf dist(keys, c.opts.f64("theta", 0.99));
+    auto s = open_store(c);
+    auto* h = dynamic_cast<hlog_store*>(s.get());
+    if (!h) throw std::invalid_argument("hlog.add_zipf needs --store=hlog");
+
+    c.out.begin_phase();
+    std::uint64_t begin = c.fs.now_ns();
+    histogram lat = run_threads(threads, [&](unsigned t) {
+        rng r(c.opts.u64("seed", 1) + t);
+        histogram out;
+        for (std::uint64_t i = t; i < ops; i += threads) {
+            std::string key = make_key(dist.next(r), key_size);
+            std::uint64_t t0 = c.fs.now_ns();
+            h->add(key, 1);
+            out.record(c.fs.now_ns() - t0);
+        }
+        return out;
+    });
+    c.out.add_ops("add", lat, c.fs.now_ns() - begin);
+    describe_store(c, *s);
+}
+
+register_workload w1("hlog.add_zipf", "--ops counter increments over zipf(--theta) keys on --threads threads; --store=hlog",
+                     add_zipf);
+
+} // namespace
+} // namespace dsa::bench
@@ -0,0 +1,93 @@
+#pragma once
+
+// deterministic key, value and index generators shared by workloads.
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+namespace dsa::bench {
+
+// splitmix64: tiny, fast and good enough to drive workloads.
+class rng {
+public:
+    explicit rng(std::uint64_t seed = 1) : s_(seed) {}
+
+    std::uint64_t next() {
+        std::uint64_t z = (s_ += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    // uniform in [0, n).
+    std::uint64_t uniform(std::uint64_t n) {
+        __extension__ using u128 = unsigned __int128;
+        return static_cast<std::uint64_t>((static_cast<u128>(next()) * n) >> 64);
+    }
+
+    double unit() { return static_cast<double>(next() >> 11) * 0x1.0p-53; }
+
+private:
+    std::uint64_t s_;
+};
+
+// zipfian over [0, n) with skew theta (0.99 is the ycsb default), after
+// gray et al. item ranks are scattered by a hash so hot keys are not all
+// adjacent in key order.
+class zipf {
+public:
+    zipf(std::uint64_t n, double theta) : n_(n), theta_(theta) {
+        double zeta2 = 0;
+        for (std::uint64_t i = 1; i <= n; ++i) {
+            double z = 1.0 / std::pow(static_cast<double>(i), theta);
+            zetan_ += z;
+            if (i <= 2) zeta2 += z;
+        }
+        alpha_ = 1.0 / (1.0 - theta);
+        eta_ = (1.0 - std::pow(2.0 / static_cast<double>(n), 1.0 - theta)) / (1.0 - zeta2 / zetan_);
+    }
+
+    // rank of the next item; 0 is the hottest.
+    std::uint64_t rank(rng& r) const {
+        double u = r.unit();
+        double uz = u * zetan_;
+        if (uz < 1.0) return 0;
+        if (uz < 1.0 + std::pow(0.5, theta_)) return n_ > 1 ? 1 : 0;
+        auto v = static_cast<std::uint64_t>(static_cast<double>(n_) * std::pow(eta_ * u - eta_ + 1.0, alpha_));
+        return v < n_ ? v : n_ - 1;
+    }
+
+    std::uint64_t next(rng& r) const {
+        std::uint64_t x = rank(r) * 0x9e3779b97f4a7c15ull;
+        return (x ^ (x >> 29)) % n_;
+    }
+
+private:
+    std::uint64_t n_;
+    double theta_;
+    double zetan_ = 0;
+    double alpha_ = 0;
+    double eta_ = 0;
+};
+
+// fixed-width key for index i, so lexicographic order matches numeric order.
+inline std::string make_key(std::uint64_t i, std::size_t len = 16) {
+    std::string k(len < 8 ? 8 : len, '0');
+    for (std::size_t p = k.size(); p-- > 0 && i;) {
+        k[p] = static_cast<char>('0' + i % 10);
+        i /= 10;
+    }
+    return k;
+}
+
+inline std::string make_value(rng& r, std::size_t len) {
+    std::string v(len, '\0');
+    for (std::size_t i = 0; i < len; i += 8) {
+        std::uint64_t x = r.next();
+        for (std::size_t j = 0; j < 8 && i + j < len; ++j) v[i + j] = static_cast<char>('a' + (x >> (j * 8)) % 26);
+    }
+    return v;
+}
+
+} // namespace dsa::bench
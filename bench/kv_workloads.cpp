@@ -0,0 +1,245 @@
+// key-value workloads against the backend picked with --store.
+
+#include "bench.hpp"
+#include "keygen.hpp"
+
+#include <dsa/deadline.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <optional>
+
+namespace dsa::bench {
+namespace {
+
+struct kv_params {
+    std::uint64_t keys;
+    std::size_t key_size;
+    std::size_t value_size;
+    std::uint64_t seed;
+
+    explicit kv_params(const options& o)
+        : keys(o.u64("keys", 100'000)), key_size(o.u64("key_size", 16)), value_size(o.u64("value_size", 100)),
+          seed(o.u64("seed", 1)) {}
+};
+
+// loads every key once in the given order and reports it as `prefix`.
+void load(context& c, store& s, const kv_params& p, bool shuffled, const char* prefix) {
+    rng r(p.seed);
+    std::vector<std::uint64_t> order(p.keys);
+    for (std::uint64_t i = 0; i < p.keys; ++i) order[i] = i;
+    if (shuffled)
+        for (std::uint64_t i = p.keys; i > 1; --i) std::swap(order[i - 1], order[r.uniform(i)]);
+    std::string value = make_value(r, p.value_size);
+    histogram lat;
+    if (prefix) c.out.begin_phase();
+    std::uint64_t begin = c.fs.now_ns();
+    for (std::uint64_t i : order) {
+        std::string key = make_key(i, p.key_size);
+        std::uint64_t t = c.fs.now_ns();
+        s.put(key, value);
+        lat.record(c.fs.now_ns() - t);
+    }
+    s.sync();
+    std::uint64_t elapsed = c.fs.now_ns() - begin;
+    if (!prefix) return;
+    c.out.add_ops(prefix, lat, elapsed);
+    c.out.add(std::string(prefix) + ".bandwidth",
+              static_cast<double>(p.keys * (p.key_size + p.value_size)) / (1 << 20) * 1e9 / static_cast<double>(elapsed), "MiB/s");
+}
+
+void fill_seq(context& c) {
+    kv_params p(c.opts);
+    auto s = open_store(c);
+    load(c, *s, p, false, "put");
+    describe_store(c, *s);
+}
+
+void fill_random(context& c) {
+    kv_params p(c.opts);
+    auto s = open_store(c);
+    load(c, *s, p, true, "put");
+    describe_store(c, *s);
+}
+
+void read_random(context& c) {
+    kv_params p(c.opts);
+    std::uint64_t ops = c.opts.u64("ops", 100'000);
+    auto threads = static_cast<unsigned>(c.opts.u64("threads", 1));
+    auto s = open_store(c);
+    load(c, *s, p, true, nullptr);
+
+    c.out.begin_phase();
+    std::uint64_t begin = c.fs.now_ns();
+    histogram lat = run_threads(threads, [&](unsigned t) {
+        rng r(p.seed + 1 + t);
+        histogram h;
+        std::string value;
+        for (std::uint64_t i = t; i < ops; i += threads) {
+            std::string key = make_key(r.uniform(p.keys), p.key_size);
+            std::uint64_t t0 = c.fs.now_ns();
+            if (!s->get(key, value)) throw std::logic_error("kv.read_random: missing key " + key);
+            h.record(c.fs.now_ns() - t0);
+        }
+        return h;
+    });
+    c.out.add_ops("get", lat, c.fs.now_ns() - begin);
+    describe_store(c, *s);
+}
+
+// random gets at 1, 2, 4, ... --max_threads threads against one loaded
+// store, to show how reads scale with cores.
+void read_scaling(context& c) {
+    kv_params p(c.opts);
+    std::uint64_t ops = c.opts.u64("ops", 200'000);
+    auto max_threads = static_cast<unsigned>(c.opts.u64("max_threads", std::max(1u, std::thread::hardware_concurrency())));
+    auto s = open_store(c);
+    load(c, *s, p, true, nullptr);
+
+    for (unsigned threads = 1;; threads = std::min(threads * 2, max_threads)) {
+        c.out.begin_phase();
+        std::uint64_t begin = c.fs.now_ns();
+        histogram lat = run_threads(threads, [&](unsigned t) {
+            rng r(p.seed + 1 + t);
+            histogram h;
+            std::string value;
+            for (std::uint64_t i = 0; i < ops; ++i) {
+                std::string key = make_key(r.uniform(p.keys), p.key_size);
+                std::uint64_t t0 = c.fs.now_ns();
+                if (!s->get(key, value)) throw std::logic_error("kv.read_scaling: missing key " + key);
+                h.record(c.fs.now_ns() - t0);
+            }
+            return h;
+        });
+        c.out.add_ops("get.t" + std::to_string(threads), lat, c.fs.now_ns() - begin);
+        if (threads == max_threads) break;
+    }
+    describe_store(c, *s);
+}
+
+void overwrite(context& c) {
+    kv_params p(c.opts);
+    std::uint64_t ops = c.opts.u64("ops", 500'000);
+    auto s = open_store(c);
+    load(c, *s, p, true, nullptr);
+
+    rng r(p.seed + 1);
+    std::string value = make_value(r, p.value_size);
+    histogram lat;
+    c.out.begin_phase();
+    std::uint64_t begin = c.fs.now_ns();
+    for (std::uint64_t i = 0; i < ops; ++i) {
+        std::string key = make_key(r.uniform(p.keys), p.key_size);
+        std::uint64_t t = c.fs.now_ns();
+        s->put(key, value);
+        lat.record(c.fs.now_ns() - t);
+    }
+    s->sync();
+    c.out.add_ops("put", lat, c.fs.now_ns() - begin);
+    describe_store(c, *s);
+}
+
+// overwrites of zipf-distributed keys with same-size values, the shape of
+// session and counter updates.
+void update_zipf(context& c) {
+    kv_params p(c.opts);
+    std::uint64_t ops = c.opts.u64("ops", 1'000'000);
+    auto threads = static_cast<unsigned>(c.opts.u64("threads", 1));
+    zipf dist(p.keys, c.opts.f64("theta", 0.99));
+    auto s = open_store(c);
+    load(c, *s, p, true, nullptr);
+
+    c.out.begin_phase();
+    std::uint64_t begin = c.fs.now_ns();
+    histogram lat = run_threads(threads, [&](unsigned t) {
+        rng r(p.seed + 1 + t);
+        std::string value = make_value(r, p.value_size);
+        histogram h;
+        for (std::uint64_t i = t; i < ops; i += threads) {
+            std::string key = make_key(dist.next(r), p.key_size);
+            std::uint64_t t0 = c.fs.now_ns();
+            s->put(key, value);
+            h.record(c.fs.now_ns() - t0);
+        }
+        return h;
+    });
+    c.out.add_ops("put", lat, c.fs.now_ns() - begin);
+    describe_store(c, *s);
+}
+
+// open-loop random gets arriving at --rate per second for --seconds, spread
+// over --threads clients, once without deadlines and once with each get
+// under a --deadline_ms deadline counted from its arrival. goodput is gets
+// answered within the deadline per second. a rate above what the device
+// serves (e.g. --env=sim --sim.profile=hdd) shows the difference: without
+// deadlines the backlog makes every answer late.
+void overload(context& c) {
+    kv_params p(c.opts);
+    auto threads = static_cast<unsigned>(c.opts.u64("threads", 32));
+    std::uint64_t rate = std::max<std::uint64_t>(1, c.opts.u64("rate", 1'000));
+    std::uint64_t ops = rate * c.opts.u64("seconds", 5);
+    std::uint64_t deadline = c.opts.u64("deadline_ms", 50) * 1'000'000;
+    auto s = open_store(c);
+    load(c, *s, p, true, nullptr);
+
+    for (bool bounded : {false, true}) {
+        std::atomic<std::uint64_t> good{0}, late{0}, rejected{0};
+        std::uint64_t begin = c.fs.now_ns();
+        histogram lat = run_threads(threads, [&](unsigned t) {
+            rng r(p.seed + 1 + t);
+            histogram h;
+            std::string value;
+            for (std::uint64_t i = t; i < ops; i += threads) {
+                std::uint64_t arrival = begin + i * 1'000'000'000 / rate, now = c.fs.now_ns();
+                if (now < arrival) c.fs.sleep_ns(arrival - now);
+                std::string key = make_key(r.uniform(p.keys), p.key_size);
+                try {
+                    std::optional<deadline_scope> scope;
+                    if (bounded) scope.emplace(c.fs, arrival + deadline);
+                    if (!s->get(key, value)) throw std::logic_error("kv.overload: missing key " + key);
+                } catch (const deadline_exceeded&) {
+                    ++rejected;
+                    continue;
+                }
+                std::uint64_t took = c.fs.now_ns() - arrival;
+                h.record(took);
+                ++(took <= deadline ? good : late);
+            }
+            return h;
+        });
+        auto elapsed = static_cast<double>(c.fs.now_ns() - begin);
+        std::string prefix = bounded ? "deadline" : "unbounded";
+        c.out.add(prefix + ".goodput", static_cast<double>(good) * 1e9 / elapsed, "ops/s");
+        c.out.add(prefix + ".late", static_cast<double>(late));
+        c.out.add(prefix + ".rejected", static_cast<double>(rejected));
+        c.out.add_latency(prefix + ".answered", lat);
+    }
+    describe_store(c, *s);
+}
+
+// time to reopen a loaded store, i.e. recovery cost.
+void reopen(context& c) {
+    kv_params p(c.opts);
+    auto s = open_store(c);
+    load(c, *s, p, true, nullptr);
+    s.reset();
+    std::uint64_t begin = c.fs.now_ns();
+    s = open_store(c);
+    c.out.add("open", static_cast<double>(c.fs.now_ns() - begin) / 1e6, "ms");
+    describe_store(c, *s);
+}
+
+register_workload w1("kv.fill_seq", "put --keys keys in key order; --key_size, --value_size", fill_seq);
+register_workload w2("kv.fill_random", "put --keys keys in random order", fill_random);
+register_workload w3("kv.read_random", "load, then --ops random gets on --threads threads", read_random);
+register_workload w7("kv.read_scaling", "load, then --ops random gets per thread at 1, 2, 4, ... --max_threads threads",
+                     read_scaling);
+register_workload w4("kv.overwrite", "load, then --ops random overwrites", overwrite);
+register_workload w6("kv.update_zipf", "load, then --ops zipf(--theta) overwrites on --threads threads", update_zipf);
+register_workload w5("kv.reopen", "load, close and time reopening", reopen);
+register_workload w8("kv.overload",
+                     "open-loop gets at --rate/s for --seconds on --threads clients, without and with --deadline_ms deadlines",
+                     overload);
+
+} // namespace
+} // namespace dsa::bench
@@ -0,0 +1,51 @@
+// adaptive_mutex against std::mutex, alone and under contention.
+
+#include "bench.hpp"
+
+#include <dsa/lock.hpp>
+
+#include <mutex>
+
+namespace dsa::bench {
+namespace {
+
+// --threads threads each take the lock --ops times around a critical
+// section of --work increments of a shared counter. returns ns per
+// acquisition over all threads.
+template <class Mutex>
+double cost(context& c, Mutex& m, unsigned threads) {
+    std::uint64_t ops = c.opts.u64("ops", 2'000'000);
+    std::uint64_t work = c.opts.u64("work", 10);
+    volatile std::uint64_t shared = 0;
+    std::uint64_t t0 = c.fs.now_ns();
+    run_threads(threads, [&](unsigned) {
+        for (std::uint64_t i = 0; i < ops; ++i) {
+            std::lock_guard<Mutex> g(m);
+            for (std::uint64_t w = 0; w < work; ++w) shared = shared + 1;
+        }
+        return histogram();
+    });
+    if (shared != ops * threads * work) throw std::logic_error("lock.overhead: lost an update");
+    return static_cast<double>(c.fs.now_ns() - t0) / static_cast<double>(ops * threads);
+}
+
+// ns per lock/unlock pair of each mutex on one thread and on --threads,
+// and adaptive_mutex's own profile of the contended run.
+void overhead(context& c) {
+    auto threads = static_cast<unsigned>(c.opts.u64("threads", 4));
+    std::mutex plain1, plain_n;
+    adaptive_mutex adaptive1, adaptive_n;
+    c.out.add("uncontended.std", cost(c, plain1, 1), "ns");
+    c.out.add("uncontended.adaptive", cost(c, adaptive1, 1), "ns");
+    c.out.add("contended.std", cost(c, plain_n, threads), "ns");
+    c.out.add("contended.adaptive", cost(c, adaptive_n, threads), "ns");
+    c.out.add_lock("adaptive", adaptive_n.stats());
+}
+
+register_workload w1("lock.overhead",
+                     "ns per lock/unlock of std::mutex and adaptive_mutex around --work increments, on one thread "
+                     "and on --threads, and the adaptive lock's contention profile",
+                     overhead);
+
+} // namespace
+} // namespace dsa::bench
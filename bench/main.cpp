@@ -0,0 +1,216 @@
+#include "baseline.hpp"
+#include "bench.hpp"
+
+#include <dsa/sim_env.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+
+namespace {
+
+using namespace dsa::bench;
+
+void usage() {
+    std::cout << "usage: dsa_bench [--env=KIND] [--workload=NAME[,NAME...]] [--dir=PATH] [--KEY=VALUE...]\n"
+                 "       dsa_bench --list\n"
+                 "a workload name ending in * matches every workload with that prefix.\n"
+                 "  --trials=N           run each workload N times; metrics become means with 95% intervals\n"
+                 "  --save_baseline=NAME keep the run's summary as --baseline_dir/NAME.tsv\n"
+                 "  --baseline=NAME      compare with a saved summary; exits 3 if any metric regressed\n"
+                 "  --regress_pct=P      smallest change that counts, in percent of the baseline (5)\n"
+                 "  --output=PATH        also write the summary, with any comparison, as tab-separated text\n"
+                 "  --perf=0             do not read hardware counters (--perf.kernel=1 to count kernel time too)\n";
+}
+
+void list() {
+    std::cout << "envs:\n";
+    for (const env_kind& k : env_kinds()) std::cout << "  " << k.name << "  " << k.help << "\n";
+    std::cout << "stores (--store):\n";
+    for (const store_kind& k : store_kinds()) std::cout << "  " << k.name << "  " << k.help << "\n";
+    std::cout << "workloads:\n";
+    for (const workload& w : workloads()) std::cout << "  " << w.name << "  " << w.help << "\n";
+}
+
+bool matches(const std::string& pattern, const std::string& name) {
+    if (pattern == "all") return true;
+    if (!pattern.empty() && pattern.back() == '*') return name.compare(0, pattern.size() - 1, pattern, 0, pattern.size() - 1) == 0;
+    return pattern == name;
+}
+
+std::vector<const workload*> select(const std::string& spec) {
+    std::vector<const workload*> out;
+    std::size_t pos = 0;
+    while (pos <= spec.size()) {
+        std::size_t comma = spec.find(',', pos);
+        std::string pattern = spec.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        bool any = false;
+        for (const workload& w : workloads()) {
+            if (matches(pattern, w.name)) {
+                out.push_back(&w);
+                any = true;
+            }
+        }
+        if (!any) throw std::invalid_argument("no workload matches " + pattern);
+        if (comma == std::string::npos) break;
+        pos = comma + 1;
+    }
+    return out;
+}
+
+void add_device_stats(dsa::env& e, report& out) {
+    auto* sim = dynamic_cast<dsa::sim_env*>(&e);
+    if (!sim) return;
+    dsa::device_stats s = sim->stats();
+    out.add("device.reads", static_cast<double>(s.reads));
+    out.add("device.writes", static_cast<double>(s.writes));
+    out.add("device.syncs", static_cast<double>(s.syncs));
+    out.add("device.read_bytes", static_cast<double>(s.read_bytes), "B");
+    out.add("device.write_bytes", static_cast<double>(s.write_bytes), "B");
+    out.add("device.busy", static_cast<double>(s.busy_ns) / 1e6, "ms");
+    out.add("device.stalled", static_cast<double>(s.stalled_ns) / 1e6, "ms");
+    out.add("device.rejected", static_cast<double>(s.rejected));
+}
+
+// the options that shape a run's numbers, as they go into a summary.
+std::vector<std::string> run_options(const options& opts) {
+    static const char* driver_only[] = {"dir", "keep", "workload", "trials", "baseline", "save_baseline", "baseline_dir", "output", "regress_pct"};
+    std::vector<std::string> out;
+    for (const auto& [k, v] : opts.all())
+        if (std::find(std::begin(driver_only), std::end(driver_only), k) == std::end(driver_only)) out.push_back("--" + k + "=" + v);
+    return out;
+}
+
+std::string baseline_path(const options& opts, const std::string& name) {
+    return dsa::join_path(opts.str("baseline_dir", "bench_baselines"), name + ".tsv");
+}
+
+// one trial prints as before; more add the interval, and a baseline the
+// change against it and the verdict.
+void print(const std::string& name, const std::string& env_name, const std::vector<summary>& metrics,
+           const std::vector<comparison>* against) {
+    std::cout << "== " << name << " (env=" << env_name << ")\n";
+    for (std::size_t i = 0; i < metrics.size(); ++i) {
+        const summary& m = metrics[i];
+        std::printf("  %-28s %14.3f", m.name.c_str(), m.mean);
+        if (m.trials > 1) std::printf(" +- %-10.3f", m.ci95());
+        if (!against) {
+            std::printf(" %s\n", m.unit.c_str());
+            continue;
+        }
+        const comparison& c = (*against)[i];
+        std::printf(" %-6s", m.unit.c_str());
+        if (c.base) std::printf(" %+8.1f%% %s\n", c.change_pct, verdict_name(c.result));
+        else std::printf(" %9s %s\n", "", verdict_name(c.result));
+    }
+    std::cout.flush();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    options opts;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--help" || a == "-h") {
+            usage();
+            return 0;
+        }
+        if (a.rfind("--", 0) != 0) {
+            usage();
+            return 2;
+        }
+        std::size_t eq = a.find('=');
+        if (eq == std::string::npos) opts.set(a.substr(2), "1");
+        else opts.set(a.substr(2, eq - 2), a.substr(eq + 1));
+    }
+    if (opts.has("list")) {
+        list();
+        return 0;
+    }
+
+    try {
+        std::string env_name = opts.str("env", "posix");
+        const env_kind& kind = find_env_kind(env_name);
+        std::string root = opts.str("dir", "/tmp/dsa_bench");
+        std::uint64_t trials = opts.u64("trials", 1);
+        if (!trials) throw std::invalid_argument("--trials must be positive");
+        double threshold = opts.f64("regress_pct", 5);
+
+        // opened once, before any workload starts a thread, so every thread
+        // after is counted.
+        std::unique_ptr<perf_counters> counters;
+        if (opts.u64("perf", 1)) {
+            counters = std::make_unique<perf_counters>(opts.u64("perf.kernel", 0) != 0);
+            if (!counters->missing().empty())
+                std::cerr << "dsa_bench: note: hardware counters not available: " << counters->missing() << "\n";
+            if (!counters->any()) counters.reset();
+        }
+
+        std::unique_ptr<baseline> base;
+        if (opts.has("baseline")) {
+            base = std::make_unique<baseline>(read_baseline(baseline_path(opts, opts.str("baseline"))));
+            if (base->options != run_options(opts)) {
+                std::cerr << "dsa_bench: note: the baseline ran with other options:";
+                for (const std::string& o : base->options) std::cerr << " " << o;
+                std::cerr << "\n";
+            }
+        }
+
+        std::vector<summary> all;
+        std::vector<comparison> compared;
+        for (const workload* w : select(opts.str("workload", "all"))) {
+            trial_set runs;
+            for (std::uint64_t t = 0; t < trials; ++t) {
+                // a fresh env per workload and trial keeps device stats and
+                // in-memory state from leaking between runs.
+                std::string dir = dsa::join_path(root, w->name);
+                if (kind.on_disk) std::filesystem::remove_all(dir);
+                std::unique_ptr<dsa::env> e = kind.make(opts);
+                e->create_dir(dir);
+                report r;
+                r.attach(counters.get());
+                context c{*e, dir, opts, r};
+                perf_counters::values before = counters ? counters->read() : perf_counters::values{};
+                w->run(c);
+                if (counters) r.add_counters("perf", before, counters->read(), 1);
+                add_device_stats(*e, r);
+                runs.add(r);
+                e.reset();
+                if (kind.on_disk && !opts.has("keep")) std::filesystem::remove_all(dir);
+            }
+            std::vector<summary> metrics = runs.summarise(w->name);
+            std::vector<comparison> against;
+            if (base)
+                for (const summary& m : metrics) against.push_back(compare(m, base->find(w->name, m.name), threshold));
+            print(w->name, env_name, metrics, base ? &against : nullptr);
+            all.insert(all.end(), metrics.begin(), metrics.end());
+            compared.insert(compared.end(), against.begin(), against.end());
+        }
+
+        if (opts.has("output")) write_summaries(opts.str("output"), run_options(opts), all, base ? &compared : nullptr);
+        if (opts.has("save_baseline")) {
+            std::filesystem::create_directories(opts.str("baseline_dir", "bench_baselines"));
+            write_summaries(baseline_path(opts, opts.str("save_baseline")), run_options(opts), all, nullptr);
+        }
+        if (base) {
+            std::size_t counts[5] = {};
+            for (const comparison& c : compared) ++counts[static_cast<unsigned>(c.result)];
+            std::cout << "== against " << opts.str("baseline") << ": " << counts[static_cast<unsigned>(verdict::regressed)]
+                      << " regressed, " << counts[static_cast<unsigned>(verdict::improved)] << " improved, "
+                      << counts[static_cast<unsigned>(verdict::changed)] << " changed, "
+                      << counts[static_cast<unsigned>(verdict::added)] << " new (threshold " << threshold << "%)\n";
+            for (std::size_t i = 0; i < all.size(); ++i)
+                if (compared[i].result == verdict::regressed)
+                    std::printf("  regressed: %s %s %.3f -> %.3f %s (%+.1f%%)\n", all[i].workload.c_str(), all[i].name.c_str(),
+                                compared[i].base->mean, all[i].mean, all[i].unit.c_str(), compared[i].change_pct);
+            if (counts[static_cast<unsigned>(verdict::regressed)]) return 3;
+        }
+    } catch (const std::exception& ex) {
+        std::cerr << "dsa_bench: " << ex.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+// workloads for mem_store's compressed cold values.
+
+#include "bench.hpp"
+#include "keygen.hpp"
+
+#include <dsa/mem_store.hpp>
+
+#include <algorithm>
+#include <numeric>
+
+namespace dsa::bench {
+namespace {
+
+mem_store& as_mem(store& s, const char* workload) {
+    auto* m = dynamic_cast<mem_store*>(&s);
+    if (!m) throw std::invalid_argument(std::string(workload) + " needs --store=mem");
+    return *m;
+}
+
+// a json-ish record of about len bytes: fixed field names, fields with a
+// handful of values and a few random digits, the way rows of a user table
+// look. random letters would not compress at all and repeated bytes
+// absurdly well.
+std::string record_value(rng& r, std::uint64_t id, std::size_t len) {
+    static const char* status[] = {"active", "suspended", "pending", "closed"};
+    static const char* plan[] = {"free", "basic", "team", "enterprise"};
+    static const char* region[] = {"eu-west", "us-east", "us-west", "ap-south", "sa-east"};
+    std::string v = "{\"id\":" + std::to_string(id) + ",\"status\":\"" + status[r.uniform(4)] + "\",\"plan\":\"" + plan[r.uniform(4)] +
+                    "\",\"region\":\"" + region[r.uniform(5)] + "\",\"balance\":" + std::to_string(r.uniform(1'000'000)) +
+                    ",\"tags\":[";
+    while (v.size() + 16 < len) v += "\"t" + std::to_string(r.uniform(32)) + "\",";
+    v += "]}";
+    v.resize(len, ' ');
+    return v;
+}
+
+// loads --keys records of --value_size bytes, keeps reading the first
+// --hot_keys of them while sweeping --mem.cold_after + 1 times so the rest
+// go cold, then alternates gets of hot keys with first gets of cold ones.
+// reports memory before and after, and the latency a cold hit adds.
+void cold(context& c) {
+    std::uint64_t keys = c.opts.u64("keys", 500'000);
+    std::uint64_t ops = c.opts.u64("ops", 100'000);
+    std::size_t key_size = c.opts.u64("key_size", 16);
+    std::size_t value_size = c.opts.u64("value_size", 200);
+    auto hot_end = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(c.opts.f64("hot_keys", 0.1) * static_cast<double>(keys)));
+    std::uint64_t cold_after = c.opts.u64("mem.cold_after", 0);
+    if (!cold_after || hot_end >= keys) throw std::invalid_argument("mem.cold needs --mem.cold_after > 0 and --hot_keys < 1");
+    auto s = open_store(c);
+    mem_store& m = as_mem(*s, "mem.cold");
+
+    rng r(c.opts.u64("seed", 1));
+    for (std::uint64_t i = 0; i < keys; ++i) m.put(make_key(i, key_size), record_value(r, i, value_size));
+    mem_store_stats before = m.stats();
+
+    std::string value;
+    histogram sweep;
+    for (std::uint64_t round = 0; round <= cold_after; ++round) {
+        for (std::uint64_t i = 0; i < hot_end; ++i) m.get(make_key(i, key_size), value);
+        std::uint64_t t0 = c.fs.now_ns();
+        m.sweep();
+        sweep.record(c.fs.now_ns() - t0);
+    }
+    mem_store_stats after = m.stats();
+
+    // cold keys in a scattered order, each read once so every read is a
+    // cold hit.
+    std::uint64_t n_cold = keys - hot_end, stride = 0x9e3779b97f4a7c15ull % n_cold | 1;
+    while (std::gcd(stride, n_cold) != 1) stride += 2;
+    histogram hot, cold;
+    for (std::uint64_t i = 0; i < ops; ++i) {
+        bool want_cold = i % 2 && i / 2 < n_cold;
+        std::string key = make_key(want_cold ? hot_end + (i / 2 * stride) % n_cold : r.uniform(hot_end), key_size);
+        std::uint64_t t0 = c.fs.now_ns();
+        if (!m.get(key, value)) throw std::logic_error("mem.cold: missing key " + key);
+        (want_cold ? cold : hot).record(c.fs.now_ns() - t0);
+    }
+
+    c.out.add("memory.before", static_cast<double>(before.bytes), "B");
+    c.out.add("memory.after", static_cast<double>(after.bytes), "B");
+    c.out.add("memory.saved", 100.0 * (1 - static_cast<double>(after.bytes) / static_cast<double>(before.bytes)), "%");
+    c.out.add("cold.keys", static_cast<double>(after.cold_keys));
+    if (after.cold_page_bytes)
+        c.out.add("cold.ratio", static_cast<double>(after.cold_value_bytes) / static_cast<double>(after.cold_page_bytes), "x");
+    c.out.add_latency("sweep", sweep);
+    c.out.add_latency("get.hot", hot);
+    c.out.add_latency("get.cold", cold);
+    c.out.add("cold.added_p99", (static_cast<double>(cold.percentile(99)) - static_cast<double>(hot.percentile(99))) / 1e3, "us");
+    describe_store(c, *s);
+}
+
+register_workload w1("mem.cold",
+                     "--keys json-ish records, the first --hot_keys kept warm while the rest go cold; memory saved and "
+                     "added get latency of cold hits; --store=mem --mem.cold_after=N",
+                     cold);
+
+} // namespace
+} // namespace dsa::bench
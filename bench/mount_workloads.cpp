@@ -0,0 +1,203 @@
+// what routing through a mount_table costs on top of the backend.
+
+#include "bench.hpp"
+#include "keygen.hpp"
+
+#include <dsa/mem_store.hpp>
+#include <dsa/mount.hpp>
+
+namespace dsa::bench {
+namespace {
+
+double per_op(std::uint64_t ns, std::uint64_t n) { return n ? static_cast<double>(ns) / static_cast<double>(n) : 0; }
+
+// prefixes of a similar shape to real ones, and sharing leading bytes so
+// the trie has to branch below the root.
+std::string prefix_of(std::uint64_t i) { return "tenant" + std::to_string(i) + "/"; }
+
+// --keys keys spread over 1, 8 and 64 mounted prefixes, each a mem_store,
+// then --ops random puts and gets through the table and straight into a
+// single mem_store holding the same keys, and the lookup alone. then
+// batches of --batch_size puts across prefixes, logged on --env. reports
+// ns per operation for each and the overhead routing adds.
+void overhead(context& c) {
+    std::uint64_t keys = c.opts.u64("keys", 200'000);
+    std::uint64_t ops = c.opts.u64("ops", 1'000'000);
+    std::uint64_t batch_size = c.opts.u64("batch_size", 16);
+    std::size_t key_size = c.opts.u64("key_size", 16);
+    std::size_t value_size = c.opts.u64("value_size", 64);
+    std::uint64_t checksum = 0;
+
+    auto time = [&](auto&& fn) {
+        std::uint64_t t0 = c.fs.now_ns();
+        fn();
+        return c.fs.now_ns() - t0;
+    };
+
+    for (std::uint64_t prefixes : {1, 8, 64}) {
+        std::vector<std::string> names(keys);
+        for (std::uint64_t i = 0; i < keys; ++i) names[i] = prefix_of(i % prefixes) + make_key(i, key_size);
+        rng r(c.opts.u64("seed", 1));
+        std::vector<std::uint32_t> probes(ops);
+        for (std::uint32_t& p : probes) p = static_cast<std::uint32_t>(r.uniform(keys));
+        std::string value = make_value(r, value_size), out;
+
+        std::vector<mount> mounts;
+        for (std::uint64_t p = 0; p < prefixes; ++p) mounts.push_back({prefix_of(p), std::make_unique<mem_store>()});
+        mount_table_options mo;
+        mo.durable_batches = true;
+        mount_table table(c.fs, join_path(c.dir, "mount" + std::to_string(prefixes)), std::move(mounts), mo);
+        mem_store direct;
+        for (const std::string& k : names) {
+            table.put(k, value);
+            direct.put(k, value);
+        }
+
+        std::string at = "p" + std::to_string(prefixes);
+        double route = per_op(time([&] {
+                                  for (std::uint32_t p : probes) checksum += reinterpret_cast<std::uintptr_t>(&table.route(names[p])) & 1;
+                              }),
+                              ops);
+        double get_direct = per_op(time([&] {
+                                       for (std::uint32_t p : probes) checksum += direct.get(names[p], out);
+                                   }),
+                                   ops);
+        double get_mount = per_op(time([&] {
+                                      for (std::uint32_t p : probes) checksum += table.get(names[p], out);
+                                  }),
+                                  ops);
+        double put_direct = per_op(time([&] {
+                                       for (std::uint32_t p : probes) direct.put(names[p], value);
+                                   }),
+                                   ops);
+        double put_mount = per_op(time([&] {
+                                      for (std::uint32_t p : probes) table.put(names[p], value);
+                                  }),
+                                  ops);
+        std::uint64_t batches = std::max<std::uint64_t>(1, std::min<std::uint64_t>(ops / batch_size, 2'000));
+        double batch = per_op(time([&] {
+                                  mount_table::batch b;
+                                  for (std::uint64_t i = 0; i < batches; ++i) {
+                                      b.clear();
+                                      for (std::uint64_t j = 0; j < batch_size; ++j) b.put(names[probes[(i * batch_size + j) % ops]], value);
+                                      table.apply(b);
+                                  }
+                              }),
+                              batches * batch_size);
+
+        c.out.add(at + ".route", route, "ns");
+        c.out.add(at + ".get.direct", get_direct, "ns");
+        c.out.add(at + ".get.mount", get_mount, "ns");
+        c.out.add(at + ".get.overhead", get_mount - get_direct, "ns");
+        c.out.add(at + ".put.direct", put_direct, "ns");
+        c.out.add(at + ".put.mount", put_mount, "ns");
+        c.out.add(at + ".put.overhead", put_mount - put_direct, "ns");
+        c.out.add(at + ".batch_put", batch, "ns");
+    }
+    if (!checksum) throw std::logic_error("mount.overhead: no lookup found anything");
+}
+
+// a mem_store whose puts of one key throw while it is armed.
+class failing_store : public mem_store {
+public:
+    explicit failing_store(std::string key) : key_(std::move(key)) {}
+
+    void put(std::string_view key, std::string_view value) override {
+        if (armed && key == key_) throw io_error("failing_store: put of " + key_ + " refused");
+        mem_store::put(key, value);
+    }
+
+    bool armed = true;
+
+private:
+    std::string key_;
+};
+
+// logged batches over a backend that throws on one key: the batch thrown
+// on has to be finished, not lost, by the next apply, which must refuse
+// its own batch while the backend still throws, and no read may see it in
+// part meanwhile. without durable batches a read finishes it the same way. a shorter batch next must
+// not let the longer one's leftover bytes into the log. one value per
+// check, so the first check that fails names what went wrong.
+void batch_failure(context& c) {
+    std::size_t value_size = c.opts.u64("value_size", 64);
+    rng r(c.opts.u64("seed", 1));
+    std::string v = make_value(r, value_size);
+    auto fail = std::make_unique<failing_store>("b/fail");
+    failing_store& failing = *fail;
+    std::vector<mount> mounts;
+    mounts.push_back({"a/", std::make_unique<mem_store>()});
+    mounts.push_back({"b/", std::move(fail)});
+    mount_table table(c.fs, join_path(c.dir, "mount"), std::move(mounts));
+    auto check = [&](bool ok, const char* what) {
+        if (!ok) throw std::logic_error(std::string("mount.batch_failure: ") + what);
+    };
+    auto threw = [&](const mount_table::batch& b) {
+        try {
+            table.apply(b);
+        } catch (const io_error&) {
+            return true;
+        }
+        return false;
+    };
+    auto read_threw = [&](mount_table& t, std::string_view key) {
+        std::string ignored;
+        try {
+            t.get(key, ignored);
+        } catch (const io_error&) {
+            return true;
+        }
+        return false;
+    };
+    std::string out;
+
+    mount_table::batch first;
+    for (int i = 0; i < 8; ++i) first.put("a/" + std::to_string(i), v);
+    first.put("b/fail", v);
+    first.put("a/last", v);
+    check(threw(first), "a batch through a throwing backend did not throw");
+    check(read_threw(table, "a/0"), "a read saw part of a batch");
+    check(!table.route("a/last").get("a/last", out), "ops after the throw ran");
+
+    mount_table::batch next;
+    next.put("a/next", v);
+    check(threw(next), "a batch went in while the one before still threw");
+    check(!table.route("a/next").get("a/next", out), "a batch refused was applied");
+
+    failing.armed = false;
+    std::uint64_t begin = c.fs.now_ns();
+    table.apply(next);
+    c.out.add("finish_and_apply", static_cast<double>(c.fs.now_ns() - begin) / 1e3, "us");
+    for (const char* k : {"a/0", "a/7", "b/fail", "a/last", "a/next"}) check(table.get(k, out) && out == v, "a logged op was lost");
+    check(table.stats().replayed == 1, "the thrown-on batch was not finished exactly once");
+
+    auto fail2 = std::make_unique<failing_store>("b/fail");
+    failing_store& failing2 = *fail2;
+    mounts.clear();
+    mounts.push_back({"a/", std::make_unique<mem_store>()});
+    mounts.push_back({"b/", std::move(fail2)});
+    mount_table_options volatile_batches;
+    volatile_batches.durable_batches = false;
+    mount_table unlogged(c.fs, join_path(c.dir, "mount_unlogged"), std::move(mounts), volatile_batches);
+    try {
+        unlogged.apply(first);
+        check(false, "an unlogged batch through a throwing backend did not throw");
+    } catch (const io_error&) {
+    }
+    check(read_threw(unlogged, "a/0"), "a read saw part of an unlogged batch");
+    failing2.armed = false;
+    for (const char* k : {"a/0", "b/fail", "a/last"}) check(unlogged.get(k, out) && out == v, "an unlogged batch was not finished");
+    check(unlogged.stats().replayed == 1, "the unlogged batch was not finished exactly once");
+}
+
+register_workload w1("mount.overhead",
+                     "--keys under 1, 8 and 64 mounted prefixes of mem_stores: ns per route, get and put through the "
+                     "table against one mem_store, and per put in logged batches of --batch_size",
+                     overhead);
+register_workload w2("mount.batch_failure",
+                     "logged batches across mounts with a backend that throws: the batch thrown on is finished by the next "
+                     "apply, which is refused while the backend still throws; checked",
+                     batch_failure);
+
+} // namespace
+} // namespace dsa::bench
@@ -0,0 +1,118 @@
+#pragma once
+
+// hardware performance counters through perf_event_open(2), so a change in
+// throughput comes with its micro-architectural reason: more cycles per
+// operation from cache or tlb misses, or fewer instructions.
+//
+// each event is opened on its own, counting user space of this process and
+// of every thread and child it starts from then on (inherit), so the
+// threads of run_threads and of the engines are included once they have
+// exited. an event the cpu, the kernel or the container does not allow is
+// left out, and the rest still count; when the kernel multiplexes events
+// onto fewer hardware counters, counts are scaled by enabled / running
+// time. elsewhere than linux nothing is counted.
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace dsa::bench {
+
+class perf_counters {
+public:
+    static constexpr unsigned count = 6;
+    using values = std::array<double, count>;
+
+    static const char* name(unsigned i) {
+        static const char* names[count] = {"cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses", "dtlb_misses"};
+        return names[i];
+    }
+
+    // kernel also counts time spent in system calls on the process's behalf,
+    // which unprivileged users usually may not.
+    explicit perf_counters(bool kernel = false) {
+        fds_.fill(-1);
+#if defined(__linux__)
+        struct event {
+            std::uint32_t type;
+            std::uint64_t config;
+        };
+        auto cache = [](std::uint64_t id) {
+            return id | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+        };
+        const event events[count] = {
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_L1D)}, {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}, {PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_DTLB)},
+        };
+        for (unsigned i = 0; i < count; ++i) {
+            perf_event_attr a;
+            std::memset(&a, 0, sizeof a);
+            a.size = sizeof a;
+            a.type = events[i].type;
+            a.config = events[i].config;
+            a.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            a.inherit = 1;
+            a.exclude_kernel = !kernel;
+            a.exclude_hv = 1;
+            fds_[i] = static_cast<int>(syscall(SYS_perf_event_open, &a, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+            if (fds_[i] < 0) {
+                if (!missing_.empty()) missing_ += ", ";
+                missing_ += std::string(name(i)) + " (" + std::strerror(errno) + ")";
+            }
+        }
+#else
+        missing_ = "all (not linux)";
+#endif
+    }
+
+    ~perf_counters() {
+#if defined(__linux__)
+        for (int fd : fds_)
+            if (fd >= 0) close(fd);
+#endif
+    }
+
+    perf_counters(const perf_counters&) = delete;
+    perf_counters& operator=(const perf_counters&) = delete;
+
+    bool has(unsigned i) const { return fds_[i] >= 0; }
+
+    bool any() const {
+        for (int fd : fds_)
+            if (fd >= 0) return true;
+        return false;
+    }
+
+    // the events that could not be opened, and why; empty if none.
+    const std::string& missing() const { return missing_; }
+
+    // counts so far, scaled for multiplexing; 0 for events not counted.
+    values read() const {
+        values v{};
+#if defined(__linux__)
+        for (unsigned i = 0; i < count; ++i) {
+            std::uint64_t buf[3];
+            if (fds_[i] < 0 || ::read(fds_[i], buf, sizeof buf) != static_cast<ssize_t>(sizeof buf)) continue;
+            v[i] = static_cast<double>(buf[0]);
+            if (buf[2] && buf[2] < buf[1]) v[i] *= static_cast<double>(buf[1]) / static_cast<double>(buf[2]);
+        }
+#endif
+        return v;
+    }
+
+private:
+    std::array<int, count> fds_;
+    std::string missing_;
+};
+
+} // namespace dsa::bench
@@ -0,0 +1,102 @@
+// reads into a per-request monotonic arena against the default heap.
+
+#include "bench.hpp"
+#include "keygen.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <memory_resource>
+#include <new>
+
+// every allocation through the global operator new, counted per thread so
+// the count costs nothing measurable in the other workloads.
+namespace {
+thread_local std::uint64_t heap_allocations = 0;
+}
+
+void* operator new(std::size_t n) {
+    ++heap_allocations;
+    if (void* p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+namespace dsa::bench {
+namespace {
+
+// loads --keys values of --value_size bytes into --store, then serves
+// --requests requests of --gets random gets each on --threads threads,
+// once collecting the values as std::strings on the heap and once as
+// std::pmr::strings in a monotonic arena per request, backed by a stack
+// buffer of --arena bytes. reports heap allocations per request and
+// requests/s for both.
+void arena(context& c) {
+    std::uint64_t keys = c.opts.u64("keys", 100'000);
+    std::uint64_t requests = c.opts.u64("requests", 200'000);
+    std::uint64_t gets = c.opts.u64("gets", 8);
+    std::size_t key_size = c.opts.u64("key_size", 24);
+    std::size_t value_size = c.opts.u64("value_size", 100);
+    std::size_t arena_size = c.opts.u64("arena", 16 << 10);
+    auto threads = static_cast<unsigned>(c.opts.u64("threads", 1));
+    auto s = open_store(c);
+
+    std::vector<std::string> names(keys);
+    rng r(c.opts.u64("seed", 1));
+    for (std::uint64_t i = 0; i < keys; ++i) {
+        names[i] = make_key(i, key_size);
+        s->put(names[i], make_value(r, value_size));
+    }
+
+    auto serve = [&](const char* name, bool use_arena) {
+        std::atomic<std::uint64_t> allocations{0}, found{0};
+        std::uint64_t t0 = c.fs.now_ns();
+        histogram lat = run_threads(threads, [&](unsigned t) {
+            rng tr(c.opts.u64("seed", 1) + t);
+            std::vector<char> buf(use_arena ? arena_size : 0);
+            histogram h;
+            std::uint64_t before = heap_allocations, hits = 0;
+            for (std::uint64_t i = t; i < requests; i += threads) {
+                std::uint64_t r0 = c.fs.now_ns();
+                if (use_arena) {
+                    std::pmr::monotonic_buffer_resource mr(buf.data(), buf.size());
+                    std::pmr::vector<std::pmr::string> values(&mr);
+                    values.reserve(gets);
+                    for (std::uint64_t g = 0; g < gets; ++g) {
+                        values.emplace_back();
+                        hits += s->get(names[tr.uniform(keys)], values.back());
+                    }
+                } else {
+                    std::vector<std::string> values;
+                    values.reserve(gets);
+                    for (std::uint64_t g = 0; g < gets; ++g) {
+                        values.emplace_back();
+                        hits += s->get(names[tr.uniform(keys)], values.back());
+                    }
+                }
+                h.record(c.fs.now_ns() - r0);
+            }
+            allocations += heap_allocations - before;
+            found += hits;
+            return h;
+        });
+        std::uint64_t elapsed = c.fs.now_ns() - t0;
+        if (found != requests * gets) throw std::logic_error("pmr.arena: missing keys");
+        std::string prefix = name;
+        c.out.add(prefix + ".allocs_per_request", static_cast<double>(allocations) / static_cast<double>(requests));
+        c.out.add_ops(prefix + ".request", lat, elapsed);
+        return static_cast<double>(requests) * 1e9 / static_cast<double>(elapsed);
+    };
+    double heap = serve("heap", false);
+    double pmr = serve("arena", true);
+    c.out.add("arena.speedup", pmr / heap, "x");
+    describe_store(c, *s);
+}
+
+register_workload w1("pmr.arena",
+                     "--requests of --gets random gets into std::strings on the heap, then into std::pmr::strings in "
+                     "a per-request monotonic arena; heap allocations per request and requests/s; any --store",
+                     arena);
+
+} // namespace
+} // namespace dsa::bench
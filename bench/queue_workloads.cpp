@@ -0,0 +1,195 @@
+// durable queue workloads: log_queue against a queue emulated on a kv store
+// with sequence-number keys.
+
+#include "bench.hpp"
+#include "keygen.hpp"
+
+#include <dsa/queue.hpp>
+
+#include <algorithm>
+#include <atomic>
+
+namespace dsa::bench {
+namespace {
+
+struct queue_params {
+    std::uint64_t messages;
+    std::size_t message_size;
+    std::size_t batch;
+    unsigned producers;
+    unsigned groups;
+
+    explicit queue_params(const options& o)
+        : messages(o.u64("messages", 1'000'000)), message_size(o.u64("message_size", 100)),
+          batch(std::max<std::uint64_t>(1, o.u64("batch", 100))), producers(static_cast<unsigned>(o.u64("producers", 1))),
+          groups(static_cast<unsigned>(o.u64("groups", 1))) {}
+};
+
+// appends --messages in --batch sized appends from --producers threads,
+// then drains them with one consumer per group (--groups), each committing
+// after every batch.
+void log_traffic(context& c) {
+    queue_params p(c.opts);
+    queue_options qo;
+    qo.segment_size = c.opts.u64("queue.segment_size", qo.segment_size);
+    qo.sync_appends = c.opts.u64("queue.sync_appends", qo.sync_appends) != 0;
+    qo.sync_commits = c.opts.u64("queue.sync_commits", qo.sync_commits) != 0;
+    log_queue q(c.fs, join_path(c.dir, "queue"), qo);
+    for (unsigned g = 0; g < p.groups; ++g) q.subscribe("g" + std::to_string(g));
+
+    std::uint64_t begin = c.fs.now_ns();
+    histogram lat = run_threads(p.producers, [&](unsigned t) {
+        rng r(c.opts.u64("seed", 1) + t);
+        std::string payload = make_value(r, p.message_size);
+        std::vector<std::string_view> msgs;
+        histogram h;
+        for (std::uint64_t i = t * p.batch; i < p.messages; i += p.producers * p.batch) {
+            msgs.assign(std::min<std::uint64_t>(p.batch, p.messages - i), payload);
+            std::uint64_t t0 = c.fs.now_ns();
+            q.append(msgs);
+            h.record(c.fs.now_ns() - t0);
+        }
+        return h;
+    });
+    std::uint64_t elapsed = c.fs.now_ns() - begin;
+    q.sync();
+    c.out.add_ops("append", lat, elapsed);
+    c.out.add("produce.messages", static_cast<double>(p.messages) * 1e9 / static_cast<double>(elapsed), "msg/s");
+
+    begin = c.fs.now_ns();
+    lat = run_threads(p.groups, [&](unsigned g) {
+        log_queue::consumer con = q.consume("g" + std::to_string(g));
+        histogram h;
+        std::uint64_t seen = 0;
+        while (seen < p.messages) {
+            std::uint64_t t0 = c.fs.now_ns();
+            log_queue::batch b = q.read(con.position(), p.batch);
+            con.seek(b.next_offset());
+            for (std::string_view m : b)
+                if (m.size() != p.message_size) throw std::logic_error("queue.log: bad message");
+            con.commit();
+            h.record(c.fs.now_ns() - t0);
+            seen += b.size();
+        }
+        return h;
+    });
+    elapsed = c.fs.now_ns() - begin;
+    c.out.add_ops("poll", lat, elapsed);
+    c.out.add("consume.messages", static_cast<double>(p.messages * p.groups) * 1e9 / static_cast<double>(elapsed), "msg/s");
+    queue_stats st = q.stats();
+    c.out.add("queue.segments", static_cast<double>(st.segments));
+    c.out.add("queue.segments_deleted", static_cast<double>(st.segments_deleted));
+    c.out.add_lock("queue.write_lock", st.write_lock);
+    c.out.add_lock("queue.group_lock", st.group_lock);
+    c.out.add_lock("queue.index_locks", st.index_locks);
+}
+
+// the same traffic as a kv queue: put(seq) to produce, get + erase(seq) to
+// consume. only one group, since erasing is what consumes.
+void kv_traffic(context& c) {
+    queue_params p(c.opts);
+    auto s = open_store(c);
+    std::atomic<std::uint64_t> next{0};
+
+    std::uint64_t begin = c.fs.now_ns();
+    histogram lat = run_threads(p.producers, [&](unsigned t) {
+        rng r(c.opts.u64("seed", 1) + t);
+        std::string payload = make_value(r, p.message_size);
+        histogram h;
+        while (true) {
+            std::uint64_t i = next.fetch_add(p.batch);
+            if (i >= p.messages) break;
+            std::uint64_t t0 = c.fs.now_ns();
+            for (std::uint64_t k = i; k < std::min(i + p.batch, p.messages); ++k) s->put(make_key(k, 20), payload);
+            h.record(c.fs.now_ns() - t0);
+        }
+        return h;
+    });
+    std::uint64_t elapsed = c.fs.now_ns() - begin;
+    s->sync();
+    c.out.add_ops("append", lat, elapsed);
+    c.out.add("produce.messages", static_cast<double>(p.messages) * 1e9 / static_cast<double>(elapsed), "msg/s");
+
+    histogram poll;
+    std::string value;
+    begin = c.fs.now_ns();
+    for (std::uint64_t i = 0; i < p.messages; i += p.batch) {
+        std::uint64_t t0 = c.fs.now_ns();
+        for (std::uint64_t k = i; k < std::min(i + p.batch, p.messages); ++k) {
+            std::string key = make_key(k, 20);
+            if (!s->get(key, value) || !s->erase(key)) throw std::logic_error("queue.kv: missing message " + key);
+        }
+        s->sync();
+        poll.record(c.fs.now_ns() - t0);
+    }
+    elapsed = c.fs.now_ns() - begin;
+    c.out.add_ops("poll", poll, elapsed);
+    c.out.add("consume.messages", static_cast<double>(p.messages) * 1e9 / static_cast<double>(elapsed), "msg/s");
+    describe_store(c, *s);
+}
+
+// appends --messages of --message_size (distinct payloads), closes the
+// queue and reopens it, timing the segment scans that rebuild it, then
+// reads every message back. more data than one read-ahead window makes the
+// scans refill mid-record; a message lost or changed on the way is an
+// error. then a batch holding one message too large for a segment must be
+// refused without publishing any of it.
+void reopen(context& c) {
+    std::uint64_t messages = c.opts.u64("messages", 20'000);
+    std::size_t size = c.opts.u64("message_size", 1000);
+    queue_options qo;
+    qo.segment_size = c.opts.u64("queue.segment_size", qo.segment_size);
+    std::string dir = join_path(c.dir, "queue");
+    auto payload = [&](std::uint64_t i) {
+        rng r(i + 1);
+        return make_value(r, size);
+    };
+    {
+        log_queue q(c.fs, dir, qo);
+        for (std::uint64_t i = 0; i < messages; ++i) q.append(payload(i));
+    }
+    std::uint64_t begin = c.fs.now_ns();
+    log_queue q(c.fs, dir, qo);
+    std::uint64_t elapsed = c.fs.now_ns() - begin;
+    c.out.add("recover", static_cast<double>(elapsed) / 1e6, "ms");
+    c.out.add("recover.bandwidth", static_cast<double>(messages * (size + 8)) / (1 << 20) * 1e9 / static_cast<double>(elapsed), "MiB/s");
+    if (q.end_offset() != messages)
+        throw std::logic_error("queue.reopen: end offset " + std::to_string(q.end_offset()) + " after " + std::to_string(messages) + " messages");
+    for (std::uint64_t at = 0; at < messages;) {
+        log_queue::batch b = q.read(at, 1000);
+        if (b.empty()) throw std::logic_error("queue.reopen: nothing to read at " + std::to_string(at));
+        for (std::string_view m : b)
+            if (m != payload(at++)) throw std::logic_error("queue.reopen: message " + std::to_string(at - 1) + " changed");
+    }
+
+    // a batch with a message too large for a segment is refused whole, and
+    // leaves nothing behind for the next append to trip over.
+    std::string big(qo.segment_size, 'x');
+    std::vector<std::string> fill;
+    for (std::uint64_t i = 0; i < qo.segment_size / (size + 8) + 1; ++i) fill.push_back(payload(i));
+    std::vector<std::string_view> bad(fill.begin(), fill.end());
+    bad.push_back(big);
+    try {
+        q.append(bad);
+        throw std::logic_error("queue.reopen: an oversized message was taken");
+    } catch (const std::length_error&) {
+    }
+    if (q.end_offset() != messages) throw std::logic_error("queue.reopen: a refused batch was published in part");
+    std::string last = payload(messages);
+    q.append(last);
+    log_queue::batch b = q.read(messages, 1);
+    if (b.size() != 1 || b[0] != last) throw std::logic_error("queue.reopen: append after a refused batch reads back wrong");
+}
+
+register_workload w1("queue.log",
+                     "--messages of --message_size appended in --batch batches by --producers threads, then drained by "
+                     "--groups consumer groups; --queue.{segment_size,sync_appends,sync_commits}",
+                     log_traffic);
+register_workload w2("queue.kv", "queue.log's traffic as put / get + erase of sequence keys on --store", kv_traffic);
+register_workload w3("queue.reopen",
+                     "--messages of --message_size appended, then the queue reopened and read back; recovery time, checked "
+                     "end to end",
+                     reopen);
+
+} // namespace
+} // namespace dsa::bench
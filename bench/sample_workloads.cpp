@@ -0,0 +1,103 @@
+// key sampling: how fast store::sample draws, and whether what it draws is
+// uniform.
+
+#include "bench.hpp"
+#include "keygen.hpp"
+
+#include <cmath>
+#include <cstdio>
+
+namespace dsa::bench {
+namespace {
+
+// upper tail of the chi-square distribution with k degrees of freedom, by
+// the wilson-hilferty normal approximation; good to a few percent for k of
+// ten or more.
+double chi2_p_value(double chi2, double k) {
+    double v = 2.0 / (9.0 * k);
+    double z = (std::cbrt(chi2 / k) - (1.0 - v)) / std::sqrt(v);
+    return 0.5 * std::erfc(z / std::sqrt(2.0));
+}
+
+// fills --store with --keys keys of --value_size bytes, inserted in
+// --order (random or sequential, which leaves tree pages fuller or
+// emptier), then erases the first --erase fraction of them so the index
+// has an uneven stretch. draws --samples keys in calls of --batch and
+// reports samples/s; the keys drawn are counted in --bins bins of equal
+// key range over what is left, and a chi-square test against equal counts
+// gives the p-value of uniformity.
+void uniform(context& c) {
+    std::uint64_t keys = c.opts.u64("keys", 1'000'000);
+    std::size_t value_size = c.opts.u64("value_size", 100);
+    std::uint64_t samples = c.opts.u64("samples", 1'000'000);
+    std::size_t batch = std::max<std::uint64_t>(c.opts.u64("batch", 1000), 1);
+    std::uint64_t bins = c.opts.u64("bins", 100);
+    std::uint64_t seed = c.opts.u64("seed", 1);
+    std::string order = c.opts.str("order", "random");
+    auto first = static_cast<std::uint64_t>(c.opts.f64("erase", 0.0) * static_cast<double>(keys));
+    if (order != "random" && order != "sequential") throw std::invalid_argument("sample.uniform: --order is random or sequential");
+    if (first >= keys || bins < 2 || bins > keys - first) throw std::invalid_argument("sample.uniform needs fewer --bins than keys left after --erase");
+    auto s = open_store(c);
+
+    std::vector<std::uint64_t> ids(keys);
+    for (std::uint64_t i = 0; i < keys; ++i) ids[i] = i;
+    rng r(seed);
+    if (order == "random")
+        for (std::uint64_t i = keys - 1; i > 0; --i) std::swap(ids[i], ids[r.uniform(i + 1)]);
+    for (std::uint64_t i : ids) s->put(make_key(i), make_value(r, value_size));
+    for (std::uint64_t i = 0; i < first; ++i) s->erase(make_key(i));
+    std::uint64_t left = keys - first;
+    c.out.add("sample.keys", static_cast<double>(left));
+
+    std::vector<std::uint64_t> counts(bins);
+    histogram lat;
+    std::uint64_t drawn = 0, outside = 0;
+    c.out.begin_phase();
+    std::uint64_t begin = c.fs.now_ns();
+    for (std::uint64_t call = 0; drawn < samples; ++call) {
+        std::size_t want = static_cast<std::size_t>(std::min<std::uint64_t>(batch, samples - drawn));
+        std::uint64_t t0 = c.fs.now_ns();
+        std::vector<std::string> got = s->sample(want, seed + 1 + call);
+        lat.record(c.fs.now_ns() - t0);
+        if (got.size() != want) throw std::logic_error("sample.uniform: store returned too few keys");
+        for (const std::string& k : got) {
+            std::uint64_t i = std::stoull(k);
+            if (i < first || i >= keys) ++outside;
+            else ++counts[(i - first) * bins / left];
+        }
+        drawn += want;
+    }
+    std::uint64_t elapsed = c.fs.now_ns() - begin;
+    c.out.add_ops("sample.call", lat, elapsed);
+    c.out.add("sample.rate", static_cast<double>(drawn) * 1e9 / static_cast<double>(elapsed), "keys/s");
+    if (outside) throw std::logic_error("sample.uniform: drew a key that is not in the store");
+
+    // bins are equal to within one key, so each expects its share of it.
+    double chi2 = 0, worst = 0;
+    for (std::uint64_t b = 0; b < bins; ++b) {
+        std::uint64_t lo = (b * left + bins - 1) / bins, hi = ((b + 1) * left + bins - 1) / bins;
+        double expect = static_cast<double>(drawn) * static_cast<double>(hi - lo) / static_cast<double>(left);
+        double d = static_cast<double>(counts[b]) - expect;
+        chi2 += d * d / expect;
+        worst = std::max(worst, std::abs(d) / expect);
+    }
+    double p = chi2_p_value(chi2, static_cast<double>(bins - 1));
+    c.out.add("uniformity.chi2", chi2);
+    c.out.add("uniformity.dof", static_cast<double>(bins - 1));
+    c.out.add("uniformity.p_value", p);
+    c.out.add("uniformity.worst_bin", 100.0 * worst, "%");
+    describe_store(c, *s);
+    if (p < 0.001) {
+        char why[64];
+        std::snprintf(why, sizeof why, "sample.uniform: samples are not uniform (p = %.2g)", p);
+        throw std::logic_error(why);
+    }
+}
+
+register_workload w1("sample.uniform",
+                     "--samples keys drawn with store::sample in calls of --batch from --keys keys put in --order with the first "
+                     "--erase fraction erased; samples/s and a chi-square test over --bins key ranges",
+                     uniform);
+
+} // namespace
+} // namespace dsa::bench
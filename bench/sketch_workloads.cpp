@@ -0,0 +1,98 @@
+// accuracy and cost of the sketches in sketch.hpp against exact answers.
+
+#include "bench.hpp"
+#include "keygen.hpp"
+
+#include <dsa/sketch.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace dsa::bench {
+namespace {
+
+double error_pct(double estimate, double truth) { return truth ? 100.0 * std::abs(estimate - truth) / truth : 0.0; }
+
+// --shards sketches each see a zipf(--theta) stream of --ops keys drawn from
+// --keys; the error of each shard and of their merge is checked against the
+// exact distinct count. --precision picks the register count.
+void hll(context& c) {
+    std::uint64_t keys = c.opts.u64("keys", 1'000'000);
+    std::uint64_t ops = c.opts.u64("ops", 2'000'000);
+    std::uint64_t shards = std::max<std::uint64_t>(1, c.opts.u64("shards", 4));
+    auto precision = static_cast<unsigned>(c.opts.u64("precision", 12));
+    zipf dist(keys, c.opts.f64("theta", 0.99));
+    rng r(c.opts.u64("seed", 1));
+
+    std::vector<hyperloglog> parts(shards, hyperloglog(precision));
+    std::vector<std::vector<bool>> seen(shards, std::vector<bool>(keys));
+    std::vector<bool> all(keys);
+    std::uint64_t add_ns = 0;
+    for (std::uint64_t i = 0; i < ops; ++i) {
+        std::uint64_t k = dist.next(r), s = i % shards;
+        std::string key = make_key(k);
+        std::uint64_t t = c.fs.now_ns();
+        parts[s].add(key);
+        add_ns += c.fs.now_ns() - t;
+        seen[s][k] = true;
+        all[k] = true;
+    }
+
+    double worst = 0;
+    for (std::uint64_t s = 0; s < shards; ++s)
+        worst = std::max(worst, error_pct(parts[s].estimate(), static_cast<double>(std::count(seen[s].begin(), seen[s].end(), true))));
+    std::uint64_t t = c.fs.now_ns();
+    hyperloglog merged(precision);
+    for (const hyperloglog& h : parts) merged.merge(h);
+    std::uint64_t merge_ns = c.fs.now_ns() - t;
+    t = c.fs.now_ns();
+    double estimate = merged.estimate();
+    std::uint64_t estimate_ns = c.fs.now_ns() - t;
+    auto distinct = static_cast<double>(std::count(all.begin(), all.end(), true));
+
+    c.out.add("distinct", distinct);
+    c.out.add("estimate", estimate);
+    c.out.add("merged.error", error_pct(estimate, distinct), "%");
+    c.out.add("shard.max_error", worst, "%");
+    c.out.add("expected.error", 104.0 / std::sqrt(std::ldexp(1.0, static_cast<int>(precision))), "%");
+    c.out.add("add.mean", static_cast<double>(add_ns) / static_cast<double>(ops), "ns");
+    c.out.add("merge.time", static_cast<double>(merge_ns) / 1e3, "us");
+    c.out.add("estimate.time", static_cast<double>(estimate_ns) / 1e3, "us");
+    c.out.add("memory", static_cast<double>(merged.memory_bytes()), "B");
+}
+
+// value size percentiles from a histogram against exact ones, for sizes
+// log-uniform in [--min_size, --max_size].
+void sizes(context& c) {
+    std::uint64_t ops = c.opts.u64("ops", 1'000'000);
+    double lo = std::log(static_cast<double>(std::max<std::uint64_t>(1, c.opts.u64("min_size", 16))));
+    double hi = std::log(static_cast<double>(std::max<std::uint64_t>(1, c.opts.u64("max_size", 64 << 10))));
+    rng r(c.opts.u64("seed", 1));
+
+    histogram h;
+    std::vector<std::uint64_t> exact;
+    exact.reserve(ops);
+    std::uint64_t t = c.fs.now_ns();
+    for (std::uint64_t i = 0; i < ops; ++i) {
+        auto v = static_cast<std::uint64_t>(std::exp(lo + (hi - lo) * r.unit()));
+        h.record(v);
+        exact.push_back(v);
+    }
+    c.out.add("record.mean", static_cast<double>(c.fs.now_ns() - t) / static_cast<double>(ops), "ns");
+    std::sort(exact.begin(), exact.end());
+    for (double p : {50.0, 90.0, 99.0, 99.9}) {
+        auto truth = static_cast<double>(exact[std::min<std::size_t>(exact.size() - 1, static_cast<std::size_t>(p / 100 * exact.size()))]);
+        char name[32];
+        std::snprintf(name, sizeof name, "p%g.error", p);
+        c.out.add(name, error_pct(static_cast<double>(h.percentile(p)), truth), "%");
+    }
+}
+
+register_workload w1("sketch.hll", "--shards hyperloglogs over a zipf(--theta) stream of --ops keys from --keys: error and cost; --precision",
+                     hll);
+register_workload w2("sketch.sizes", "histogram percentiles of --ops log-uniform sizes in [--min_size, --max_size] against exact ones",
+                     sizes);
+
+} // namespace
+} // namespace dsa::bench
@@ -0,0 +1,110 @@
+// sorted set workloads: leaderboard updates, rank queries and a delay-queue
+// style scheduler.
+
+#include "bench.hpp"
+#include "keygen.hpp"
+
+#include <dsa/sorted_set.hpp>
+
+namespace dsa::bench {
+namespace {
+
+std::unique_ptr<sorted_set> open_zset(context& c) {
+    sorted_set_options o;
+    o.sync_writes = c.opts.u64("zset.sync_writes", o.sync_writes) != 0;
+    o.compact_ratio = c.opts.f64("zset.compact_ratio", o.compact_ratio);
+    return std::make_unique<sorted_set>(c.fs, join_path(c.dir, "zset"), o);
+}
+
+// gives each of --members a random score, timed as inserts.
+void load(context& c, sorted_set& z, std::uint64_t members, rng& r) {
+    histogram lat;
+    std::uint64_t begin = c.fs.now_ns();
+    for (std::uint64_t i = 0; i < members; ++i) {
+        std::string m = make_key(i);
+        double score = static_cast<double>(r.uniform(1'000'000));
+        std::uint64_t t = c.fs.now_ns();
+        z.add(m, score);
+        lat.record(c.fs.now_ns() - t);
+    }
+    c.out.add_ops("add", lat, c.fs.now_ns() - begin);
+}
+
+// score increments on zipf(--theta) members, the shape of a leaderboard.
+void update(context& c) {
+    std::uint64_t members = c.opts.u64("members", 1'000'000);
+    std::uint64_t ops = c.opts.u64("ops", 1'000'000);
+    zipf dist(members, c.opts.f64("theta", 0.99));
+    rng r(c.opts.u64("seed", 1));
+    auto z = open_zset(c);
+    load(c, *z, members, r);
+
+    histogram lat;
+    std::uint64_t begin = c.fs.now_ns();
+    for (std::uint64_t i = 0; i < ops; ++i) {
+        std::string m = make_key(dist.next(r));
+        double delta = static_cast<double>(r.uniform(100));
+        std::uint64_t t = c.fs.now_ns();
+        z->increment(m, delta);
+        lat.record(c.fs.now_ns() - t);
+    }
+    c.out.add_ops("increment", lat, c.fs.now_ns() - begin);
+}
+
+// rank of random members, top --top by rank, and count of a score window.
+void rank(context& c) {
+    std::uint64_t members = c.opts.u64("members", 1'000'000);
+    std::uint64_t ops = c.opts.u64("ops", 1'000'000);
+    std::uint64_t top = c.opts.u64("top", 10);
+    rng r(c.opts.u64("seed", 1));
+    auto z = open_zset(c);
+    load(c, *z, members, r);
+
+    histogram rank_lat, top_lat, count_lat;
+    for (std::uint64_t i = 0; i < ops; ++i) {
+        std::string m = make_key(r.uniform(members));
+        std::uint64_t t = c.fs.now_ns();
+        if (!z->rank(m)) throw std::logic_error("zset.rank: missing member " + m);
+        rank_lat.record(c.fs.now_ns() - t);
+        if (i % 16) continue;
+        t = c.fs.now_ns();
+        z->range_by_rank(members - top, members);
+        top_lat.record(c.fs.now_ns() - t);
+        double lo = static_cast<double>(r.uniform(1'000'000));
+        t = c.fs.now_ns();
+        z->count(lo, lo + 10'000);
+        count_lat.record(c.fs.now_ns() - t);
+    }
+    c.out.add_latency("rank", rank_lat);
+    c.out.add_latency("top", top_lat);
+    c.out.add_latency("count", count_lat);
+}
+
+// a timer queue: every op schedules a task --delay ticks ahead, with
+// jitter, and pops the earliest task.
+void schedule(context& c) {
+    std::uint64_t pending = c.opts.u64("members", 100'000);
+    std::uint64_t ops = c.opts.u64("ops", 1'000'000);
+    std::uint64_t delay = c.opts.u64("delay", 1'000'000);
+    rng r(c.opts.u64("seed", 1));
+    auto z = open_zset(c);
+    for (std::uint64_t i = 0; i < pending; ++i) z->add(make_key(i), static_cast<double>(r.uniform(delay)));
+
+    histogram lat;
+    std::uint64_t begin = c.fs.now_ns();
+    for (std::uint64_t i = 0; i < ops; ++i) {
+        std::uint64_t t = c.fs.now_ns();
+        auto due = z->pop_min();
+        z->add(make_key(pending + i), (due ? due->score : 0) + static_cast<double>(delay / 2 + r.uniform(delay)));
+        lat.record(c.fs.now_ns() - t);
+    }
+    c.out.add_ops("pop_push", lat, c.fs.now_ns() - begin);
+}
+
+register_workload w1("zset.update", "load --members, then --ops zipf(--theta) score increments; --zset.{sync_writes,compact_ratio}",
+                     update);
+register_workload w2("zset.rank", "load --members, then --ops rank queries plus top --top and score-window counts", rank);
+register_workload w3("zset.schedule", "--members pending timers, then --ops pop-min + reschedule pairs", schedule);
+
+} // namespace
+} // namespace dsa::bench
@@ -0,0 +1,212 @@
+// backends the kv workloads can run against.
+
+#include "bench.hpp"
+
+#include <dsa/bitcask.hpp>
+#include <dsa/bptree.hpp>
+#include <dsa/ehash.hpp>
+#include <dsa/hlog.hpp>
+#include <dsa/mem_store.hpp>
+#include <dsa/mount.hpp>
+#include <dsa/tiered.hpp>
+
+namespace dsa::bench {
+namespace {
+
+std::unique_ptr<store> open_bitcask(env& e, const std::string& dir, const options& o) {
+    bitcask_options b;
+    b.max_file_size = o.u64("bitcask.max_file_size", b.max_file_size);
+    b.sync_writes = o.u64("bitcask.sync_writes", b.sync_writes) != 0;
+    b.merge_dead_ratio = o.f64("bitcask.merge_dead_ratio", b.merge_dead_ratio);
+    b.merge_min_dead_bytes = o.u64("bitcask.merge_min_dead_bytes", b.merge_min_dead_bytes);
+    b.background_merge = o.u64("bitcask.background_merge", b.background_merge) != 0;
+    return std::make_unique<bitcask_store>(e, dir, b);
+}
+
+void describe_bitcask(store& s, report& out) {
+    bitcask_stats st = static_cast<bitcask_store&>(s).stats();
+    out.add("bitcask.keys", static_cast<double>(st.keys));
+    out.add("bitcask.files", static_cast<double>(st.files));
+    out.add("bitcask.live_bytes", static_cast<double>(st.live_bytes), "B");
+    out.add("bitcask.dead_bytes", static_cast<double>(st.dead_bytes), "B");
+    out.add("bitcask.merges", static_cast<double>(st.merges));
+    out.add_lock("bitcask.write_lock", st.write_lock);
+    out.add_lock("bitcask.merge_lock", st.merge_lock);
+    data_sketch sk = static_cast<bitcask_store&>(s).sketch();
+    out.add("bitcask.sketch.keys", sk.keys.estimate());
+    out.add("bitcask.sketch.value_p50", static_cast<double>(sk.value_sizes.percentile(50)), "B");
+    out.add("bitcask.sketch.value_p99", static_cast<double>(sk.value_sizes.percentile(99)), "B");
+}
+
+register_store bitcask_kind("bitcask",
+                            "append-only log files plus in-memory keydir; --bitcask.{max_file_size,sync_writes,"
+                            "merge_dead_ratio,merge_min_dead_bytes,background_merge}",
+                            open_bitcask, describe_bitcask);
+
+std::unique_ptr<store> open_hlog(env& e, const std::string& dir, const options& o) {
+    hlog_options h;
+    h.page_size = o.u64("hlog.page_size", h.page_size);
+    h.memory_pages = o.u64("hlog.memory_pages", h.memory_pages);
+    h.mutable_fraction = o.f64("hlog.mutable_fraction", h.mutable_fraction);
+    h.index_buckets = o.u64("hlog.index_buckets", h.index_buckets);
+    return std::make_unique<hlog_store>(e, dir, h);
+}
+
+void describe_hlog(store& s, report& out) {
+    hlog_stats st = static_cast<hlog_store&>(s).stats();
+    out.add("hlog.in_place_updates", static_cast<double>(st.in_place_updates));
+    out.add("hlog.copy_updates", static_cast<double>(st.copy_updates));
+    out.add("hlog.disk_reads", static_cast<double>(st.disk_reads));
+    out.add("hlog.pages_flushed", static_cast<double>(st.pages_flushed));
+    out.add("hlog.on_disk", static_cast<double>(st.head), "B");
+    out.add("hlog.in_memory", static_cast<double>(st.tail - st.head), "B");
+    out.add_lock("hlog.bucket_locks", st.bucket_locks);
+    out.add_lock("hlog.alloc_lock", st.alloc_lock);
+}
+
+register_store hlog_kind("hlog",
+                         "hybrid log, in-place updates in the mutable tail; --hlog.{page_size,memory_pages,"
+                         "mutable_fraction,index_buckets}",
+                         open_hlog, describe_hlog);
+
+std::unique_ptr<store> open_bptree(env& e, const std::string& dir, const options& o) {
+    bptree_options b;
+    b.page_size = static_cast<std::uint32_t>(o.u64("bptree.page_size", b.page_size));
+    b.map_size = o.u64("bptree.map_size", b.map_size);
+    b.max_readers = static_cast<std::uint32_t>(o.u64("bptree.max_readers", b.max_readers));
+    b.sync_commits = o.u64("bptree.sync_commits", b.sync_commits) != 0;
+    return std::make_unique<bptree_store>(e, dir, b);
+}
+
+void describe_bptree(store& s, report& out) {
+    bptree_stats st = static_cast<bptree_store&>(s).stats();
+    out.add("bptree.entries", static_cast<double>(st.entries));
+    out.add("bptree.depth", static_cast<double>(st.depth));
+    out.add("bptree.pages", static_cast<double>(st.pages));
+    out.add("bptree.free_pages", static_cast<double>(st.free_pages));
+    out.add_lock("bptree.writer_lock", st.writer_lock);
+}
+
+register_store bptree_kind("bptree",
+                           "copy-on-write b+tree over a mapped file, lock-free readers; --bptree.{page_size,map_size,"
+                           "max_readers,sync_commits}",
+                           open_bptree, describe_bptree);
+
+std::unique_ptr<store> open_ehash(env& e, const std::string& dir, const options& o) {
+    ehash_options h;
+    h.bucket_size = static_cast<std::uint32_t>(o.u64("ehash.bucket_size", h.bucket_size));
+    h.max_global_depth = static_cast<std::uint32_t>(o.u64("ehash.max_global_depth", h.max_global_depth));
+    h.sync_writes = o.u64("ehash.sync_writes", h.sync_writes) != 0;
+    return std::make_unique<ehash_store>(e, dir, h);
+}
+
+void describe_ehash(store& s, report& out) {
+    ehash_stats st = static_cast<ehash_store&>(s).stats();
+    out.add("ehash.keys", static_cast<double>(st.keys));
+    out.add("ehash.buckets", static_cast<double>(st.buckets));
+    out.add("ehash.global_depth", static_cast<double>(st.global_depth));
+    out.add("ehash.splits", static_cast<double>(st.splits));
+    out.add("ehash.doublings", static_cast<double>(st.doublings));
+    out.add("ehash.bucket_reads", static_cast<double>(st.bucket_reads));
+    out.add("ehash.bucket_writes", static_cast<double>(st.bucket_writes));
+}
+
+register_store ehash_kind("ehash",
+                          "extendible hashing, page-sized buckets on disk, one read per lookup; --ehash.{bucket_size,"
+                          "max_global_depth,sync_writes}",
+                          open_ehash, describe_ehash);
+
+std::unique_ptr<store> open_mem(env&, const std::string&, const options& o) {
+    mem_store_options m;
+    m.stripes = static_cast<std::uint32_t>(o.u64("mem.stripes", m.stripes));
+    m.cold_after = static_cast<std::uint32_t>(o.u64("mem.cold_after", m.cold_after));
+    m.cold_page_size = static_cast<std::uint32_t>(o.u64("mem.cold_page_size", m.cold_page_size));
+    m.sweep_interval_ms = o.u64("mem.sweep_interval_ms", m.sweep_interval_ms);
+    return std::make_unique<mem_store>(m);
+}
+
+void describe_mem(store& s, report& out) {
+    mem_store_stats st = static_cast<mem_store&>(s).stats();
+    out.add("mem.keys", static_cast<double>(st.keys));
+    out.add("mem.bytes", static_cast<double>(st.bytes), "B");
+    out.add("mem.cold_keys", static_cast<double>(st.cold_keys));
+    out.add("mem.cold_value_bytes", static_cast<double>(st.cold_value_bytes), "B");
+    out.add("mem.cold_page_bytes", static_cast<double>(st.cold_page_bytes), "B");
+    out.add("mem.promotions", static_cast<double>(st.promotions));
+}
+
+register_store mem_kind("mem",
+                        "volatile striped hash maps, nothing on disk, idle values compressed in pages; --mem.{stripes,"
+                        "cold_after,cold_page_size,sweep_interval_ms}",
+                        open_mem, describe_mem);
+
+std::unique_ptr<store> open_tiered(env& e, const std::string& dir, const options& o) {
+    tiered_options t;
+    t.hot_fraction = o.f64("tiered.hot_fraction", t.hot_fraction);
+    t.max_range_keys = o.u64("tiered.max_range_keys", t.max_range_keys);
+    t.cold_after = static_cast<std::uint32_t>(o.u64("tiered.cold_after", t.cold_after));
+    t.thaw_hits = o.u64("tiered.thaw_hits", t.thaw_hits);
+    t.rebalance_interval_ms = o.u64("tiered.rebalance_interval_ms", t.rebalance_interval_ms);
+    t.block_cache = static_cast<std::uint32_t>(o.u64("tiered.block_cache", t.block_cache));
+    t.tree.map_size = o.u64("bptree.map_size", t.tree.map_size);
+    t.tree.sync_commits = o.u64("bptree.sync_commits", t.tree.sync_commits) != 0;
+    return std::make_unique<tiered_store>(e, dir, t);
+}
+
+void describe_tiered(store& s, report& out) {
+    tiered_stats st = static_cast<tiered_store&>(s).stats();
+    out.add("tiered.hot_ranges", static_cast<double>(st.hot_ranges));
+    out.add("tiered.warm_ranges", static_cast<double>(st.warm_ranges));
+    out.add("tiered.cold_ranges", static_cast<double>(st.cold_ranges));
+    out.add("tiered.hot_bytes", static_cast<double>(st.hot_bytes), "B");
+    out.add("tiered.warm_bytes", static_cast<double>(st.warm_bytes), "B");
+    out.add("tiered.warm_file_bytes", static_cast<double>(st.warm_file_bytes), "B");
+    out.add("tiered.cold_bytes", static_cast<double>(st.cold_bytes), "B");
+    out.add("tiered.cold_file_bytes", static_cast<double>(st.cold_file_bytes), "B");
+    out.add("tiered.rebalances", static_cast<double>(st.rebalances));
+    out.add("tiered.splits", static_cast<double>(st.splits));
+    out.add("tiered.freezes", static_cast<double>(st.freezes));
+    out.add("tiered.thaws", static_cast<double>(st.thaws));
+    out.add("tiered.errors", static_cast<double>(st.errors));
+    out.add_lock("tiered.cache_lock", st.cache_lock);
+}
+
+register_store tiered_kind("tiered",
+                           "key ranges placed in memory, a b+tree or compressed blocks by access heat; --tiered.{hot_fraction,"
+                           "max_range_keys,cold_after,thaw_hits,rebalance_interval_ms,block_cache}, --bptree.{map_size,sync_commits}",
+                           open_tiered, describe_tiered);
+
+// --mount.routes is a comma list of prefix=kind; each backend gets its own
+// subdirectory named after its position in the list.
+std::unique_ptr<store> open_mount(env& e, const std::string& dir, const options& o) {
+    std::string routes = o.str("mount.routes", "session/=mem,event/=bitcask,=bptree");
+    std::vector<mount> mounts;
+    for (std::size_t at = 0; at <= routes.size();) {
+        std::size_t end = std::min(routes.find(',', at), routes.size());
+        std::string route = routes.substr(at, end - at);
+        std::size_t eq = route.rfind('=');
+        if (eq == std::string::npos) throw std::invalid_argument("--mount.routes: expected prefix=kind, got '" + route + "'");
+        std::string sub = join_path(dir, std::to_string(mounts.size()));
+        mounts.push_back({route.substr(0, eq), find_store_kind(route.substr(eq + 1)).open(e, sub, o)});
+        at = end + 1;
+    }
+    mount_table_options m;
+    m.durable_batches = o.u64("mount.durable_batches", m.durable_batches) != 0;
+    return std::make_unique<mount_table>(e, dir, std::move(mounts), m);
+}
+
+void describe_mount(store& s, report& out) {
+    mount_table_stats st = static_cast<mount_table&>(s).stats();
+    out.add("mount.mounts", static_cast<double>(static_cast<mount_table&>(s).mounts()));
+    out.add("mount.batches", static_cast<double>(st.batches));
+    out.add("mount.batch_ops", static_cast<double>(st.batch_ops));
+    out.add("mount.replayed", static_cast<double>(st.replayed));
+}
+
+register_store mount_kind("mount",
+                          "key prefixes routed to other backends by longest match; --mount.{routes,durable_batches}, "
+                          "routes as prefix=kind,... (default session/=mem,event/=bitcask,=bptree)",
+                          open_mount, describe_mount);
+
+} // namespace
+} // namespace dsa::bench
@@ -0,0 +1,116 @@
+// workloads for tiered_store: where data settles under skew, what it costs
+// to keep it there and how fast each tier answers.
+
+#include "bench.hpp"
+#include "keygen.hpp"
+
+#include <dsa/tiered.hpp>
+
+#include <algorithm>
+
+namespace dsa::bench {
+namespace {
+
+tiered_store& as_tiered(store& s, const char* workload) {
+    auto* t = dynamic_cast<tiered_store*>(&s);
+    if (!t) throw std::invalid_argument(std::string(workload) + " needs --store=tiered");
+    return *t;
+}
+
+// loads --keys keys, then reads with a skew in key order: the first
+// --hot_keys of the key space gets --hot_share of the reads, the next
+// --warm_keys the rest, and the remainder is never read. rebalance runs
+// every --rebalance_every reads. values come from a pool of --value_pool
+// distinct ones, so cold blocks compress as real data with repeats would.
+// reports the bytes each tier ends up holding, the monthly cost of that at
+// --price.ram_gb and --price.disk_gb per GB against keeping everything in
+// memory, and get latency by the tier that answered.
+void skew(context& c) {
+    std::uint64_t keys = c.opts.u64("keys", 200'000);
+    std::uint64_t ops = c.opts.u64("ops", 1'000'000);
+    std::size_t key_size = c.opts.u64("key_size", 16);
+    std::size_t value_size = c.opts.u64("value_size", 100);
+    std::uint64_t pool = std::max<std::uint64_t>(1, c.opts.u64("value_pool", 256));
+    double hot_keys = c.opts.f64("hot_keys", 0.05), warm_keys = c.opts.f64("warm_keys", 0.25);
+    double hot_share = c.opts.f64("hot_share", 0.95);
+    std::uint64_t every = std::max<std::uint64_t>(1, c.opts.u64("rebalance_every", 50'000));
+    double ram_gb = c.opts.f64("price.ram_gb", 3.0), disk_gb = c.opts.f64("price.disk_gb", 0.08);
+    auto s = open_store(c);
+    tiered_store& t = as_tiered(*s, "tier.skew");
+
+    rng r(c.opts.u64("seed", 1));
+    std::vector<std::string> values;
+    for (std::uint64_t i = 0; i < pool; ++i) values.push_back(make_value(r, value_size));
+    std::uint64_t begin = c.fs.now_ns();
+    for (std::uint64_t i = 0; i < keys; ++i) t.put(make_key(i, key_size), values[r.uniform(pool)]);
+    c.out.add("load.throughput", static_cast<double>(keys) * 1e9 / static_cast<double>(c.fs.now_ns() - begin), "ops/s");
+
+    auto hot_end = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(hot_keys * static_cast<double>(keys)));
+    auto warm_end = std::min(keys, hot_end + std::max<std::uint64_t>(1, static_cast<std::uint64_t>(warm_keys * static_cast<double>(keys))));
+    histogram lat[3];
+    histogram rebalance;
+    std::string value;
+    begin = c.fs.now_ns();
+    for (std::uint64_t i = 0; i < ops; ++i) {
+        std::uint64_t k = r.unit() < hot_share ? r.uniform(hot_end) : hot_end + r.uniform(warm_end - hot_end);
+        std::string key = make_key(k, key_size);
+        tier from;
+        std::uint64_t t0 = c.fs.now_ns();
+        if (!t.get(key, value, from)) throw std::logic_error("tier.skew: missing key " + key);
+        lat[static_cast<int>(from)].record(c.fs.now_ns() - t0);
+        if ((i + 1) % every == 0) {
+            t0 = c.fs.now_ns();
+            t.rebalance();
+            rebalance.record(c.fs.now_ns() - t0);
+        }
+    }
+    c.out.add("get.throughput", static_cast<double>(ops) * 1e9 / static_cast<double>(c.fs.now_ns() - begin), "ops/s");
+    const char* names[] = {"get.hot", "get.warm", "get.cold"};
+    for (int i = 0; i < 3; ++i) {
+        c.out.add(std::string(names[i]) + ".share", 100.0 * static_cast<double>(lat[i].count()) / static_cast<double>(ops), "%");
+        if (lat[i].count()) c.out.add_latency(names[i], lat[i]);
+    }
+    if (rebalance.count()) c.out.add_latency("rebalance", rebalance);
+
+    // a cold get is only ever measured if a read lands in a frozen range,
+    // which the skew above never does; time a few directly.
+    tiered_stats st = t.stats();
+    if (st.cold_ranges) {
+        histogram cold;
+        for (std::uint64_t i = 0; i < 1000; ++i) {
+            std::string key = make_key(warm_end + r.uniform(keys - warm_end), key_size);
+            tier from;
+            std::uint64_t t0 = c.fs.now_ns();
+            t.get(key, value, from);
+            if (from == tier::cold) cold.record(c.fs.now_ns() - t0);
+        }
+        if (cold.count()) c.out.add_latency("probe.cold", cold);
+        st = t.stats();
+    }
+
+    double gb = 1e9;
+    double logical = static_cast<double>(st.warm_bytes + st.cold_bytes);
+    double all_ram = logical + static_cast<double>(keys * mem_store::entry_overhead);
+    double disk = static_cast<double>(st.warm_file_bytes + st.cold_file_bytes);
+    double cost = static_cast<double>(st.hot_bytes) / gb * ram_gb + disk / gb * disk_gb;
+    double baseline = all_ram / gb * ram_gb;
+    c.out.add("bytes.logical", logical, "B");
+    c.out.add("bytes.memory", static_cast<double>(st.hot_bytes), "B");
+    c.out.add("bytes.disk", disk, "B");
+    c.out.add("memory.share", 100.0 * static_cast<double>(st.hot_bytes) / all_ram, "%");
+    c.out.add("memory.target", 100.0 * c.opts.f64("tiered.hot_fraction", tiered_options().hot_fraction), "%");
+    if (st.cold_bytes) c.out.add("cold.ratio", static_cast<double>(st.cold_bytes) / static_cast<double>(st.cold_file_bytes), "x");
+    c.out.add("cost_per_gb.tiered", cost / (logical / gb), "$/GB");
+    c.out.add("cost_per_gb.all_ram", baseline / (logical / gb), "$/GB");
+    c.out.add("cost.saving", 100.0 * (1 - cost / baseline), "%");
+    describe_store(c, *s);
+}
+
+register_workload w1("tier.skew",
+                     "--keys loaded, --ops gets with --hot_share on the first --hot_keys, the rest on the next --warm_keys; "
+                     "rebalance every --rebalance_every; bytes, cost (--price.{ram_gb,disk_gb}) and latency by tier; "
+                     "--store=tiered",
+                     skew);
+
+} // namespace
+} // namespace dsa::bench
@@ -0,0 +1,95 @@
+// the slow-operation log: what the tail is made of, and what tracing costs.
+
+#include "bench.hpp"
+#include "keygen.hpp"
+
+#include <dsa/slow_log.hpp>
+
+#include <algorithm>
+
+namespace dsa::bench {
+namespace {
+
+// loads --keys keys into --store, then runs --ops random operations
+// (--write_fraction of them puts) on --threads threads, once straight and
+// once through a traced_store logging operations over --trace.threshold_us
+// and one in --trace.sample_every of the rest. reports what tracing cost,
+// how the slow and the sampled operations split their time between
+// stages, and the slowest operation's breakdown.
+void slow_ops(context& c) {
+    std::uint64_t keys = c.opts.u64("keys", 100'000);
+    std::uint64_t ops = c.opts.u64("ops", 500'000);
+    double write_fraction = c.opts.f64("write_fraction", 0.1);
+    std::size_t key_size = c.opts.u64("key_size", 16);
+    std::size_t value_size = c.opts.u64("value_size", 100);
+    auto threads = static_cast<unsigned>(c.opts.u64("threads", 4));
+    slow_op_log_options lo;
+    lo.threshold_ns = c.opts.u64("trace.threshold_us", 100) * 1000;
+    lo.sample_every = static_cast<std::uint32_t>(c.opts.u64("trace.sample_every", lo.sample_every));
+    lo.capacity = static_cast<std::uint32_t>(c.opts.u64("trace.capacity", 4096));
+    slow_op_log log(lo);
+    traced_store traced(open_store(c), log);
+    store& plain = traced.inner();
+
+    rng r(c.opts.u64("seed", 1));
+    for (std::uint64_t i = 0; i < keys; ++i) plain.put(make_key(i, key_size), make_value(r, value_size));
+
+    auto run = [&](store& s) {
+        std::uint64_t t0 = c.fs.now_ns();
+        histogram lat = run_threads(threads, [&](unsigned t) {
+            rng tr(c.opts.u64("seed", 1) + t);
+            std::string value = make_value(tr, value_size), out;
+            histogram h;
+            for (std::uint64_t i = t; i < ops; i += threads) {
+                std::string key = make_key(tr.uniform(keys), key_size);
+                std::uint64_t o0 = c.fs.now_ns();
+                if (tr.unit() < write_fraction) s.put(key, value);
+                else s.get(key, out);
+                h.record(c.fs.now_ns() - o0);
+            }
+            return h;
+        });
+        return std::make_pair(lat, c.fs.now_ns() - t0);
+    };
+    auto [plain_lat, plain_ns] = run(plain);
+    auto [traced_lat, traced_ns] = run(traced);
+    c.out.add_ops("untraced", plain_lat, plain_ns);
+    c.out.add_ops("traced", traced_lat, traced_ns);
+    c.out.add("trace.overhead", 100.0 * (static_cast<double>(traced_ns) / static_cast<double>(plain_ns) - 1), "%");
+
+    slow_op_log_stats st = log.stats();
+    c.out.add("slow.ops", static_cast<double>(st.slow));
+    c.out.add("sampled.ops", static_cast<double>(st.sampled));
+    c.out.add("log.overwritten", static_cast<double>(st.overwritten));
+
+    // each stage's share of the time of the records still in the ring.
+    std::vector<slow_op> recs = log.read();
+    for (bool slow : {true, false}) {
+        std::array<std::uint64_t, stage_count> by_stage{};
+        std::uint64_t total = 0;
+        for (const slow_op& o : recs) {
+            if (o.slow != slow) continue;
+            for (unsigned i = 0; i < stage_count; ++i) by_stage[i] += o.stage_ns[i];
+            total += o.total_ns;
+        }
+        if (!total) continue;
+        for (unsigned i = 0; i < stage_count; ++i)
+            c.out.add(std::string(slow ? "slow" : "sampled") + ".share." + stage_name(static_cast<stage>(i)),
+                      100.0 * static_cast<double>(by_stage[i]) / static_cast<double>(total), "%");
+    }
+    auto worst = std::max_element(recs.begin(), recs.end(), [](const slow_op& a, const slow_op& b) { return a.total_ns < b.total_ns; });
+    if (worst != recs.end()) {
+        c.out.add(std::string("slowest.") + op_name(worst->op), static_cast<double>(worst->total_ns) / 1e3, "us");
+        for (unsigned i = 0; i < stage_count; ++i)
+            if (worst->stage_ns[i]) c.out.add(std::string("slowest.") + stage_name(static_cast<stage>(i)), static_cast<double>(worst->stage_ns[i]) / 1e3, "us");
+    }
+    describe_store(c, plain);
+}
+
+register_workload w1("trace.slow_ops",
+                     "--ops random gets and puts on --threads, straight and through the slow-op log "
+                     "(--trace.{threshold_us,sample_every,capacity}); tracing overhead and where slow and sampled ops spend their time",
+                     slow_ops);
+
+} // namespace
+} // namespace dsa::bench
@@ -0,0 +1,584 @@
+#pragma once
+
+// log-structured hash store in the style of bitcask. every write is appended
+// to the active data file and an in-memory keydir maps each key to the
+// record holding its latest value, so a point read is exactly one pread.
+// nothing is ordered. sealed files are periodically merged: live records are
+// copied into fresh files, each with a hint file that lets recovery rebuild
+// the keydir without reading values.
+//
+// record:  crc32c:4 seq:8 key_size:4 value_size:4 key value
+// hint:    (seq:8 key_size:4 value_size:4 offset:8 key)* crc32c:4
+// inputs:  (file_id:4)* crc32c:4
+//
+// the crc covers everything after itself. a tombstone has value_size
+// 0xffffffff and no value. records carry a sequence number so recovery can
+// pick the newest version of a key regardless of which file it sits in.
+//
+// every data file carries a data_sketch of the records in it, kept as they
+// are appended and rebuilt from hints or records on recovery, so distinct
+// key counts and value size percentiles for any set of files come from
+// merging sketches rather than reading the files.
+//
+// a merge drops tombstones, so its inputs must go all at once: a tombstone
+// left in one input would otherwise stop shadowing a put that an earlier
+// merge copied into a newer file. once the outputs are durable the merge
+// writes the ids of its inputs to an "inputs" file before deleting any of
+// them, and recovery finishes deleting whatever that file still lists.
+
+#include "coding.hpp"
+#include "crc32c.hpp"
+#include "deadline.hpp"
+#include "env.hpp"
+#include "lock.hpp"
+#include "reader.hpp"
+#include "sample.hpp"
+#include "sketch.hpp"
+#include "store.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace dsa {
+
+struct bitcask_options {
+    std::uint64_t max_file_size = 64u << 20;
+    // sync the active file after every write.
+    bool sync_writes = false;
+    // merge sealed files once this fraction of their bytes is dead ...
+    double merge_dead_ratio = 0.4;
+    // ... and at least this many bytes would be reclaimed.
+    std::uint64_t merge_min_dead_bytes = 16u << 20;
+    // check for merge work on a background thread whenever a file is sealed.
+    bool background_merge = true;
+};
+
+struct bitcask_stats {
+    std::uint64_t keys = 0;
+    std::uint64_t files = 0;
+    std::uint64_t live_bytes = 0;
+    std::uint64_t dead_bytes = 0;
+    std::uint64_t merges = 0;
+    std::uint64_t merge_errors = 0;
+    lock_stats write_lock; // serializes appends to the active file
+    lock_stats merge_lock;
+};
+
+class bitcask_store : public store {
+public:
+    bitcask_store(env& e, std::string dir, bitcask_options opts = {})
+        : env_(e), dir_(std::move(dir)), opts_(opts) {
+        env_.create_dir(dir_);
+        recover();
+        if (opts_.background_merge) merger_ = std::thread([this] { merge_loop(); });
+    }
+
+    ~bitcask_store() override {
+        if (merger_.joinable()) {
+            {
+                std::lock_guard<std::mutex> g(bg_mu_);
+                stop_ = true;
+            }
+            bg_cv_.notify_one();
+            merger_.join();
+        }
+        try {
+            sync();
+        } catch (const io_error&) {
+        }
+    }
+
+    bitcask_store(const bitcask_store&) = delete;
+    bitcask_store& operator=(const bitcask_store&) = delete;
+
+    void put(std::string_view key, std::string_view value) override {
+        if (value.size() >= tombstone) throw std::length_error("bitcask: value too large");
+        auto w = lock_within_deadline<std::unique_lock<adaptive_mutex>>(write_mu_);
+        append(key, value, false);
+    }
+
+    bool get(std::string_view key, std::string& value) override { return get_into(key, value); }
+    bool get(std::string_view key, std::pmr::string& value) override { return get_into(key, value); }
+
+    bool erase(std::string_view key) override {
+        auto w = lock_within_deadline<std::unique_lock<adaptive_mutex>>(write_mu_);
+        {
+            std::shared_lock<std::shared_mutex> g(mu_);
+            if (!keydir_.count(std::string(key))) return false;
+        }
+        append(key, {}, true);
+        return true;
+    }
+
+    void sync() override {
+        std::lock_guard<adaptive_mutex> w(write_mu_);
+        active_->sync();
+    }
+
+    // from the keydir's buckets: no data file is read.
+    std::vector<std::string> sample(std::size_t n, std::uint64_t seed) override {
+        std::vector<std::size_t> ends(1);
+        {
+            std::shared_lock<std::shared_mutex> g(mu_);
+            if (keydir_.empty()) return {};
+            ends[0] = keydir_.bucket_count();
+        }
+        return sample_buckets(n, seed, ends, [&](std::size_t, auto&& fn) {
+            std::shared_lock<std::shared_mutex> g(mu_);
+            fn(keydir_);
+        });
+    }
+
+    std::uint64_t key_count() override {
+        std::shared_lock<std::shared_mutex> g(mu_);
+        return keydir_.size();
+    }
+
+    // seals the active file and merges every sealed file now.
+    void merge() {
+        {
+            std::lock_guard<adaptive_mutex> w(write_mu_);
+            if (active_->size()) roll();
+        }
+        merge_sealed();
+    }
+
+    // the sketch of each data file, keyed by file id, active file included.
+    // tombstones are left out; overwritten and deleted records are not.
+    std::map<std::uint32_t, data_sketch> file_sketches() const {
+        std::shared_lock<std::shared_mutex> g(mu_);
+        std::map<std::uint32_t, data_sketch> out;
+        for (const auto& [id, df] : files_) out.emplace(id, df.sketch);
+        return out;
+    }
+
+    // every file's sketch merged: estimates distinct keys written and value
+    // sizes across the store without a scan.
+    data_sketch sketch() const {
+        std::shared_lock<std::shared_mutex> g(mu_);
+        data_sketch all;
+        for (const auto& [id, df] : files_) all.merge(df.sketch);
+        return all;
+    }
+
+    bitcask_stats stats() const {
+        std::shared_lock<std::shared_mutex> g(mu_);
+        bitcask_stats s;
+        s.keys = keydir_.size();
+        s.files = files_.size();
+        for (const auto& [id, df] : files_) {
+            s.live_bytes += df.live_bytes;
+            s.dead_bytes += df.f->size() - df.live_bytes;
+        }
+        s.merges = merges_;
+        s.merge_errors = merge_errors_;
+        s.write_lock = write_mu_.stats();
+        s.merge_lock = merge_mu_.stats();
+        return s;
+    }
+
+private:
+    // get for std::string and std::pmr::string values alike.
+    template <class String>
+    bool get_into(std::string_view key, String& value) {
+        // the lookup key goes through a reused buffer: a std::string per
+        // call would hit the heap for any key past the short-string size.
+        thread_local std::string k;
+        k.assign(key);
+        entry e;
+        std::shared_ptr<file> f;
+        {
+            std::shared_lock<std::shared_mutex> g(mu_);
+            auto it = keydir_.find(k);
+            if (it == keydir_.end()) return false;
+            e = it->second;
+            f = files_.at(e.file_id).f;
+        }
+        thread_local std::string buf;
+        buf.resize(record_size(key.size(), e.value_size));
+        read_exact(*f, e.offset, buf.data(), buf.size());
+        if (get_u32(buf.data()) != crc32c(std::string_view(buf).substr(4)))
+            throw io_error("bitcask: corrupt record in " + data_path(e.file_id));
+        value.assign(buf.data() + header_size + key.size(), e.value_size);
+        return true;
+    }
+
+    static constexpr std::size_t header_size = 20;
+    static constexpr std::uint32_t tombstone = 0xffffffffu;
+
+    struct entry {
+        std::uint32_t file_id;
+        std::uint32_t value_size;
+        std::uint64_t offset; // of the record, not the value
+        std::uint64_t seq;
+    };
+
+    struct data_file {
+        std::shared_ptr<file> f;
+        std::uint64_t live_bytes = 0;
+        data_sketch sketch;
+    };
+
+    static std::uint64_t record_size(std::size_t key_size, std::uint32_t value_size) {
+        return header_size + key_size + (value_size == tombstone ? 0 : value_size);
+    }
+
+    std::string data_path(std::uint32_t id) const { return file_path(id, "data"); }
+    std::string hint_path(std::uint32_t id) const { return file_path(id, "hint"); }
+
+    std::string file_path(std::uint32_t id, const char* ext) const {
+        char name[32];
+        std::snprintf(name, sizeof name, "%010u.%s", id, ext);
+        return join_path(dir_, name);
+    }
+
+    static void encode(std::string& out, std::uint64_t seq, std::string_view key, std::string_view value, bool tomb) {
+        out.assign(4, '\0');
+        put_u64(out, seq);
+        put_u32(out, static_cast<std::uint32_t>(key.size()));
+        put_u32(out, tomb ? tombstone : static_cast<std::uint32_t>(value.size()));
+        out.append(key);
+        out.append(value);
+        std::uint32_t crc = crc32c(std::string_view(out).substr(4));
+        for (int i = 0; i < 4; ++i) out[i] = static_cast<char>(crc >> (8 * i));
+    }
+
+    // caller holds write_mu_.
+    void append(std::string_view key, std::string_view value, bool tomb) {
+        encode(record_, next_seq_, key, value, tomb);
+        std::uint64_t offset = active_->append(record_);
+        if (opts_.sync_writes) active_->sync();
+        {
+            std::unique_lock<std::shared_mutex> g(mu_);
+            auto it = keydir_.find(std::string(key));
+            if (it != keydir_.end()) {
+                files_.at(it->second.file_id).live_bytes -= record_size(key.size(), it->second.value_size);
+                if (tomb) keydir_.erase(it);
+            }
+            if (!tomb) {
+                entry e{active_id_, static_cast<std::uint32_t>(value.size()), offset, next_seq_};
+                if (it != keydir_.end()) it->second = e;
+                else keydir_.emplace(key, e);
+                data_file& df = files_.at(active_id_);
+                df.live_bytes += record_.size();
+                df.sketch.add(key, value.size());
+            }
+        }
+        ++next_seq_;
+        if (active_->size() >= opts_.max_file_size) {
+            roll();
+            if (merger_.joinable()) {
+                {
+                    std::lock_guard<std::mutex> g(bg_mu_);
+                    merge_wanted_ = true;
+                }
+                bg_cv_.notify_one();
+            }
+        }
+    }
+
+    // seals the active file and starts a new one. caller holds write_mu_.
+    void roll() {
+        active_->sync();
+        std::uint32_t id = next_file_id_++;
+        std::shared_ptr<file> f = env_.open(data_path(id), open_mode::truncate);
+        std::unique_lock<std::shared_mutex> g(mu_);
+        files_[id].f = f;
+        active_ = std::move(f);
+        active_id_ = id;
+    }
+
+    void recover() {
+        finish_merge_deletes();
+        // a .merge file is an unfinished merge output and a hint without its
+        // data file was left by a merge that finished deleting its inputs.
+        std::vector<std::uint32_t> ids, hints;
+        for (const std::string& name : env_.list(dir_)) {
+            unsigned id;
+            char ext[8];
+            if (std::sscanf(name.c_str(), "%10u.%7s", &id, ext) != 2) continue;
+            std::string_view x(ext);
+            if (x == "data") ids.push_back(id);
+            else if (x == "hint") hints.push_back(id);
+            else if (x == "merge") env_.remove(file_path(id, "merge"));
+        }
+        for (std::uint32_t id : hints)
+            if (std::find(ids.begin(), ids.end(), id) == ids.end()) env_.remove(hint_path(id));
+        std::sort(ids.begin(), ids.end());
+
+        std::uint64_t max_seq = 0;
+        auto apply = [&](std::string_view key, const entry& e) {
+            max_seq = std::max(max_seq, e.seq);
+            if (e.value_size != tombstone) files_.at(e.file_id).sketch.add(key, e.value_size);
+            auto [it, inserted] = keydir_.try_emplace(std::string(key), e);
+            if (!inserted && e.seq > it->second.seq) it->second = e;
+        };
+        for (std::uint32_t id : ids) {
+            files_[id].f = env_.open(data_path(id), open_mode::read_write);
+            if (!load_hints(id, apply)) scan_data(id, apply);
+        }
+        for (auto it = keydir_.begin(); it != keydir_.end();) {
+            if (it->second.value_size == tombstone) {
+                it = keydir_.erase(it);
+                continue;
+            }
+            files_.at(it->second.file_id).live_bytes += record_size(it->first.size(), it->second.value_size);
+            ++it;
+        }
+        next_seq_ = max_seq + 1;
+        next_file_id_ = ids.empty() ? 1 : ids.back() + 1;
+        std::uint32_t id = next_file_id_++;
+        active_ = env_.open(data_path(id), open_mode::truncate);
+        files_[id].f = active_;
+        active_id_ = id;
+    }
+
+    // deletes the inputs of a merge that was interrupted while deleting them.
+    void finish_merge_deletes() {
+        std::string list = join_path(dir_, "inputs");
+        if (env_.exists(list + ".tmp")) env_.remove(list + ".tmp");
+        if (!env_.exists(list)) return;
+        auto f = env_.open(list, open_mode::read_only);
+        std::string buf(static_cast<std::size_t>(f->size()), '\0');
+        read_exact(*f, 0, buf.data(), buf.size());
+        f.reset();
+        if (buf.size() < 4 || buf.size() % 4 || get_u32(buf.data() + buf.size() - 4) != crc32c(std::string_view(buf).substr(0, buf.size() - 4)))
+            throw io_error("bitcask: corrupt merge inputs list");
+        for (std::size_t p = 0; p + 4 < buf.size(); p += 4) {
+            std::uint32_t id = get_u32(buf.data() + p);
+            if (env_.exists(data_path(id))) env_.remove(data_path(id));
+            if (env_.exists(hint_path(id))) env_.remove(hint_path(id));
+        }
+        env_.remove(list);
+    }
+
+    template <class Apply>
+    bool load_hints(std::uint32_t id, Apply& apply) {
+        if (!env_.exists(hint_path(id))) return false;
+        auto f = env_.open(hint_path(id), open_mode::read_only);
+        std::string all(f->size(), '\0');
+        if (all.size() < 4 || f->read(0, all.data(), all.size()) != all.size()) return false;
+        std::string_view body(all.data(), all.size() - 4);
+        if (get_u32(all.data() + body.size()) != crc32c(body)) return false;
+        std::vector<std::pair<std::string_view, entry>> hints;
+        for (std::size_t p = 0; p < body.size();) {
+            if (body.size() - p < 24) return false;
+            entry e{id, get_u32(body.data() + p + 12), get_u64(body.data() + p + 16), get_u64(body.data() + p)};
+            std::uint32_t key_size = get_u32(body.data() + p + 8);
+            if (body.size() - p - 24 < key_size) return false;
+            hints.emplace_back(body.substr(p + 24, key_size), e);
+            p += 24 + key_size;
+        }
+        for (auto& [key, e] : hints) apply(key, e);
+        return true;
+    }
+
+    // replays a data file, cutting it off at the first record that fails its
+    // crc. that is the torn tail a crash mid-append leaves behind.
+    template <class Apply>
+    void scan_data(std::uint32_t id, Apply& apply) {
+        file& f = *files_.at(id).f;
+        sequential_reader in(f);
+        std::uint64_t off = 0, end = f.size();
+        while (off < end) {
+            std::string_view h = in.read(off, header_size);
+            bool ok = h.size() == header_size;
+            std::uint64_t n = ok ? record_size(get_u32(h.data() + 12), get_u32(h.data() + 16)) : 0;
+            std::string_view rec = ok ? in.read(off, n) : std::string_view();
+            if (!ok || rec.size() != n || get_u32(rec.data()) != crc32c(rec.substr(4))) {
+                f.truncate(off);
+                break;
+            }
+            std::uint32_t key_size = get_u32(rec.data() + 12);
+            apply(rec.substr(header_size, key_size), entry{id, get_u32(rec.data() + 16), off, get_u64(rec.data() + 4)});
+            off += n;
+        }
+    }
+
+    bool needs_merge() const {
+        std::shared_lock<std::shared_mutex> g(mu_);
+        std::uint64_t total = 0, dead = 0;
+        for (const auto& [id, df] : files_) {
+            if (id == active_id_) continue;
+            total += df.f->size();
+            dead += df.f->size() - df.live_bytes;
+        }
+        return dead >= opts_.merge_min_dead_bytes && static_cast<double>(dead) >= opts_.merge_dead_ratio * static_cast<double>(total);
+    }
+
+    void merge_loop() {
+        std::unique_lock<std::mutex> l(bg_mu_);
+        while (true) {
+            bg_cv_.wait(l, [&] { return stop_ || merge_wanted_; });
+            if (stop_) return;
+            merge_wanted_ = false;
+            l.unlock();
+            try {
+                if (needs_merge()) merge_sealed();
+            } catch (const io_error&) {
+                std::unique_lock<std::shared_mutex> g(mu_);
+                ++merge_errors_;
+            }
+            l.lock();
+        }
+    }
+
+    // copies the live records of every sealed file into new files, repoints
+    // the keydir at the copies and deletes the originals. writers keep going
+    // meanwhile; a key they overwrite mid-merge keeps its newer location.
+    void merge_sealed() {
+        deadline_exempt whole;
+        std::lock_guard<adaptive_mutex> m(merge_mu_);
+        std::vector<std::pair<std::uint32_t, std::shared_ptr<file>>> inputs;
+        {
+            std::shared_lock<std::shared_mutex> g(mu_);
+            for (const auto& [id, df] : files_)
+                if (id != active_id_) inputs.emplace_back(id, df.f);
+        }
+        if (inputs.empty()) return;
+
+        struct output {
+            std::uint32_t id;
+            std::shared_ptr<file> f;
+            std::string hints;
+        };
+        std::vector<output> outputs;
+        auto new_output = [&] {
+            std::uint32_t id;
+            {
+                std::lock_guard<adaptive_mutex> w(write_mu_);
+                id = next_file_id_++;
+            }
+            std::shared_ptr<file> f = env_.open(file_path(id, "merge"), open_mode::truncate);
+            {
+                std::unique_lock<std::shared_mutex> g(mu_);
+                files_[id].f = f;
+            }
+            outputs.push_back({id, std::move(f), {}});
+        };
+
+        struct move {
+            std::string key;
+            std::uint32_t from_id;
+            std::uint64_t from_offset;
+            std::uint64_t to_offset;
+            std::uint64_t size;
+        };
+        std::vector<move> moves;
+        auto publish = [&] {
+            std::unique_lock<std::shared_mutex> g(mu_);
+            data_sketch& out = files_.at(outputs.back().id).sketch;
+            for (const move& m : moves) {
+                out.add(m.key, m.size - header_size - m.key.size());
+                auto it = keydir_.find(m.key);
+                if (it == keydir_.end() || it->second.file_id != m.from_id || it->second.offset != m.from_offset) continue;
+                files_.at(m.from_id).live_bytes -= m.size;
+                it->second.file_id = outputs.back().id;
+                it->second.offset = m.to_offset;
+                files_.at(outputs.back().id).live_bytes += m.size;
+            }
+            moves.clear();
+        };
+
+        new_output();
+        for (auto& [id, f] : inputs) {
+            sequential_reader in(*f);
+            for (std::uint64_t off = 0, end = f->size(); off < end;) {
+                std::string_view h = in.read(off, header_size);
+                std::uint32_t key_size = get_u32(h.data() + 12), value_size = get_u32(h.data() + 16);
+                std::uint64_t n = record_size(key_size, value_size);
+                std::string_view rec = in.read(off, n);
+                std::string_view key = rec.substr(header_size, key_size);
+                bool live = false;
+                if (value_size != tombstone) {
+                    std::shared_lock<std::shared_mutex> g(mu_);
+                    auto it = keydir_.find(std::string(key));
+                    live = it != keydir_.end() && it->second.file_id == id && it->second.offset == off;
+                }
+                if (live) {
+                    if (outputs.back().f->size() + n > opts_.max_file_size && outputs.back().f->size()) {
+                        publish();
+                        new_output();
+                    }
+                    output& o = outputs.back();
+                    std::uint64_t to = o.f->append(rec);
+                    put_u64(o.hints, get_u64(rec.data() + 4));
+                    put_u32(o.hints, key_size);
+                    put_u32(o.hints, value_size);
+                    put_u64(o.hints, to);
+                    o.hints.append(key);
+                    moves.push_back({std::string(key), id, off, to, n});
+                }
+                off += n;
+            }
+            publish();
+        }
+
+        // an output only becomes a data file once it is complete and durable;
+        // its handle stays valid across the rename.
+        for (output& o : outputs) {
+            o.f->sync();
+            env_.rename(file_path(o.id, "merge"), data_path(o.id));
+            put_u32(o.hints, crc32c(o.hints));
+            auto h = env_.open(hint_path(o.id), open_mode::truncate);
+            h->append(o.hints);
+            h->sync();
+        }
+        {
+            std::unique_lock<std::shared_mutex> g(mu_);
+            for (auto& [id, f] : inputs) files_.erase(id);
+            ++merges_;
+        }
+        std::string ids;
+        for (auto& [id, f] : inputs) put_u32(ids, id);
+        put_u32(ids, crc32c(ids));
+        std::string list = join_path(dir_, "inputs");
+        {
+            auto l = env_.open(list + ".tmp", open_mode::truncate);
+            l->append(ids);
+            l->sync();
+        }
+        env_.rename(list + ".tmp", list);
+        for (auto& [id, f] : inputs) {
+            env_.remove(data_path(id));
+            if (env_.exists(hint_path(id))) env_.remove(hint_path(id));
+        }
+        env_.remove(list);
+    }
+
+    env& env_;
+    std::string dir_;
+    bitcask_options opts_;
+
+    // guards keydir_, files_ and the active file's identity.
+    mutable std::shared_mutex mu_;
+    std::unordered_map<std::string, entry> keydir_;
+    std::map<std::uint32_t, data_file> files_;
+    std::uint64_t merges_ = 0;
+    std::uint64_t merge_errors_ = 0;
+
+    // serializes writers and guards everything below it. active_ and
+    // active_id_ change under both locks, so holding either one is enough
+    // to read them.
+    adaptive_mutex write_mu_;
+    std::shared_ptr<file> active_;
+    std::uint32_t active_id_ = 0;
+    std::uint32_t next_file_id_ = 1;
+    std::uint64_t next_seq_ = 1;
+    std::string record_;
+
+    adaptive_mutex merge_mu_;
+    std::mutex bg_mu_;
+    std::condition_variable bg_cv_;
+    bool stop_ = false;
+    bool merge_wanted_ = false;
+    std::thread merger_;
+};
+
+} // namespace dsa
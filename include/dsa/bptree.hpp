@@ -0,0 +1,1103 @@
+#pragma once
+
+// copy-on-write b+tree over a memory-mapped file, in the style of lmdb.
+//
+// a write transaction never modifies a committed page: every page on the
+// path to a change is copied to a free page first, so committing means
+// writing the new pages and then a meta page naming the new root. the file
+// starts with two meta pages used alternately; opening picks the valid one
+// with the higher transaction id, so recovery is instant and there is no log
+// to replay.
+//
+// there is one writer at a time. readers take no locks at all: a read
+// transaction pins its snapshot by publishing the transaction id it reads
+// in a reader slot, and reads pages straight out of the mapping, so values
+// are returned without copying. pages freed by transaction t are recycled
+// once no reader is on a snapshot older than t. the free list itself is
+// stored in pages chained from the meta page.
+//
+// page:       type:2 count:2 pad:4 link:8, then count u16 entry offsets;
+//             entries are packed from the end of the page
+// leaf entry: key_size:2 flags:1 pad:1 value_size:4 key (value | overflow:8)
+// branch:     child:8 key_size:2 key; key 0 is unused
+// overflow:   link is the run length; the value follows the header
+// freelist:   link is the next freelist page; entries are (txn:8 page:8)
+// meta:       magic:8 page_size:4 pad:4 txn:8 root:8 next_page:8
+//             freelist:8 entries:8 depth:8 crc32c:4
+//
+// integers are in host byte order.
+
+#include "crc32c.hpp"
+#include "deadline.hpp"
+#include "env.hpp"
+#include "lock.hpp"
+#include "sample.hpp"
+#include "store.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <memory_resource>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace dsa {
+
+struct bptree_options {
+    std::uint32_t page_size = 4096;      // power of two in [1024, 32768]
+    std::uint64_t map_size = 1ull << 30; // the file may not grow past this
+    std::uint32_t max_readers = 126;     // concurrent read transactions
+    // fsync before and after writing each meta page. without it a crash
+    // can lose or corrupt recent commits, as with lmdb's nosync.
+    bool sync_commits = true;
+};
+
+struct bptree_stats {
+    std::uint64_t txn = 0;
+    std::uint64_t entries = 0;
+    std::uint64_t depth = 0;
+    std::uint64_t pages = 0;      // file size in pages
+    std::uint64_t free_pages = 0; // free now or once older readers finish
+    lock_stats writer_lock;       // held for each write transaction
+};
+
+class bptree_store : public store {
+    // a snapshot slot's txn while publish rewrites it.
+    static constexpr std::uint64_t rewriting = ~std::uint64_t{0};
+
+    struct snapshot {
+        std::atomic<std::uint64_t> txn{0};
+        std::atomic<std::uint64_t> root{0};
+        std::atomic<std::uint64_t> entries{0};
+    };
+
+public:
+    class cursor;
+
+    // a consistent snapshot of the tree. views it hands out stay valid until
+    // it is destroyed, and it must not outlive its store.
+    class read_txn {
+    public:
+        read_txn(read_txn&& o) noexcept
+            : s_(o.s_), slot_(std::exchange(o.slot_, nullptr)), txn_(o.txn_), root_(o.root_), entries_(o.entries_) {}
+        read_txn& operator=(read_txn&&) = delete;
+        ~read_txn() {
+            if (slot_) slot_->store(0, std::memory_order_release);
+        }
+
+        std::uint64_t id() const { return txn_; }
+        std::uint64_t entries() const { return entries_; }
+
+        bool get(std::string_view key, std::string_view& value) const {
+            if (!root_) return false;
+            const char* p = s_->leaf_for(root_, key);
+            unsigned i = lower_bound(p, key);
+            if (i == count(p) || leaf_key(entry(p, i)) != key) return false;
+            value = s_->leaf_value(entry(p, i));
+            return true;
+        }
+
+        // positioned at the first key >= key. a cursor's path and bound are
+        // allocated from mr.
+        cursor seek(std::string_view key, std::pmr::memory_resource* mr = std::pmr::get_default_resource()) const {
+            cursor c(s_, root_, mr);
+            c.seek(key);
+            return c;
+        }
+        cursor first(std::pmr::memory_resource* mr = std::pmr::get_default_resource()) const { return seek({}, mr); }
+
+        // a cursor over [lo, hi) only. an empty hi means no upper bound.
+        cursor range(std::string_view lo, std::string_view hi, std::pmr::memory_resource* mr = std::pmr::get_default_resource()) const {
+            cursor c(s_, root_, mr);
+            c.end_ = hi;
+            c.seek(lo);
+            return c;
+        }
+
+        // boundaries splitting [lo, hi) into at most n ranges of roughly
+        // equal key count: lo first, hi last, strictly increasing between.
+        // they come from the shape of the tree, as for approximate_count, so
+        // this reads n paths rather than the range. an empty hi means no
+        // upper bound.
+        std::vector<std::string> split(std::string_view lo, std::string_view hi, unsigned n) const {
+            std::vector<std::string> cuts{std::string(lo)};
+            if (root_ && n > 1 && (hi.empty() || lo < hi)) {
+                double a = s_->locate(root_, lo).fraction;
+                double b = hi.empty() ? 1.0 : s_->locate(root_, hi).fraction;
+                for (unsigned k = 1; k < n; ++k) {
+                    position p = s_->position_at(root_, a + (b - a) * k / n);
+                    std::string_view key = leaf_key(entry(p.leaf, p.index));
+                    if (key > cuts.back() && (hi.empty() || key < hi)) cuts.emplace_back(key);
+                }
+            }
+            cuts.emplace_back(hi);
+            return cuts;
+        }
+
+        // one cursor per range of split(lo, hi, n), in key order. they are
+        // independent of each other, so each may be driven by its own
+        // thread while this read_txn lives.
+        std::vector<cursor> partition(std::string_view lo, std::string_view hi, unsigned n) const {
+            std::vector<std::string> cuts = split(lo, hi, n);
+            std::vector<cursor> out;
+            out.reserve(cuts.size() - 1);
+            for (std::size_t i = 0; i + 1 < cuts.size(); ++i) out.push_back(range(cuts[i], cuts[i + 1]));
+            return out;
+        }
+
+        // estimated number of keys in [lo, hi). each bound is placed by its
+        // position within every page on its root-to-leaf path, weighting the
+        // children of a page by their own fanout, so this reads two paths and
+        // the pages beside them however wide the range is. exact when both
+        // bounds fall under the same lowest branch page. an empty hi means
+        // no upper bound.
+        std::uint64_t approximate_count(std::string_view lo, std::string_view hi) const {
+            if (!root_ || !(hi.empty() || lo < hi)) return 0;
+            position a = s_->locate(root_, lo), b = hi.empty() ? s_->locate_end(root_) : s_->locate(root_, hi);
+            if (a.leaf == b.leaf) return b.index - a.index;
+            if (a.parent == b.parent) {
+                std::uint64_t n = count(a.leaf) - a.index + b.index;
+                for (unsigned i = a.slot + 1; i < b.slot; ++i) n += count(s_->page(branch_child(entry(a.parent, i))));
+                return n;
+            }
+            double n = (b.fraction - a.fraction) * static_cast<double>(entries_);
+            return std::min(entries_, static_cast<std::uint64_t>(std::max(0.0, n) + 0.5));
+        }
+
+        // estimated key plus value bytes in [lo, hi): approximate_count times
+        // the mean entry size of `samples` leaves spread evenly over the range.
+        std::uint64_t approximate_size(std::string_view lo, std::string_view hi, unsigned samples = 8) const {
+            if (!root_ || !(hi.empty() || lo < hi)) return 0;
+            position a = s_->locate(root_, lo), b = hi.empty() ? s_->locate_end(root_) : s_->locate(root_, hi);
+            if (a.leaf == b.leaf) return leaf_bytes(a.leaf, a.index, b.index);
+            std::uint64_t bytes = 0, counted = 0;
+            samples = std::max(samples, 1u);
+            for (unsigned k = 0; k < samples; ++k) {
+                double f = a.fraction + (b.fraction - a.fraction) * (k + 0.5) / samples;
+                const char* p = s_->position_at(root_, f).leaf;
+                bytes += leaf_bytes(p, 0, count(p));
+                counted += count(p);
+            }
+            if (!counted) return 0;
+            return static_cast<std::uint64_t>(static_cast<double>(approximate_count(lo, hi)) * static_cast<double>(bytes) /
+                                              static_cast<double>(counted));
+        }
+
+        // n keys drawn uniformly from this snapshot, with replacement, by
+        // random descents from the root (see sample.hpp). the root is its
+        // level's only page, so its count is its bound. below it, a level's
+        // bound is a quarter above the fullest page the store has met there
+        // while sampling, which a few warm-up descents start off. a page
+        // fuller than its bound raises the bound for good, and the sample
+        // starts over, so every key of the result was drawn under the same
+        // bounds; keys under pages fuller than any met so far may still be
+        // under-drawn, which only the first samples of a store risk. a
+        // descent is accepted with probability about the product over the
+        // levels below the root of mean count / bound. when sample_max_tries
+        // descents in a row are rejected, as in a tree of mostly emptied
+        // pages, the rest of the sample is taken by rank instead: uniform
+        // ranks below entries(), sorted, picked up in one pass in key
+        // order.
+        std::vector<std::string> sample(std::size_t n, std::uint64_t seed) const {
+            std::vector<std::string> out;
+            if (!root_ || !entries_) return out;
+            sample_rng r(seed);
+            std::size_t levels = 1;
+            for (const char* p = s_->page(root_); type(p) == branch_page; p = s_->page(branch_child(entry(p, 0)))) ++levels;
+            if (levels > max_sample_levels) throw std::length_error("bptree: too deep to sample");
+            // fullest page by height above the leaves, as levels count from the root.
+            auto fullest = [&](std::size_t level) -> std::atomic<unsigned>& { return s_->sample_fullest_[levels - 1 - level]; };
+            if (!fullest(levels - 1).load(std::memory_order_relaxed)) {
+                for (int k = 0; k < 16; ++k) {
+                    const char* p = s_->page(root_);
+                    for (std::size_t level = 0; level < levels && count(p); ++level) {
+                        raise(fullest(level), count(p));
+                        if (type(p) == branch_page) p = s_->page(branch_child(entry(p, static_cast<unsigned>(r.uniform(count(p))))));
+                    }
+                }
+            }
+            std::vector<unsigned> bound(levels, count(s_->page(root_)));
+            auto set_bound = [&](std::size_t level) {
+                unsigned f = fullest(level).load(std::memory_order_relaxed);
+                bound[level] = f + f / 4 + 1;
+            };
+            for (std::size_t level = 1; level < levels; ++level) set_bound(level);
+            auto draw = [&]() -> const char* {
+                const char* p = s_->page(root_);
+                for (std::size_t level = 0; level < levels; ++level) {
+                    unsigned c = count(p);
+                    if (c > bound[level]) {
+                        raise(fullest(level), c);
+                        set_bound(level);
+                        out.clear();
+                        return nullptr;
+                    }
+                    auto slot = static_cast<unsigned>(r.uniform(bound[level]));
+                    if (slot >= c) return nullptr;
+                    if (type(p) != branch_page) return entry(p, slot);
+                    p = s_->page(branch_child(entry(p, slot)));
+                }
+                return nullptr;
+            };
+            out.reserve(n);
+            for (std::uint64_t tries = 0; out.size() < n && tries < sample_max_tries; ++tries) {
+                if (const char* e = draw()) {
+                    out.emplace_back(leaf_key(e));
+                    tries = 0;
+                }
+            }
+            if (out.size() == n) return out;
+            std::size_t have = out.size();
+            std::vector<std::pair<std::uint64_t, std::size_t>> ranks(n - have);
+            for (std::size_t k = 0; k < ranks.size(); ++k) ranks[k] = {r.uniform(entries_), k};
+            std::sort(ranks.begin(), ranks.end());
+            out.resize(n);
+            cursor c = first();
+            std::uint64_t at = 0;
+            for (const auto& [rank, k] : ranks) {
+                for (; at < rank && c.valid(); ++at) c.next();
+                if (!c.valid()) throw io_error("bptree: fewer keys than the snapshot counts");
+                out[have + k] = std::string(c.key());
+            }
+            return out;
+        }
+
+    private:
+        friend class bptree_store;
+
+        static void raise(std::atomic<unsigned>& a, unsigned v) {
+            unsigned cur = a.load(std::memory_order_relaxed);
+            while (cur < v && !a.compare_exchange_weak(cur, v, std::memory_order_relaxed)) {
+            }
+        }
+
+        static std::uint64_t leaf_bytes(const char* p, unsigned from, unsigned to) {
+            std::uint64_t b = 0;
+            for (unsigned i = from; i < to; ++i) b += ld16(entry(p, i)) + ld32(entry(p, i) + 4);
+            return b;
+        }
+
+        explicit read_txn(const bptree_store& s) : s_(&s), slot_(s.acquire_slot()) {
+            // publish the snapshot before trusting it: the writer recycles
+            // pages only below the oldest published id, so re-check that the
+            // id is still current once it is visible. the slot's root and
+            // entries are taken only if its txn reads t both before and
+            // after, so both belong to t and not to a commit rewriting it.
+            while (true) {
+                std::uint64_t t = s.current_.load(std::memory_order_seq_cst);
+                slot_->store(t + 1, std::memory_order_seq_cst);
+                if (s.current_.load(std::memory_order_seq_cst) != t) continue;
+                const snapshot& sn = s.snaps_[t & 1];
+                if (sn.txn.load(std::memory_order_acquire) != t) continue;
+                root_ = sn.root.load(std::memory_order_relaxed);
+                entries_ = sn.entries.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (sn.txn.load(std::memory_order_relaxed) != t) continue;
+                txn_ = t;
+                break;
+            }
+        }
+
+        const bptree_store* s_;
+        std::atomic<std::uint64_t>* slot_;
+        std::uint64_t txn_ = 0;
+        std::uint64_t root_ = 0;
+        std::uint64_t entries_ = 0;
+    };
+
+    // forward iteration in key order, optionally up to an exclusive end key.
+    // must not outlive its read_txn.
+    class cursor {
+    public:
+        bool valid() const { return !stack_.empty(); }
+        std::string_view key() const { return leaf_key(entry(stack_.back().first, stack_.back().second)); }
+        std::string_view value() const { return s_->leaf_value(entry(stack_.back().first, stack_.back().second)); }
+
+        void next() {
+            ++stack_.back().second;
+            settle();
+        }
+
+        void seek(std::string_view key) {
+            stack_.clear();
+            if (!root_) return;
+            const char* p = s_->page(root_);
+            while (type(p) == branch_page) {
+                unsigned i = child_index(p, key);
+                stack_.emplace_back(p, i);
+                p = s_->page(branch_child(entry(p, i)));
+            }
+            stack_.emplace_back(p, lower_bound(p, key));
+            settle();
+        }
+
+    private:
+        friend class bptree_store;
+        cursor(const bptree_store* s, std::uint64_t root, std::pmr::memory_resource* mr) : s_(s), root_(root), end_(mr), stack_(mr) {}
+
+        // moves off the end of a leaf onto the next one. a scan's deadline is
+        // checked once per leaf.
+        void settle() {
+            while (!stack_.empty() && stack_.back().second >= count(stack_.back().first)) {
+                check_deadline();
+                stack_.pop_back();
+                if (stack_.empty()) return;
+                if (++stack_.back().second >= count(stack_.back().first)) continue;
+                const char* p = s_->page(branch_child(entry(stack_.back().first, stack_.back().second)));
+                while (type(p) == branch_page) {
+                    stack_.emplace_back(p, 0);
+                    p = s_->page(branch_child(entry(p, 0)));
+                }
+                stack_.emplace_back(p, 0);
+            }
+            if (!end_.empty() && !stack_.empty() && key() >= end_) stack_.clear();
+        }
+
+        const bptree_store* s_;
+        std::uint64_t root_;
+        std::pmr::string end_; // empty for no bound
+        std::pmr::vector<std::pair<const char*, unsigned>> stack_;
+    };
+
+    // the single writer. holds the writer lock from construction until
+    // commit or abort; destroying it uncommitted aborts.
+    class write_txn {
+    public:
+        write_txn(write_txn&& o) noexcept = default;
+        write_txn& operator=(write_txn&&) = delete;
+        ~write_txn() {
+            if (lock_.owns_lock()) abort();
+        }
+
+        std::uint64_t id() const { return id_; }
+
+        void put(std::string_view key, std::string_view value) {
+            if (key.size() > s_->max_key()) throw std::length_error("bptree: key too large");
+            if (value.size() > 0xffffffffu) throw std::length_error("bptree: value too large");
+            if (!root_) {
+                root_ = alloc();
+                dirty_[root_].leaf = true;
+                depth_ = 1;
+            }
+            std::vector<std::pair<std::uint64_t, unsigned>> path;
+            node& n = dirty_.at(descend(key, path));
+            unsigned i = static_cast<unsigned>(std::lower_bound(n.keys.begin(), n.keys.end(), key) - n.keys.begin());
+            if (i < n.keys.size() && n.keys[i] == key) {
+                release_value(n, i);
+            } else {
+                n.keys.insert(n.keys.begin() + i, std::string(key));
+                n.vals.insert(n.vals.begin() + i, std::string());
+                n.ovf.insert(n.ovf.begin() + i, 0);
+                n.vsize.insert(n.vsize.begin() + i, 0);
+                ++entries_;
+            }
+            n.vsize[i] = static_cast<std::uint32_t>(value.size());
+            if (key.size() + value.size() > s_->inline_limit()) {
+                std::uint64_t run = (page_header + value.size() + s_->ps_ - 1) / s_->ps_;
+                n.ovf[i] = alloc_run(run);
+                n.vals[i].clear();
+                overflow_[n.ovf[i]] = std::string(value);
+            } else {
+                n.vals[i].assign(value);
+            }
+            split_up(path, pg_);
+        }
+
+        bool erase(std::string_view key) {
+            std::string_view ignored;
+            if (!find(key, ignored)) return false;
+            std::vector<std::pair<std::uint64_t, unsigned>> path;
+            std::uint64_t pg = descend(key, path);
+            node& n = dirty_.at(pg);
+            unsigned i = static_cast<unsigned>(std::lower_bound(n.keys.begin(), n.keys.end(), key) - n.keys.begin());
+            release_value(n, i);
+            n.keys.erase(n.keys.begin() + i);
+            n.vals.erase(n.vals.begin() + i);
+            n.ovf.erase(n.ovf.begin() + i);
+            n.vsize.erase(n.vsize.begin() + i);
+            --entries_;
+            // underfull pages are left alone; only empty ones are unlinked.
+            while (dirty_.at(pg).keys.empty() && !path.empty()) {
+                drop_dirty(pg);
+                auto [parent, idx] = path.back();
+                path.pop_back();
+                node& p = dirty_.at(parent);
+                p.keys.erase(p.keys.begin() + idx);
+                p.kids.erase(p.kids.begin() + idx);
+                if (idx == 0 && !p.keys.empty()) p.keys[0].clear();
+                pg = parent;
+            }
+            if (dirty_.at(root_).keys.empty()) {
+                drop_dirty(root_);
+                root_ = 0;
+                depth_ = 0;
+            }
+            while (root_ && dirty_.count(root_) && !dirty_.at(root_).leaf && dirty_.at(root_).kids.size() == 1) {
+                std::uint64_t child = dirty_.at(root_).kids[0];
+                drop_dirty(root_);
+                root_ = child;
+                --depth_;
+            }
+            return true;
+        }
+
+        // sees this transaction's own writes.
+        bool get(std::string_view key, std::string& value) {
+            std::string_view v;
+            if (!find(key, v)) return false;
+            value.assign(v);
+            return true;
+        }
+
+        void commit() {
+            std::vector<std::pair<std::uint64_t, std::uint64_t>> list; // (freeing txn, page)
+            std::vector<std::uint64_t> list_pages;
+            plan_freelist(list, list_pages);
+
+            std::string buf(s_->ps_, '\0');
+            for (auto& [pg, n] : dirty_) {
+                s_->encode(n, buf.data());
+                s_->f_->write(pg * s_->ps_, buf);
+            }
+            for (auto& [pg, v] : overflow_) {
+                std::string run(page_header, '\0');
+                st16(run.data(), overflow_page);
+                st64(run.data() + 8, (page_header + v.size() + s_->ps_ - 1) / s_->ps_);
+                run += v;
+                s_->f_->write(pg * s_->ps_, run);
+            }
+            std::size_t per_page = (s_->ps_ - page_header) / 16;
+            for (std::size_t p = 0; p < list_pages.size(); ++p) {
+                std::memset(buf.data(), 0, buf.size());
+                std::size_t begin = std::min(list.size(), p * per_page), end = std::min(list.size(), begin + per_page);
+                st16(buf.data(), freelist_page);
+                st16(buf.data() + 2, static_cast<std::uint16_t>(end - begin));
+                st64(buf.data() + 8, p + 1 < list_pages.size() ? list_pages[p + 1] : 0);
+                for (std::size_t e = begin; e < end; ++e) {
+                    st64(buf.data() + page_header + 16 * (e - begin), list[e].first);
+                    st64(buf.data() + page_header + 16 * (e - begin) + 8, list[e].second);
+                }
+                s_->f_->write(list_pages[p] * s_->ps_, buf);
+            }
+            if (s_->opts_.sync_commits) s_->f_->sync();
+
+            meta m{id_, root_, next_page_, list_pages.empty() ? 0 : list_pages[0], entries_, depth_};
+            s_->write_meta(m);
+            if (s_->opts_.sync_commits) s_->f_->sync();
+
+            // only now, with the commit durable, does the store's own state
+            // move on.
+            s_->reusable_ = std::move(reusable_);
+            for (std::uint64_t pg : freed_) s_->pending_.emplace_back(id_, pg);
+            s_->freelist_pages_ = std::move(list_pages);
+            s_->meta_ = m;
+            s_->publish(m);
+            lock_.unlock();
+        }
+
+        void abort() { lock_.unlock(); }
+
+    private:
+        friend class bptree_store;
+
+        // a page being rewritten by this transaction, decoded.
+        struct node {
+            bool leaf = true;
+            std::vector<std::string> keys;
+            // leaf only. a value lives in vals or, if ovf is non-zero, in an
+            // overflow run starting at that page.
+            std::vector<std::string> vals;
+            std::vector<std::uint64_t> ovf;
+            std::vector<std::uint32_t> vsize;
+            // branch only. kids[i] holds keys >= keys[i]; keys[0] is unused.
+            std::vector<std::uint64_t> kids;
+        };
+
+        explicit write_txn(bptree_store& s)
+            : s_(&s), lock_(lock_within_deadline<std::unique_lock<adaptive_mutex>>(s.writer_mu_)), id_(s.meta_.txn + 1), root_(s.meta_.root), next_page_(s.meta_.next_page),
+              entries_(s.meta_.entries), depth_(s.meta_.depth) {
+            std::uint64_t oldest = s.oldest_reader();
+            while (!s.pending_.empty() && s.pending_.front().first <= oldest) {
+                s.reusable_.push_back(s.pending_.front().second);
+                s.pending_.pop_front();
+            }
+            // allocation works on a copy, so aborting leaves the store as is.
+            reusable_ = s.reusable_;
+        }
+
+        std::uint64_t alloc() {
+            if (!reusable_.empty()) {
+                std::uint64_t pg = reusable_.back();
+                reusable_.pop_back();
+                return pg;
+            }
+            return grow(1);
+        }
+
+        // n contiguous pages, from the free list if it has such a run and
+        // from the end of the file otherwise.
+        std::uint64_t alloc_run(std::uint64_t n) {
+            if (n == 1) return alloc();
+            if (reusable_.size() >= n) {
+                std::sort(reusable_.begin(), reusable_.end());
+                for (std::size_t i = 0; i + n <= reusable_.size(); ++i) {
+                    if (reusable_[i + n - 1] - reusable_[i] != n - 1) continue;
+                    std::uint64_t pg = reusable_[i];
+                    reusable_.erase(reusable_.begin() + static_cast<std::ptrdiff_t>(i),
+                                    reusable_.begin() + static_cast<std::ptrdiff_t>(i + n));
+                    return pg;
+                }
+            }
+            return grow(n);
+        }
+
+        std::uint64_t grow(std::uint64_t n) {
+            if ((next_page_ + n) * s_->ps_ > s_->opts_.map_size) throw io_error("bptree: map full");
+            std::uint64_t pg = next_page_;
+            next_page_ += n;
+            return pg;
+        }
+
+        // frees a committed page: readers may still use it.
+        void free_committed(std::uint64_t pg) { freed_.push_back(pg); }
+
+        // frees a page this transaction allocated: nobody else has seen it.
+        void drop_dirty(std::uint64_t pg) {
+            dirty_.erase(pg);
+            reusable_.push_back(pg);
+        }
+
+        void release_value(node& n, unsigned i) {
+            if (!n.ovf[i]) return;
+            std::uint64_t run = (page_header + n.vsize[i] + s_->ps_ - 1) / s_->ps_;
+            bool mine = overflow_.erase(n.ovf[i]) != 0;
+            for (std::uint64_t k = 0; k < run; ++k) {
+                if (mine) reusable_.push_back(n.ovf[i] + k);
+                else free_committed(n.ovf[i] + k);
+            }
+            n.ovf[i] = 0;
+        }
+
+        // returns a dirty copy of pg, copying it on first touch.
+        std::uint64_t touch(std::uint64_t pg) {
+            if (dirty_.count(pg)) return pg;
+            node n = s_->decode(s_->page(pg));
+            std::uint64_t copy = alloc();
+            free_committed(pg);
+            dirty_.emplace(copy, std::move(n));
+            return copy;
+        }
+
+        // copies the path to key's leaf and returns the leaf. path gets the
+        // branch pages above it and the child index taken in each.
+        std::uint64_t descend(std::string_view key, std::vector<std::pair<std::uint64_t, unsigned>>& path) {
+            root_ = touch(root_);
+            std::uint64_t pg = root_;
+            while (!dirty_.at(pg).leaf) {
+                node& n = dirty_.at(pg);
+                unsigned i = static_cast<unsigned>(std::upper_bound(n.keys.begin() + 1, n.keys.end(), key) - n.keys.begin()) - 1;
+                std::uint64_t child = touch(n.kids[i]);
+                n.kids[i] = child;
+                path.emplace_back(pg, i);
+                pg = child;
+            }
+            pg_ = pg;
+            return pg;
+        }
+
+        void split_up(std::vector<std::pair<std::uint64_t, unsigned>>& path, std::uint64_t pg) {
+            while (s_->encoded_size(dirty_.at(pg)) > s_->ps_) {
+                node& n = dirty_.at(pg);
+                std::string sep;
+                node right = split(n, sep);
+                std::uint64_t rp = alloc();
+                dirty_.emplace(rp, std::move(right));
+                if (path.empty()) {
+                    node root;
+                    root.leaf = false;
+                    root.keys = {std::string(), std::move(sep)};
+                    root.kids = {pg, rp};
+                    root_ = alloc();
+                    dirty_.emplace(root_, std::move(root));
+                    ++depth_;
+                    return;
+                }
+                auto [parent, idx] = path.back();
+                path.pop_back();
+                node& p = dirty_.at(parent);
+                p.keys.insert(p.keys.begin() + idx + 1, std::move(sep));
+                p.kids.insert(p.kids.begin() + idx + 1, rp);
+                pg = parent;
+            }
+        }
+
+        // moves the upper half of n by bytes into the returned node and sets
+        // sep to the first key the new node covers.
+        node split(node& n, std::string& sep) {
+            std::size_t total = s_->encoded_size(n), acc = page_header;
+            std::size_t m = 1;
+            for (; m + 1 < n.keys.size(); ++m) {
+                acc += s_->entry_size(n, m - 1);
+                if (acc >= total / 2) break;
+            }
+            node r;
+            r.leaf = n.leaf;
+            auto cut = [m](auto& from, auto& to) {
+                to.assign(std::make_move_iterator(from.begin() + static_cast<std::ptrdiff_t>(m)), std::make_move_iterator(from.end()));
+                from.resize(m);
+            };
+            cut(n.keys, r.keys);
+            if (n.leaf) {
+                cut(n.vals, r.vals);
+                cut(n.ovf, r.ovf);
+                cut(n.vsize, r.vsize);
+                sep = r.keys[0];
+            } else {
+                cut(n.kids, r.kids);
+                sep = std::move(r.keys[0]);
+                r.keys[0].clear();
+            }
+            return r;
+        }
+
+        bool find(std::string_view key, std::string_view& value) {
+            std::uint64_t pg = root_;
+            while (pg) {
+                auto it = dirty_.find(pg);
+                if (it == dirty_.end()) {
+                    const char* p = s_->leaf_for(pg, key);
+                    unsigned i = lower_bound(p, key);
+                    if (i == count(p) || leaf_key(entry(p, i)) != key) return false;
+                    value = s_->leaf_value(entry(p, i));
+                    return true;
+                }
+                node& n = it->second;
+                if (!n.leaf) {
+                    unsigned i = static_cast<unsigned>(std::upper_bound(n.keys.begin() + 1, n.keys.end(), key) - n.keys.begin()) - 1;
+                    pg = n.kids[i];
+                    continue;
+                }
+                auto k = std::lower_bound(n.keys.begin(), n.keys.end(), key);
+                if (k == n.keys.end() || *k != key) return false;
+                std::size_t i = static_cast<std::size_t>(k - n.keys.begin());
+                if (!n.ovf[i]) value = n.vals[i];
+                else if (auto o = overflow_.find(n.ovf[i]); o != overflow_.end()) value = o->second;
+                else value = std::string_view(s_->page(n.ovf[i]) + page_header, n.vsize[i]);
+                return true;
+            }
+            return false;
+        }
+
+        // decides the free list this commit persists and the pages holding
+        // it. those pages come out of the free list first, which only
+        // shrinks it, so the page count computed up front always suffices.
+        void plan_freelist(std::vector<std::pair<std::uint64_t, std::uint64_t>>& list, std::vector<std::uint64_t>& pages) {
+            for (std::uint64_t pg : s_->freelist_pages_) free_committed(pg);
+            std::size_t per_page = (s_->ps_ - page_header) / 16;
+            std::size_t total = reusable_.size() + s_->pending_.size() + freed_.size();
+            std::size_t need = (total + per_page - 1) / per_page;
+            for (std::size_t k = 0; k < need; ++k) pages.push_back(alloc());
+            for (std::uint64_t pg : reusable_) list.emplace_back(0, pg);
+            for (auto& e : s_->pending_) list.push_back(e);
+            for (std::uint64_t pg : freed_) list.emplace_back(id_, pg);
+        }
+
+        bptree_store* s_;
+        std::unique_lock<adaptive_mutex> lock_;
+        std::uint64_t id_;
+        std::uint64_t root_;
+        std::uint64_t next_page_;
+        std::uint64_t entries_;
+        std::uint64_t depth_;
+        std::uint64_t pg_ = 0;
+        std::unordered_map<std::uint64_t, node> dirty_;
+        std::unordered_map<std::uint64_t, std::string> overflow_; // first page -> value
+        std::vector<std::uint64_t> reusable_;
+        std::vector<std::uint64_t> freed_;
+    };
+
+    bptree_store(env& e, const std::string& dir, bptree_options opts = {})
+        : opts_(opts), ps_(opts.page_size), slots_(new std::atomic<std::uint64_t>[opts.max_readers]) {
+        if (ps_ < 1024 || ps_ > 32768 || (ps_ & (ps_ - 1))) throw std::invalid_argument("bptree: page_size must be a power of two in [1024, 32768]");
+        if (!opts_.max_readers) throw std::invalid_argument("bptree: max_readers must be positive");
+        for (std::uint32_t i = 0; i < opts_.max_readers; ++i) slots_[i].store(0, std::memory_order_relaxed);
+        e.create_dir(dir);
+        f_ = e.open(join_path(dir, "data.bpt"), open_mode::create);
+        if (f_->size() == 0) {
+            meta_ = meta{0, 0, 2, 0, 0, 0};
+            write_meta(meta_, 0);
+            write_meta(meta_, 1);
+            f_->sync();
+        } else {
+            meta_ = read_metas();
+        }
+        if (f_->size() > opts_.map_size) throw io_error("bptree: file larger than map_size");
+        map_ = f_->map(opts_.map_size);
+        if (!map_) throw io_error("bptree: env cannot map files");
+        // with no readers left from before, everything free is reusable.
+        for (std::uint64_t pg = meta_.freelist; pg;) {
+            const char* p = page(pg);
+            freelist_pages_.push_back(pg);
+            for (unsigned i = 0; i < count(p); ++i) reusable_.push_back(ld64(p + page_header + 16 * i + 8));
+            pg = ld64(p + 8);
+        }
+        publish(meta_);
+    }
+
+    read_txn begin_read() const { return read_txn(*this); }
+    write_txn begin_write() { return write_txn(*this); }
+
+    void put(std::string_view key, std::string_view value) override {
+        write_txn t = begin_write();
+        t.put(key, value);
+        t.commit();
+    }
+
+    bool get(std::string_view key, std::string& value) override { return get_into(key, value); }
+    bool get(std::string_view key, std::pmr::string& value) override { return get_into(key, value); }
+
+    bool erase(std::string_view key) override {
+        write_txn t = begin_write();
+        if (!t.erase(key)) return false;
+        t.commit();
+        return true;
+    }
+
+    void sync() override {
+        std::lock_guard<adaptive_mutex> g(writer_mu_);
+        f_->sync();
+    }
+
+    std::vector<std::string> sample(std::size_t n, std::uint64_t seed) override { return begin_read().sample(n, seed); }
+    std::uint64_t key_count() override { return begin_read().entries(); }
+
+    bptree_stats stats() const {
+        bptree_stats s;
+        s.writer_lock = writer_mu_.stats();
+        std::lock_guard<adaptive_mutex> g(writer_mu_);
+        s.txn = meta_.txn;
+        s.entries = meta_.entries;
+        s.depth = meta_.depth;
+        s.pages = meta_.next_page;
+        s.free_pages = reusable_.size() + pending_.size();
+        return s;
+    }
+
+private:
+    // get for std::string and std::pmr::string values alike.
+    template <class String>
+    bool get_into(std::string_view key, String& value) {
+        read_txn t = begin_read();
+        std::string_view v;
+        if (!t.get(key, v)) return false;
+        value.assign(v);
+        return true;
+    }
+
+    static constexpr std::size_t page_header = 16;
+    static constexpr std::uint16_t leaf_page = 1, branch_page = 2, freelist_page = 3, meta_page = 4, overflow_page = 5;
+    static constexpr std::uint64_t magic = 0x31656572747062ull; // "bptree1"
+
+    struct meta {
+        std::uint64_t txn;
+        std::uint64_t root;
+        std::uint64_t next_page;
+        std::uint64_t freelist;
+        std::uint64_t entries;
+        std::uint64_t depth;
+    };
+
+    static std::uint16_t ld16(const char* p) {
+        std::uint16_t v;
+        std::memcpy(&v, p, 2);
+        return v;
+    }
+    static std::uint32_t ld32(const char* p) {
+        std::uint32_t v;
+        std::memcpy(&v, p, 4);
+        return v;
+    }
+    static std::uint64_t ld64(const char* p) {
+        std::uint64_t v;
+        std::memcpy(&v, p, 8);
+        return v;
+    }
+    static void st16(char* p, std::uint16_t v) { std::memcpy(p, &v, 2); }
+    static void st32(char* p, std::uint32_t v) { std::memcpy(p, &v, 4); }
+    static void st64(char* p, std::uint64_t v) { std::memcpy(p, &v, 8); }
+
+    static std::uint16_t type(const char* p) { return ld16(p); }
+    static unsigned count(const char* p) { return ld16(p + 2); }
+    static const char* entry(const char* p, unsigned i) { return p + ld16(p + page_header + 2 * i); }
+    static std::string_view leaf_key(const char* e) { return std::string_view(e + 8, ld16(e)); }
+    static std::string_view branch_key(const char* e) { return std::string_view(e + 10, ld16(e + 8)); }
+    static std::uint64_t branch_child(const char* e) { return ld64(e); }
+
+    static unsigned lower_bound(const char* p, std::string_view key) {
+        unsigned lo = 0, hi = count(p);
+        while (lo < hi) {
+            unsigned mid = (lo + hi) / 2;
+            if (leaf_key(entry(p, mid)) < key) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    // index of the child covering key: the last i with key_i <= key.
+    static unsigned child_index(const char* p, std::string_view key) {
+        unsigned lo = 1, hi = count(p);
+        while (lo < hi) {
+            unsigned mid = (lo + hi) / 2;
+            if (branch_key(entry(p, mid)) <= key) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo - 1;
+    }
+
+    const char* page(std::uint64_t pg) const { return map_->data() + pg * ps_; }
+
+    // where a key falls: its leaf, its index there, the leaf's slot in its
+    // parent (null for a root leaf) and its estimated fraction of the way
+    // through the tree's keys. a child's share of its parent is taken to be
+    // its share of the fanout one level down.
+    struct position {
+        const char* leaf;
+        unsigned index;
+        const char* parent;
+        unsigned slot;
+        double fraction;
+    };
+
+    position locate(std::uint64_t root, std::string_view key) const {
+        position pos{page(root), 0, nullptr, 0, 0};
+        double width = 1;
+        while (type(pos.leaf) == branch_page) {
+            const char* p = pos.parent = pos.leaf;
+            pos.slot = child_index(p, key);
+            double before = 0, total = 0;
+            for (unsigned i = 0; i < count(p); ++i) {
+                double w = count(page(branch_child(entry(p, i))));
+                if (i < pos.slot) before += w;
+                total += w;
+            }
+            pos.fraction += width * before / total;
+            width *= count(page(branch_child(entry(p, pos.slot)))) / total;
+            pos.leaf = page(branch_child(entry(p, pos.slot)));
+        }
+        pos.index = lower_bound(pos.leaf, key);
+        if (count(pos.leaf)) pos.fraction += pos.index * width / count(pos.leaf);
+        return pos;
+    }
+
+    // just past the last key.
+    position locate_end(std::uint64_t root) const {
+        position pos{page(root), 0, nullptr, 0, 1};
+        while (type(pos.leaf) == branch_page) {
+            pos.parent = pos.leaf;
+            pos.slot = count(pos.leaf) - 1;
+            pos.leaf = page(branch_child(entry(pos.leaf, pos.slot)));
+        }
+        pos.index = count(pos.leaf);
+        return pos;
+    }
+
+    // the key roughly fraction f in [0, 1) of the way through a non-empty
+    // tree, by the same model as locate.
+    position position_at(std::uint64_t root, double f) const {
+        position pos{page(root), 0, nullptr, 0, f};
+        while (type(pos.leaf) == branch_page) {
+            const char* p = pos.parent = pos.leaf;
+            auto fanout = [&](unsigned i) { return static_cast<double>(count(page(branch_child(entry(p, i))))); };
+            double total = 0, before = 0;
+            for (unsigned i = 0; i < count(p); ++i) total += fanout(i);
+            double target = f * total;
+            pos.slot = 0;
+            while (pos.slot + 1 < count(p) && before + fanout(pos.slot) <= target) before += fanout(pos.slot++);
+            f = std::clamp((target - before) / fanout(pos.slot), 0.0, 1.0);
+            pos.leaf = page(branch_child(entry(p, pos.slot)));
+        }
+        pos.index = std::min(count(pos.leaf) - 1, static_cast<unsigned>(f * count(pos.leaf)));
+        return pos;
+    }
+
+    const char* leaf_for(std::uint64_t pg, std::string_view key) const {
+        const char* p = page(pg);
+        while (type(p) == branch_page) p = page(branch_child(entry(p, child_index(p, key))));
+        return p;
+    }
+
+    std::string_view leaf_value(const char* e) const {
+        std::size_t key_size = ld16(e);
+        std::uint32_t size = ld32(e + 4);
+        if (e[2] & 1) return std::string_view(page(ld64(e + 8 + key_size)) + page_header, size);
+        return std::string_view(e + 8 + key_size, size);
+    }
+
+    std::size_t max_key() const { return ps_ / 8; }
+    std::size_t inline_limit() const { return ps_ / 4; }
+
+    static std::size_t entry_size(const write_txn::node& n, std::size_t i) {
+        if (!n.leaf) return 2 + 10 + n.keys[i].size();
+        return 2 + 8 + n.keys[i].size() + (n.ovf[i] ? 8 : n.vals[i].size());
+    }
+
+    static std::size_t encoded_size(const write_txn::node& n) {
+        std::size_t b = page_header;
+        for (std::size_t i = 0; i < n.keys.size(); ++i) b += entry_size(n, i);
+        return b;
+    }
+
+    void encode(const write_txn::node& n, char* out) const {
+        std::memset(out, 0, ps_);
+        st16(out, n.leaf ? leaf_page : branch_page);
+        st16(out + 2, static_cast<std::uint16_t>(n.keys.size()));
+        std::size_t off = ps_;
+        for (std::size_t i = 0; i < n.keys.size(); ++i) {
+            const std::string& k = n.keys[i];
+            off -= entry_size(n, i) - 2;
+            char* e = out + off;
+            st16(out + page_header + 2 * i, static_cast<std::uint16_t>(off));
+            if (n.leaf) {
+                st16(e, static_cast<std::uint16_t>(k.size()));
+                e[2] = n.ovf[i] ? 1 : 0;
+                st32(e + 4, n.vsize[i]);
+                std::memcpy(e + 8, k.data(), k.size());
+                if (n.ovf[i]) st64(e + 8 + k.size(), n.ovf[i]);
+                else std::memcpy(e + 8 + k.size(), n.vals[i].data(), n.vals[i].size());
+            } else {
+                st64(e, n.kids[i]);
+                st16(e + 8, static_cast<std::uint16_t>(k.size()));
+                std::memcpy(e + 10, k.data(), k.size());
+            }
+        }
+    }
+
+    write_txn::node decode(const char* p) const {
+        write_txn::node n;
+        n.leaf = type(p) == leaf_page;
+        unsigned c = count(p);
+        n.keys.reserve(c + 1);
+        if (n.leaf) {
+            n.vals.reserve(c + 1);
+            n.ovf.reserve(c + 1);
+            n.vsize.reserve(c + 1);
+        } else {
+            n.kids.reserve(c + 1);
+        }
+        for (unsigned i = 0; i < c; ++i) {
+            const char* e = entry(p, i);
+            if (n.leaf) {
+                std::size_t key_size = ld16(e);
+                n.keys.emplace_back(e + 8, key_size);
+                n.vsize.push_back(ld32(e + 4));
+                if (e[2] & 1) {
+                    n.ovf.push_back(ld64(e + 8 + key_size));
+                    n.vals.emplace_back();
+                } else {
+                    n.ovf.push_back(0);
+                    n.vals.emplace_back(e + 8 + key_size, n.vsize.back());
+                }
+            } else {
+                n.kids.push_back(branch_child(e));
+                n.keys.emplace_back(branch_key(e));
+            }
+        }
+        return n;
+    }
+
+    void write_meta(const meta& m) { write_meta(m, m.txn & 1); }
+
+    void write_meta(const meta& m, std::uint64_t slot) {
+        std::string p(ps_, '\0');
+        st16(p.data(), meta_page);
+        char* b = p.data() + page_header;
+        st64(b, magic);
+        st32(b + 8, ps_);
+        st64(b + 16, m.txn);
+        st64(b + 24, m.root);
+        st64(b + 32, m.next_page);
+        st64(b + 40, m.freelist);
+        st64(b + 48, m.entries);
+        st64(b + 56, m.depth);
+        st32(b + 64, crc32c(std::string_view(b, 64)));
+        f_->write(slot * ps_, p);
+    }
+
+    meta read_metas() {
+        bool found = false;
+        meta best{};
+        std::string p(ps_, '\0');
+        for (std::uint64_t slot = 0; slot < 2; ++slot) {
+            if (f_->read(slot * ps_, p.data(), ps_) != ps_) continue;
+            const char* b = p.data() + page_header;
+            if (ld64(b) != magic || ld32(b + 64) != crc32c(std::string_view(b, 64))) continue;
+            if (ld32(b + 8) != ps_) throw io_error("bptree: file was created with a different page size");
+            meta m{ld64(b + 16), ld64(b + 24), ld64(b + 32), ld64(b + 40), ld64(b + 48), ld64(b + 56)};
+            if (!found || m.txn > best.txn) best = m;
+            found = true;
+        }
+        if (!found) throw io_error("bptree: no valid meta page");
+        return best;
+    }
+
+    // the slot's txn reads as no txn while its root and entries change, so
+    // a reader never takes them as one snapshot's.
+    void publish(const meta& m) {
+        snapshot& sn = snaps_[m.txn & 1];
+        sn.txn.store(rewriting, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        sn.root.store(m.root, std::memory_order_relaxed);
+        sn.entries.store(m.entries, std::memory_order_relaxed);
+        sn.txn.store(m.txn, std::memory_order_release);
+        current_.store(m.txn, std::memory_order_seq_cst);
+    }
+
+    std::atomic<std::uint64_t>* acquire_slot() const {
+        constexpr std::uint64_t claimed = ~std::uint64_t{0};
+        std::uint32_t start = static_cast<std::uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id()) % opts_.max_readers);
+        for (std::uint32_t k = 0; k < opts_.max_readers; ++k) {
+            std::atomic<std::uint64_t>& s = slots_[(start + k) % opts_.max_readers];
+            std::uint64_t expected = 0;
+            if (s.compare_exchange_strong(expected, claimed, std::memory_order_acq_rel)) return &s;
+        }
+        throw std::runtime_error("bptree: out of reader slots");
+    }
+
+    // id of the oldest snapshot any reader may be on. slots hold id + 1;
+    // a slot claimed but not yet published re-checks after publishing.
+    std::uint64_t oldest_reader() const {
+        std::uint64_t oldest = current_.load(std::memory_order_seq_cst);
+        for (std::uint32_t i = 0; i < opts_.max_readers; ++i) {
+            std::uint64_t v = slots_[i].load(std::memory_order_seq_cst);
+            if (v && v != ~std::uint64_t{0}) oldest = std::min(oldest, v - 1);
+        }
+        return oldest;
+    }
+
+    bptree_options opts_;
+    std::uint32_t ps_;
+    std::unique_ptr<file> f_;
+    std::unique_ptr<mapping> map_;
+
+    std::unique_ptr<std::atomic<std::uint64_t>[]> slots_;
+    snapshot snaps_[2];
+    std::atomic<std::uint64_t> current_{0};
+
+    // fullest page read_txn::sample has met at each height above the
+    // leaves; only ever raised. deeper trees are not sampled.
+    static constexpr std::size_t max_sample_levels = 64;
+    mutable std::array<std::atomic<unsigned>, max_sample_levels> sample_fullest_{};
+
+    // writer state, guarded by writer_mu_.
+    mutable adaptive_mutex writer_mu_;
+    meta meta_{};
+    std::vector<std::uint64_t> reusable_;
+    std::deque<std::pair<std::uint64_t, std::uint64_t>> pending_; // (freeing txn, page), txn ascending
+    std::vector<std::uint64_t> freelist_pages_;
+};
+
+} // namespace dsa
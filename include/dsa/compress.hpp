@@ -0,0 +1,98 @@
+#pragma once
+
+// small lz77 compressor for cold data: a greedy match finder over a hash of
+// the next four bytes, with no entropy coding. it trades ratio for speed
+// and simplicity; repetitive keys and values still shrink several fold.
+//
+// stream:   raw_size:varint sequence*
+// sequence: literal_count:varint literals match_length:varint
+//           (offset:varint if match_length > 0)
+//
+// the last sequence, and only it, has match_length 0. a match copies
+// match_length bytes starting offset bytes back, and may overlap itself.
+
+#include "coding.hpp"
+#include "env.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dsa {
+
+inline std::string compress(std::string_view in) {
+    constexpr std::size_t min_match = 4;
+    std::string out;
+    out.reserve(in.size() / 2 + 16);
+    put_varint(out, in.size());
+    unsigned bits = 8;
+    while (bits < 14 && (std::size_t{1} << bits) < in.size() / 4) ++bits;
+    std::vector<std::uint32_t> table(std::size_t{1} << bits, 0); // position + 1
+    auto load = [&](std::size_t i) {
+        std::uint32_t v;
+        std::memcpy(&v, in.data() + i, 4);
+        return static_cast<std::uint32_t>(v * 2654435761u) >> (32 - bits);
+    };
+    std::size_t literal = 0, i = 0;
+    while (i + min_match <= in.size()) {
+        std::uint32_t& slot = table[load(i)];
+        std::size_t cand = slot;
+        slot = static_cast<std::uint32_t>(i + 1);
+        if (!cand || std::memcmp(in.data() + cand - 1, in.data() + i, min_match) != 0) {
+            ++i;
+            continue;
+        }
+        std::size_t from = cand - 1, len = min_match;
+        while (i + len < in.size() && in[from + len] == in[i + len]) ++len;
+        put_varint(out, i - literal);
+        out.append(in.data() + literal, i - literal);
+        put_varint(out, len);
+        put_varint(out, i - from);
+        i += len;
+        literal = i;
+    }
+    put_varint(out, in.size() - literal);
+    out.append(in.data() + literal, in.size() - literal);
+    put_varint(out, 0);
+    return out;
+}
+
+// throws io_error if in is not a well-formed stream. with a limit, stops
+// once the first limit bytes are out and returns those, leaving the rest of
+// the stream unread and unchecked.
+inline std::string decompress(std::string_view in, std::size_t limit = SIZE_MAX) {
+    stage_scope expanding(stage::decompress);
+    auto fail = [] { throw io_error("decompress: corrupt stream"); };
+    std::uint64_t size;
+    if (!get_varint(in, size)) fail();
+    std::size_t want = static_cast<std::size_t>(std::min<std::uint64_t>(size, limit));
+    std::string out;
+    // a corrupt size must not reserve the world; a real stream that expands
+    // further than this just grows the string.
+    out.reserve(std::min<std::size_t>(want, 256 * (in.size() + 1)));
+    while (true) {
+        std::uint64_t lit, len, off;
+        if (!get_varint(in, lit) || lit > in.size() || lit > size - out.size()) fail();
+        out.append(in.data(), std::min<std::size_t>(static_cast<std::size_t>(lit), want - out.size()));
+        in.remove_prefix(static_cast<std::size_t>(lit));
+        if (out.size() == want && want < size) return out;
+        if (!get_varint(in, len)) fail();
+        if (!len) break;
+        if (!get_varint(in, off) || !off || off > out.size() || len > size - out.size()) fail();
+        // the bytes from pos on repeat with period off, so each copy can
+        // take everything appended so far: overlapping matches double.
+        std::size_t pos = out.size() - static_cast<std::size_t>(off);
+        for (std::size_t left = std::min<std::size_t>(static_cast<std::size_t>(len), want - out.size()); left;) {
+            std::size_t n = std::min(left, out.size() - pos);
+            out.append(out, pos, n);
+            left -= n;
+        }
+        if (out.size() == want && want < size) return out;
+    }
+    if (out.size() != size || !in.empty()) fail();
+    return out;
+}
+
+} // namespace dsa
@@ -0,0 +1,52 @@
+#pragma once
+
+// crc32c (castagnoli), slicing-by-8 in software. used to detect torn or
+// corrupted records in every on-disk format.
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+namespace dsa {
+
+namespace detail {
+
+struct crc32c_tables {
+    std::array<std::array<std::uint32_t, 256>, 8> t{};
+
+    crc32c_tables() {
+        for (std::uint32_t i = 0; i < 256; ++i) {
+            std::uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c >> 1) ^ (0x82f63b78u & (0u - (c & 1u)));
+            t[0][i] = c;
+        }
+        for (std::uint32_t i = 0; i < 256; ++i)
+            for (int s = 1; s < 8; ++s) t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xff];
+    }
+};
+
+inline const crc32c_tables& crc_tables() {
+    static const crc32c_tables tables;
+    return tables;
+}
+
+} // namespace detail
+
+// extends crc with data; start from 0.
+inline std::uint32_t crc32c(std::string_view data, std::uint32_t crc = 0) {
+    const auto& t = detail::crc_tables().t;
+    const auto* p = reinterpret_cast<const unsigned char*>(data.data());
+    std::size_t n = data.size();
+    crc = ~crc;
+    while (n >= 8) {
+        std::uint32_t lo = crc ^ (std::uint32_t{p[0]} | std::uint32_t{p[1]} << 8 | std::uint32_t{p[2]} << 16 | std::uint32_t{p[3]} << 24);
+        crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+              t[3][p[4]] ^ t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+        p += 8;
+        n -= 8;
+    }
+    while (n--) crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+    return ~crc;
+}
+
+} // namespace dsa
@@ -0,0 +1,140 @@
+#pragma once
+
+// per-operation deadlines and cancellation. a deadline_scope attaches a
+// deadline and/or a cancel_token to everything the calling thread does
+// until it is destroyed, so every store call made inside it carries them
+// without any change to the store interface.
+//
+// they are checked where waiting happens: before a read is submitted to a
+// file, while waiting for an engine's writer lock and between blocks of a
+// scan. an expired operation throws deadline_exceeded at the next check
+// instead of queueing behind slow work. writes already submitted are never
+// abandoned halfway, so an engine is never left with half an update; the
+// checks come before an operation's first write, not between its writes.
+//
+//   dsa::deadline_scope d = dsa::deadline_scope::after(env, 50'000'000);
+//   store.get(key, value); // throws deadline_exceeded once 50 ms are up
+
+#include "env.hpp"
+#include "trace.hpp"
+
+#include <atomic>
+#include <limits>
+#include <mutex>
+#include <optional>
+
+namespace dsa {
+
+// not an io_error: the device is fine, the caller ran out of time.
+class deadline_exceeded : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// cancels every operation running under a scope holding a copy of it. safe
+// to cancel from any thread.
+class cancel_token {
+public:
+    cancel_token() : flag_(std::make_shared<std::atomic<bool>>(false)) {}
+
+    void cancel() { flag_->store(true, std::memory_order_release); }
+    bool cancelled() const { return flag_->load(std::memory_order_acquire); }
+
+private:
+    std::shared_ptr<std::atomic<bool>> flag_;
+};
+
+class deadline_scope {
+public:
+    static constexpr std::uint64_t none = std::numeric_limits<std::uint64_t>::max();
+
+    // deadline_ns is absolute on clock's now_ns(). scopes nest; an inner one
+    // can only tighten the deadline.
+    deadline_scope(env& clock, std::uint64_t deadline_ns, std::optional<cancel_token> token = std::nullopt)
+        : clock_(clock), deadline_(deadline_ns), token_(std::move(token)), outer_(current()) {
+        if (outer_ && outer_->deadline_ < deadline_) deadline_ = outer_->deadline_;
+        current() = this;
+    }
+
+    static deadline_scope after(env& clock, std::uint64_t timeout_ns, std::optional<cancel_token> token = std::nullopt) {
+        return deadline_scope(clock, clock.now_ns() + timeout_ns, std::move(token));
+    }
+
+    deadline_scope(const deadline_scope&) = delete;
+    deadline_scope& operator=(const deadline_scope&) = delete;
+    ~deadline_scope() { current() = outer_; }
+
+    // the innermost scope on this thread, or null.
+    static const deadline_scope* active() { return current(); }
+
+    env& clock() const { return clock_; }
+    std::uint64_t deadline_ns() const { return deadline_; }
+
+    bool cancelled() const {
+        for (const deadline_scope* s = this; s; s = s->outer_)
+            if (s->token_ && s->token_->cancelled()) return true;
+        return false;
+    }
+
+    void check() const {
+        if (cancelled()) throw deadline_exceeded("operation cancelled");
+        if (deadline_ != none && clock_.now_ns() >= deadline_) throw deadline_exceeded("deadline exceeded");
+    }
+
+private:
+    friend class deadline_exempt;
+
+    // guaranteed copy elision lets after() return a scope that registered
+    // itself at its final address.
+    static const deadline_scope*& current() {
+        thread_local const deadline_scope* s = nullptr;
+        return s;
+    }
+
+    env& clock_;
+    std::uint64_t deadline_;
+    std::optional<cancel_token> token_;
+    const deadline_scope* outer_;
+};
+
+// hides the calling thread's scopes while it lives, for work that must not
+// stop halfway once started, such as a merge.
+class deadline_exempt {
+public:
+    deadline_exempt() : saved_(deadline_scope::current()) { deadline_scope::current() = nullptr; }
+    deadline_exempt(const deadline_exempt&) = delete;
+    deadline_exempt& operator=(const deadline_exempt&) = delete;
+    ~deadline_exempt() { deadline_scope::current() = saved_; }
+
+private:
+    const deadline_scope* saved_;
+};
+
+// throws deadline_exceeded if the calling thread's operation has expired or
+// been cancelled. one thread-local load when there is no scope.
+inline void check_deadline() {
+    if (const deadline_scope* s = deadline_scope::active()) s->check();
+}
+
+// a Lock (std::unique_lock or std::shared_lock) on m that gives up with
+// deadline_exceeded if the operation expires while waiting. std mutexes
+// cannot be woken by a deadline, so a contended wait under a scope polls.
+template <class Lock, class Mutex>
+Lock lock_within_deadline(Mutex& m) {
+    Lock l(m, std::try_to_lock);
+    if (l.owns_lock()) return l;
+    stage_scope wait(stage::lock_wait);
+    const deadline_scope* s = deadline_scope::active();
+    if (!s) {
+        l.lock();
+        return l;
+    }
+    for (unsigned spins = 0; !l.try_lock(); ++spins) {
+        s->check();
+        if (spins < 64) std::this_thread::yield();
+        else std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+    return l;
+}
+
+} // namespace dsa
@@ -0,0 +1,300 @@
+#pragma once
+
+// binary document values: named, typed fields behind an offset table, so a
+// reader finds one field by binary search over fixed-width entries and
+// reads its bytes in place, without touching the others. a document is an
+// ordinary value to every store; this is only its encoding.
+//
+// finding a field is O(log n) in the field count, not O(1): a hashed slot
+// table would cost every document bytes on top of its entries, for a
+// search that over the tens of fields documents have stays within a cache
+// line or two of the entries.
+//
+// document: magic:1 count:4 entry* name* value*
+// entry:    hash:4 name_off:4 value_off:4 name_size:1 type:1
+//
+// entries are sorted by (hash of name, name), and values are laid out in
+// entry order, so a value ends where the next entry's begins and the last
+// at the end of the document. offsets are from the start of the document.
+// ints and doubles take 8 bytes, booleans 1, null none; strings and nested
+// documents are their bytes. names are at most 255 bytes.
+//
+// projection copies the raw bytes of the wanted fields into a new document
+// without decoding them. an update that keeps a field's size overwrites it
+// in place; one that changes it moves the values after it and fixes up
+// their offsets, still without decoding any; adding or erasing a field
+// rebuilds the table from raw bytes. the store still writes the value
+// whole.
+
+#include "coding.hpp"
+#include "hash.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace dsa {
+
+enum class field_type : std::uint8_t { null, boolean, int64, float64, string, document };
+
+// a field's type and encoded bytes, for building and updating documents.
+struct field_value {
+    field_type type = field_type::null;
+    std::string bytes;
+
+    static field_value null() { return {}; }
+    static field_value boolean(bool v) { return {field_type::boolean, std::string(1, v ? '\1' : '\0')}; }
+    static field_value int64(std::int64_t v) {
+        field_value f{field_type::int64, {}};
+        put_u64(f.bytes, static_cast<std::uint64_t>(v));
+        return f;
+    }
+    static field_value float64(double v) {
+        std::uint64_t bits;
+        std::memcpy(&bits, &v, 8);
+        field_value f{field_type::float64, {}};
+        put_u64(f.bytes, bits);
+        return f;
+    }
+    static field_value string(std::string_view v) { return {field_type::string, std::string(v)}; }
+    // v must be an encoded document.
+    static field_value document(std::string_view v) { return {field_type::document, std::string(v)}; }
+};
+
+class document_view;
+
+// one field of a document_view, pointing into its bytes.
+struct field {
+    std::string_view name;
+    field_type type = field_type::null;
+    std::string_view raw;
+
+    bool as_bool() const {
+        expect(field_type::boolean, 1);
+        return raw[0] != 0;
+    }
+    std::int64_t as_int() const {
+        expect(field_type::int64, 8);
+        return static_cast<std::int64_t>(get_u64(raw.data()));
+    }
+    double as_double() const {
+        expect(field_type::float64, 8);
+        std::uint64_t bits = get_u64(raw.data());
+        double v;
+        std::memcpy(&v, &bits, 8);
+        return v;
+    }
+    std::string_view as_string() const {
+        expect(field_type::string, raw.size());
+        return raw;
+    }
+    inline document_view as_document() const;
+
+    field_value value() const { return {type, std::string(raw)}; }
+
+private:
+    void expect(field_type t, std::size_t size) const {
+        if (type != t || raw.size() != size) throw std::invalid_argument("document: field " + std::string(name) + " has another type");
+    }
+};
+
+namespace detail {
+
+constexpr char document_magic = '\xd0';
+constexpr std::size_t document_header = 5;
+constexpr std::size_t document_entry = 14;
+
+inline std::uint32_t field_hash(std::string_view name) { return static_cast<std::uint32_t>(hash64(name)); }
+
+} // namespace detail
+
+// read-only access to an encoded document. checks the header and the table
+// bounds when constructed, and each field's bounds when it is read.
+class document_view {
+public:
+    document_view() = default;
+
+    explicit document_view(std::string_view bytes) : b_(bytes) {
+        if (b_.size() < detail::document_header || b_[0] != detail::document_magic) throw std::invalid_argument("document: bad header");
+        n_ = get_u32(b_.data() + 1);
+        if (n_ > (b_.size() - detail::document_header) / detail::document_entry) throw std::invalid_argument("document: table past the end");
+    }
+
+    std::size_t size() const { return n_; }
+    std::string_view bytes() const { return b_; }
+
+    // the i-th field in table order.
+    field at(std::size_t i) const {
+        const char* e = entry(i);
+        field f;
+        std::uint32_t name_off = get_u32(e + 4), value_off = get_u32(e + 8);
+        auto name_size = static_cast<unsigned char>(e[12]);
+        std::size_t value_end = i + 1 < n_ ? get_u32(entry(i + 1) + 8) : b_.size();
+        if (name_off + std::size_t{name_size} > b_.size() || value_off > value_end || value_end > b_.size())
+            throw std::invalid_argument("document: field past the end");
+        f.name = b_.substr(name_off, name_size);
+        f.type = static_cast<field_type>(e[13]);
+        f.raw = b_.substr(value_off, value_end - value_off);
+        return f;
+    }
+
+    // table index of the field called name, by binary search on its hash.
+    std::optional<std::size_t> index_of(std::string_view name) const { return index_of(name, detail::field_hash(name)); }
+
+    std::optional<std::size_t> index_of(std::string_view name, std::uint32_t hash) const {
+        std::size_t lo = 0, hi = n_;
+        while (lo < hi) {
+            std::size_t mid = (lo + hi) / 2;
+            if (get_u32(entry(mid)) < hash) lo = mid + 1;
+            else hi = mid;
+        }
+        for (; lo < n_ && get_u32(entry(lo)) == hash; ++lo)
+            if (at(lo).name == name) return lo;
+        return std::nullopt;
+    }
+
+    std::optional<field> find(std::string_view name) const {
+        std::optional<std::size_t> i = index_of(name);
+        if (!i) return std::nullopt;
+        return at(*i);
+    }
+
+private:
+    const char* entry(std::size_t i) const { return b_.data() + detail::document_header + i * detail::document_entry; }
+
+    std::string_view b_;
+    std::size_t n_ = 0;
+};
+
+inline document_view field::as_document() const {
+    expect(field_type::document, raw.size());
+    return document_view(raw);
+}
+
+// collects fields and encodes them. names must be unique.
+class document_builder {
+public:
+    document_builder& set(std::string_view name, field_value v) {
+        if (name.size() > 255) throw std::length_error("document: field name longer than 255 bytes");
+        fields_.push_back({detail::field_hash(name), std::string(name), std::move(v)});
+        return *this;
+    }
+
+    document_builder& set(const field& f) { return set(f.name, f.value()); }
+
+    std::string finish() {
+        std::sort(fields_.begin(), fields_.end(), [](const pending& a, const pending& b) {
+            return a.hash < b.hash || (a.hash == b.hash && a.name < b.name);
+        });
+        for (std::size_t i = 1; i < fields_.size(); ++i)
+            if (fields_[i].hash == fields_[i - 1].hash && fields_[i].name == fields_[i - 1].name)
+                throw std::invalid_argument("document: duplicate field " + fields_[i].name);
+        std::size_t names = detail::document_header + fields_.size() * detail::document_entry, values = names;
+        for (const pending& f : fields_) values += f.name.size();
+        std::string out;
+        out += detail::document_magic;
+        put_u32(out, static_cast<std::uint32_t>(fields_.size()));
+        std::size_t name_at = names, value_at = values;
+        for (const pending& f : fields_) {
+            put_u32(out, f.hash);
+            put_u32(out, static_cast<std::uint32_t>(name_at));
+            put_u32(out, static_cast<std::uint32_t>(value_at));
+            out += static_cast<char>(f.name.size());
+            out += static_cast<char>(f.value.type);
+            name_at += f.name.size();
+            value_at += f.value.bytes.size();
+        }
+        if (value_at > UINT32_MAX) throw std::length_error("document: larger than 4 GiB");
+        for (const pending& f : fields_) out += f.name;
+        for (const pending& f : fields_) out += f.value.bytes;
+        fields_.clear();
+        return out;
+    }
+
+private:
+    struct pending {
+        std::uint32_t hash;
+        std::string name;
+        field_value value;
+    };
+
+    std::vector<pending> fields_;
+};
+
+// the names a scan wants, hashed once for every document it reads.
+class projection {
+public:
+    explicit projection(std::vector<std::string> names) : names_(std::move(names)) {
+        for (const std::string& n : names_) hashes_.push_back(detail::field_hash(n));
+    }
+
+    std::size_t size() const { return names_.size(); }
+
+    // calls fn(i, field) for each wanted field present in d, i being the
+    // field's position among the names given.
+    template <class Fn>
+    void each(const document_view& d, Fn&& fn) const {
+        for (std::size_t i = 0; i < names_.size(); ++i)
+            if (std::optional<std::size_t> at = d.index_of(names_[i], hashes_[i])) fn(i, d.at(*at));
+    }
+
+    // a document of just the wanted fields of d, their bytes copied as is.
+    std::string apply(const document_view& d) const {
+        document_builder b;
+        each(d, [&](std::size_t, const field& f) { b.set(f); });
+        return b.finish();
+    }
+
+private:
+    std::vector<std::string> names_;
+    std::vector<std::uint32_t> hashes_;
+};
+
+// sets field name of the encoded document doc to v, adding it if absent.
+inline void update_field(std::string& doc, std::string_view name, const field_value& v) {
+    document_view d(doc);
+    std::optional<std::size_t> i = d.index_of(name);
+    if (!i) {
+        document_builder b;
+        for (std::size_t k = 0; k < d.size(); ++k) b.set(d.at(k));
+        b.set(name, v);
+        doc = b.finish();
+        return;
+    }
+    field f = d.at(*i);
+    std::size_t count = d.size();
+    auto off = static_cast<std::size_t>(f.raw.data() - doc.data());
+    std::size_t old_size = f.raw.size();
+    std::size_t entry = detail::document_header + *i * detail::document_entry;
+    doc[entry + 13] = static_cast<char>(v.type);
+    if (v.bytes.size() == old_size) {
+        std::memcpy(&doc[off], v.bytes.data(), old_size);
+        return;
+    }
+    if (doc.size() - old_size + v.bytes.size() > UINT32_MAX) throw std::length_error("document: larger than 4 GiB");
+    doc.replace(off, old_size, v.bytes);
+    auto delta = static_cast<std::uint32_t>(v.bytes.size() - old_size); // wraps for shrinking, as intended
+    for (std::size_t k = *i + 1; k < count; ++k) {
+        char* p = &doc[detail::document_header + k * detail::document_entry + 8];
+        std::uint32_t moved = get_u32(p) + delta;
+        for (int j = 0; j < 4; ++j) p[j] = static_cast<char>(moved >> (8 * j));
+    }
+}
+
+// removes field name from doc. returns whether it was there.
+inline bool erase_field(std::string& doc, std::string_view name) {
+    document_view d(doc);
+    std::optional<std::size_t> i = d.index_of(name);
+    if (!i) return false;
+    document_builder b;
+    for (std::size_t k = 0; k < d.size(); ++k)
+        if (k != *i) b.set(d.at(k));
+    doc = b.finish();
+    return true;
+}
+
+} // namespace dsa
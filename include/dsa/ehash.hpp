@@ -0,0 +1,501 @@
+#pragma once
+
+// disk-resident hash store using extendible hashing. records live in
+// page-sized buckets in one file; an in-memory directory of 2^global_depth
+// slots, indexed by the low bits of the key hash, names the bucket for each
+// slot. a point lookup is therefore exactly one bucket read, whatever the
+// size of the table. a full bucket is split in two by the next hash bit,
+// doubling the directory only when the bucket was already as deep as the
+// directory, so growth never rehashes more than one bucket at a time.
+//
+// bucket:    crc32c:4 local_depth:4 pattern:8 count:4 record*
+// record:    varint key_size, varint value_size, key, value
+// directory: global_depth:4 buckets:8 keys:8 (bucket:4)* crc32c:4
+//
+// pattern is the hash bits every key in the bucket shares. a split appends
+// its new buckets in file order before rewriting the old one in place, so a
+// crash midway leaves the old bucket still holding every record: recovery
+// drops a torn tail of new buckets, or finishes the split. bucket rewrites
+// are assumed to be atomic, which holds for aligned writes of up to 4 KiB
+// on most devices. the directory is saved on sync and rebuilt from bucket
+// headers after a crash. buckets never merge.
+
+#include "coding.hpp"
+#include "crc32c.hpp"
+#include "deadline.hpp"
+#include "env.hpp"
+#include "hash.hpp"
+#include "reader.hpp"
+#include "sample.hpp"
+#include "store.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+namespace dsa {
+
+struct ehash_options {
+    std::uint32_t bucket_size = 4096;     // power of two in [512, 65536]
+    std::uint32_t max_global_depth = 30; // directory holds at most 2^this slots
+    // sync the bucket file after every write.
+    bool sync_writes = false;
+};
+
+struct ehash_stats {
+    std::uint64_t keys = 0;
+    std::uint64_t buckets = 0;
+    std::uint64_t global_depth = 0;
+    std::uint64_t bucket_reads = 0;
+    std::uint64_t bucket_writes = 0;
+    std::uint64_t splits = 0;
+    std::uint64_t doublings = 0;
+};
+
+class ehash_store : public store {
+public:
+    ehash_store(env& e, std::string dir, ehash_options opts = {})
+        : env_(e), dir_(std::move(dir)), opts_(validate(opts)), bs_(opts.bucket_size) {
+        env_.create_dir(dir_);
+        f_ = env_.open(join_path(dir_, "buckets"), open_mode::create);
+        if (!load_directory()) rebuild_directory();
+    }
+
+    ~ehash_store() override {
+        try {
+            sync();
+        } catch (const io_error&) {
+        }
+    }
+
+    ehash_store(const ehash_store&) = delete;
+    ehash_store& operator=(const ehash_store&) = delete;
+
+    void put(std::string_view key, std::string_view value) override {
+        if (record_size(key.size(), value.size()) > (bs_ - header_size) / 4)
+            throw std::length_error("ehash: record larger than a quarter bucket");
+        std::uint64_t h = hash64(key);
+        auto g = lock_within_deadline<std::unique_lock<std::shared_mutex>>(mu_);
+        std::uint32_t b = dir_slots_[h & mask(global_depth_)];
+        bucket bk = read_bucket(b);
+        dirty();
+        auto it = bk.find(key);
+        bool added = it == bk.records.end();
+        if (!added) {
+            bk.bytes = bk.bytes - record_size(key.size(), it->second.size()) + record_size(key.size(), value.size());
+            it->second.assign(value);
+        } else {
+            bk.records.emplace_back(key, value);
+            bk.bytes += record_size(key.size(), value.size());
+        }
+        if (bk.bytes <= bs_) {
+            write_bucket(b, bk);
+        } else {
+            split(b, std::move(bk));
+        }
+        keys_ += added;
+        if (opts_.sync_writes) f_->sync();
+    }
+
+    bool get(std::string_view key, std::string& value) override { return get_into(key, value); }
+    bool get(std::string_view key, std::pmr::string& value) override { return get_into(key, value); }
+
+    bool erase(std::string_view key) override {
+        std::uint64_t h = hash64(key);
+        auto g = lock_within_deadline<std::unique_lock<std::shared_mutex>>(mu_);
+        std::uint32_t b = dir_slots_[h & mask(global_depth_)];
+        bucket bk = read_bucket(b);
+        auto it = bk.find(key);
+        if (it == bk.records.end()) return false;
+        dirty();
+        bk.bytes -= record_size(it->first.size(), it->second.size());
+        bk.records.erase(it);
+        --keys_;
+        write_bucket(b, bk);
+        if (opts_.sync_writes) f_->sync();
+        return true;
+    }
+
+    // by olken over the buckets (see sample.hpp): a random bucket, then a
+    // random position below a bound a quarter above the fullest bucket met
+    // so far, accepted if the bucket holds a record there. a fuller bucket
+    // raises the bound for good and starts the sample over, as bptree's
+    // pages do. a draw reads a bucket and buckets never merge, so once the
+    // draws still wanted would read more buckets than the file holds, as
+    // after most keys are erased, the file is read in one pass instead and
+    // the rest drawn from the keys in it. runs under the read lock.
+    std::vector<std::string> sample(std::size_t n, std::uint64_t seed) override {
+        std::vector<std::string> out;
+        sample_rng r(seed);
+        std::string page(bs_, '\0');
+        auto g = lock_within_deadline<std::shared_lock<std::shared_mutex>>(mu_);
+        if (!keys_) return out;
+        // bucket b's record count, its page left in page.
+        auto read = [&](std::uint64_t b) {
+            read_exact(*f_, b * bs_, page.data(), bs_);
+            reads_.fetch_add(1, std::memory_order_relaxed);
+            if (get_u32(page.data()) != crc32c(std::string_view(page).substr(4))) throw io_error("ehash: corrupt bucket " + std::to_string(b));
+            return get_u32(page.data() + 16);
+        };
+        auto raise = [&](std::uint32_t v) {
+            std::uint32_t cur = sample_fullest_.load(std::memory_order_relaxed);
+            while (cur < v && !sample_fullest_.compare_exchange_weak(cur, v, std::memory_order_relaxed)) {
+            }
+        };
+        if (!sample_fullest_.load(std::memory_order_relaxed))
+            for (int k = 0; k < 16; ++k) raise(read(r.uniform(buckets_)));
+        std::uint32_t f = sample_fullest_.load(std::memory_order_relaxed);
+        std::uint64_t bound = f + f / 4 + 1;
+        out.reserve(n);
+        while (out.size() < n && (n - out.size()) * bound < keys_) {
+            std::uint64_t b = r.uniform(buckets_);
+            std::uint32_t c = read(b);
+            if (c > bound) {
+                raise(c);
+                f = sample_fullest_.load(std::memory_order_relaxed);
+                bound = f + f / 4 + 1;
+                out.clear();
+                continue;
+            }
+            std::uint64_t slot = r.uniform(bound);
+            if (slot >= c) continue;
+            std::string_view in = std::string_view(page).substr(header_size), k, v;
+            for (std::uint64_t i = 0; i <= slot; ++i)
+                if (!next_record(in, k, v)) throw io_error("ehash: corrupt bucket " + std::to_string(b));
+            out.emplace_back(k);
+        }
+        if (out.size() == n) return out;
+        std::vector<std::string> keys;
+        keys.reserve(keys_);
+        sequential_reader in(*f_);
+        bucket bk;
+        for (std::uint64_t b = 0; b < buckets_; ++b) {
+            if (!decode(in.read(b * bs_, bs_), bk)) throw io_error("ehash: corrupt bucket " + std::to_string(b));
+            for (auto& rec : bk.records) keys.push_back(std::move(rec.first));
+        }
+        reads_.fetch_add(buckets_, std::memory_order_relaxed);
+        while (out.size() < n && !keys.empty()) out.push_back(keys[r.uniform(keys.size())]);
+        return out;
+    }
+
+    std::uint64_t key_count() override {
+        std::shared_lock<std::shared_mutex> g(mu_);
+        return keys_;
+    }
+
+    // syncs the buckets and saves the directory, so the next open skips the
+    // rebuild.
+    void sync() override {
+        std::unique_lock<std::shared_mutex> g(mu_);
+        f_->sync();
+        if (!saved_) save_directory();
+    }
+
+    ehash_stats stats() const {
+        std::shared_lock<std::shared_mutex> g(mu_);
+        ehash_stats s;
+        s.keys = keys_;
+        s.buckets = buckets_;
+        s.global_depth = global_depth_;
+        s.bucket_reads = reads_.load(std::memory_order_relaxed);
+        s.bucket_writes = writes_;
+        s.splits = splits_;
+        s.doublings = doublings_;
+        return s;
+    }
+
+private:
+    // get for std::string and std::pmr::string values alike.
+    template <class String>
+    bool get_into(std::string_view key, String& value) {
+        std::uint64_t h = hash64(key);
+        thread_local std::string buf;
+        buf.resize(bs_);
+        auto g = lock_within_deadline<std::shared_lock<std::shared_mutex>>(mu_);
+        std::uint32_t b = dir_slots_[h & mask(global_depth_)];
+        read_exact(*f_, std::uint64_t{b} * bs_, buf.data(), bs_);
+        reads_.fetch_add(1, std::memory_order_relaxed);
+        if (get_u32(buf.data()) != crc32c(std::string_view(buf).substr(4))) throw io_error("ehash: corrupt bucket " + std::to_string(b));
+        std::string_view in(buf.data() + header_size, bs_ - header_size);
+        for (std::uint32_t n = get_u32(buf.data() + 16); n; --n) {
+            std::string_view k, v;
+            if (!next_record(in, k, v)) throw io_error("ehash: corrupt bucket " + std::to_string(b));
+            if (k == key) {
+                value.assign(v);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static constexpr std::size_t header_size = 20;
+
+    struct bucket {
+        std::uint32_t depth = 0;
+        std::uint64_t pattern = 0;
+        std::vector<std::pair<std::string, std::string>> records;
+        std::size_t bytes = header_size; // encoded size
+
+        std::vector<std::pair<std::string, std::string>>::iterator find(std::string_view key) {
+            return std::find_if(records.begin(), records.end(), [&](const auto& r) { return r.first == key; });
+        }
+    };
+
+    static ehash_options validate(ehash_options o) {
+        if (o.bucket_size < 512 || o.bucket_size > 65536 || (o.bucket_size & (o.bucket_size - 1)))
+            throw std::invalid_argument("ehash: bucket_size must be a power of two in [512, 65536]");
+        if (o.max_global_depth > 32) throw std::invalid_argument("ehash: max_global_depth must be at most 32");
+        return o;
+    }
+
+    static std::uint64_t mask(std::uint32_t depth) { return (std::uint64_t{1} << depth) - 1; }
+
+    static std::size_t varint_size(std::uint64_t v) {
+        std::size_t n = 1;
+        while (v >= 0x80) {
+            v >>= 7;
+            ++n;
+        }
+        return n;
+    }
+
+    static std::size_t record_size(std::size_t key_size, std::size_t value_size) {
+        return varint_size(key_size) + varint_size(value_size) + key_size + value_size;
+    }
+
+    static bool next_record(std::string_view& in, std::string_view& key, std::string_view& value) {
+        std::uint64_t ks, vs;
+        if (!get_varint(in, ks) || !get_varint(in, vs) || in.size() < ks + vs) return false;
+        key = in.substr(0, ks);
+        value = in.substr(ks, vs);
+        in.remove_prefix(ks + vs);
+        return true;
+    }
+
+    // decodes a bucket page. returns false if it fails its crc.
+    bool decode(std::string_view page, bucket& bk) const {
+        if (page.size() != bs_ || get_u32(page.data()) != crc32c(page.substr(4))) return false;
+        bk.depth = get_u32(page.data() + 4);
+        bk.pattern = get_u64(page.data() + 8);
+        bk.records.clear();
+        bk.bytes = header_size;
+        std::string_view in = page.substr(header_size);
+        for (std::uint32_t n = get_u32(page.data() + 16); n; --n) {
+            std::string_view k, v;
+            if (!next_record(in, k, v)) return false;
+            bk.records.emplace_back(k, v);
+            bk.bytes += record_size(k.size(), v.size());
+        }
+        return true;
+    }
+
+    bucket read_bucket(std::uint32_t b) {
+        std::string page(bs_, '\0');
+        read_exact(*f_, std::uint64_t{b} * bs_, page.data(), bs_);
+        reads_.fetch_add(1, std::memory_order_relaxed);
+        bucket bk;
+        if (!decode(page, bk)) throw io_error("ehash: corrupt bucket " + std::to_string(b));
+        return bk;
+    }
+
+    void write_bucket(std::uint32_t b, const bucket& bk) {
+        std::string page(4, '\0');
+        put_u32(page, bk.depth);
+        put_u64(page, bk.pattern);
+        put_u32(page, static_cast<std::uint32_t>(bk.records.size()));
+        for (const auto& [k, v] : bk.records) {
+            put_varint(page, k.size());
+            put_varint(page, v.size());
+            page += k;
+            page += v;
+        }
+        page.resize(bs_, '\0');
+        std::uint32_t crc = crc32c(std::string_view(page).substr(4));
+        for (int i = 0; i < 4; ++i) page[i] = static_cast<char>(crc >> (8 * i));
+        f_->write(std::uint64_t{b} * bs_, page);
+        ++writes_;
+    }
+
+    // splits bucket b, which holds bk and has outgrown its page, until every
+    // piece fits. new buckets are written before b is rewritten.
+    void split(std::uint32_t b, bucket bk) {
+        std::vector<std::pair<std::uint32_t, bucket>> created;
+        std::pair<std::uint32_t, bucket> over{b, std::move(bk)};
+        while (over.second.bytes > bs_) {
+            bucket& old = over.second;
+            if (old.depth == global_depth_) {
+                if (global_depth_ == opts_.max_global_depth) throw io_error("ehash: directory at max_global_depth");
+                dir_slots_.resize(dir_slots_.size() * 2);
+                std::copy_n(dir_slots_.begin(), dir_slots_.size() / 2, dir_slots_.begin() + static_cast<std::ptrdiff_t>(dir_slots_.size() / 2));
+                ++global_depth_;
+                ++doublings_;
+            }
+            bucket hi;
+            hi.depth = ++old.depth;
+            hi.pattern = old.pattern | std::uint64_t{1} << (old.depth - 1);
+            auto moved = std::stable_partition(old.records.begin(), old.records.end(),
+                                               [&](const auto& r) { return (hash64(r.first) & mask(old.depth)) == old.pattern; });
+            for (auto r = moved; r != old.records.end(); ++r) {
+                std::size_t n = record_size(r->first.size(), r->second.size());
+                old.bytes -= n;
+                hi.bytes += n;
+                hi.records.push_back(std::move(*r));
+            }
+            old.records.erase(moved, old.records.end());
+            std::uint32_t nb = static_cast<std::uint32_t>(buckets_++);
+            for (std::uint64_t s = hi.pattern; s < dir_slots_.size(); s += std::uint64_t{1} << hi.depth) dir_slots_[s] = nb;
+            ++splits_;
+            // at most one half can still be too big: the other lacks the
+            // record that overflowed the page.
+            if (hi.bytes > bs_) std::swap(over, created.emplace_back(nb, std::move(hi)));
+            else created.emplace_back(nb, std::move(hi));
+        }
+        // the new buckets go in file order, so a crash can only tear the
+        // tail, and b last; with sync_writes they are on disk before b
+        // gives up their records.
+        created.push_back(std::move(over));
+        auto b_last = [&](const auto& x) { return std::make_pair(x.first == b, x.first); };
+        std::sort(created.begin(), created.end(), [&](const auto& x, const auto& y) { return b_last(x) < b_last(y); });
+        for (auto& [id, piece] : created) {
+            if (id == b && opts_.sync_writes) f_->sync();
+            write_bucket(id, piece);
+        }
+    }
+
+    // the saved directory describes the file only until the next write.
+    void dirty() {
+        if (!saved_) return;
+        env_.remove(join_path(dir_, "directory"));
+        saved_ = false;
+    }
+
+    void save_directory() {
+        std::string out;
+        put_u32(out, global_depth_);
+        put_u64(out, buckets_);
+        put_u64(out, keys_);
+        for (std::uint32_t b : dir_slots_) put_u32(out, b);
+        put_u32(out, crc32c(out));
+        std::string tmp = join_path(dir_, "directory.tmp");
+        auto f = env_.open(tmp, open_mode::truncate);
+        f->append(out);
+        f->sync();
+        env_.rename(tmp, join_path(dir_, "directory"));
+        saved_ = true;
+    }
+
+    bool load_directory() {
+        std::string path = join_path(dir_, "directory");
+        if (!env_.exists(path)) return false;
+        auto f = env_.open(path, open_mode::read_only);
+        std::string all(f->size(), '\0');
+        if (all.size() < 24 || f->read(0, all.data(), all.size()) != all.size()) return false;
+        std::string_view body(all.data(), all.size() - 4);
+        if (get_u32(body.data() + body.size()) != crc32c(body)) return false;
+        std::uint32_t depth = get_u32(body.data());
+        std::uint64_t buckets = get_u64(body.data() + 4);
+        if (depth > opts_.max_global_depth || body.size() != 20 + 4 * (std::uint64_t{1} << depth) || buckets * bs_ != f_->size()) return false;
+        global_depth_ = depth;
+        buckets_ = buckets;
+        keys_ = get_u64(body.data() + 12);
+        dir_slots_.resize(std::size_t{1} << depth);
+        for (std::size_t s = 0; s < dir_slots_.size(); ++s) dir_slots_[s] = get_u32(body.data() + 20 + 4 * s);
+        saved_ = true;
+        return true;
+    }
+
+    // rebuilds the directory from bucket headers. deeper buckets override
+    // shallower ones; a bucket left owning fewer slots than its depth implies
+    // was mid-split, and is rewritten as the piece it still owns.
+    void rebuild_directory() {
+        std::uint64_t n = f_->size() / bs_;
+        struct header {
+            std::uint32_t id;
+            std::uint32_t depth;
+            std::uint64_t pattern;
+            std::uint32_t count;
+        };
+        std::vector<header> headers;
+        sequential_reader in(*f_);
+        bucket bk;
+        std::uint64_t torn = n;
+        for (std::uint64_t b = 0; b < n; ++b) {
+            if (!decode(in.read(b * bs_, bs_), bk)) {
+                if (torn == n) torn = b;
+                continue;
+            }
+            if (torn == n) headers.push_back({static_cast<std::uint32_t>(b), bk.depth, bk.pattern, static_cast<std::uint32_t>(bk.records.size())});
+        }
+        // only the new buckets of the last split can be invalid: it appends
+        // at most one per level of depth, and its bucket keeps their records
+        // until all of them are written. drop every page from the first
+        // invalid one on.
+        if (torn < n) {
+            if (n - torn > opts_.max_global_depth) throw io_error("ehash: corrupt bucket " + std::to_string(torn));
+            f_->truncate(torn * bs_);
+            n = torn;
+        }
+        if (n == 0) {
+            buckets_ = 1;
+            global_depth_ = 0;
+            dir_slots_.assign(1, 0);
+            write_bucket(0, bucket{});
+            f_->sync();
+            return;
+        }
+        std::stable_sort(headers.begin(), headers.end(), [](const header& x, const header& y) { return x.depth < y.depth; });
+        buckets_ = n;
+        global_depth_ = headers.back().depth;
+        if (global_depth_ > opts_.max_global_depth) throw io_error("ehash: bucket deeper than max_global_depth");
+        dir_slots_.assign(std::size_t{1} << global_depth_, 0);
+        for (const header& h : headers)
+            for (std::uint64_t s = h.pattern; s < dir_slots_.size(); s += std::uint64_t{1} << h.depth) dir_slots_[s] = h.id;
+
+        std::vector<std::uint64_t> owned(n, 0);
+        for (std::uint32_t b : dir_slots_) ++owned[b];
+        keys_ = 0;
+        for (const header& h : headers) {
+            std::uint64_t expected = std::uint64_t{1} << (global_depth_ - h.depth);
+            // owning nothing cannot happen with one split at a time; such a
+            // bucket would just be unreachable.
+            if (owned[h.id] == expected || owned[h.id] == 0) {
+                keys_ += h.count;
+                continue;
+            }
+            bucket old = read_bucket(h.id);
+            std::uint64_t slot = std::find(dir_slots_.begin(), dir_slots_.end(), h.id) - dir_slots_.begin();
+            while ((std::uint64_t{1} << (global_depth_ - old.depth)) > owned[h.id]) ++old.depth;
+            old.pattern = slot & mask(old.depth);
+            old.records.erase(std::remove_if(old.records.begin(), old.records.end(),
+                                             [&](const auto& r) { return (hash64(r.first) & mask(old.depth)) != old.pattern; }),
+                              old.records.end());
+            write_bucket(h.id, old);
+            keys_ += old.records.size();
+        }
+        f_->sync();
+    }
+
+    env& env_;
+    std::string dir_;
+    ehash_options opts_;
+    std::uint32_t bs_;
+    std::unique_ptr<file> f_;
+
+    mutable std::shared_mutex mu_;
+    std::vector<std::uint32_t> dir_slots_;
+    std::uint32_t global_depth_ = 0;
+    std::uint64_t buckets_ = 0;
+    std::uint64_t keys_ = 0;
+    bool saved_ = false;
+
+    mutable std::atomic<std::uint64_t> reads_{0};
+    // the most records sample has met in one bucket; only ever raised.
+    std::atomic<std::uint32_t> sample_fullest_{0};
+    std::uint64_t writes_ = 0;
+    std::uint64_t splits_ = 0;
+    std::uint64_t doublings_ = 0;
+};
+
+} // namespace dsa
@@ -0,0 +1,101 @@
+#pragma once
+
+// file and environment abstraction every durable part of the storage
+// abstraction goes through. engines never touch the os directly, so an env
+// can be swapped for a simulated or in-memory one without them noticing.
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace dsa {
+
+// thrown by env and file operations when the underlying device fails.
+class io_error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+enum class open_mode {
+    read_only,  // must exist
+    read_write, // must exist
+    create,     // read_write, created if missing
+    truncate,   // read_write, created if missing, emptied if present
+};
+
+// read-only view of the start of a file, valid for the mapping's lifetime.
+class mapping {
+public:
+    virtual ~mapping() = default;
+    virtual const char* data() const = 0;
+};
+
+class file {
+public:
+    virtual ~file() = default;
+
+    // reads up to n bytes at offset into buf. returns the number of bytes
+    // read, which is short only at end of file.
+    virtual std::size_t read(std::uint64_t offset, char* buf, std::size_t n) = 0;
+    virtual void write(std::uint64_t offset, std::string_view data) = 0;
+    // appends at the current end of file and returns the offset written at.
+    // concurrent appends land at distinct offsets.
+    virtual std::uint64_t append(std::string_view data) = 0;
+    // makes everything written so far durable.
+    virtual void sync() = 0;
+    virtual std::uint64_t size() const = 0;
+    virtual void truncate(std::uint64_t n) = 0;
+
+    // maps the first n bytes read-only, or returns null if this kind of file
+    // cannot be mapped. n may exceed the file's size so the mapping keeps
+    // covering it as it grows, but only bytes inside the file may be
+    // touched, and the file must not grow beyond n while mapped.
+    virtual std::unique_ptr<mapping> map(std::uint64_t n) {
+        (void)n;
+        return nullptr;
+    }
+};
+
+class env {
+public:
+    virtual ~env() = default;
+
+    virtual std::unique_ptr<file> open(const std::string& path, open_mode mode) = 0;
+    virtual bool exists(const std::string& path) = 0;
+    virtual void remove(const std::string& path) = 0;
+    // replaces `to` if it exists.
+    virtual void rename(const std::string& from, const std::string& to) = 0;
+    // names (not paths) of the entries directly inside dir.
+    virtual std::vector<std::string> list(const std::string& dir) = 0;
+    // creates dir and any missing parents. no-op if it already exists.
+    virtual void create_dir(const std::string& dir) = 0;
+
+    // the clock engines and benchmarks measure time with. simulated envs may
+    // run on a virtual clock, so never mix this with std::chrono directly.
+    virtual std::uint64_t now_ns() {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+    virtual void sleep_ns(std::uint64_t ns) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(ns));
+    }
+};
+
+inline std::string join_path(std::string_view dir, std::string_view name) {
+    std::string p(dir);
+    if (!p.empty() && p.back() != '/') p += '/';
+    p += name;
+    return p;
+}
+
+// reads exactly n bytes or throws.
+inline void read_exact(file& f, std::uint64_t offset, char* buf, std::size_t n) {
+    if (f.read(offset, buf, n) != n) throw io_error("short read");
+}
+
+} // namespace dsa
@@ -0,0 +1,250 @@
+#pragma once
+
+// env that keeps every file in ram. engines run unchanged on it with zero
+// kernel i/o, which isolates their cpu cost in benchmarks. open handles
+// keep a removed file's contents alive, as unlink does on posix.
+//
+// a mapped file must not move while it grows, so mapping one moves its
+// bytes into an anonymous range reserved for the whole mapping size. the
+// kernel backs that range only as pages are written, so a 1 GiB map of a
+// small file costs address space, not memory.
+
+#include "env.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+
+#include <sys/mman.h>
+
+namespace dsa {
+
+class mem_env : public env {
+    // a file's bytes: a heap string, or once mapped a reserved range that
+    // never moves.
+    class buffer {
+    public:
+        buffer() = default;
+        buffer(const buffer&) = delete;
+        buffer& operator=(const buffer&) = delete;
+        ~buffer() {
+            if (region_) munmap(region_, cap_);
+        }
+
+        const char* data() const { return region_ ? region_ : heap_.data(); }
+        char* data() { return region_ ? region_ : heap_.data(); }
+        std::size_t size() const { return region_ ? size_ : heap_.size(); }
+
+        // new bytes are zero, as with std::string::resize.
+        void resize(std::size_t n) {
+            if (!region_) return heap_.resize(n);
+            if (n > cap_) throw io_error("mem_env: file grew past its mapping");
+            if (n < size_) std::memset(region_ + n, 0, size_ - n);
+            size_ = n;
+        }
+
+        void clear() { resize(0); }
+
+        void append(std::string_view s) {
+            std::size_t at = size();
+            resize(at + s.size());
+            std::copy(s.begin(), s.end(), data() + at);
+        }
+
+        void map(std::size_t n) {
+            if (region_) {
+                if (n > cap_) throw io_error("mem_env: file is already mapped with a smaller size");
+                return;
+            }
+            n = std::max(n, heap_.size());
+            if (!n) n = 1;
+            void* p = mmap(nullptr, n, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (p == MAP_FAILED) throw io_error("mem_env: cannot reserve " + std::to_string(n) + " bytes to map");
+            region_ = static_cast<char*>(p);
+            cap_ = n;
+            size_ = heap_.size();
+            std::copy(heap_.begin(), heap_.end(), region_);
+            std::string().swap(heap_);
+        }
+
+    private:
+        std::string heap_;
+        char* region_ = nullptr;
+        std::size_t cap_ = 0, size_ = 0;
+    };
+
+    struct node {
+        mutable std::shared_mutex mu;
+        buffer data;
+    };
+
+public:
+    class mem_mapping : public mapping {
+    public:
+        explicit mem_mapping(std::shared_ptr<node> n) : n_(std::move(n)), p_(n_->data.data()) {}
+        const char* data() const override { return p_; }
+
+    private:
+        std::shared_ptr<node> n_;
+        const char* p_;
+    };
+
+    class mem_file : public file {
+    public:
+        explicit mem_file(std::shared_ptr<node> n) : n_(std::move(n)) {}
+
+        std::size_t read(std::uint64_t offset, char* buf, std::size_t n) override {
+            std::shared_lock<std::shared_mutex> g(n_->mu);
+            if (offset >= n_->data.size()) return 0;
+            n = std::min<std::size_t>(n, n_->data.size() - offset);
+            std::copy_n(n_->data.data() + offset, n, buf);
+            return n;
+        }
+
+        void write(std::uint64_t offset, std::string_view data) override {
+            std::lock_guard<std::shared_mutex> g(n_->mu);
+            if (n_->data.size() < offset + data.size()) n_->data.resize(offset + data.size());
+            std::copy(data.begin(), data.end(), n_->data.data() + offset);
+        }
+
+        std::uint64_t append(std::string_view data) override {
+            std::lock_guard<std::shared_mutex> g(n_->mu);
+            std::uint64_t offset = n_->data.size();
+            n_->data.append(data);
+            return offset;
+        }
+
+        void sync() override {}
+
+        std::uint64_t size() const override {
+            std::shared_lock<std::shared_mutex> g(n_->mu);
+            return n_->data.size();
+        }
+
+        void truncate(std::uint64_t n) override {
+            std::lock_guard<std::shared_mutex> g(n_->mu);
+            n_->data.resize(n);
+        }
+
+        std::unique_ptr<mapping> map(std::uint64_t n) override {
+            std::lock_guard<std::shared_mutex> g(n_->mu);
+            n_->data.map(n);
+            return std::make_unique<mem_mapping>(n_);
+        }
+
+    private:
+        std::shared_ptr<node> n_;
+    };
+
+    std::unique_ptr<file> open(const std::string& path, open_mode mode) override {
+        std::string p = normalize(path);
+        std::lock_guard<std::mutex> g(mu_);
+        auto it = files_.find(p);
+        if (it == files_.end()) {
+            if (mode == open_mode::read_only || mode == open_mode::read_write) throw io_error("open " + p + ": no such file");
+            if (!dirs_.count(parent(p))) throw io_error("open " + p + ": no such directory");
+            it = files_.emplace(p, std::make_shared<node>()).first;
+        } else if (mode == open_mode::truncate) {
+            std::lock_guard<std::shared_mutex> ng(it->second->mu);
+            it->second->data.clear();
+        }
+        return std::make_unique<mem_file>(it->second);
+    }
+
+    bool exists(const std::string& path) override {
+        std::string p = normalize(path);
+        std::lock_guard<std::mutex> g(mu_);
+        return files_.count(p) || dirs_.count(p);
+    }
+
+    void remove(const std::string& path) override {
+        std::string p = normalize(path);
+        std::lock_guard<std::mutex> g(mu_);
+        auto it = files_.find(p);
+        if (it == files_.end()) throw io_error("remove " + p + ": no such file");
+        removed_.push_back(it->second);
+        files_.erase(it);
+    }
+
+    void rename(const std::string& from, const std::string& to) override {
+        std::string f = normalize(from), t = normalize(to);
+        std::lock_guard<std::mutex> g(mu_);
+        auto it = files_.find(f);
+        if (it == files_.end()) throw io_error("rename " + f + ": no such file");
+        if (!dirs_.count(parent(t))) throw io_error("rename " + t + ": no such directory");
+        std::shared_ptr<node> n = std::move(it->second);
+        files_.erase(it);
+        std::shared_ptr<node>& dst = files_[t];
+        if (dst) removed_.push_back(dst);
+        dst = std::move(n);
+    }
+
+    std::vector<std::string> list(const std::string& dir) override {
+        std::string d = normalize(dir);
+        std::lock_guard<std::mutex> g(mu_);
+        if (!dirs_.count(d)) throw io_error("list " + d + ": no such directory");
+        std::vector<std::string> names;
+        std::string prefix = d == "/" ? d : d + "/";
+        auto collect = [&](const std::string& p) {
+            if (p.size() > prefix.size() && p.compare(0, prefix.size(), prefix) == 0 &&
+                p.find('/', prefix.size()) == std::string::npos)
+                names.push_back(p.substr(prefix.size()));
+        };
+        for (auto it = files_.lower_bound(prefix); it != files_.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it)
+            collect(it->first);
+        for (auto it = dirs_.lower_bound(prefix); it != dirs_.end() && it->compare(0, prefix.size(), prefix) == 0; ++it)
+            collect(*it);
+        return names;
+    }
+
+    void create_dir(const std::string& dir) override {
+        std::string d = normalize(dir);
+        std::lock_guard<std::mutex> g(mu_);
+        for (std::size_t i = 1; i <= d.size(); ++i)
+            if (i == d.size() || d[i] == '/') dirs_.insert(d.substr(0, i));
+    }
+
+    // bytes held by all files, including removed ones still open.
+    std::uint64_t bytes() const {
+        std::lock_guard<std::mutex> g(mu_);
+        std::uint64_t total = 0;
+        auto add = [&](const node& n) {
+            std::shared_lock<std::shared_mutex> ng(n.mu);
+            total += n.data.size();
+        };
+        for (const auto& f : files_) add(*f.second);
+        removed_.erase(std::remove_if(removed_.begin(), removed_.end(), [](const std::weak_ptr<node>& w) { return w.expired(); }),
+                       removed_.end());
+        for (const auto& w : removed_)
+            if (std::shared_ptr<node> n = w.lock()) add(*n);
+        return total;
+    }
+
+private:
+    // collapses duplicate and trailing slashes; relative paths stay relative.
+    static std::string normalize(const std::string& path) {
+        std::string p;
+        for (char c : path)
+            if (c != '/' || p.empty() || p.back() != '/') p += c;
+        if (p.size() > 1 && p.back() == '/') p.pop_back();
+        return p;
+    }
+
+    static std::string parent(const std::string& p) {
+        std::size_t slash = p.rfind('/');
+        if (slash == std::string::npos) return ".";
+        return slash == 0 ? "/" : p.substr(0, slash);
+    }
+
+    mutable std::mutex mu_;
+    std::map<std::string, std::shared_ptr<node>> files_;
+    // replaced or removed files, counted by bytes() while a handle holds them.
+    mutable std::vector<std::weak_ptr<node>> removed_;
+    std::set<std::string> dirs_{"/", "."};
+};
+
+} // namespace dsa
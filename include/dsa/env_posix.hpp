@@ -0,0 +1,181 @@
+#pragma once
+
+// env backed by the real filesystem through pread / pwrite / fsync.
+
+#include "deadline.hpp"
+#include "env.hpp"
+#include "trace.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace dsa {
+
+namespace detail {
+
+[[noreturn]] inline void throw_errno(const std::string& what) {
+    throw io_error(what + ": " + std::strerror(errno));
+}
+
+} // namespace detail
+
+class posix_mapping : public mapping {
+public:
+    posix_mapping(void* p, std::size_t n) : p_(p), n_(n) {}
+    ~posix_mapping() override { ::munmap(p_, n_); }
+
+    posix_mapping(const posix_mapping&) = delete;
+    posix_mapping& operator=(const posix_mapping&) = delete;
+
+    const char* data() const override { return static_cast<const char*>(p_); }
+
+private:
+    void* p_;
+    std::size_t n_;
+};
+
+class posix_file : public file {
+public:
+    posix_file(int fd, std::string path, std::uint64_t size)
+        : fd_(fd), path_(std::move(path)), size_(size) {}
+    ~posix_file() override { ::close(fd_); }
+
+    posix_file(const posix_file&) = delete;
+    posix_file& operator=(const posix_file&) = delete;
+
+    std::size_t read(std::uint64_t offset, char* buf, std::size_t n) override {
+        check_deadline();
+        stage_scope io(stage::io);
+        std::size_t done = 0;
+        while (done < n) {
+            ssize_t r = ::pread(fd_, buf + done, n - done, static_cast<off_t>(offset + done));
+            if (r < 0) {
+                if (errno == EINTR) continue;
+                detail::throw_errno("pread " + path_);
+            }
+            if (r == 0) break;
+            done += static_cast<std::size_t>(r);
+        }
+        return done;
+    }
+
+    void write(std::uint64_t offset, std::string_view data) override {
+        write_at(offset, data);
+        std::uint64_t end = offset + data.size();
+        std::uint64_t cur = size_.load(std::memory_order_relaxed);
+        while (cur < end && !size_.compare_exchange_weak(cur, end, std::memory_order_relaxed)) {}
+    }
+
+    std::uint64_t append(std::string_view data) override {
+        std::uint64_t offset = size_.fetch_add(data.size(), std::memory_order_relaxed);
+        write_at(offset, data);
+        return offset;
+    }
+
+    void sync() override {
+        stage_scope io(stage::io);
+        if (::fdatasync(fd_) != 0) detail::throw_errno("fdatasync " + path_);
+    }
+
+    std::uint64_t size() const override { return size_.load(std::memory_order_relaxed); }
+
+    void truncate(std::uint64_t n) override {
+        if (::ftruncate(fd_, static_cast<off_t>(n)) != 0) detail::throw_errno("ftruncate " + path_);
+        size_.store(n, std::memory_order_relaxed);
+    }
+
+    // shared with the page cache, so later pwrites show through.
+    std::unique_ptr<mapping> map(std::uint64_t n) override {
+        void* p = ::mmap(nullptr, n, PROT_READ, MAP_SHARED, fd_, 0);
+        if (p == MAP_FAILED) detail::throw_errno("mmap " + path_);
+        return std::make_unique<posix_mapping>(p, n);
+    }
+
+    int fd() const { return fd_; }
+
+private:
+    void write_at(std::uint64_t offset, std::string_view data) {
+        stage_scope io(stage::io);
+        std::size_t done = 0;
+        while (done < data.size()) {
+            ssize_t r = ::pwrite(fd_, data.data() + done, data.size() - done, static_cast<off_t>(offset + done));
+            if (r < 0) {
+                if (errno == EINTR) continue;
+                detail::throw_errno("pwrite " + path_);
+            }
+            done += static_cast<std::size_t>(r);
+        }
+    }
+
+    int fd_;
+    std::string path_;
+    std::atomic<std::uint64_t> size_;
+};
+
+class posix_env : public env {
+public:
+    std::unique_ptr<file> open(const std::string& path, open_mode mode) override {
+        int flags = O_CLOEXEC;
+        switch (mode) {
+        case open_mode::read_only: flags |= O_RDONLY; break;
+        case open_mode::read_write: flags |= O_RDWR; break;
+        case open_mode::create: flags |= O_RDWR | O_CREAT; break;
+        case open_mode::truncate: flags |= O_RDWR | O_CREAT | O_TRUNC; break;
+        }
+        int fd = ::open(path.c_str(), flags, 0644);
+        if (fd < 0) detail::throw_errno("open " + path);
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            detail::throw_errno("fstat " + path);
+        }
+        return std::make_unique<posix_file>(fd, path, static_cast<std::uint64_t>(st.st_size));
+    }
+
+    bool exists(const std::string& path) override {
+        struct stat st;
+        return ::stat(path.c_str(), &st) == 0;
+    }
+
+    void remove(const std::string& path) override {
+        if (::unlink(path.c_str()) != 0) detail::throw_errno("unlink " + path);
+    }
+
+    void rename(const std::string& from, const std::string& to) override {
+        if (::rename(from.c_str(), to.c_str()) != 0) detail::throw_errno("rename " + from);
+    }
+
+    std::vector<std::string> list(const std::string& dir) override {
+        DIR* d = ::opendir(dir.c_str());
+        if (!d) detail::throw_errno("opendir " + dir);
+        std::vector<std::string> names;
+        while (dirent* e = ::readdir(d)) {
+            std::string_view n(e->d_name);
+            if (n != "." && n != "..") names.emplace_back(n);
+        }
+        ::closedir(d);
+        return names;
+    }
+
+    void create_dir(const std::string& dir) override {
+        for (std::size_t i = 1; i <= dir.size(); ++i) {
+            if (i != dir.size() && dir[i] != '/') continue;
+            std::string prefix = dir.substr(0, i);
+            if (::mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) detail::throw_errno("mkdir " + prefix);
+        }
+    }
+};
+
+inline env& default_env() {
+    static posix_env e;
+    return e;
+}
+
+} // namespace dsa
@@ -0,0 +1,362 @@
+#pragma once
+
+// in-memory stores specialised at compile time for uint64_t keys and one
+// fixed-size value type V, trivially copyable and default constructible,
+// for the common id → struct case that pays for byte strings it does not
+// need.
+//
+// fixed_hash_store<V> is mem_store's layout with the strings taken out:
+// stripes of open-addressing tables, each a packed array of keys, a
+// packed array of values and an occupancy bitmap. linear probing with
+// backward-shift deletion, so there are no tombstones and a lookup touches
+// the key array until it meets the key or a free slot, then one value.
+//
+// fixed_tree_store<V> is the ordered counterpart: a b+tree in memory whose
+// leaves hold their keys and values in two packed arrays, found by integer
+// comparison. leaves are never merged; one emptied by erases stays in the
+// tree until a put lands in it again.
+//
+// neither has any length prefix or per-entry allocation: an entry costs
+// 8 + sizeof(V) bytes plus slack in the table or leaves.
+
+#include "deadline.hpp"
+#include "hash.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace dsa {
+
+struct fixed_hash_options {
+    std::uint32_t stripes = 16; // power of two
+    // grow a stripe's table once this fraction of its slots is taken.
+    double max_load = 0.875;
+};
+
+template <class V>
+class fixed_hash_store {
+    static_assert(std::is_trivially_copyable_v<V> && std::is_default_constructible_v<V>,
+                  "fixed_hash_store: values must be trivially copyable and default constructible");
+
+public:
+    explicit fixed_hash_store(fixed_hash_options opts = {}) : opts_(opts), mask_(opts.stripes - 1) {
+        if (!opts.stripes || (opts.stripes & (opts.stripes - 1))) throw std::invalid_argument("fixed_hash_store: stripes must be a power of two");
+        if (!(opts.max_load > 0 && opts.max_load < 1)) throw std::invalid_argument("fixed_hash_store: max_load must be in (0, 1)");
+        stripes_ = std::make_unique<stripe[]>(opts.stripes);
+    }
+
+    fixed_hash_store(const fixed_hash_store&) = delete;
+    fixed_hash_store& operator=(const fixed_hash_store&) = delete;
+
+    void put(std::uint64_t key, const V& value) {
+        std::uint64_t h = hash64(key);
+        stripe& s = stripes_[h & mask_];
+        auto g = lock_within_deadline<std::unique_lock<std::shared_mutex>>(s.mu);
+        if (static_cast<double>(s.size + 1) > opts_.max_load * static_cast<double>(s.cap)) grow(s);
+        std::size_t i = s.find(key, h);
+        if (!s.used(i)) {
+            s.mark(i);
+            s.keys[i] = key;
+            ++s.size;
+        }
+        s.vals[i] = value;
+    }
+
+    bool get(std::uint64_t key, V& value) const {
+        std::uint64_t h = hash64(key);
+        stripe& s = stripes_[h & mask_];
+        auto g = lock_within_deadline<std::shared_lock<std::shared_mutex>>(s.mu);
+        if (!s.cap) return false;
+        std::size_t i = s.find(key, h);
+        if (!s.used(i)) return false;
+        value = s.vals[i];
+        return true;
+    }
+
+    bool erase(std::uint64_t key) {
+        std::uint64_t h = hash64(key);
+        stripe& s = stripes_[h & mask_];
+        auto g = lock_within_deadline<std::unique_lock<std::shared_mutex>>(s.mu);
+        if (!s.cap) return false;
+        std::size_t i = s.find(key, h);
+        if (!s.used(i)) return false;
+        // shift later members of the probe run back over the hole, as long
+        // as that does not move one in front of its home slot.
+        std::size_t m = s.cap - 1;
+        for (std::size_t j = (i + 1) & m; s.used(j); j = (j + 1) & m) {
+            std::size_t home = (hash64(s.keys[j]) >> 32) & m;
+            if (((j - home) & m) >= ((j - i) & m)) {
+                s.keys[i] = s.keys[j];
+                s.vals[i] = s.vals[j];
+                i = j;
+            }
+        }
+        s.unmark(i);
+        --s.size;
+        return true;
+    }
+
+    std::uint64_t size() const {
+        std::uint64_t n = 0;
+        for (std::uint64_t i = 0; i <= mask_; ++i) {
+            std::shared_lock<std::shared_mutex> g(stripes_[i].mu);
+            n += stripes_[i].size;
+        }
+        return n;
+    }
+
+    // bytes held by the tables.
+    std::uint64_t memory_bytes() const {
+        std::uint64_t n = 0;
+        for (std::uint64_t i = 0; i <= mask_; ++i) {
+            std::shared_lock<std::shared_mutex> g(stripes_[i].mu);
+            n += stripes_[i].cap * (8 + sizeof(V)) + stripes_[i].cap / 8;
+        }
+        return n;
+    }
+
+private:
+    struct stripe {
+        mutable std::shared_mutex mu;
+        std::size_t cap = 0; // power of two, or 0 before the first put
+        std::size_t size = 0;
+        std::unique_ptr<std::uint64_t[]> keys;
+        std::unique_ptr<V[]> vals;
+        std::unique_ptr<std::uint64_t[]> bits;
+
+        bool used(std::size_t i) const { return bits[i >> 6] >> (i & 63) & 1; }
+        void mark(std::size_t i) { bits[i >> 6] |= std::uint64_t{1} << (i & 63); }
+        void unmark(std::size_t i) { bits[i >> 6] &= ~(std::uint64_t{1} << (i & 63)); }
+
+        // the slot holding key, or the free slot ending its probe run. the
+        // low hash bits chose the stripe, so the slot comes from the high.
+        std::size_t find(std::uint64_t key, std::uint64_t h) const {
+            std::size_t m = cap - 1;
+            std::size_t i = (h >> 32) & m;
+            while (used(i) && keys[i] != key) i = (i + 1) & m;
+            return i;
+        }
+    };
+
+    void grow(stripe& s) {
+        std::size_t cap = s.cap ? 2 * s.cap : 64;
+        auto keys = std::make_unique<std::uint64_t[]>(cap);
+        auto vals = std::unique_ptr<V[]>(new V[cap]);
+        auto bits = std::make_unique<std::uint64_t[]>((cap + 63) / 64);
+        std::swap(s.keys, keys);
+        std::swap(s.vals, vals);
+        std::swap(s.bits, bits);
+        std::size_t old = s.cap;
+        s.cap = cap;
+        for (std::size_t i = 0; i < old; ++i) {
+            if (!(bits[i >> 6] >> (i & 63) & 1)) continue;
+            std::size_t j = s.find(keys[i], hash64(keys[i]));
+            s.mark(j);
+            s.keys[j] = keys[i];
+            s.vals[j] = vals[i];
+        }
+    }
+
+    fixed_hash_options opts_;
+    std::uint64_t mask_;
+    std::unique_ptr<stripe[]> stripes_;
+};
+
+template <class V>
+class fixed_tree_store {
+    static_assert(std::is_trivially_copyable_v<V> && std::is_default_constructible_v<V>,
+                  "fixed_tree_store: values must be trivially copyable and default constructible");
+
+public:
+    // about 4 KiB leaves and 256-way branches.
+    static constexpr std::size_t leaf_cap = std::max<std::size_t>(16, 4096 / (8 + sizeof(V)));
+    static constexpr std::size_t branch_cap = 256;
+
+    fixed_tree_store() : root_(new leaf) { leaves_ = 1; }
+
+    ~fixed_tree_store() { destroy(root_, height_); }
+
+    fixed_tree_store(const fixed_tree_store&) = delete;
+    fixed_tree_store& operator=(const fixed_tree_store&) = delete;
+
+    void put(std::uint64_t key, const V& value) {
+        auto g = lock_within_deadline<std::unique_lock<std::shared_mutex>>(mu_);
+        std::uint64_t sep;
+        void* right = insert(root_, height_, key, value, sep);
+        if (!right) return;
+        auto* b = new branch;
+        b->n = 1;
+        b->keys[0] = sep;
+        b->kids[0] = root_;
+        b->kids[1] = right;
+        root_ = b;
+        ++height_;
+        ++branches_;
+    }
+
+    bool get(std::uint64_t key, V& value) const {
+        auto g = lock_within_deadline<std::shared_lock<std::shared_mutex>>(mu_);
+        const leaf* l = leaf_for(key);
+        std::size_t i = l->lower_bound(key);
+        if (i == l->n || l->keys[i] != key) return false;
+        value = l->vals[i];
+        return true;
+    }
+
+    bool erase(std::uint64_t key) {
+        auto g = lock_within_deadline<std::unique_lock<std::shared_mutex>>(mu_);
+        leaf* l = const_cast<leaf*>(leaf_for(key));
+        std::size_t i = l->lower_bound(key);
+        if (i == l->n || l->keys[i] != key) return false;
+        std::memmove(l->keys + i, l->keys + i + 1, (l->n - i - 1) * 8);
+        std::memmove(l->vals + i, l->vals + i + 1, (l->n - i - 1) * sizeof(V));
+        --l->n;
+        --size_;
+        return true;
+    }
+
+    // calls fn(key, value) for keys in [lo, hi) in order until it returns
+    // false. holds the tree shared meanwhile, so fn must not write to it.
+    template <class Fn>
+    void scan(std::uint64_t lo, std::uint64_t hi, Fn fn) const {
+        auto g = lock_within_deadline<std::shared_lock<std::shared_mutex>>(mu_);
+        const leaf* l = leaf_for(lo);
+        for (std::size_t i = l->lower_bound(lo); l; l = l->next, i = 0) {
+            check_deadline();
+            for (; i < l->n; ++i)
+                if (l->keys[i] >= hi || !fn(l->keys[i], l->vals[i])) return;
+        }
+    }
+
+    std::uint64_t size() const {
+        std::shared_lock<std::shared_mutex> g(mu_);
+        return size_;
+    }
+
+    // bytes held by the nodes.
+    std::uint64_t memory_bytes() const {
+        std::shared_lock<std::shared_mutex> g(mu_);
+        return leaves_ * sizeof(leaf) + branches_ * sizeof(branch);
+    }
+
+private:
+    struct leaf {
+        std::uint32_t n = 0;
+        leaf* next = nullptr;
+        std::uint64_t keys[leaf_cap];
+        V vals[leaf_cap];
+
+        std::size_t lower_bound(std::uint64_t key) const { return std::lower_bound(keys, keys + n, key) - keys; }
+    };
+
+    // kids[i] holds keys below keys[i]; kids[n] holds the rest.
+    struct branch {
+        std::uint32_t n = 0;
+        std::uint64_t keys[branch_cap];
+        void* kids[branch_cap + 1];
+
+        std::size_t child(std::uint64_t key) const { return std::upper_bound(keys, keys + n, key) - keys; }
+    };
+
+    const leaf* leaf_for(std::uint64_t key) const {
+        void* p = root_;
+        for (unsigned h = height_; h; --h) {
+            auto* b = static_cast<branch*>(p);
+            p = b->kids[b->child(key)];
+        }
+        return static_cast<const leaf*>(p);
+    }
+
+    // inserts below p, at height h. if p splits, returns the new right
+    // sibling and its first key in sep.
+    void* insert(void* p, unsigned h, std::uint64_t key, const V& value, std::uint64_t& sep) {
+        if (!h) {
+            auto* l = static_cast<leaf*>(p);
+            std::size_t i = l->lower_bound(key);
+            if (i < l->n && l->keys[i] == key) {
+                l->vals[i] = value;
+                return nullptr;
+            }
+            ++size_;
+            if (l->n < leaf_cap) {
+                insert_at(l, i, key, value);
+                return nullptr;
+            }
+            auto* r = new leaf;
+            ++leaves_;
+            std::size_t half = leaf_cap / 2;
+            r->n = static_cast<std::uint32_t>(leaf_cap - half);
+            std::memcpy(r->keys, l->keys + half, r->n * 8);
+            std::memcpy(r->vals, l->vals + half, r->n * sizeof(V));
+            l->n = static_cast<std::uint32_t>(half);
+            r->next = l->next;
+            l->next = r;
+            if (i <= half) insert_at(l, i, key, value);
+            else insert_at(r, i - half, key, value);
+            sep = r->keys[0];
+            return r;
+        }
+        auto* b = static_cast<branch*>(p);
+        std::size_t c = b->child(key);
+        std::uint64_t kid_sep;
+        void* kid = insert(b->kids[c], h - 1, key, value, kid_sep);
+        if (!kid) return nullptr;
+        if (b->n < branch_cap) {
+            insert_kid(b, c, kid_sep, kid);
+            return nullptr;
+        }
+        // the middle key moves up; the right half keeps the keys after it.
+        auto* r = new branch;
+        ++branches_;
+        std::size_t mid = branch_cap / 2;
+        sep = b->keys[mid];
+        r->n = static_cast<std::uint32_t>(branch_cap - mid - 1);
+        std::memcpy(r->keys, b->keys + mid + 1, r->n * 8);
+        std::memcpy(r->kids, b->kids + mid + 1, (r->n + 1) * sizeof(void*));
+        b->n = static_cast<std::uint32_t>(mid);
+        if (c <= mid) insert_kid(b, c, kid_sep, kid);
+        else insert_kid(r, c - mid - 1, kid_sep, kid);
+        return r;
+    }
+
+    static void insert_at(leaf* l, std::size_t i, std::uint64_t key, const V& value) {
+        std::memmove(l->keys + i + 1, l->keys + i, (l->n - i) * 8);
+        std::memmove(l->vals + i + 1, l->vals + i, (l->n - i) * sizeof(V));
+        l->keys[i] = key;
+        l->vals[i] = value;
+        ++l->n;
+    }
+
+    // adds kid right of kids[c], holding the keys from sep on.
+    static void insert_kid(branch* b, std::size_t c, std::uint64_t sep, void* kid) {
+        std::memmove(b->keys + c + 1, b->keys + c, (b->n - c) * 8);
+        std::memmove(b->kids + c + 2, b->kids + c + 1, (b->n - c) * sizeof(void*));
+        b->keys[c] = sep;
+        b->kids[c + 1] = kid;
+        ++b->n;
+    }
+
+    static void destroy(void* p, unsigned h) {
+        if (!h) {
+            delete static_cast<leaf*>(p);
+            return;
+        }
+        auto* b = static_cast<branch*>(p);
+        for (std::size_t i = 0; i <= b->n; ++i) destroy(b->kids[i], h - 1);
+        delete b;
+    }
+
+    mutable std::shared_mutex mu_;
+    void* root_;
+    unsigned height_ = 0; // branch levels above the leaves
+    std::uint64_t size_ = 0;
+    std::uint64_t leaves_ = 0, branches_ = 0;
+};
+
+} // namespace dsa
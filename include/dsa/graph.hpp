@@ -0,0 +1,401 @@
+#pragma once
+
+// directed graph over uint64 vertex ids, kept as adjacency lists for
+// traversal rather than as one entry per edge. a vertex's out-neighbors are
+// sorted and cut into blocks of at most block_edges; a block holds its
+// smallest neighbor and the varint gaps to the rest, so an edge costs a
+// byte or two and walking a neighborhood is one hash lookup for the vertex
+// followed by a sequential decode.
+//
+// edges arrive in batches. a batch is sorted once, and each vertex it
+// touches has each affected block decoded, merged with its new neighbors
+// and re-encoded once, however many of its edges the batch carries. a block
+// grown past block_edges splits into half-full blocks so later inserts have
+// room; blocks emptied by erases are dropped, small ones are not merged.
+//
+// the graph lives in memory and is made durable, like sorted_set, by a
+// journal of batches replayed on open and rewritten as a snapshot once
+// mostly superseded:
+//
+// record: crc32c:4 op:1 edges:4 body_size:4 body
+//
+// op 1 adds the body's edges and op 2 erases them; the body is varint pairs
+// of source and target.
+
+#include "coding.hpp"
+#include "crc32c.hpp"
+#include "deadline.hpp"
+#include "env.hpp"
+#include "reader.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace dsa {
+
+struct edge {
+    std::uint64_t from;
+    std::uint64_t to;
+
+    bool operator<(const edge& o) const { return from < o.from || (from == o.from && to < o.to); }
+    bool operator==(const edge& o) const { return from == o.from && to == o.to; }
+};
+
+struct graph_options {
+    // most neighbors in one block; larger blocks pack tighter, smaller ones
+    // make inserts into long lists cheaper.
+    std::uint32_t block_edges = 64;
+    // sync the journal after every batch.
+    bool sync_writes = false;
+    // rewrite the journal once it is this many times the snapshot size ...
+    double compact_ratio = 4.0;
+    // ... and at least this large.
+    std::uint64_t compact_min_bytes = 4u << 20;
+};
+
+struct graph_stats {
+    std::uint64_t vertices = 0; // with at least one out-edge
+    std::uint64_t edges = 0;
+    std::uint64_t blocks = 0;
+    std::uint64_t block_bytes = 0; // encoded gaps, excluding each block's first neighbor
+    std::uint64_t batches = 0;
+    std::uint64_t journal_bytes = 0;
+    std::uint64_t compactions = 0;
+};
+
+class graph {
+    struct block {
+        std::uint64_t first = 0; // smallest neighbor in the block
+        std::uint32_t count = 0;
+        std::string gaps; // count - 1 varints, each the distance from the neighbor before
+    };
+
+public:
+    // reads under one shared lock, for traversals that visit many vertices.
+    class view {
+    public:
+        // calls fn(target) for each out-neighbor of v in ascending order.
+        template <class Fn>
+        void for_each_neighbor(std::uint64_t v, Fn&& fn) const {
+            auto it = g_->adj_.find(v);
+            if (it == g_->adj_.end()) return;
+            for (const block& b : it->second) decode(b, fn);
+        }
+
+        std::uint64_t degree(std::uint64_t v) const {
+            auto it = g_->adj_.find(v);
+            if (it == g_->adj_.end()) return 0;
+            std::uint64_t n = 0;
+            for (const block& b : it->second) n += b.count;
+            return n;
+        }
+
+        bool has_edge(std::uint64_t from, std::uint64_t to) const {
+            auto it = g_->adj_.find(from);
+            if (it == g_->adj_.end()) return false;
+            const std::vector<block>& bs = it->second;
+            auto b = std::upper_bound(bs.begin(), bs.end(), to, [](std::uint64_t t, const block& x) { return t < x.first; });
+            if (b == bs.begin()) return false;
+            bool found = false;
+            decode(*--b, [&](std::uint64_t n) { found |= n == to; });
+            return found;
+        }
+
+        std::vector<std::uint64_t> neighbors(std::uint64_t v) const {
+            std::vector<std::uint64_t> out;
+            out.reserve(static_cast<std::size_t>(degree(v)));
+            for_each_neighbor(v, [&](std::uint64_t n) { out.push_back(n); });
+            return out;
+        }
+
+    private:
+        friend class graph;
+        explicit view(const graph& g) : g_(&g), lock_(g.mu_) {}
+
+        const graph* g_;
+        std::shared_lock<std::shared_mutex> lock_;
+    };
+
+    graph(env& e, std::string dir, graph_options opts = {}) : env_(e), dir_(std::move(dir)), opts_(opts) {
+        if (opts_.block_edges < 2) throw std::invalid_argument("graph: block_edges must be at least 2");
+        env_.create_dir(dir_);
+        recover();
+    }
+
+    ~graph() {
+        try {
+            sync();
+        } catch (const io_error&) {
+        }
+    }
+
+    graph(const graph&) = delete;
+    graph& operator=(const graph&) = delete;
+
+    view read() const { return view(*this); }
+
+    // adds edges, ignoring duplicates and ones already present. returns how
+    // many were new.
+    std::uint64_t add_edges(std::vector<edge> edges) { return update(add_op, std::move(edges)); }
+
+    // erases edges, ignoring ones not present. returns how many were.
+    std::uint64_t erase_edges(std::vector<edge> edges) { return update(erase_op, std::move(edges)); }
+
+    bool add_edge(std::uint64_t from, std::uint64_t to) { return add_edges({{from, to}}) != 0; }
+    bool erase_edge(std::uint64_t from, std::uint64_t to) { return erase_edges({{from, to}}) != 0; }
+
+    bool has_edge(std::uint64_t from, std::uint64_t to) const { return read().has_edge(from, to); }
+    std::uint64_t degree(std::uint64_t v) const { return read().degree(v); }
+    std::vector<std::uint64_t> neighbors(std::uint64_t v) const { return read().neighbors(v); }
+
+    template <class Fn>
+    void for_each_neighbor(std::uint64_t v, Fn&& fn) const {
+        read().for_each_neighbor(v, fn);
+    }
+
+    void sync() {
+        std::unique_lock<std::shared_mutex> g(mu_);
+        journal_->sync();
+    }
+
+    // rewrites the journal as a snapshot of the current graph.
+    void compact() {
+        std::unique_lock<std::shared_mutex> g(mu_);
+        rewrite();
+    }
+
+    graph_stats stats() const {
+        std::shared_lock<std::shared_mutex> g(mu_);
+        graph_stats s;
+        s.vertices = adj_.size();
+        s.edges = edges_;
+        s.blocks = blocks_;
+        s.block_bytes = block_bytes_;
+        s.batches = batches_;
+        s.journal_bytes = journal_->size();
+        s.compactions = compactions_;
+        return s;
+    }
+
+private:
+    static constexpr char add_op = 1, erase_op = 2;
+    static constexpr std::size_t record_header = 13;
+    // edges per record when the journal is rewritten.
+    static constexpr std::size_t snapshot_edges = 1 << 16;
+
+    // calls fn on the block's neighbors in order. blocks are built here, so
+    // their varints are trusted.
+    template <class Fn>
+    static void decode(const block& b, Fn&& fn) {
+        std::uint64_t v = b.first;
+        fn(v);
+        const auto* p = reinterpret_cast<const unsigned char*>(b.gaps.data());
+        const auto* end = p + b.gaps.size();
+        while (p < end) {
+            std::uint64_t gap = *p & 0x7fu;
+            for (unsigned shift = 7; *p++ & 0x80; shift += 7) gap |= std::uint64_t{*p & 0x7fu} << shift;
+            v += gap;
+            fn(v);
+        }
+    }
+
+    std::uint64_t update(char op, std::vector<edge> edges) {
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+        if (edges.empty()) return 0;
+        auto g = lock_within_deadline<std::unique_lock<std::shared_mutex>>(mu_);
+        log(op, edges);
+        std::uint64_t changed = apply(op, edges);
+        ++batches_;
+        maybe_compact();
+        return changed;
+    }
+
+    // caller holds mu_ exclusively; edges are sorted and unique.
+    std::uint64_t apply(char op, const std::vector<edge>& edges) {
+        std::uint64_t changed = 0;
+        for (std::size_t i = 0; i < edges.size();) {
+            std::size_t j = i;
+            targets_.clear();
+            while (j < edges.size() && edges[j].from == edges[i].from) targets_.push_back(edges[j++].to);
+            if (op == add_op) {
+                changed += merge(adj_[edges[i].from], true);
+            } else if (auto it = adj_.find(edges[i].from); it != adj_.end()) {
+                changed += merge(it->second, false);
+                if (it->second.empty()) adj_.erase(it);
+            }
+            i = j;
+        }
+        edges_ = op == add_op ? edges_ + changed : edges_ - changed;
+        return changed;
+    }
+
+    // merges targets_ into a vertex's blocks, or takes them out. each block
+    // covers the neighbors below the next block's first, the first block
+    // everything below too.
+    std::uint64_t merge(std::vector<block>& blocks, bool add) {
+        std::uint64_t changed = 0;
+        rebuilt_.clear();
+        std::size_t i = 0, n = targets_.size();
+        if (blocks.empty() && add) {
+            emit(targets_);
+            changed = n;
+        }
+        for (std::size_t b = 0; b < blocks.size(); ++b) {
+            std::size_t j = n;
+            if (b + 1 < blocks.size()) j = static_cast<std::size_t>(std::lower_bound(targets_.begin() + i, targets_.end(), blocks[b + 1].first) - targets_.begin());
+            if (j == i) {
+                rebuilt_.push_back(std::move(blocks[b]));
+                continue;
+            }
+            old_.clear();
+            decode(blocks[b], [&](std::uint64_t v) { old_.push_back(v); });
+            --blocks_;
+            block_bytes_ -= blocks[b].gaps.size();
+            merged_.clear();
+            if (add) std::set_union(old_.begin(), old_.end(), targets_.begin() + i, targets_.begin() + j, std::back_inserter(merged_));
+            else std::set_difference(old_.begin(), old_.end(), targets_.begin() + i, targets_.begin() + j, std::back_inserter(merged_));
+            changed += add ? merged_.size() - old_.size() : old_.size() - merged_.size();
+            emit(merged_);
+            i = j;
+        }
+        blocks.swap(rebuilt_);
+        return changed;
+    }
+
+    // appends sorted neighbors to rebuilt_ as one block, or as half-full
+    // ones when they do not fit in one.
+    void emit(const std::vector<std::uint64_t>& vs) {
+        std::size_t half = opts_.block_edges / 2;
+        for (std::size_t at = 0; at < vs.size();) {
+            std::size_t left = vs.size() - at;
+            std::size_t take = left <= opts_.block_edges ? left : half;
+            block b;
+            b.first = vs[at];
+            b.count = static_cast<std::uint32_t>(take);
+            for (std::size_t k = at + 1; k < at + take; ++k) put_varint(b.gaps, vs[k] - vs[k - 1]);
+            ++blocks_;
+            block_bytes_ += b.gaps.size();
+            rebuilt_.push_back(std::move(b));
+            at += take;
+        }
+    }
+
+    static void encode(std::string& out, char op, const edge* edges, std::size_t n) {
+        std::size_t at = out.size();
+        out.append(4, '\0');
+        out += op;
+        put_u32(out, static_cast<std::uint32_t>(n));
+        put_u32(out, 0);
+        std::size_t body = out.size();
+        for (std::size_t i = 0; i < n; ++i) {
+            put_varint(out, edges[i].from);
+            put_varint(out, edges[i].to);
+        }
+        std::uint32_t size = static_cast<std::uint32_t>(out.size() - body);
+        for (int i = 0; i < 4; ++i) out[at + 9 + i] = static_cast<char>(size >> (8 * i));
+        std::uint32_t crc = crc32c(std::string_view(out).substr(at + 4));
+        for (int i = 0; i < 4; ++i) out[at + i] = static_cast<char>(crc >> (8 * i));
+    }
+
+    // caller holds mu_ exclusively.
+    void log(char op, const std::vector<edge>& edges) {
+        record_.clear();
+        encode(record_, op, edges.data(), edges.size());
+        journal_->append(record_);
+        if (opts_.sync_writes) journal_->sync();
+    }
+
+    // caller holds mu_ exclusively and has applied every logged batch. a
+    // snapshot costs about two varints an edge.
+    void maybe_compact() {
+        std::uint64_t snapshot = 6 * edges_;
+        if (journal_->size() >= opts_.compact_min_bytes && static_cast<double>(journal_->size()) > opts_.compact_ratio * static_cast<double>(snapshot))
+            rewrite();
+    }
+
+    // caller holds mu_ exclusively.
+    void rewrite() {
+        std::string out;
+        std::vector<edge> chunk;
+        auto flush = [&] {
+            if (!chunk.empty()) encode(out, add_op, chunk.data(), chunk.size());
+            chunk.clear();
+        };
+        for (const auto& v : adj_) {
+            std::uint64_t from = v.first;
+            for (const block& b : v.second) {
+                decode(b, [&](std::uint64_t to) {
+                    chunk.push_back({from, to});
+                    if (chunk.size() == snapshot_edges) flush();
+                });
+            }
+        }
+        flush();
+        std::string tmp = join_path(dir_, "journal.tmp");
+        auto f = env_.open(tmp, open_mode::truncate);
+        f->append(out);
+        f->sync();
+        journal_.reset();
+        env_.rename(tmp, join_path(dir_, "journal"));
+        journal_ = env_.open(join_path(dir_, "journal"), open_mode::read_write);
+        ++compactions_;
+    }
+
+    void recover() {
+        if (env_.exists(join_path(dir_, "journal.tmp"))) env_.remove(join_path(dir_, "journal.tmp"));
+        journal_ = env_.open(join_path(dir_, "journal"), open_mode::create);
+        sequential_reader in(*journal_);
+        std::uint64_t off = 0, end = journal_->size();
+        std::vector<edge> edges;
+        while (off < end) {
+            std::string_view h = in.read(off, record_header);
+            bool ok = h.size() == record_header;
+            std::uint64_t n = ok ? record_header + get_u32(h.data() + 9) : 0;
+            std::string_view rec = ok ? in.read(off, n) : std::string_view();
+            if (!ok || rec.size() != n || get_u32(rec.data()) != crc32c(rec.substr(4))) {
+                journal_->truncate(off);
+                break;
+            }
+            char op = rec[4];
+            std::uint32_t count = get_u32(rec.data() + 5);
+            std::string_view body = rec.substr(record_header);
+            edges.clear();
+            edges.reserve(count);
+            for (std::uint32_t i = 0; i < count; ++i) {
+                edge e{};
+                if (!get_varint(body, e.from) || !get_varint(body, e.to)) throw io_error("graph: bad journal record at " + std::to_string(off));
+                edges.push_back(e);
+            }
+            // rewritten snapshots are in hash order, not sorted.
+            std::sort(edges.begin(), edges.end());
+            apply(op, edges);
+            ++batches_;
+            off += n;
+        }
+    }
+
+    env& env_;
+    std::string dir_;
+    graph_options opts_;
+
+    mutable std::shared_mutex mu_;
+    std::unordered_map<std::uint64_t, std::vector<block>> adj_;
+    std::uint64_t edges_ = 0;
+    std::uint64_t blocks_ = 0;
+    std::uint64_t block_bytes_ = 0;
+    std::uint64_t batches_ = 0;
+    std::uint64_t compactions_ = 0;
+
+    // scratch for apply and merge, under mu_.
+    std::vector<std::uint64_t> targets_, old_, merged_;
+    std::vector<block> rebuilt_;
+
+    std::unique_ptr<file> journal_;
+    std::string record_;
+};
+
+} // namespace dsa
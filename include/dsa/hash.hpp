@@ -0,0 +1,64 @@
+#pragma once
+
+// fast 64-bit hash for keys. not cryptographic; well mixed in every bit, so
+// callers may take bucket numbers from the low bits and tags from the high.
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace dsa {
+
+namespace detail {
+
+inline std::uint64_t hash_mix(std::uint64_t a, std::uint64_t b) {
+    __extension__ using u128 = unsigned __int128;
+    u128 r = static_cast<u128>(a) * b;
+    return static_cast<std::uint64_t>(r) ^ static_cast<std::uint64_t>(r >> 64);
+}
+
+inline std::uint64_t load64(const char* p) {
+    std::uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+}
+
+} // namespace detail
+
+inline std::uint64_t hash64(std::string_view key, std::uint64_t seed = 0) {
+    constexpr std::uint64_t k0 = 0xa0761d6478bd642full, k1 = 0xe7037ed1a0b428dbull, k2 = 0x8ebc6af09c88c6e3ull;
+    const char* p = key.data();
+    std::size_t n = key.size();
+    std::uint64_t h = seed ^ k0 ^ detail::hash_mix(seed ^ k1, n ^ k2);
+    while (n >= 16) {
+        h = detail::hash_mix(detail::load64(p) ^ k1, detail::load64(p + 8) ^ h);
+        p += 16;
+        n -= 16;
+    }
+    std::uint64_t a = 0, b = 0;
+    if (n >= 8) {
+        a = detail::load64(p);
+        b = detail::load64(p + n - 8);
+    } else if (n >= 4) {
+        std::uint32_t x, y;
+        std::memcpy(&x, p, 4);
+        std::memcpy(&y, p + n - 4, 4);
+        a = x;
+        b = y;
+    } else if (n > 0) {
+        a = std::uint64_t{static_cast<unsigned char>(p[0])} << 16 | std::uint64_t{static_cast<unsigned char>(p[n / 2])} << 8 |
+            static_cast<unsigned char>(p[n - 1]);
+    }
+    return detail::hash_mix(k1 ^ key.size(), detail::hash_mix(a ^ k1, b ^ h));
+}
+
+// final avalanche for integer keys.
+inline std::uint64_t hash64(std::uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    return x ^ (x >> 33);
+}
+
+} // namespace dsa
@@ -0,0 +1,80 @@
+#pragma once
+
+// log-linear histogram for latencies and sizes. each power of two is split
+// into 16 sub-buckets, so reported percentiles are within ~6% of the truth
+// over the whole 64-bit range at a fixed 8 KiB footprint.
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+
+namespace dsa {
+
+class histogram {
+public:
+    static constexpr unsigned sub_bits = 4;
+    static constexpr unsigned sub_count = 1u << sub_bits;
+    static constexpr unsigned bucket_count = (64 - sub_bits + 1) * sub_count;
+
+    void record(std::uint64_t v, std::uint64_t n = 1) {
+        counts_[bucket_of(v)] += n;
+        count_ += n;
+        sum_ += v * n;
+        min_ = std::min(min_, v);
+        max_ = std::max(max_, v);
+    }
+
+    void merge(const histogram& o) {
+        for (unsigned i = 0; i < bucket_count; ++i) counts_[i] += o.counts_[i];
+        count_ += o.count_;
+        sum_ += o.sum_;
+        min_ = std::min(min_, o.min_);
+        max_ = std::max(max_, o.max_);
+    }
+
+    void clear() { *this = histogram(); }
+
+    std::uint64_t count() const { return count_; }
+    std::uint64_t sum() const { return sum_; }
+    std::uint64_t min() const { return count_ ? min_ : 0; }
+    std::uint64_t max() const { return max_; }
+    double mean() const { return count_ ? static_cast<double>(sum_) / static_cast<double>(count_) : 0.0; }
+
+    // value at percentile p in [0, 100], reported as the upper bound of the
+    // bucket it falls in and clamped to the observed range.
+    std::uint64_t percentile(double p) const {
+        if (!count_) return 0;
+        auto rank = static_cast<std::uint64_t>(p / 100.0 * static_cast<double>(count_) + 0.5);
+        rank = std::clamp<std::uint64_t>(rank, 1, count_);
+        std::uint64_t seen = 0;
+        for (unsigned i = 0; i < bucket_count; ++i) {
+            seen += counts_[i];
+            if (seen >= rank) return std::clamp(upper_bound_of(i), min(), max_);
+        }
+        return max_;
+    }
+
+    static unsigned bucket_of(std::uint64_t v) {
+        if (v < sub_count) return static_cast<unsigned>(v);
+        unsigned msb = 63u - static_cast<unsigned>(__builtin_clzll(v));
+        unsigned shift = msb - sub_bits;
+        return (shift + 1) * sub_count + static_cast<unsigned>((v >> shift) & (sub_count - 1));
+    }
+
+    static std::uint64_t upper_bound_of(unsigned bucket) {
+        if (bucket < sub_count) return bucket;
+        unsigned shift = bucket / sub_count - 1;
+        std::uint64_t base = (std::uint64_t{1} << (shift + sub_bits)) | (std::uint64_t{bucket % sub_count} << shift);
+        return base + ((std::uint64_t{1} << shift) - 1);
+    }
+
+private:
+    std::array<std::uint64_t, bucket_count> counts_{};
+    std::uint64_t count_ = 0;
+    std::uint64_t sum_ = 0;
+    std::uint64_t min_ = std::numeric_limits<std::uint64_t>::max();
+    std::uint64_t max_ = 0;
+};
+
+} // namespace dsa
@@ -0,0 +1,334 @@
+#pragma once
+
+// hybrid-log store in the style of faster. a hash index maps each bucket to
+// the newest record in a chain threaded through the log by each record's
+// previous address. the log is one logical address space in three regions:
+//
+//   [begin, head)      on disk, read with pread
+//   [head, read_only)  in memory, immutable, already flushed
+//   [read_only, tail)  in memory, updated in place
+//
+// an update to a record in the mutable region overwrites it in place; any
+// other update appends a copy at the tail (read-copy-update). as the tail
+// moves on, pages turn read-only, get flushed and are eventually evicted,
+// so hot keys update at memory speed while capacity is bounded by disk.
+//
+// the on-disk log is spill space for evicted pages, not a recovery log:
+// opening a store starts from an empty log.
+
+#include "env.hpp"
+#include "hash.hpp"
+#include "lock.hpp"
+#include "store.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+namespace dsa {
+
+struct hlog_options {
+    std::uint64_t page_size = 1u << 20;      // power of two; records must be smaller
+    std::uint64_t memory_pages = 64;         // in-memory part of the log, at least 2 pages
+    double mutable_fraction = 0.9;           // of the in-memory pages
+    std::uint64_t index_buckets = 1u << 20;  // power of two
+};
+
+struct hlog_stats {
+    std::uint64_t in_place_updates = 0;
+    std::uint64_t copy_updates = 0;
+    std::uint64_t disk_reads = 0;
+    std::uint64_t pages_flushed = 0;
+    std::uint64_t head = 0;
+    std::uint64_t read_only = 0;
+    std::uint64_t tail = 0;
+    lock_stats bucket_locks; // all index stripes together
+    lock_stats alloc_lock;   // log tail allocation and page turnover
+};
+
+class hlog_store : public store {
+public:
+    hlog_store(env& e, const std::string& dir, hlog_options opts = {})
+        : opts_(validate(opts)), page_bits_(static_cast<unsigned>(__builtin_ctzll(opts.page_size))),
+          mutable_pages_(std::clamp<std::uint64_t>(static_cast<std::uint64_t>(static_cast<double>(opts.memory_pages) * opts.mutable_fraction), 1,
+                                                   opts.memory_pages - 1)),
+          index_(opts.index_buckets, 0) {
+        e.create_dir(dir);
+        log_ = e.open(join_path(dir, "hlog"), open_mode::truncate);
+        frames_.resize(opts.memory_pages);
+        for (auto& f : frames_) f = std::make_unique<char[]>(opts.page_size);
+    }
+
+    void put(std::string_view key, std::string_view value) override {
+        upsert(key, static_cast<std::uint32_t>(value.size()), [&](char* dst, const char*, std::uint32_t) {
+            std::memcpy(dst, value.data(), value.size());
+        });
+    }
+
+    // adds delta to the 8-byte little-endian counter at key, treating a
+    // missing key as zero, and returns the new value.
+    std::int64_t add(std::string_view key, std::int64_t delta) {
+        std::int64_t result = 0;
+        upsert(key, 8, [&](char* dst, const char* old, std::uint32_t old_size) {
+            std::int64_t v = 0;
+            if (old && old_size == 8) std::memcpy(&v, old, 8);
+            result = v + delta;
+            std::memcpy(dst, &result, 8);
+        });
+        return result;
+    }
+
+    bool get(std::string_view key, std::string& value) override { return get_into(key, value); }
+    bool get(std::string_view key, std::pmr::string& value) override { return get_into(key, value); }
+
+    bool erase(std::string_view key) override {
+        std::size_t b = hash64(key) & (opts_.index_buckets - 1);
+        std::lock_guard<adaptive_mutex> s(stripe(b));
+        std::shared_lock<std::shared_mutex> region(region_mu_);
+        located loc = find(key, index_[b], region);
+        if (!loc.addr || loc.hdr.flags & tombstone) return false;
+        if (!region.owns_lock()) region.lock();
+        if (loc.mem && loc.addr >= read_only_) {
+            loc.mem->flags |= tombstone;
+            in_place_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        std::uint64_t addr = allocate(record_size(key.size(), 0), region);
+        write_header(addr, index_[b], key, 0, 0, tombstone);
+        index_[b] = addr;
+        copies_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    hlog_stats stats() const {
+        hlog_stats s;
+        s.in_place_updates = in_place_.load(std::memory_order_relaxed);
+        s.copy_updates = copies_.load(std::memory_order_relaxed);
+        s.disk_reads = disk_reads_.load(std::memory_order_relaxed);
+        s.tail = tail_.load(std::memory_order_relaxed);
+        s.bucket_locks = merged_lock_stats(stripes_.begin(), stripes_.end());
+        s.alloc_lock = alloc_mu_.stats();
+        std::lock_guard<adaptive_mutex> a(alloc_mu_);
+        s.pages_flushed = flushed_pages_;
+        std::shared_lock<std::shared_mutex> region(region_mu_);
+        s.head = head_;
+        s.read_only = read_only_;
+        return s;
+    }
+
+private:
+    // get for std::string and std::pmr::string values alike.
+    template <class String>
+    bool get_into(std::string_view key, String& value) {
+        std::size_t b = hash64(key) & (opts_.index_buckets - 1);
+        std::lock_guard<adaptive_mutex> s(stripe(b));
+        std::shared_lock<std::shared_mutex> region(region_mu_);
+        located loc = find(key, index_[b], region);
+        if (!loc.addr || loc.hdr.flags & tombstone) return false;
+        value.assign(loc.value(key.size()), loc.hdr.value_size);
+        return true;
+    }
+
+    static constexpr std::uint32_t tombstone = 1;
+    static constexpr std::size_t stripe_count = 1024;
+    // address 0 is the null address, so the log starts just past it.
+    static constexpr std::uint64_t first_address = 8;
+
+    struct record_header {
+        std::uint64_t prev;
+        std::uint32_t key_size;
+        std::uint32_t value_size;
+        std::uint32_t capacity; // bytes reserved for the value
+        std::uint32_t flags;
+    };
+    static_assert(sizeof(record_header) == 24);
+
+    // a record found by find(): either in memory, or copied off disk.
+    struct located {
+        std::uint64_t addr = 0;
+        record_header hdr{};
+        record_header* mem = nullptr;
+        std::string disk;
+
+        const char* value(std::size_t key_size) const {
+            const char* base = mem ? reinterpret_cast<const char*>(mem) : disk.data();
+            return base + sizeof(record_header) + key_size;
+        }
+    };
+
+    static const hlog_options& validate(const hlog_options& o) {
+        if (o.page_size & (o.page_size - 1) || o.page_size < 4096) throw std::invalid_argument("hlog: page_size must be a power of two >= 4096");
+        if (!o.index_buckets || o.index_buckets & (o.index_buckets - 1)) throw std::invalid_argument("hlog: index_buckets must be a power of two");
+        if (o.memory_pages < 2) throw std::invalid_argument("hlog: memory_pages must be at least 2");
+        return o;
+    }
+
+    static std::uint64_t record_size(std::size_t key_size, std::uint32_t capacity) {
+        return (sizeof(record_header) + key_size + capacity + 7) & ~std::uint64_t{7};
+    }
+
+    adaptive_mutex& stripe(std::size_t bucket) { return stripes_[bucket % stripe_count]; }
+
+    char* frame(std::uint64_t addr) {
+        return frames_[(addr >> page_bits_) % opts_.memory_pages].get() + (addr & (opts_.page_size - 1));
+    }
+
+    // walks the chain from addr for the newest record of key. the caller
+    // holds the key's stripe and region; region is released once the walk
+    // goes below head, since everything there is immutable on disk.
+    located find(std::string_view key, std::uint64_t addr, std::shared_lock<std::shared_mutex>& region) {
+        located loc;
+        while (addr >= first_address && addr >= head_) {
+            auto* h = reinterpret_cast<record_header*>(frame(addr));
+            if (h->key_size == key.size() && std::memcmp(h + 1, key.data(), key.size()) == 0) {
+                loc.addr = addr;
+                loc.hdr = *h;
+                loc.mem = h;
+                return loc;
+            }
+            addr = h->prev;
+        }
+        if (addr < first_address) return loc;
+        region.unlock();
+        while (addr >= first_address) {
+            read_disk(addr, loc.disk);
+            std::memcpy(&loc.hdr, loc.disk.data(), sizeof loc.hdr);
+            if (loc.hdr.key_size == key.size() && std::memcmp(loc.disk.data() + sizeof loc.hdr, key.data(), key.size()) == 0) {
+                loc.addr = addr;
+                return loc;
+            }
+            addr = loc.hdr.prev;
+        }
+        return located{};
+    }
+
+    // reads the header, key and value of the record at addr, usually in one
+    // pread by guessing a size that covers small records.
+    void read_disk(std::uint64_t addr, std::string& out) {
+        std::uint64_t room = opts_.page_size - (addr & (opts_.page_size - 1));
+        out.resize(std::min<std::uint64_t>(512, room));
+        read_exact(*log_, addr, out.data(), out.size());
+        disk_reads_.fetch_add(1, std::memory_order_relaxed);
+        record_header h;
+        std::memcpy(&h, out.data(), sizeof h);
+        std::size_t need = sizeof h + h.key_size + h.value_size;
+        if (need > out.size()) {
+            out.resize(need);
+            read_exact(*log_, addr, out.data(), need);
+            disk_reads_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // in place if the key's newest record is mutable and big enough,
+    // otherwise a new record at the tail. fill(dst, old, old_size) writes
+    // the new value; old is null for a missing key.
+    template <class Fill>
+    void upsert(std::string_view key, std::uint32_t size, Fill fill) {
+        std::size_t b = hash64(key) & (opts_.index_buckets - 1);
+        std::lock_guard<adaptive_mutex> s(stripe(b));
+        std::shared_lock<std::shared_mutex> region(region_mu_);
+        located loc = find(key, index_[b], region);
+        bool live = loc.addr && !(loc.hdr.flags & tombstone);
+        if (region.owns_lock() && live && loc.mem && loc.addr >= read_only_ && loc.hdr.capacity >= size) {
+            char* v = const_cast<char*>(loc.value(key.size()));
+            fill(v, v, loc.hdr.value_size);
+            loc.mem->value_size = size;
+            in_place_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        // the old value can be evicted while allocate() waits on a page
+        // turnover, so keep a copy.
+        std::string old;
+        if (live) old.assign(loc.value(key.size()), loc.hdr.value_size);
+        if (!region.owns_lock()) region.lock();
+        std::uint32_t capacity = (size + 7) & ~7u;
+        std::uint64_t addr = allocate(record_size(key.size(), capacity), region);
+        char* v = write_header(addr, index_[b], key, size, capacity, 0);
+        fill(v, live ? old.data() : nullptr, static_cast<std::uint32_t>(old.size()));
+        index_[b] = addr;
+        copies_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    char* write_header(std::uint64_t addr, std::uint64_t prev, std::string_view key, std::uint32_t size,
+                       std::uint32_t capacity, std::uint32_t flags) {
+        char* p = frame(addr);
+        record_header h{prev, static_cast<std::uint32_t>(key.size()), size, capacity, flags};
+        std::memcpy(p, &h, sizeof h);
+        std::memcpy(p + sizeof h, key.data(), key.size());
+        return p + sizeof h + key.size();
+    }
+
+    // reserves n bytes at the tail. returns with region held, so the
+    // reserved bytes stay mutable until the caller lets go of it.
+    std::uint64_t allocate(std::uint64_t n, std::shared_lock<std::shared_mutex>& region) {
+        if (n >= opts_.page_size) throw std::length_error("hlog: record does not fit a page");
+        while (true) {
+            std::uint64_t t = tail_.load(std::memory_order_acquire);
+            // strictly less: the tail may only reach a page boundary through
+            // open_page(), which readies the frame first.
+            if ((t & (opts_.page_size - 1)) + n < opts_.page_size) {
+                if (tail_.compare_exchange_weak(t, t + n, std::memory_order_acq_rel)) return t;
+                continue;
+            }
+            region.unlock();
+            {
+                std::lock_guard<adaptive_mutex> a(alloc_mu_);
+                std::uint64_t page = t >> page_bits_;
+                if (tail_.load(std::memory_order_acquire) >> page_bits_ == page) open_page(page + 1);
+            }
+            region.lock();
+        }
+    }
+
+    // moves the tail onto page q: shifts the read-only boundary so only
+    // mutable_pages_ stay updatable, flushes what just became immutable and
+    // evicts the page whose frame q reuses. caller holds alloc_mu_.
+    void open_page(std::uint64_t q) {
+        if (q > mutable_pages_) {
+            std::uint64_t ro_page = q - mutable_pages_;
+            {
+                std::unique_lock<std::shared_mutex> x(region_mu_);
+                read_only_ = std::max(read_only_, ro_page << page_bits_);
+            }
+            for (; flushed_pages_ < ro_page; ++flushed_pages_)
+                log_->write(flushed_pages_ << page_bits_, std::string_view(frame(flushed_pages_ << page_bits_), opts_.page_size));
+        }
+        if (q >= opts_.memory_pages) {
+            std::unique_lock<std::shared_mutex> x(region_mu_);
+            head_ = std::max(head_, (q - opts_.memory_pages + 1) << page_bits_);
+        }
+        // close the old page for good: its unused end is never allocated.
+        std::uint64_t t = tail_.load(std::memory_order_acquire);
+        while ((t >> page_bits_) < q && !tail_.compare_exchange_weak(t, q << page_bits_, std::memory_order_acq_rel)) {}
+    }
+
+    hlog_options opts_;
+    unsigned page_bits_;
+    std::uint64_t mutable_pages_;
+    std::unique_ptr<file> log_;
+    std::vector<std::unique_ptr<char[]>> frames_;
+
+    // index_[b] is guarded by the stripe covering b.
+    std::vector<std::uint64_t> index_;
+    std::array<adaptive_mutex, stripe_count> stripes_;
+
+    // held shared by every operation touching in-memory records, exclusive
+    // to move the read-only and head boundaries.
+    mutable std::shared_mutex region_mu_;
+    std::uint64_t head_ = 0;
+    std::uint64_t read_only_ = 0;
+    std::atomic<std::uint64_t> tail_{first_address};
+
+    mutable adaptive_mutex alloc_mu_;
+    std::uint64_t flushed_pages_ = 0;
+
+    std::atomic<std::uint64_t> in_place_{0};
+    std::atomic<std::uint64_t> copies_{0};
+    std::atomic<std::uint64_t> disk_reads_{0};
+};
+
+} // namespace dsa
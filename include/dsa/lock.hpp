@@ -0,0 +1,191 @@
+#pragma once
+
+// adaptive_mutex: the engines' internal exclusive lock. a taker that finds
+// it held spins briefly, since most critical sections here are short, and
+// then parks on a futex until the holder wakes it (elsewhere it yields).
+//
+// each mutex profiles itself: acquisitions, how many had to wait, wait
+// times and hold times. everything is written by the thread holding the
+// lock, so the uncontended path adds one relaxed counter store to the
+// compare-and-swap; the clock is read only by waiters and for one
+// acquisition in hold_sample_every. engines report their locks' profiles
+// in their stats, merged per site for striped locks.
+//
+// wait and hold times come from the steady clock, not an env: they measure
+// the host, also under a simulated env.
+
+#include "histogram.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace dsa {
+
+struct lock_stats {
+    std::uint64_t acquisitions = 0;
+    std::uint64_t contended = 0; // acquisitions that found the lock held
+    std::uint64_t parked = 0;    // of those, ones that slept after spinning
+    std::uint64_t wait_ns = 0;   // total over contended acquisitions
+    histogram wait;              // ns, every contended acquisition
+    histogram hold;              // ns, one acquisition in hold_sample_every
+
+    void merge(const lock_stats& o) {
+        acquisitions += o.acquisitions;
+        contended += o.contended;
+        parked += o.parked;
+        wait_ns += o.wait_ns;
+        wait.merge(o.wait);
+        hold.merge(o.hold);
+    }
+};
+
+class adaptive_mutex {
+public:
+    static constexpr std::uint32_t hold_sample_every = 64;
+    static constexpr unsigned spin_limit = 100;
+
+    adaptive_mutex() = default;
+    adaptive_mutex(const adaptive_mutex&) = delete;
+    adaptive_mutex& operator=(const adaptive_mutex&) = delete;
+
+    void lock() {
+        std::uint32_t c = 0;
+        if (!state_.compare_exchange_strong(c, 1, std::memory_order_acquire, std::memory_order_relaxed)) lock_slow(c);
+        acquired();
+    }
+
+    bool try_lock() {
+        std::uint32_t c = 0;
+        if (!state_.compare_exchange_strong(c, 1, std::memory_order_acquire, std::memory_order_relaxed)) return false;
+        acquired();
+        return true;
+    }
+
+    void unlock() {
+        if (held_since_) {
+            record(hold_, now() - held_since_);
+            held_since_ = 0;
+        }
+        if (state_.exchange(0, std::memory_order_release) == 2) wake();
+    }
+
+    // a consistent enough snapshot: counters may be a few acquisitions
+    // apart, never torn.
+    lock_stats stats() const {
+        lock_stats s;
+        s.acquisitions = acquisitions_.load(std::memory_order_relaxed);
+        s.contended = contended_.load(std::memory_order_relaxed);
+        s.parked = parked_.load(std::memory_order_relaxed);
+        s.wait_ns = wait_ns_.load(std::memory_order_relaxed);
+        replay(wait_, s.wait);
+        replay(hold_, s.hold);
+        return s;
+    }
+
+private:
+    // power-of-two buckets, the last open-ended: a mutex cannot afford a
+    // full histogram, and which lock waits 1 us against 1 ms is the question.
+    static constexpr unsigned log_buckets = 32;
+    using log_histogram = std::array<std::atomic<std::uint64_t>, log_buckets>;
+
+    static std::uint64_t now() {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    // the counters only change under the lock, so a load and a store do
+    // where an atomic add would cost a locked instruction.
+    static void bump(std::atomic<std::uint64_t>& a, std::uint64_t n = 1) {
+        a.store(a.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    static void record(log_histogram& h, std::uint64_t ns) {
+        unsigned b = ns ? 64u - static_cast<unsigned>(__builtin_clzll(ns)) : 0;
+        bump(h[std::min(b, log_buckets - 1)]);
+    }
+
+    // each bucket is reported at its midpoint.
+    static void replay(const log_histogram& h, histogram& out) {
+        for (unsigned b = 0; b < log_buckets; ++b) {
+            std::uint64_t n = h[b].load(std::memory_order_relaxed);
+            if (n) out.record(b ? (std::uint64_t{3} << b) / 4 : 0, n);
+        }
+    }
+
+    void acquired() {
+        std::uint64_t n = acquisitions_.load(std::memory_order_relaxed) + 1;
+        acquisitions_.store(n, std::memory_order_relaxed);
+        if (n % hold_sample_every == 0) held_since_ = now();
+    }
+
+    // c is the state the fast path saw: 1 held, 2 held with sleepers.
+    void lock_slow(std::uint32_t c) {
+        stage_scope wait(stage::lock_wait);
+        std::uint64_t t0 = now();
+        bool parked = false;
+        for (unsigned i = 0; i < spin_limit && c != 2; ++i) {
+            pause();
+            c = state_.load(std::memory_order_relaxed);
+            if (c == 0 && state_.compare_exchange_weak(c, 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+                waited(now() - t0, parked);
+                return;
+            }
+        }
+        // from here on take it as 2: whoever holds it may leave sleepers.
+        while (state_.exchange(2, std::memory_order_acquire) != 0) {
+            parked = true;
+            park();
+        }
+        waited(now() - t0, parked);
+    }
+
+    void waited(std::uint64_t ns, bool parked) {
+        bump(contended_);
+        bump(wait_ns_, ns);
+        if (parked) bump(parked_);
+        record(wait_, ns);
+    }
+
+    static void pause() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+
+#if defined(__linux__)
+    void park() { syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&state_), FUTEX_WAIT_PRIVATE, 2, nullptr, nullptr, 0); }
+    void wake() { syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&state_), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0); }
+#else
+    void park() { std::this_thread::yield(); }
+    void wake() {}
+#endif
+
+    static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t), "futex word");
+    std::atomic<std::uint32_t> state_{0}; // 0 free, 1 held, 2 held and maybe sleepers
+    std::uint64_t held_since_ = 0;        // holder's sampled start, or 0
+    std::atomic<std::uint64_t> acquisitions_{0}, contended_{0}, parked_{0}, wait_ns_{0};
+    log_histogram wait_{}, hold_{};
+};
+
+// merges the profiles of a run of mutexes, e.g. a lock stripe array.
+template <class It>
+lock_stats merged_lock_stats(It first, It last) {
+    lock_stats s;
+    for (; first != last; ++first) s.merge(first->stats());
+    return s;
+}
+
+} // namespace dsa
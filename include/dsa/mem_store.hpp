@@ -0,0 +1,353 @@
+#pragma once
+
+// volatile hash store in memory: hash maps split into stripes by key hash,
+// each behind its own reader-writer lock so unrelated keys do not contend.
+// nothing survives the process; use it as a baseline, or as the memory
+// tier in front of a durable store.
+//
+// values can be kept compressed once they go cold. every key counts the
+// sweeps since it was last touched; a sweep packs the values of keys idle
+// for cold_after sweeps into pages of about cold_page_size bytes and
+// compresses each page as a whole, so similar values share one dictionary.
+// reading a cold value decompresses its page and promotes the value back
+// to plain form. a page is freed once none of its values is left, and
+// repacked once more than half of its bytes belong to promoted or
+// overwritten values. values of a page that would save too little are
+// marked incompressible and left plain, out of later pages, until they are
+// overwritten.
+
+#include "compress.hpp"
+#include "deadline.hpp"
+#include "hash.hpp"
+#include "sample.hpp"
+#include "store.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace dsa {
+
+struct mem_store_options {
+    std::uint32_t stripes = 64; // power of two
+    // compress values idle for this many sweeps, at most 255. 0 never
+    // compresses.
+    std::uint32_t cold_after = 0;
+    // uncompressed bytes packed into one cold page.
+    std::uint32_t cold_page_size = 4 << 10;
+    // sweep this often on a background thread while cold_after is set. 0
+    // leaves sweeping to the caller.
+    std::uint64_t sweep_interval_ms = 1000;
+};
+
+struct mem_store_stats {
+    std::uint64_t keys = 0;
+    // key and value bytes, compressed pages included, plus an estimate of
+    // the map's own overhead.
+    std::uint64_t bytes = 0;
+    std::uint64_t cold_keys = 0;
+    std::uint64_t cold_value_bytes = 0; // uncompressed size of cold values
+    std::uint64_t cold_page_bytes = 0;  // what they take compressed
+    std::uint64_t pages = 0;
+    std::uint64_t sweeps = 0;
+    std::uint64_t promotions = 0; // cold values read back
+};
+
+class mem_store : public store {
+public:
+    // estimated bytes the map spends per entry besides the key and value:
+    // the node, its two string headers, the cold page fields and a bucket
+    // slot.
+    static constexpr std::uint64_t entry_overhead = 2 * sizeof(std::string) + 16 + 3 * sizeof(void*);
+
+    explicit mem_store(mem_store_options opts = {}) : opts_(opts), mask_(opts.stripes - 1) {
+        if (!opts.stripes || (opts.stripes & (opts.stripes - 1))) throw std::invalid_argument("mem_store: stripes must be a power of two");
+        if (opts.cold_after > 255) throw std::invalid_argument("mem_store: cold_after must be at most 255");
+        stripes_ = std::make_unique<stripe[]>(opts.stripes);
+        if (opts_.cold_after && opts_.sweep_interval_ms) sweeper_ = std::thread([this] { sweep_loop(); });
+    }
+
+    ~mem_store() override {
+        if (sweeper_.joinable()) {
+            {
+                std::lock_guard<std::mutex> g(bg_mu_);
+                stop_ = true;
+            }
+            bg_cv_.notify_one();
+            sweeper_.join();
+        }
+    }
+
+    mem_store(const mem_store&) = delete;
+    mem_store& operator=(const mem_store&) = delete;
+
+    void put(std::string_view key, std::string_view value) override {
+        stripe& s = stripe_for(key);
+        auto g = lock_within_deadline<std::unique_lock<std::shared_mutex>>(s.mu);
+        auto [it, added] = s.map.try_emplace(std::string(key));
+        entry& e = it->second;
+        if (added) {
+            keys_.fetch_add(1, std::memory_order_relaxed);
+            bytes_.fetch_add(key.size() + entry_overhead, std::memory_order_relaxed);
+        } else {
+            if (e.page != no_page) detach(s, e);
+            bytes_.fetch_sub(e.value.size(), std::memory_order_relaxed);
+            e.idle.store(0, std::memory_order_relaxed);
+            e.incompressible = false;
+        }
+        e.value.assign(value);
+        bytes_.fetch_add(value.size(), std::memory_order_relaxed);
+    }
+
+    bool get(std::string_view key, std::string& value) override { return get_into(key, value); }
+    bool get(std::string_view key, std::pmr::string& value) override { return get_into(key, value); }
+
+    bool erase(std::string_view key) override {
+        stripe& s = stripe_for(key);
+        auto g = lock_within_deadline<std::unique_lock<std::shared_mutex>>(s.mu);
+        auto it = s.map.find(std::string(key));
+        if (it == s.map.end()) return false;
+        if (it->second.page != no_page) detach(s, it->second);
+        keys_.fetch_sub(1, std::memory_order_relaxed);
+        bytes_.fetch_sub(key.size() + it->second.value.size() + entry_overhead, std::memory_order_relaxed);
+        s.map.erase(it);
+        return true;
+    }
+
+    // the stripes are sampled as one table, so stripes of different sizes
+    // stay fair. keys drawn are not counted as accessed.
+    std::vector<std::string> sample(std::size_t n, std::uint64_t seed) override {
+        if (!keys_.load(std::memory_order_relaxed)) return {};
+        std::vector<std::size_t> ends(mask_ + 1);
+        std::size_t buckets = 0;
+        for (std::uint64_t i = 0; i <= mask_; ++i) {
+            std::shared_lock<std::shared_mutex> g(stripes_[i].mu);
+            ends[i] = buckets += stripes_[i].map.bucket_count();
+        }
+        return sample_buckets(n, seed, ends, [&](std::size_t i, auto&& fn) {
+            auto g = lock_within_deadline<std::shared_lock<std::shared_mutex>>(stripes_[i].mu);
+            fn(stripes_[i].map);
+        });
+    }
+
+    std::uint64_t key_count() override { return keys_.load(std::memory_order_relaxed); }
+
+    // ages every plain value by one sweep and compresses those that have
+    // gone cold, one stripe at a time. runs on the background thread unless
+    // sweep_interval_ms is 0; a no-op while cold_after is 0.
+    void sweep() {
+        if (!opts_.cold_after) return;
+        deadline_exempt whole;
+        for (std::uint64_t i = 0; i <= mask_; ++i) {
+            std::unique_lock<std::shared_mutex> g(stripes_[i].mu);
+            sweep_stripe(stripes_[i]);
+        }
+        sweeps_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    mem_store_stats stats() const {
+        mem_store_stats st;
+        st.keys = keys_.load(std::memory_order_relaxed);
+        st.bytes = bytes_.load(std::memory_order_relaxed);
+        st.cold_keys = cold_keys_.load(std::memory_order_relaxed);
+        st.cold_value_bytes = cold_value_bytes_.load(std::memory_order_relaxed);
+        st.cold_page_bytes = cold_page_bytes_.load(std::memory_order_relaxed);
+        st.pages = pages_.load(std::memory_order_relaxed);
+        st.sweeps = sweeps_.load(std::memory_order_relaxed);
+        st.promotions = promotions_.load(std::memory_order_relaxed);
+        return st;
+    }
+
+private:
+    // get for std::string and std::pmr::string values alike.
+    template <class String>
+    bool get_into(std::string_view key, String& value) {
+        stripe& s = stripe_for(key);
+        // the lookup key goes through a reused buffer: a std::string per
+        // call would hit the heap for any key past the short-string size.
+        thread_local std::string k;
+        k.assign(key);
+        {
+            auto g = lock_within_deadline<std::shared_lock<std::shared_mutex>>(s.mu);
+            auto it = s.map.find(k);
+            if (it == s.map.end()) return false;
+            entry& e = it->second;
+            if (e.idle.load(std::memory_order_relaxed)) e.idle.store(0, std::memory_order_relaxed);
+            if (e.page == no_page) {
+                value.assign(e.value);
+                return true;
+            }
+        }
+        // cold: promoting it changes the entry, which needs the stripe alone.
+        auto g = lock_within_deadline<std::unique_lock<std::shared_mutex>>(s.mu);
+        auto it = s.map.find(k);
+        if (it == s.map.end()) return false;
+        entry& e = it->second;
+        if (e.page != no_page) {
+            // only the page up to the value is needed.
+            promote(s, e, decompress(s.pages[e.page].data, e.offset + e.size));
+            promotions_.fetch_add(1, std::memory_order_relaxed);
+        }
+        value.assign(e.value);
+        return true;
+    }
+
+    static constexpr std::uint32_t no_page = ~0u;
+
+    struct entry {
+        std::string value; // empty while cold
+        // sweeps since the last access. readers sharing the stripe reset
+        // it, so it is atomic; everything else changes under the stripe
+        // lock held exclusively.
+        std::atomic<std::uint8_t> idle{0};
+        // the value was in a page pack turned down; it stays plain until
+        // put replaces it.
+        bool incompressible = false;
+        std::uint32_t page = no_page;
+        std::uint32_t offset = 0, size = 0; // within the page, uncompressed
+    };
+
+    struct page {
+        std::string data; // compressed
+        std::uint32_t raw_size = 0;
+        std::uint32_t live = 0; // values still cold in it
+        std::uint64_t live_bytes = 0;
+    };
+
+    struct stripe {
+        std::shared_mutex mu;
+        std::unordered_map<std::string, entry> map;
+        std::vector<page> pages;
+        std::vector<std::uint32_t> free_pages;
+    };
+
+    stripe& stripe_for(std::string_view key) { return stripes_[hash64(key) & mask_]; }
+
+    // the caller holds s.mu exclusively in this and everything below.
+
+    // drops e's claim on its page, freeing the page once nothing is left.
+    void detach(stripe& s, entry& e) {
+        page& p = s.pages[e.page];
+        --p.live;
+        p.live_bytes -= e.size;
+        cold_keys_.fetch_sub(1, std::memory_order_relaxed);
+        cold_value_bytes_.fetch_sub(e.size, std::memory_order_relaxed);
+        if (!p.live) {
+            bytes_.fetch_sub(p.data.size(), std::memory_order_relaxed);
+            cold_page_bytes_.fetch_sub(p.data.size(), std::memory_order_relaxed);
+            pages_.fetch_sub(1, std::memory_order_relaxed);
+            std::string().swap(p.data);
+            s.free_pages.push_back(e.page);
+        }
+        e.page = no_page;
+    }
+
+    // raw is e's page decompressed.
+    void promote(stripe& s, entry& e, const std::string& raw) {
+        e.value.assign(raw, e.offset, e.size);
+        bytes_.fetch_add(e.size, std::memory_order_relaxed);
+        detach(s, e);
+    }
+
+    void sweep_stripe(stripe& s) {
+        // values on mostly dead pages go back to plain form first, to be
+        // packed again below with the rest.
+        std::vector<bool> sparse(s.pages.size());
+        for (std::size_t i = 0; i < s.pages.size(); ++i) sparse[i] = s.pages[i].live && s.pages[i].live_bytes * 2 < s.pages[i].raw_size;
+        std::vector<std::string> unpacked(s.pages.size());
+        std::vector<std::pair<const std::string*, entry*>> cold;
+        for (auto& [key, e] : s.map) {
+            if (e.page != no_page && sparse[e.page]) {
+                std::string& raw = unpacked[e.page];
+                if (raw.empty()) raw = decompress(s.pages[e.page].data);
+                promote(s, e, raw);
+            }
+            if (e.page != no_page) continue;
+            std::uint8_t idle = e.idle.load(std::memory_order_relaxed);
+            if (idle < 255) e.idle.store(++idle, std::memory_order_relaxed);
+            if (idle >= opts_.cold_after && !e.value.empty() && !e.incompressible) cold.emplace_back(&key, &e);
+        }
+        std::string raw;
+        std::size_t first = 0;
+        for (std::size_t i = 0; i < cold.size(); ++i) {
+            raw += cold[i].second->value;
+            if (raw.size() >= opts_.cold_page_size || i + 1 == cold.size()) {
+                pack(s, raw, cold.data() + first, cold.data() + i + 1);
+                raw.clear();
+                first = i + 1;
+            }
+        }
+    }
+
+    // compresses the values of [from, to), whose concatenation is raw, into
+    // one page. pages saving under an eighth are not worth a decompression
+    // per read, so their values stay plain, marked so later sweeps do not
+    // compress them again.
+    void pack(stripe& s, const std::string& raw, std::pair<const std::string*, entry*>* from, std::pair<const std::string*, entry*>* to) {
+        std::string z = compress(raw);
+        if (z.size() > raw.size() - raw.size() / 8) {
+            for (auto* c = from; c != to; ++c) c->second->incompressible = true;
+            return;
+        }
+        std::uint32_t id;
+        if (!s.free_pages.empty()) {
+            id = s.free_pages.back();
+            s.free_pages.pop_back();
+        } else {
+            id = static_cast<std::uint32_t>(s.pages.size());
+            s.pages.emplace_back();
+        }
+        page& p = s.pages[id];
+        z.shrink_to_fit();
+        p.data = std::move(z);
+        p.raw_size = static_cast<std::uint32_t>(raw.size());
+        p.live = static_cast<std::uint32_t>(to - from);
+        p.live_bytes = raw.size();
+        std::uint32_t offset = 0;
+        for (auto* c = from; c != to; ++c) {
+            entry& e = *c->second;
+            e.page = id;
+            e.offset = offset;
+            e.size = static_cast<std::uint32_t>(e.value.size());
+            offset += e.size;
+            std::string().swap(e.value);
+        }
+        bytes_.fetch_add(p.data.size(), std::memory_order_relaxed);
+        bytes_.fetch_sub(raw.size(), std::memory_order_relaxed);
+        cold_keys_.fetch_add(p.live, std::memory_order_relaxed);
+        cold_value_bytes_.fetch_add(raw.size(), std::memory_order_relaxed);
+        cold_page_bytes_.fetch_add(p.data.size(), std::memory_order_relaxed);
+        pages_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void sweep_loop() {
+        std::unique_lock<std::mutex> l(bg_mu_);
+        while (!bg_cv_.wait_for(l, std::chrono::milliseconds(opts_.sweep_interval_ms), [&] { return stop_; })) {
+            l.unlock();
+            sweep();
+            l.lock();
+        }
+    }
+
+    mem_store_options opts_;
+    std::uint64_t mask_;
+    std::unique_ptr<stripe[]> stripes_;
+    std::atomic<std::uint64_t> keys_{0};
+    std::atomic<std::uint64_t> bytes_{0};
+    std::atomic<std::uint64_t> cold_keys_{0}, cold_value_bytes_{0}, cold_page_bytes_{0}, pages_{0};
+    std::atomic<std::uint64_t> sweeps_{0}, promotions_{0};
+
+    std::mutex bg_mu_;
+    std::condition_variable bg_cv_;
+    bool stop_ = false;
+    std::thread sweeper_;
+};
+
+} // namespace dsa
@@ -0,0 +1,389 @@
+#pragma once
+
+// one store over several: each key goes to the backend mounted at its
+// longest matching prefix, so e.g. sessions can live in a mem_store,
+// events in a bitcask and everything else in a b+tree behind a single
+// store. the prefixes are compiled into a byte trie when the table is
+// built, so routing walks at most the length of the longest prefix and
+// never compares strings. keys reach their backend unchanged.
+//
+// batches of puts and erases may span backends and apply atomically: no
+// reader sees part of one, and one interrupted by a crash is finished on
+// the next open. a batch is logged and synced before it touches any
+// backend, then the backends it touched are synced and the log emptied.
+// one a backend threw on stays in the log and is finished before the next
+// batch is logged and before any read or single write runs; while it keeps
+// throwing, so do they.
+//
+// batch log: crc32c:4 (op:1 key_size:varint key (value_size:varint value)?)*
+//
+// op 1 is a put and op 2 an erase. volatile backends forget their part of
+// a batch in a crash like everything else, but durable ones agree on it.
+
+#include "coding.hpp"
+#include "crc32c.hpp"
+#include "deadline.hpp"
+#include "env.hpp"
+#include "sample.hpp"
+#include "store.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace dsa {
+
+struct mount {
+    std::string prefix; // "" catches every key no longer prefix matches
+    std::unique_ptr<store> backend;
+    bool read_only = false;
+};
+
+struct mount_table_options {
+    // log batches and sync what they touched, so a crash cannot leave one
+    // half applied. without it batches are still isolated from readers and
+    // one a backend threw on is still finished, from memory.
+    bool durable_batches = true;
+};
+
+struct mount_table_stats {
+    std::uint64_t batches = 0;
+    std::uint64_t batch_ops = 0;
+    std::uint64_t replayed = 0; // batches finished on open or after a throw
+};
+
+class mount_table : public store {
+public:
+    // keys, values and the op list are allocated from the batch's memory
+    // resource.
+    class batch {
+    public:
+        explicit batch(std::pmr::memory_resource* mr = std::pmr::get_default_resource()) : ops_(mr) {}
+
+        void put(std::string_view key, std::string_view value) {
+            ops_.push_back({put_op, std::pmr::string(key, resource()), std::pmr::string(value, resource())});
+        }
+        void erase(std::string_view key) { ops_.push_back({erase_op, std::pmr::string(key, resource()), std::pmr::string(resource())}); }
+        std::size_t size() const { return ops_.size(); }
+        bool empty() const { return ops_.empty(); }
+        void clear() { ops_.clear(); }
+
+    private:
+        friend class mount_table;
+        struct op {
+            char kind;
+            std::pmr::string key, value;
+        };
+        std::pmr::memory_resource* resource() const { return ops_.get_allocator().resource(); }
+        std::pmr::vector<op> ops_;
+    };
+
+    // dir holds the batch log. prefixes must be distinct.
+    mount_table(env& e, std::string dir, std::vector<mount> mounts, mount_table_options opts = {})
+        : env_(e), dir_(std::move(dir)), opts_(opts), mounts_(std::move(mounts)) {
+        nodes_.emplace_back();
+        for (std::size_t i = 0; i < mounts_.size(); ++i) {
+            if (!mounts_[i].backend) throw std::invalid_argument("mount_table: no backend for '" + mounts_[i].prefix + "'");
+            std::uint32_t n = 0;
+            for (char ch : mounts_[i].prefix) n = child(n, static_cast<unsigned char>(ch));
+            if (nodes_[n].mount != no_mount) throw std::invalid_argument("mount_table: '" + mounts_[i].prefix + "' mounted twice");
+            nodes_[n].mount = static_cast<std::uint32_t>(i);
+        }
+        env_.create_dir(dir_);
+        log_ = env_.open(join_path(dir_, "batch.log"), open_mode::create);
+        recover();
+    }
+
+    mount_table(const mount_table&) = delete;
+    mount_table& operator=(const mount_table&) = delete;
+
+    // the backend key routes to. throws std::invalid_argument if no prefix
+    // matches.
+    store& route(std::string_view key) { return *mounts_[find(key)].backend; }
+
+    std::size_t mounts() const { return mounts_.size(); }
+    const mount& mount_at(std::size_t i) const { return mounts_[i]; }
+
+    void put(std::string_view key, std::string_view value) override {
+        std::size_t m = writable(key);
+        auto g = read_lock();
+        mounts_[m].backend->put(key, value);
+    }
+
+    bool get(std::string_view key, std::string& value) override { return get_into(key, value); }
+    bool get(std::string_view key, std::pmr::string& value) override { return get_into(key, value); }
+
+    bool erase(std::string_view key) override {
+        std::size_t m = writable(key);
+        auto g = read_lock();
+        return mounts_[m].backend->erase(key);
+    }
+
+    void sync() override {
+        for (mount& m : mounts_) m.backend->sync();
+    }
+
+    // from the backends, each drawn from by its share of the keys as
+    // key_count gives it, so a backend must hold only keys routed to it.
+    // draws a backend comes up short on, emptied since it was counted, are
+    // made again over fresh counts. backends that cannot sample or count
+    // throw std::logic_error through this. runs under the read lock, so no
+    // batch is seen in part.
+    std::vector<std::string> sample(std::size_t n, std::uint64_t seed) override {
+        auto g = read_lock();
+        sample_rng r(seed);
+        std::vector<std::string> out;
+        out.reserve(n);
+        std::vector<std::uint64_t> ends(mounts_.size());
+        std::vector<std::size_t> from, want(mounts_.size()), used(mounts_.size());
+        std::vector<std::vector<std::string>> got(mounts_.size());
+        while (out.size() < n) {
+            std::uint64_t keys = 0;
+            for (std::size_t i = 0; i < mounts_.size(); ++i) ends[i] = keys += mounts_[i].backend->key_count();
+            if (!keys) break;
+            from.resize(n - out.size());
+            std::fill(want.begin(), want.end(), 0);
+            for (std::size_t& w : from) {
+                w = static_cast<std::size_t>(std::upper_bound(ends.begin(), ends.end(), r.uniform(keys)) - ends.begin());
+                ++want[w];
+            }
+            for (std::size_t i = 0; i < mounts_.size(); ++i) {
+                got[i].clear();
+                if (want[i]) got[i] = mounts_[i].backend->sample(want[i], r.next());
+                used[i] = 0;
+            }
+            for (std::size_t w : from)
+                if (used[w] < got[w].size()) out.push_back(std::move(got[w][used[w]++]));
+        }
+        return out;
+    }
+
+    std::uint64_t key_count() override {
+        auto g = read_lock();
+        std::uint64_t n = 0;
+        for (mount& m : mounts_) n += m.backend->key_count();
+        return n;
+    }
+
+    // applies every operation in b, in order, or none if a key is routed
+    // to a read-only mount or nowhere. if a backend throws partway, the
+    // rest of the batch is applied before the next apply, read or single
+    // write, or with durable batches when the table is next opened; while
+    // that keeps throwing, so do they, and no apply's batch is applied.
+    void apply(const batch& b) {
+        if (b.empty()) return;
+        std::pmr::vector<bool> touched(mounts_.size(), b.resource());
+        for (const batch::op& o : b.ops_) touched[writable(o.key)] = true;
+        auto g = lock_within_deadline<std::unique_lock<std::shared_mutex>>(mu_);
+        // once logged, a batch is finished even if its deadline passes.
+        deadline_exempt whole;
+        finish_pending();
+        if (opts_.durable_batches) {
+            // reused, like the batch's own memory it never touches the heap
+            // once warm.
+            thread_local std::string rec;
+            rec.assign(4, '\0');
+            for (const batch::op& o : b.ops_) encode(rec, o.kind, o.key, o.value);
+            std::uint32_t crc = crc32c(std::string_view(rec).substr(4));
+            for (int i = 0; i < 4; ++i) rec[i] = static_cast<char>(crc >> (8 * i));
+            pending_ = true;
+            log_->write(0, rec);
+            log_->sync();
+        }
+        std::size_t i = 0;
+        try {
+            for (; i < b.ops_.size(); ++i) run(b.ops_[i].kind, b.ops_[i].key, b.ops_[i].value);
+        } catch (...) {
+            // a logged batch is finished from the log.
+            if (!opts_.durable_batches) {
+                rest_.assign(b.ops_.begin() + static_cast<std::ptrdiff_t>(i), b.ops_.end());
+                pending_ = true;
+            }
+            throw;
+        }
+        if (opts_.durable_batches) {
+            for (std::size_t i = 0; i < mounts_.size(); ++i)
+                if (touched[i]) mounts_[i].backend->sync();
+            log_->truncate(0);
+            log_->sync();
+            pending_ = false;
+        }
+        batches_.fetch_add(1, std::memory_order_relaxed);
+        batch_ops_.fetch_add(b.size(), std::memory_order_relaxed);
+    }
+
+    mount_table_stats stats() const {
+        mount_table_stats s;
+        s.batches = batches_.load(std::memory_order_relaxed);
+        s.batch_ops = batch_ops_.load(std::memory_order_relaxed);
+        s.replayed = replayed_.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    // mu_ held shared with no batch half applied: one a backend threw on is
+    // finished first, under mu_ alone, and whatever that throws is thrown
+    // from here.
+    std::shared_lock<std::shared_mutex> read_lock() {
+        auto g = lock_within_deadline<std::shared_lock<std::shared_mutex>>(mu_);
+        while (pending_) {
+            g.unlock();
+            {
+                auto w = lock_within_deadline<std::unique_lock<std::shared_mutex>>(mu_);
+                deadline_exempt whole;
+                finish_pending();
+            }
+            g = lock_within_deadline<std::shared_lock<std::shared_mutex>>(mu_);
+        }
+        return g;
+    }
+
+    // finishes the batch a backend threw on, if any. caller holds mu_
+    // alone.
+    void finish_pending() {
+        if (!pending_) return;
+        if (opts_.durable_batches) {
+            finish_logged();
+        } else {
+            for (const batch::op& o : rest_) run(o.kind, o.key, o.value);
+            rest_.clear();
+            replayed_.fetch_add(1, std::memory_order_relaxed);
+        }
+        pending_ = false;
+    }
+
+    // get for std::string and std::pmr::string values alike.
+    template <class String>
+    bool get_into(std::string_view key, String& value) {
+        std::size_t m = find(key);
+        auto g = read_lock();
+        return mounts_[m].backend->get(key, value);
+    }
+
+    static constexpr char put_op = 1, erase_op = 2;
+    static constexpr std::uint32_t no_mount = ~0u;
+
+    // children are kept sorted by byte; a mount table has few prefixes,
+    // so a node rarely has more than a handful.
+    struct node {
+        std::uint32_t mount = no_mount;
+        std::vector<std::pair<unsigned char, std::uint32_t>> kids;
+    };
+
+    // the child of n for ch, added if missing.
+    std::uint32_t child(std::uint32_t n, unsigned char ch) {
+        auto& kids = nodes_[n].kids;
+        auto it = std::lower_bound(kids.begin(), kids.end(), ch, [](const auto& k, unsigned char c) { return k.first < c; });
+        if (it != kids.end() && it->first == ch) return it->second;
+        auto id = static_cast<std::uint32_t>(nodes_.size());
+        kids.insert(it, {ch, id});
+        nodes_.emplace_back();
+        return id;
+    }
+
+    std::size_t find(std::string_view key) const {
+        std::uint32_t n = 0, best = nodes_[0].mount;
+        for (char ch : key) {
+            const auto& kids = nodes_[n].kids;
+            auto c = static_cast<unsigned char>(ch);
+            auto it = kids.begin();
+            while (it != kids.end() && it->first < c) ++it;
+            if (it == kids.end() || it->first != c) break;
+            n = it->second;
+            if (nodes_[n].mount != no_mount) best = nodes_[n].mount;
+        }
+        if (best == no_mount) throw std::invalid_argument("mount_table: no mount for key");
+        return best;
+    }
+
+    std::size_t writable(std::string_view key) const {
+        std::size_t m = find(key);
+        if (mounts_[m].read_only) throw std::invalid_argument("mount_table: '" + mounts_[m].prefix + "' is mounted read-only");
+        return m;
+    }
+
+    void run(char kind, std::string_view key, std::string_view value) {
+        store& s = *mounts_[find(key)].backend;
+        if (kind == put_op) s.put(key, value);
+        else s.erase(key);
+    }
+
+    static void encode(std::string& out, char kind, std::string_view key, std::string_view value) {
+        out += kind;
+        put_varint(out, key.size());
+        out.append(key);
+        if (kind != put_op) return;
+        put_varint(out, value.size());
+        out.append(value);
+    }
+
+    void recover() {
+        if (log_->size()) finish_logged();
+    }
+
+    // finishes the batch in the log, logged before a crash or thrown on by
+    // a backend. a torn log was never acted on, so it is dropped. the log
+    // is emptied only once every op has run, so a backend throwing again
+    // leaves the batch for the next try.
+    void finish_logged() {
+        std::uint64_t n = log_->size();
+        std::string buf(static_cast<std::size_t>(n), '\0');
+        read_exact(*log_, 0, buf.data(), buf.size());
+        std::string_view body = std::string_view(buf).substr(std::min<std::size_t>(4, buf.size()));
+        if (buf.size() > 4 && get_u32(buf.data()) == crc32c(body)) {
+            struct op {
+                char kind;
+                std::string_view key, value;
+            };
+            std::vector<op> ops;
+            std::string_view in = body;
+            bool ok = true;
+            while (ok && !in.empty()) {
+                op o{in.front(), {}, {}};
+                in.remove_prefix(1);
+                std::uint64_t len;
+                ok = (o.kind == put_op || o.kind == erase_op) && get_varint(in, len) && len <= in.size();
+                if (!ok) break;
+                o.key = in.substr(0, len);
+                in.remove_prefix(len);
+                if (o.kind == put_op) {
+                    ok = get_varint(in, len) && len <= in.size();
+                    if (!ok) break;
+                    o.value = in.substr(0, len);
+                    in.remove_prefix(len);
+                }
+                ops.push_back(o);
+            }
+            if (!ok) throw io_error("mount_table: corrupt batch log");
+            for (const op& o : ops) run(o.kind, o.key, o.value);
+            sync();
+            replayed_.fetch_add(1, std::memory_order_relaxed);
+        }
+        log_->truncate(0);
+        log_->sync();
+    }
+
+    env& env_;
+    std::string dir_;
+    mount_table_options opts_;
+    std::vector<mount> mounts_;
+    std::vector<node> nodes_; // the trie; node 0 is the root
+
+    // single operations share it and batches take it alone, so readers
+    // see a batch whole or not at all.
+    mutable std::shared_mutex mu_;
+    std::unique_ptr<file> log_;
+    std::atomic<std::uint64_t> batches_{0}, batch_ops_{0}, replayed_{0};
+    // a batch is not yet through: it is in the log, or without durable
+    // batches its ops from the one thrown on are in rest_. both change
+    // only under mu_ held alone.
+    bool pending_ = false;
+    std::vector<batch::op> rest_;
+};
+
+} // namespace dsa
@@ -0,0 +1,520 @@
+#pragma once
+
+// durable fifo queue in the style of a kafka partition. messages are
+// appended to segment files and addressed by a dense 64-bit offset; a read
+// never removes anything. consumer groups each have a committed offset, and
+// a segment is deleted once every group has committed past its end, so
+// consuming costs no tombstones and no compaction.
+//
+// segment:  named after its first offset, %020llu.seg
+// message:  crc32c:4 size:4 payload
+// groups:   log of (crc32c:4 name_size:4 offset:8 name); the last record
+//           for a name wins, offset ~0 removes the group
+//
+// segments are read through a mapping where the env supports one, so
+// batches are views into the page cache rather than copies. each segment
+// keeps a sparse in-memory offset -> position index, rebuilt by a scan on
+// open; the scan cuts a segment at its first bad crc, the torn tail a crash
+// mid-append leaves.
+
+#include "coding.hpp"
+#include "crc32c.hpp"
+#include "deadline.hpp"
+#include "env.hpp"
+#include "lock.hpp"
+#include "reader.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <map>
+#include <memory_resource>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+namespace dsa {
+
+struct queue_options {
+    // a segment is rolled once it reaches this size. no message may be
+    // larger.
+    std::uint64_t segment_size = 64u << 20;
+    // sync after every append call.
+    bool sync_appends = false;
+    // sync the group log after every commit.
+    bool sync_commits = true;
+    // bytes of messages between sparse index entries.
+    std::uint32_t index_interval = 4096;
+};
+
+struct queue_stats {
+    std::uint64_t first_offset = 0;
+    std::uint64_t end_offset = 0;
+    std::uint64_t segments = 0;
+    std::uint64_t bytes = 0;
+    std::uint64_t groups = 0;
+    std::uint64_t segments_deleted = 0;
+    lock_stats write_lock;  // serializes appends
+    lock_stats group_lock;  // consumer group offsets
+    lock_stats index_locks; // live segments' offset indexes together
+};
+
+class log_queue {
+    struct segment {
+        std::uint64_t first;
+        std::unique_ptr<file> f;
+        std::unique_ptr<mapping> map; // null if the env cannot map
+        std::atomic<std::uint64_t> bytes{0};
+        std::atomic<std::uint64_t> end{0}; // offset after the last message
+        adaptive_mutex index_mu;
+        std::vector<std::pair<std::uint64_t, std::uint64_t>> index; // (offset, position)
+    };
+
+public:
+    static constexpr std::uint64_t earliest = 0;
+    static constexpr std::uint64_t latest = ~std::uint64_t{0};
+
+    // messages read in one call. the views stay valid for the batch's
+    // lifetime, even if the segment is deleted meanwhile. the message list,
+    // and the copy when the segment is not mapped, come from the memory
+    // resource passed to read or poll.
+    class batch {
+    public:
+        explicit batch(std::pmr::memory_resource* mr = std::pmr::get_default_resource()) : copy_(mr), msgs_(mr) {}
+
+        std::size_t size() const { return msgs_.size(); }
+        bool empty() const { return msgs_.empty(); }
+        std::string_view operator[](std::size_t i) const { return msgs_[i]; }
+        std::pmr::vector<std::string_view>::const_iterator begin() const { return msgs_.begin(); }
+        std::pmr::vector<std::string_view>::const_iterator end() const { return msgs_.end(); }
+        // offset of the first message and of the one after the last.
+        std::uint64_t first_offset() const { return first_; }
+        std::uint64_t next_offset() const { return next_; }
+
+    private:
+        friend class log_queue;
+        std::shared_ptr<segment> seg_;
+        std::pmr::vector<char> copy_; // backing store when the segment is not mapped
+        std::pmr::vector<std::string_view> msgs_;
+        std::uint64_t first_ = 0;
+        std::uint64_t next_ = 0;
+    };
+
+    // a group's read position. poll advances it; commit makes it the
+    // group's durable offset.
+    class consumer {
+    public:
+        batch poll(std::size_t max_messages, std::size_t max_bytes = 1 << 20,
+                   std::pmr::memory_resource* mr = std::pmr::get_default_resource()) {
+            batch b = q_->read(pos_, max_messages, max_bytes, mr);
+            pos_ = b.next_offset();
+            return b;
+        }
+        void commit() { q_->commit(group_, pos_); }
+        std::uint64_t position() const { return pos_; }
+        void seek(std::uint64_t offset) { pos_ = offset; }
+
+    private:
+        friend class log_queue;
+        consumer(log_queue& q, std::string group, std::uint64_t pos) : q_(&q), group_(std::move(group)), pos_(pos) {}
+
+        log_queue* q_;
+        std::string group_;
+        std::uint64_t pos_;
+    };
+
+    log_queue(env& e, std::string dir, queue_options opts = {}) : env_(e), dir_(std::move(dir)), opts_(opts) {
+        if (opts_.segment_size < 64) throw std::invalid_argument("queue: segment_size too small");
+        if (!opts_.index_interval) throw std::invalid_argument("queue: index_interval must be positive");
+        env_.create_dir(dir_);
+        recover();
+    }
+
+    ~log_queue() {
+        try {
+            sync();
+        } catch (const io_error&) {
+        }
+    }
+
+    log_queue(const log_queue&) = delete;
+    log_queue& operator=(const log_queue&) = delete;
+
+    // appends one message and returns its offset.
+    std::uint64_t append(std::string_view msg) { return append(std::vector<std::string_view>{msg}); }
+
+    // appends msgs with one write per segment touched and returns the offset
+    // of the first. readers see all of them or none of a segment's share.
+    std::uint64_t append(const std::vector<std::string_view>& msgs) {
+        auto w = lock_within_deadline<std::unique_lock<adaptive_mutex>>(write_mu_);
+        std::uint64_t first = active_->end.load(std::memory_order_relaxed);
+        for (std::string_view m : msgs)
+            if (m.size() + 8 > opts_.segment_size) throw std::length_error("queue: message larger than a segment");
+        std::string buf;
+        // index entries for what is in buf, published once it is written.
+        std::vector<std::pair<std::uint64_t, std::uint64_t>> index;
+        std::uint64_t pos = active_->bytes.load(std::memory_order_relaxed), off = first;
+        for (std::string_view m : msgs) {
+            if (pos + buf.size() + 8 + m.size() > opts_.segment_size && pos + buf.size() > 0) {
+                flush(buf, index, off);
+                roll(off);
+                pos = 0;
+            }
+            if ((pos + buf.size()) / opts_.index_interval != (pos + buf.size() + 8 + m.size()) / opts_.index_interval)
+                index.emplace_back(off, pos + buf.size());
+            std::size_t at = buf.size();
+            buf.append(8, '\0');
+            buf.append(m);
+            std::uint32_t crc = crc32c(m);
+            for (int i = 0; i < 4; ++i) {
+                buf[at + i] = static_cast<char>(crc >> (8 * i));
+                buf[at + 4 + i] = static_cast<char>(m.size() >> (8 * i));
+            }
+            ++off;
+        }
+        flush(buf, index, off);
+        if (opts_.sync_appends) active_->f->sync();
+        return first;
+    }
+
+    void sync() {
+        std::lock_guard<adaptive_mutex> w(write_mu_);
+        active_->f->sync();
+    }
+
+    std::uint64_t first_offset() const {
+        std::shared_lock<std::shared_mutex> g(mu_);
+        return segments_.begin()->second->first;
+    }
+
+    std::uint64_t end_offset() const {
+        std::shared_lock<std::shared_mutex> g(mu_);
+        return active_->end.load(std::memory_order_acquire);
+    }
+
+    // up to max_messages from offset, stopping before max_bytes of payload
+    // unless that would return nothing. offsets before the first retained
+    // message read from the first one.
+    batch read(std::uint64_t offset, std::size_t max_messages, std::size_t max_bytes = 1 << 20,
+               std::pmr::memory_resource* mr = std::pmr::get_default_resource()) const {
+        check_deadline();
+        batch b(mr);
+        std::shared_ptr<segment> seg;
+        {
+            std::shared_lock<std::shared_mutex> g(mu_);
+            auto it = segments_.upper_bound(offset);
+            if (it == segments_.begin()) offset = it->second->first;
+            else --it;
+            // a cut segment may end before the next one starts.
+            while (offset >= it->second->end.load(std::memory_order_acquire) && std::next(it) != segments_.end()) {
+                ++it;
+                offset = std::max(offset, it->second->first);
+            }
+            seg = it->second;
+        }
+        b.first_ = b.next_ = offset;
+        std::uint64_t end = seg->end.load(std::memory_order_acquire);
+        std::uint64_t limit = seg->bytes.load(std::memory_order_acquire);
+        if (offset >= end || !max_messages) return b;
+
+        std::uint64_t pos = 0, at = seg->first;
+        {
+            std::lock_guard<adaptive_mutex> g(seg->index_mu);
+            auto i = std::upper_bound(seg->index.begin(), seg->index.end(), std::make_pair(offset, ~std::uint64_t{0}));
+            if (i != seg->index.begin()) std::tie(at, pos) = *std::prev(i);
+        }
+        // without a mapping, messages are copied into a window that slides
+        // forward only while nothing has been returned from it yet.
+        const char* base = seg->map ? seg->map->data() : nullptr;
+        std::uint64_t window = 0, window_end = seg->map ? limit : pos; // segment positions base covers
+        auto fill = [&](std::uint64_t from, std::uint64_t n) {
+            n = std::min(n, limit - from);
+            b.copy_.resize(n);
+            read_exact(*seg->f, from, b.copy_.data(), n);
+            base = b.copy_.data();
+            window = from;
+            window_end = from + n;
+        };
+        std::uint64_t span = opts_.index_interval + max_bytes + 8;
+        std::size_t bytes = 0;
+        while (at < end && b.msgs_.size() < max_messages) {
+            // every record below end lies below limit, so one that does not
+            // fit there has a bad length.
+            if (pos + 8 > limit) throw io_error("queue: corrupt record");
+            if (pos + 8 > window_end) {
+                if (seg->map || !b.msgs_.empty()) break;
+                fill(pos, span);
+            }
+            std::uint32_t size = get_u32(base + (pos - window) + 4);
+            if (pos + 8 + size > limit) throw io_error("queue: corrupt record");
+            if (pos + 8 + size > window_end) {
+                if (seg->map || !b.msgs_.empty()) break;
+                fill(pos, std::max<std::uint64_t>(span, 8 + size));
+            }
+            if (at >= offset) {
+                if (!b.msgs_.empty() && bytes + size > max_bytes) break;
+                std::string_view m(base + (pos - window) + 8, size);
+                if (get_u32(base + (pos - window)) != crc32c(m)) throw io_error("queue: corrupt record");
+                b.msgs_.push_back(m);
+                bytes += size;
+            }
+            pos += 8 + size;
+            ++at;
+        }
+        b.next_ = std::max(at, offset);
+        b.seg_ = std::move(seg);
+        return b;
+    }
+
+    // creates group at `from` (earliest, latest or an offset) unless it
+    // already exists.
+    void subscribe(std::string_view group, std::uint64_t from = earliest) {
+        std::lock_guard<adaptive_mutex> g(group_mu_);
+        if (groups_.count(std::string(group))) return;
+        if (from == latest) from = end_offset();
+        else from = std::max(from, first_offset());
+        log_group(group, from);
+    }
+
+    // a consumer starting at group's committed offset. the group must exist.
+    consumer consume(std::string_view group) { return consumer(*this, std::string(group), committed(group)); }
+
+    std::uint64_t committed(std::string_view group) const {
+        std::lock_guard<adaptive_mutex> g(group_mu_);
+        auto it = groups_.find(std::string(group));
+        if (it == groups_.end()) throw std::invalid_argument("queue: no group " + std::string(group));
+        return it->second;
+    }
+
+    // records that group has consumed everything before offset, then drops
+    // segments every group is done with.
+    void commit(std::string_view group, std::uint64_t offset) {
+        {
+            std::lock_guard<adaptive_mutex> g(group_mu_);
+            if (!groups_.count(std::string(group))) throw std::invalid_argument("queue: no group " + std::string(group));
+            log_group(group, offset);
+        }
+        trim();
+    }
+
+    void remove_group(std::string_view group) {
+        {
+            std::lock_guard<adaptive_mutex> g(group_mu_);
+            if (!groups_.count(std::string(group))) return;
+            log_group(group, removed);
+        }
+        trim();
+    }
+
+    queue_stats stats() const {
+        queue_stats s;
+        s.write_lock = write_mu_.stats();
+        s.group_lock = group_mu_.stats();
+        {
+            std::lock_guard<adaptive_mutex> g(group_mu_);
+            s.groups = groups_.size();
+            s.segments_deleted = deleted_;
+        }
+        std::shared_lock<std::shared_mutex> g(mu_);
+        s.first_offset = segments_.begin()->second->first;
+        s.end_offset = active_->end.load(std::memory_order_acquire);
+        s.segments = segments_.size();
+        for (const auto& [first, seg] : segments_) {
+            s.bytes += seg->bytes.load(std::memory_order_relaxed);
+            s.index_locks.merge(seg->index_mu.stats());
+        }
+        return s;
+    }
+
+private:
+    static constexpr std::uint64_t removed = ~std::uint64_t{0};
+
+    std::string segment_path(std::uint64_t first) const {
+        char name[32];
+        std::snprintf(name, sizeof name, "%020" PRIu64 ".seg", first);
+        return join_path(dir_, name);
+    }
+
+    std::shared_ptr<segment> open_segment(std::uint64_t first, open_mode mode) {
+        auto s = std::make_shared<segment>();
+        s->first = first;
+        s->end.store(first, std::memory_order_relaxed);
+        s->f = env_.open(segment_path(first), mode);
+        return s;
+    }
+
+    // caller holds write_mu_. writes buf at the end of the active segment
+    // and publishes it, end being the offset after its last message.
+    void flush(std::string& buf, std::vector<std::pair<std::uint64_t, std::uint64_t>>& index, std::uint64_t end) {
+        if (buf.empty()) return;
+        std::uint64_t pos = active_->bytes.load(std::memory_order_relaxed);
+        active_->f->write(pos, buf);
+        {
+            std::lock_guard<adaptive_mutex> g(active_->index_mu);
+            active_->index.insert(active_->index.end(), index.begin(), index.end());
+        }
+        index.clear();
+        active_->bytes.store(pos + buf.size(), std::memory_order_release);
+        active_->end.store(end, std::memory_order_release);
+        buf.clear();
+    }
+
+    // caller holds write_mu_.
+    void roll(std::uint64_t first) {
+        active_->f->sync();
+        auto s = open_segment(first, open_mode::truncate);
+        s->map = s->f->map(opts_.segment_size);
+        std::unique_lock<std::shared_mutex> g(mu_);
+        segments_[first] = s;
+        active_ = std::move(s);
+    }
+
+    // caller holds group_mu_.
+    void log_group(std::string_view group, std::uint64_t offset) {
+        std::string rec(4, '\0');
+        put_u32(rec, static_cast<std::uint32_t>(group.size()));
+        put_u64(rec, offset);
+        rec.append(group);
+        std::uint32_t crc = crc32c(std::string_view(rec).substr(4));
+        for (int i = 0; i < 4; ++i) rec[i] = static_cast<char>(crc >> (8 * i));
+        groups_log_->append(rec);
+        if (opts_.sync_commits) groups_log_->sync();
+        if (offset == removed) groups_.erase(std::string(group));
+        else groups_[std::string(group)] = offset;
+        // rewrite the log once it is mostly superseded records.
+        if (groups_log_->size() > (64u << 10) && groups_log_->size() > 8 * live_group_bytes()) rewrite_groups();
+    }
+
+    std::uint64_t live_group_bytes() const {
+        std::uint64_t n = 0;
+        for (const auto& [name, off] : groups_) n += 16 + name.size();
+        return n;
+    }
+
+    // caller holds group_mu_.
+    void rewrite_groups() {
+        std::string out;
+        for (const auto& [name, off] : groups_) {
+            std::string rec(4, '\0');
+            put_u32(rec, static_cast<std::uint32_t>(name.size()));
+            put_u64(rec, off);
+            rec += name;
+            std::uint32_t crc = crc32c(std::string_view(rec).substr(4));
+            for (int i = 0; i < 4; ++i) rec[i] = static_cast<char>(crc >> (8 * i));
+            out += rec;
+        }
+        std::string tmp = join_path(dir_, "groups.tmp");
+        auto f = env_.open(tmp, open_mode::truncate);
+        f->append(out);
+        f->sync();
+        groups_log_.reset();
+        env_.rename(tmp, join_path(dir_, "groups"));
+        groups_log_ = env_.open(join_path(dir_, "groups"), open_mode::read_write);
+    }
+
+    // deletes sealed segments that every group has committed past. with no
+    // groups nothing has been consumed, so everything is kept.
+    void trim() {
+        std::uint64_t low = removed;
+        {
+            std::lock_guard<adaptive_mutex> g(group_mu_);
+            if (groups_.empty()) return;
+            for (const auto& [name, off] : groups_) low = std::min(low, off);
+        }
+        std::vector<std::uint64_t> doomed;
+        {
+            std::unique_lock<std::shared_mutex> g(mu_);
+            for (auto it = segments_.begin(); it->second != active_;) {
+                if (it->second->end.load(std::memory_order_acquire) > low) break;
+                doomed.push_back(it->first);
+                it = segments_.erase(it);
+            }
+        }
+        for (std::uint64_t first : doomed) env_.remove(segment_path(first));
+        std::lock_guard<adaptive_mutex> g(group_mu_);
+        deleted_ += doomed.size();
+    }
+
+    void recover() {
+        std::vector<std::uint64_t> firsts;
+        for (const std::string& name : env_.list(dir_)) {
+            std::uint64_t first;
+            char ext[8];
+            if (std::sscanf(name.c_str(), "%20" SCNu64 ".%7s", &first, ext) == 2 && std::string_view(ext) == "seg") firsts.push_back(first);
+        }
+        std::sort(firsts.begin(), firsts.end());
+        for (std::uint64_t first : firsts) {
+            auto s = open_segment(first, open_mode::read_write);
+            scan(*s);
+            segments_[first] = std::move(s);
+        }
+        if (segments_.empty()) {
+            auto s = open_segment(0, open_mode::truncate);
+            segments_[0] = std::move(s);
+        }
+        active_ = segments_.rbegin()->second;
+        for (auto& [first, s] : segments_) s->map = s->f->map(opts_.segment_size);
+
+        std::string path = join_path(dir_, "groups");
+        if (env_.exists(join_path(dir_, "groups.tmp"))) env_.remove(join_path(dir_, "groups.tmp"));
+        groups_log_ = env_.open(path, open_mode::create);
+        sequential_reader in(*groups_log_);
+        std::uint64_t off = 0, end = groups_log_->size();
+        while (off < end) {
+            std::string_view h = in.read(off, 16);
+            bool ok = h.size() == 16;
+            std::uint64_t n = ok ? 16 + get_u32(h.data() + 4) : 0;
+            std::string_view rec = ok ? in.read(off, n) : std::string_view();
+            if (!ok || rec.size() != n || get_u32(rec.data()) != crc32c(rec.substr(4))) {
+                groups_log_->truncate(off);
+                break;
+            }
+            std::string name(rec.substr(16));
+            std::uint64_t o = get_u64(rec.data() + 8);
+            if (o == removed) groups_.erase(name);
+            else groups_[name] = o;
+            off += n;
+        }
+    }
+
+    // rebuilds a segment's index and end offset, cutting it at the first
+    // record that fails its crc.
+    void scan(segment& s) {
+        sequential_reader in(*s.f);
+        std::uint64_t pos = 0, at = s.first, size = s.f->size();
+        while (pos < size) {
+            std::string_view h = in.read(pos, 8);
+            bool ok = h.size() == 8;
+            std::uint64_t n = ok ? get_u32(h.data() + 4) : 0;
+            // the header view dies with the next read, so take the whole
+            // record in one.
+            std::string_view rec = ok ? in.read(pos, 8 + n) : std::string_view();
+            if (!ok || rec.size() != 8 + n || get_u32(rec.data()) != crc32c(rec.substr(8))) {
+                s.f->truncate(pos);
+                break;
+            }
+            if (pos / opts_.index_interval != (pos + 8 + n) / opts_.index_interval) s.index.emplace_back(at, pos);
+            pos += 8 + n;
+            ++at;
+        }
+        s.bytes.store(pos, std::memory_order_relaxed);
+        s.end.store(at, std::memory_order_relaxed);
+    }
+
+    env& env_;
+    std::string dir_;
+    queue_options opts_;
+
+    adaptive_mutex write_mu_;      // serializes appends
+    mutable std::shared_mutex mu_; // guards segments_ and active_
+    std::map<std::uint64_t, std::shared_ptr<segment>> segments_;
+    std::shared_ptr<segment> active_;
+
+    mutable adaptive_mutex group_mu_;
+    std::unique_ptr<file> groups_log_;
+    std::map<std::string, std::uint64_t> groups_;
+    std::uint64_t deleted_ = 0;
+};
+
+} // namespace dsa
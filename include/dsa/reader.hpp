@@ -0,0 +1,102 @@
+#pragma once
+
+// windowed reader for scanning a file front to back, so record-at-a-time
+// parsers issue one large read per window instead of one per field.
+//
+// the window adapts to the access pattern: it starts small, doubles on every
+// refill that carries on where the last window ended and drops back to the
+// minimum on a seek. while a scan stays sequential the next window is read
+// on a helper thread as the caller parses the current one, so device time
+// and parse time overlap instead of alternating.
+
+#include "env.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <future>
+
+namespace dsa {
+
+class sequential_reader {
+public:
+    static constexpr std::size_t min_window = 64 << 10;
+
+    // window is the largest read issued. async=false keeps every read on the
+    // calling thread.
+    explicit sequential_reader(file& f, std::size_t window = 1 << 20, bool async = true)
+        : f_(f), max_window_(window), min_window_(std::min(window, min_window)), window_(min_window_), async_(async) {}
+
+    sequential_reader(const sequential_reader&) = delete;
+    sequential_reader& operator=(const sequential_reader&) = delete;
+
+    // view of n bytes at offset, or fewer at end of file. valid until the
+    // next call.
+    std::string_view read(std::uint64_t offset, std::size_t n) {
+        if (offset < buf_off_ || offset + n > buf_off_ + len_) refill(offset, n);
+        std::size_t start = static_cast<std::size_t>(offset - buf_off_);
+        if (start >= len_) return {};
+        return std::string_view(buf_.data() + begin_ + start, std::min(n, len_ - start));
+    }
+
+private:
+    void refill(std::uint64_t offset, std::size_t n) {
+        std::uint64_t end = buf_off_ + len_;
+        bool sequential = len_ && offset >= buf_off_ && offset <= end;
+        window_ = sequential ? std::min(window_ * 2, max_window_) : min_window_;
+        if (ahead_.valid()) {
+            // a failed read ahead is retried below, where its error surfaces.
+            std::size_t got = 0;
+            try {
+                got = ahead_.get();
+            } catch (const io_error&) {
+            }
+            if (sequential && offset + n <= end + got) {
+                // the unread tail of this window goes in the room left for
+                // it in front of the next.
+                std::size_t tail = static_cast<std::size_t>(end - offset);
+                std::memcpy(spare_.data() + ahead_room_ - tail, buf_.data() + begin_ + (offset - buf_off_), tail);
+                std::swap(buf_, spare_);
+                begin_ = ahead_room_ - tail;
+                buf_off_ = offset;
+                len_ = tail + got;
+                if (got == ahead_size_) read_ahead();
+                return;
+            }
+        }
+        buf_.resize(std::max(window_, n));
+        begin_ = 0;
+        buf_off_ = offset;
+        len_ = f_.read(offset, buf_.data(), buf_.size());
+        if (sequential && len_ == buf_.size()) read_ahead();
+    }
+
+    void read_ahead() {
+        if (!async_) return;
+        ahead_room_ = len_;
+        ahead_size_ = window_;
+        spare_.resize(ahead_room_ + ahead_size_);
+        ahead_ = std::async(std::launch::async, [&f = f_, off = buf_off_ + len_, p = spare_.data() + ahead_room_, n = ahead_size_] {
+            return f.read(off, p, n);
+        });
+    }
+
+    file& f_;
+    std::size_t max_window_;
+    std::size_t min_window_;
+    std::size_t window_;
+    bool async_;
+
+    std::string buf_;
+    std::size_t begin_ = 0; // of the window within buf_
+    std::uint64_t buf_off_ = 0;
+    std::size_t len_ = 0;
+
+    // the next window, read into spare_ after ahead_room_ bytes. declared
+    // last so a read in flight finishes before its buffer goes away.
+    std::string spare_;
+    std::size_t ahead_room_ = 0;
+    std::size_t ahead_size_ = 0;
+    std::future<std::size_t> ahead_;
+};
+
+} // namespace dsa
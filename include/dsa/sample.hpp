@@ -0,0 +1,149 @@
+#pragma once
+
+// uniform key sampling from an index's shape instead of a scan, for
+// store::sample. every backend samples the same way, by acceptance /
+// rejection (olken): a draw walks down the index picking a random slot
+// below a fixed bound at each level, and starts over when the slot is past
+// the end of what is there. every key then sits behind exactly one walk of
+// the same probability, the product of 1/bound, so accepted draws are
+// uniform however unevenly keys are spread; unevenness only costs retries.
+//
+// hash maps are sampled through their buckets: a random bucket, then a
+// random position below sample_chain_bound in its chain. a chain longer
+// than that would have keys never drawn; at the load factor of at most 1
+// the maps keep, one occurs about once in 10^10 buckets. most draws miss,
+// so they are made in rounds grouped by map, each map locked once a round
+// rather than once a draw.
+//
+// a sample is short only if the index is or becomes empty. an index can
+// hold few keys for its shape, once most of what was put in is erased;
+// draws then almost never land, and a sampler that keeps missing counts or
+// walks what is left instead of drawing on.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dsa {
+
+// splitmix64: small, fast and statistically sound for sampling.
+class sample_rng {
+public:
+    explicit sample_rng(std::uint64_t seed) : s_(seed) {}
+
+    std::uint64_t next() {
+        std::uint64_t z = (s_ += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    // uniform in [0, n).
+    std::uint64_t uniform(std::uint64_t n) {
+        __extension__ using u128 = unsigned __int128;
+        return static_cast<std::uint64_t>((static_cast<u128>(next()) * n) >> 64);
+    }
+
+private:
+    std::uint64_t s_;
+};
+
+constexpr std::size_t sample_chain_bound = 12;
+
+// draws in a row that may all be rejected before a sampler looks at how
+// many keys are left, or walks them.
+constexpr std::uint64_t sample_max_tries = 1u << 20;
+
+// the element at position at of bucket b's chain in m, or null.
+template <class Map>
+const typename Map::value_type* sample_chain(const Map& m, std::size_t b, std::size_t at) {
+    if (b >= m.bucket_count()) return nullptr; // rehashed since the draw
+    auto it = m.begin(b);
+    for (; at && it != m.end(b); --at) ++it;
+    return it == m.end(b) ? nullptr : &*it;
+}
+
+// n keys from string-keyed hash maps taken as one table, map i holding its
+// buckets from ends[i - 1] (or 0) up to ends[i]. with_map(i, fn) calls
+// fn(map i) under its read lock. accepted draws are kept in the order they
+// were drawn, so a round cut short at n is still a uniform sample.
+//
+// after a run of misses the maps' keys are counted, from 1/16 of
+// sample_max_tries on and again each time the run doubles: none left ends
+// the sample, and so few that walking every bucket is cheaper than the
+// draws still to come, or a run of sample_max_tries, finishes it from the
+// keys the walk collects. a draw costs about ten times a bucket stepped
+// over, and each key wanted takes about 12 * buckets / keys draws, so the
+// walk wins below about 120 keys per key wanted.
+template <class WithMap>
+std::vector<std::string> sample_buckets(std::size_t n, std::uint64_t seed, const std::vector<std::size_t>& ends, WithMap&& with_map) {
+    constexpr std::size_t max_round = 4096;
+    struct draw {
+        std::size_t bucket, at;
+    };
+    std::vector<std::string> out;
+    if (ends.empty() || !ends.back()) return out;
+    out.reserve(n);
+    sample_rng r(seed);
+    std::vector<draw> draws;
+    std::vector<std::size_t> map_of, by_map, starts(ends.size() + 1);
+    std::vector<std::string> got;
+    std::vector<char> hit;
+    std::uint64_t missed = 0, count_at = sample_max_tries / 16;
+    while (out.size() < n) {
+        std::size_t round = std::min(max_round, 16 * (n - out.size()));
+        draws.resize(round);
+        map_of.resize(round);
+        std::fill(starts.begin(), starts.end(), 0);
+        for (std::size_t k = 0; k < round; ++k) {
+            draws[k] = {r.uniform(ends.back()), r.uniform(sample_chain_bound)};
+            map_of[k] = static_cast<std::size_t>(std::upper_bound(ends.begin(), ends.end(), draws[k].bucket) - ends.begin());
+            ++starts[map_of[k] + 1];
+        }
+        // draws grouped by map, each group in draw order.
+        for (std::size_t i = 0; i < ends.size(); ++i) starts[i + 1] += starts[i];
+        by_map.resize(round);
+        for (std::size_t k = 0; k < round; ++k) by_map[starts[map_of[k]]++] = k;
+        got.assign(round, {});
+        hit.assign(round, 0);
+        for (std::size_t i = 0, d = 0; i < ends.size(); ++i) {
+            std::size_t end = starts[i], first = i ? ends[i - 1] : 0;
+            if (d == end) continue;
+            with_map(i, [&](const auto& m) {
+                for (; d < end; ++d) {
+                    std::size_t k = by_map[d];
+                    if (const auto* kv = sample_chain(m, draws[k].bucket - first, draws[k].at)) {
+                        got[k] = kv->first;
+                        hit[k] = 1;
+                    }
+                }
+            });
+        }
+        std::size_t before = out.size();
+        for (std::size_t k = 0; k < round && out.size() < n; ++k)
+            if (hit[k]) out.push_back(std::move(got[k]));
+        if (out.size() > before) {
+            missed = 0;
+            count_at = sample_max_tries / 16;
+            continue;
+        }
+        if ((missed += round) < count_at) continue;
+        count_at *= 2;
+        std::size_t keys = 0;
+        for (std::size_t i = 0; i < ends.size(); ++i) with_map(i, [&](const auto& m) { keys += m.size(); });
+        if (!keys) break;
+        if (keys > 128 * (n - out.size()) && missed < sample_max_tries) continue;
+        got.clear();
+        for (std::size_t i = 0; i < ends.size(); ++i)
+            with_map(i, [&](const auto& m) {
+                for (const auto& kv : m) got.push_back(kv.first);
+            });
+        if (got.empty()) break;
+        while (out.size() < n) out.push_back(got[r.uniform(got.size())]);
+    }
+    return out;
+}
+
+} // namespace dsa
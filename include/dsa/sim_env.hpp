@@ -0,0 +1,280 @@
+#pragma once
+
+// env that puts a simulated device in front of another env. every read,
+// write and sync is charged against a device model with latency, bandwidth,
+// iops and fsync cost, and the caller is held until the modelled request
+// would have completed. the base env still stores the bytes, so this works
+// in front of the real filesystem as well as an in-memory one.
+//
+// on the virtual clock nothing actually sleeps: the env's clock jumps to
+// each completion time instead. single-threaded runs on the virtual clock
+// are fully deterministic, including jitter and injected stalls. the clock
+// models no overlap between cpu and i/o, and a sequential_reader's async
+// read ahead is a second thread, so scans that interleave other i/o with
+// one are deterministic only with async off.
+
+#include "deadline.hpp"
+#include "env.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <mutex>
+
+namespace dsa {
+
+struct device_profile {
+    std::uint64_t read_latency_ns = 0;
+    std::uint64_t write_latency_ns = 0;
+    // uniform extra latency in [0, jitter] per request, from a seeded prng.
+    std::uint64_t latency_jitter_ns = 0;
+    std::uint64_t read_bandwidth = 0;  // bytes per second, 0 is unlimited
+    std::uint64_t write_bandwidth = 0; // bytes per second, 0 is unlimited
+    std::uint64_t iops = 0;            // requests per second, 0 is unlimited
+    std::uint64_t fsync_ns = 0;
+    std::uint64_t seed = 1;
+
+    static device_profile hdd() {
+        device_profile p;
+        p.read_latency_ns = p.write_latency_ns = 4'000'000;
+        p.latency_jitter_ns = 4'000'000;
+        p.read_bandwidth = p.write_bandwidth = 150u << 20;
+        p.iops = 200;
+        p.fsync_ns = 8'000'000;
+        return p;
+    }
+
+    static device_profile sata_ssd() {
+        device_profile p;
+        p.read_latency_ns = 80'000;
+        p.write_latency_ns = 40'000;
+        p.latency_jitter_ns = 20'000;
+        p.read_bandwidth = p.write_bandwidth = 500u << 20;
+        p.iops = 80'000;
+        p.fsync_ns = 1'000'000;
+        return p;
+    }
+
+    // throttled cloud block volume.
+    static device_profile network_disk() {
+        device_profile p;
+        p.read_latency_ns = p.write_latency_ns = 1'000'000;
+        p.latency_jitter_ns = 500'000;
+        p.read_bandwidth = p.write_bandwidth = 125u << 20;
+        p.iops = 3'000;
+        p.fsync_ns = 2'000'000;
+        return p;
+    }
+};
+
+// window during which the device serves nothing. times are relative to the
+// creation of the env; a non-zero period repeats the window.
+struct device_stall {
+    std::uint64_t at_ns = 0;
+    std::uint64_t duration_ns = 0;
+    std::uint64_t period_ns = 0;
+};
+
+enum class sim_clock { real, virtual_time };
+
+struct device_stats {
+    std::uint64_t reads = 0;
+    std::uint64_t writes = 0;
+    std::uint64_t syncs = 0;
+    std::uint64_t read_bytes = 0;
+    std::uint64_t write_bytes = 0;
+    std::uint64_t busy_ns = 0;    // time the device spent serving requests
+    std::uint64_t wait_ns = 0;    // time callers spent waiting, summed
+    std::uint64_t stalled_ns = 0; // part of wait_ns caused by stalls
+    std::uint64_t rejected = 0;   // reads refused for missing their deadline
+};
+
+class sim_env : public env {
+public:
+    enum class op { read, write, sync };
+
+    sim_env(env& base, device_profile profile, sim_clock clock = sim_clock::real)
+        : base_(base), profile_(profile), clock_(clock), rng_(profile.seed),
+          epoch_(clock == sim_clock::real ? base.now_ns() : 0) {}
+
+    const device_profile& profile() const { return profile_; }
+
+    void add_stall(device_stall s) {
+        std::lock_guard<std::mutex> g(mu_);
+        stalls_.push_back(s);
+    }
+
+    device_stats stats() const {
+        std::lock_guard<std::mutex> g(mu_);
+        return stats_;
+    }
+
+    // charges one request of `bytes` to the device and returns once it has
+    // completed. files opened through this env call it for every operation.
+    // a read that would complete after the caller's deadline is refused with
+    // deadline_exceeded before it takes any device time.
+    void charge(op kind, std::uint64_t bytes) {
+        const deadline_scope* scope = kind == op::read ? deadline_scope::active() : nullptr;
+        if (scope) scope->check();
+        std::uint64_t now, done;
+        {
+            std::lock_guard<std::mutex> g(mu_);
+            now = clock_ == sim_clock::virtual_time ? vclock_ : base_.now_ns() - epoch_;
+            std::uint64_t queued = std::max(now, next_free_);
+            std::uint64_t start = skip_stalls(queued);
+
+            std::uint64_t occupy, latency;
+            bool rd = kind == op::read;
+            if (kind == op::sync) {
+                occupy = profile_.fsync_ns;
+                latency = 0;
+            } else {
+                occupy = transfer_ns(bytes, rd ? profile_.read_bandwidth : profile_.write_bandwidth);
+                if (profile_.iops) occupy = std::max<std::uint64_t>(occupy, 1'000'000'000 / profile_.iops);
+                latency = rd ? profile_.read_latency_ns : profile_.write_latency_ns;
+                if (profile_.latency_jitter_ns) latency += next_random() % (profile_.latency_jitter_ns + 1);
+            }
+            if (scope && scope->deadline_ns() != deadline_scope::none &&
+                start + occupy + latency > scope->deadline_ns() - (clock_ == sim_clock::real ? epoch_ : 0)) {
+                ++stats_.rejected;
+                throw deadline_exceeded("deadline exceeded: device busy");
+            }
+
+            stats_.stalled_ns += start - queued;
+            if (kind == op::sync) {
+                ++stats_.syncs;
+            } else if (rd) {
+                ++stats_.reads;
+                stats_.read_bytes += bytes;
+            } else {
+                ++stats_.writes;
+                stats_.write_bytes += bytes;
+            }
+            next_free_ = start + occupy;
+            done = start + occupy + latency;
+            stats_.busy_ns += occupy;
+            stats_.wait_ns += done - now;
+            if (clock_ == sim_clock::virtual_time) vclock_ = std::max(vclock_, done);
+        }
+        if (clock_ == sim_clock::real && done > now) base_.sleep_ns(done - now);
+    }
+
+    std::unique_ptr<file> open(const std::string& path, open_mode mode) override;
+
+    bool exists(const std::string& path) override { return base_.exists(path); }
+    std::vector<std::string> list(const std::string& dir) override { return base_.list(dir); }
+
+    // metadata updates are journaled by real filesystems, so they cost one
+    // small write each.
+    void remove(const std::string& path) override {
+        charge(op::write, 0);
+        base_.remove(path);
+    }
+    void rename(const std::string& from, const std::string& to) override {
+        charge(op::write, 0);
+        base_.rename(from, to);
+    }
+    void create_dir(const std::string& dir) override {
+        charge(op::write, 0);
+        base_.create_dir(dir);
+    }
+
+    std::uint64_t now_ns() override {
+        if (clock_ == sim_clock::real) return base_.now_ns();
+        std::lock_guard<std::mutex> g(mu_);
+        return vclock_;
+    }
+
+    void sleep_ns(std::uint64_t ns) override {
+        if (clock_ == sim_clock::real) return base_.sleep_ns(ns);
+        std::lock_guard<std::mutex> g(mu_);
+        vclock_ += ns;
+    }
+
+private:
+    static std::uint64_t transfer_ns(std::uint64_t bytes, std::uint64_t bandwidth) {
+        if (!bandwidth) return 0;
+        return static_cast<std::uint64_t>(static_cast<double>(bytes) * 1e9 / static_cast<double>(bandwidth));
+    }
+
+    std::uint64_t skip_stalls(std::uint64_t t) const {
+        for (bool moved = true; moved;) {
+            moved = false;
+            for (const device_stall& s : stalls_) {
+                if (t < s.at_ns || !s.duration_ns) continue;
+                std::uint64_t phase = t - s.at_ns;
+                if (s.period_ns) phase %= s.period_ns;
+                else if (phase >= s.duration_ns) continue;
+                if (phase < s.duration_ns) {
+                    t += s.duration_ns - phase;
+                    moved = true;
+                }
+            }
+        }
+        return t;
+    }
+
+    std::uint64_t next_random() {
+        std::uint64_t z = (rng_ += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    env& base_;
+    device_profile profile_;
+    sim_clock clock_;
+
+    mutable std::mutex mu_;
+    std::vector<device_stall> stalls_;
+    device_stats stats_;
+    std::uint64_t rng_;
+    std::uint64_t epoch_;
+    std::uint64_t vclock_ = 0;
+    std::uint64_t next_free_ = 0;
+};
+
+class sim_file : public file {
+public:
+    sim_file(sim_env& owner, std::unique_ptr<file> base) : owner_(owner), base_(std::move(base)) {}
+
+    // the deadline was judged against the device when charging, so the base
+    // env does not judge it again.
+    std::size_t read(std::uint64_t offset, char* buf, std::size_t n) override {
+        stage_scope io(stage::io);
+        owner_.charge(sim_env::op::read, n);
+        deadline_exempt charged;
+        return base_->read(offset, buf, n);
+    }
+    void write(std::uint64_t offset, std::string_view data) override {
+        stage_scope io(stage::io);
+        owner_.charge(sim_env::op::write, data.size());
+        base_->write(offset, data);
+    }
+    std::uint64_t append(std::string_view data) override {
+        stage_scope io(stage::io);
+        owner_.charge(sim_env::op::write, data.size());
+        return base_->append(data);
+    }
+    void sync() override {
+        stage_scope io(stage::io);
+        owner_.charge(sim_env::op::sync, 0);
+        base_->sync();
+    }
+    std::uint64_t size() const override { return base_->size(); }
+    void truncate(std::uint64_t n) override {
+        owner_.charge(sim_env::op::write, 0);
+        base_->truncate(n);
+    }
+    // loads through a mapping are page-cache hits and are not charged.
+    std::unique_ptr<mapping> map(std::uint64_t n) override { return base_->map(n); }
+
+private:
+    sim_env& owner_;
+    std::unique_ptr<file> base_;
+};
+
+inline std::unique_ptr<file> sim_env::open(const std::string& path, open_mode mode) {
+    return std::make_unique<sim_file>(*this, base_.open(path, mode));
+}
+
+} // namespace dsa
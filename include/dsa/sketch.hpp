@@ -0,0 +1,85 @@
+#pragma once
+
+// mergeable summaries of a key stream. hyperloglog estimates how many
+// distinct keys it has seen with a standard error of 1.04 / sqrt(2^p) in
+// 2^p bytes; data_sketch pairs one with a histogram of value sizes, whose
+// percentiles are within ~6% (see histogram.hpp). both merge by taking the
+// union, so summaries kept per file or per shard combine into one for any
+// set of them without touching the data. neither can forget a key: they
+// describe what was written, deletes included.
+
+#include "hash.hpp"
+#include "histogram.hpp"
+
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+namespace dsa {
+
+class hyperloglog {
+public:
+    // precision p in [4, 18]: 2^p one-byte registers.
+    explicit hyperloglog(unsigned p = 12) : p_(p) {
+        if (p < 4 || p > 18) throw std::invalid_argument("hyperloglog: precision must be in [4, 18]");
+        regs_.assign(std::size_t{1} << p, 0);
+    }
+
+    unsigned precision() const { return p_; }
+
+    void add(std::string_view key) { add_hash(hash64(key)); }
+
+    // h must be well mixed in every bit, as hash64's output is.
+    void add_hash(std::uint64_t h) {
+        std::uint64_t rest = h << p_ | std::uint64_t{1} << (p_ - 1);
+        auto rank = static_cast<std::uint8_t>(__builtin_clzll(rest) + 1);
+        std::uint8_t& r = regs_[h >> (64 - p_)];
+        if (rank > r) r = rank;
+    }
+
+    void merge(const hyperloglog& o) {
+        if (o.p_ != p_) throw std::invalid_argument("hyperloglog: merging sketches of different precision");
+        for (std::size_t i = 0; i < regs_.size(); ++i) regs_[i] = std::max(regs_[i], o.regs_[i]);
+    }
+
+    void clear() { std::fill(regs_.begin(), regs_.end(), 0); }
+
+    // flajolet et al.'s estimator with linear counting for small sets. with
+    // 64-bit hashes no large-range correction is needed.
+    double estimate() const {
+        double m = static_cast<double>(regs_.size());
+        double sum = 0;
+        std::size_t zeros = 0;
+        for (std::uint8_t r : regs_) {
+            sum += std::ldexp(1.0, -static_cast<int>(r));
+            zeros += r == 0;
+        }
+        double alpha = regs_.size() == 16 ? 0.673 : regs_.size() == 32 ? 0.697 : regs_.size() == 64 ? 0.709 : 0.7213 / (1 + 1.079 / m);
+        double e = alpha * m * m / sum;
+        if (e <= 2.5 * m && zeros) e = m * std::log(m / static_cast<double>(zeros));
+        return e;
+    }
+
+    std::size_t memory_bytes() const { return regs_.size(); }
+
+private:
+    unsigned p_;
+    std::vector<std::uint8_t> regs_;
+};
+
+struct data_sketch {
+    hyperloglog keys;
+    histogram value_sizes;
+
+    void add(std::string_view key, std::uint64_t value_size) {
+        keys.add(key);
+        value_sizes.record(value_size);
+    }
+
+    void merge(const data_sketch& o) {
+        keys.merge(o.keys);
+        value_sizes.merge(o.value_sizes);
+    }
+};
+
+} // namespace dsa
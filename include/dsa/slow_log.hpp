@@ -0,0 +1,225 @@
+#pragma once
+
+// slow-operation log. traced_store wraps any store and traces each of its
+// operations (see trace.hpp); an operation slower than the threshold, and
+// a random one in sample_every of the rest, is written to a fixed-size ring
+// with its time split by stage. aggregate latency histograms show that the
+// tail is bad; the log shows what the tail operations were waiting on.
+//
+// the ring is lock-free: writers claim slots with one atomic add and
+// publish each through a per-slot sequence number, readers copy a slot and
+// keep it only if the sequence did not move meanwhile. when full, the
+// oldest records are overwritten.
+//
+// an operation that is neither slow nor sampled costs two clock reads, the
+// stage switches it passes and a thread-local random draw; nothing is
+// written anywhere shared.
+
+#include "store.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace dsa {
+
+enum class op_kind : std::uint8_t { get, put, erase };
+
+inline const char* op_name(op_kind k) {
+    static const char* names[] = {"get", "put", "erase"};
+    return names[static_cast<unsigned>(k)];
+}
+
+struct slow_op_log_options {
+    std::uint64_t threshold_ns = 1'000'000; // log every operation at least this slow
+    std::uint32_t sample_every = 1000;      // and about one in this many others; 0 for none
+    std::uint32_t capacity = 1024;          // records kept, rounded up to a power of two
+};
+
+struct slow_op {
+    static constexpr std::size_t key_prefix = 24;
+
+    op_kind op = op_kind::get;
+    bool slow = false; // over the threshold rather than sampled
+    std::uint64_t start_ns = 0;
+    std::uint64_t total_ns = 0;
+    std::array<std::uint64_t, stage_count> stage_ns{};
+    std::uint32_t key_size = 0;
+    std::string key; // at most key_prefix bytes of it
+};
+
+struct slow_op_log_stats {
+    std::uint64_t slow = 0;
+    std::uint64_t sampled = 0;
+    std::uint64_t overwritten = 0;
+};
+
+class slow_op_log {
+public:
+    explicit slow_op_log(slow_op_log_options opts = {}) : opts_(opts) {
+        if (!opts_.capacity) throw std::invalid_argument("slow_op_log: capacity must be positive");
+        std::size_t n = 1;
+        while (n < opts_.capacity) n <<= 1;
+        slots_ = std::make_unique<slot[]>(n);
+        mask_ = n - 1;
+    }
+
+    const slow_op_log_options& options() const { return opts_; }
+
+    // whether an operation that took total_ns belongs in the log, and as
+    // which kind.
+    bool wants(std::uint64_t total_ns, bool& slow) const {
+        slow = total_ns >= opts_.threshold_ns;
+        if (slow) return true;
+        if (!opts_.sample_every) return false;
+        thread_local std::uint64_t x = 0x9e3779b97f4a7c15ull ^ reinterpret_cast<std::uintptr_t>(&x);
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        return x % opts_.sample_every == 0;
+    }
+
+    void record(const slow_op& r) {
+        std::uint64_t ticket = next_.fetch_add(1, std::memory_order_relaxed);
+        slot& s = slots_[ticket & mask_];
+        // odd while being written. a record can only come out mixed if a
+        // whole ring of others is written while this one writes its words,
+        // i.e. if this writer is descheduled mid-record; that is accepted.
+        s.seq.store(2 * ticket + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::uint64_t w[words] = {};
+        encode(r, w);
+        for (std::size_t i = 0; i < words; ++i) s.w[i].store(w[i], std::memory_order_relaxed);
+        s.seq.store(2 * ticket + 2, std::memory_order_release);
+        (r.slow ? slow_ : sampled_).fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // the records still in the ring, oldest first.
+    std::vector<slow_op> read() const {
+        std::uint64_t end = next_.load(std::memory_order_acquire);
+        std::uint64_t first = end > mask_ + 1 ? end - (mask_ + 1) : 0;
+        std::vector<slow_op> out;
+        out.reserve(static_cast<std::size_t>(end - first));
+        for (std::uint64_t t = first; t < end; ++t) {
+            const slot& s = slots_[t & mask_];
+            if (s.seq.load(std::memory_order_acquire) != 2 * t + 2) continue;
+            std::uint64_t w[words];
+            for (std::size_t i = 0; i < words; ++i) w[i] = s.w[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (s.seq.load(std::memory_order_relaxed) != 2 * t + 2) continue;
+            out.push_back(decode(w));
+        }
+        return out;
+    }
+
+    slow_op_log_stats stats() const {
+        slow_op_log_stats st;
+        st.slow = slow_.load(std::memory_order_relaxed);
+        st.sampled = sampled_.load(std::memory_order_relaxed);
+        std::uint64_t n = next_.load(std::memory_order_relaxed);
+        st.overwritten = n > mask_ + 1 ? n - (mask_ + 1) : 0;
+        return st;
+    }
+
+private:
+    // a record as words: op | slow << 8 | key_size << 32, start, total, the
+    // stages, then the key prefix.
+    static constexpr std::size_t key_words = slow_op::key_prefix / 8;
+    static constexpr std::size_t words = 3 + stage_count + key_words;
+
+    struct slot {
+        std::atomic<std::uint64_t> seq{0};
+        std::atomic<std::uint64_t> w[words] = {};
+    };
+
+    static void encode(const slow_op& r, std::uint64_t* w) {
+        w[0] = static_cast<std::uint64_t>(r.op) | std::uint64_t{r.slow} << 8 | std::uint64_t{r.key_size} << 32;
+        w[1] = r.start_ns;
+        w[2] = r.total_ns;
+        for (unsigned i = 0; i < stage_count; ++i) w[3 + i] = r.stage_ns[i];
+        std::memcpy(w + 3 + stage_count, r.key.data(), std::min(r.key.size(), slow_op::key_prefix));
+    }
+
+    static slow_op decode(const std::uint64_t* w) {
+        slow_op r;
+        r.op = static_cast<op_kind>(w[0] & 0xff);
+        r.slow = (w[0] >> 8) & 1;
+        r.key_size = static_cast<std::uint32_t>(w[0] >> 32);
+        r.start_ns = w[1];
+        r.total_ns = w[2];
+        for (unsigned i = 0; i < stage_count; ++i) r.stage_ns[i] = w[3 + i];
+        r.key.assign(reinterpret_cast<const char*>(w + 3 + stage_count), std::min<std::size_t>(r.key_size, slow_op::key_prefix));
+        return r;
+    }
+
+    slow_op_log_options opts_;
+    std::unique_ptr<slot[]> slots_;
+    std::uint64_t mask_ = 0;
+    std::atomic<std::uint64_t> next_{0};
+    std::atomic<std::uint64_t> slow_{0}, sampled_{0};
+};
+
+// a store whose operations go to log when slow or sampled.
+class traced_store : public store {
+public:
+    traced_store(std::unique_ptr<store> inner, slow_op_log& log) : inner_(std::move(inner)), log_(log) {}
+
+    store& inner() { return *inner_; }
+
+    void put(std::string_view key, std::string_view value) override {
+        op_trace t;
+        inner_->put(key, value);
+        done(t, op_kind::put, key);
+    }
+
+    bool get(std::string_view key, std::string& value) override {
+        op_trace t;
+        bool found = inner_->get(key, value);
+        done(t, op_kind::get, key);
+        return found;
+    }
+
+    bool get(std::string_view key, std::pmr::string& value) override {
+        op_trace t;
+        bool found = inner_->get(key, value);
+        done(t, op_kind::get, key);
+        return found;
+    }
+
+    bool erase(std::string_view key) override {
+        op_trace t;
+        bool found = inner_->erase(key);
+        done(t, op_kind::erase, key);
+        return found;
+    }
+
+    void sync() override { inner_->sync(); }
+    std::vector<std::string> sample(std::size_t n, std::uint64_t seed) override { return inner_->sample(n, seed); }
+    std::uint64_t key_count() override { return inner_->key_count(); }
+
+private:
+    // operations that throw are not logged; their caller sees why.
+    void done(op_trace& t, op_kind op, std::string_view key) {
+        std::uint64_t end = op_trace::now(), total = end - t.start();
+        bool slow;
+        if (!log_.wants(total, slow)) return;
+        slow_op r;
+        r.op = op;
+        r.slow = slow;
+        r.start_ns = t.start();
+        r.total_ns = total;
+        r.stage_ns = t.finish(end);
+        r.key_size = static_cast<std::uint32_t>(key.size());
+        r.key.assign(key.substr(0, slow_op::key_prefix));
+        log_.record(r);
+    }
+
+    std::unique_ptr<store> inner_;
+    slow_op_log& log_;
+};
+
+} // namespace dsa
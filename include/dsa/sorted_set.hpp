@@ -0,0 +1,438 @@
+#pragma once
+
+// sorted set: members with a score, ordered by (score, member), in the style
+// of a redis zset. a skiplist whose links carry span widths gives insert,
+// erase, rank, select by rank and range by score in O(log n); a hash map
+// from member to score makes score lookups O(1) and lets an update find the
+// node it replaces.
+//
+// the set lives in memory and is made durable by a journal of updates,
+// replayed on open and rewritten as a snapshot once mostly superseded:
+//
+// record: crc32c:4 op:1 score:8 member_size:4 member
+//
+// op 1 sets member's score, op 2 removes member. scores are ieee doubles
+// stored by bit pattern; nan is rejected.
+
+#include "coding.hpp"
+#include "crc32c.hpp"
+#include "deadline.hpp"
+#include "env.hpp"
+#include "reader.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace dsa {
+
+struct sorted_set_options {
+    // sync the journal after every update.
+    bool sync_writes = false;
+    // rewrite the journal once it is this many times the snapshot size ...
+    double compact_ratio = 4.0;
+    // ... and at least this large.
+    std::uint64_t compact_min_bytes = 4u << 20;
+};
+
+struct sorted_set_stats {
+    std::uint64_t members = 0;
+    std::uint64_t levels = 0;
+    std::uint64_t journal_bytes = 0;
+    std::uint64_t compactions = 0;
+};
+
+class sorted_set {
+public:
+    struct entry {
+        std::string member;
+        double score;
+    };
+
+    sorted_set(env& e, std::string dir, sorted_set_options opts = {}) : env_(e), dir_(std::move(dir)), opts_(opts) {
+        env_.create_dir(dir_);
+        head_ = make_node(max_level, 0, {});
+        recover();
+    }
+
+    ~sorted_set() {
+        try {
+            sync();
+        } catch (const io_error&) {
+        }
+        for (node* n = head_; n;) {
+            node* next = n->next[0].to;
+            free_node(n);
+            n = next;
+        }
+    }
+
+    sorted_set(const sorted_set&) = delete;
+    sorted_set& operator=(const sorted_set&) = delete;
+
+    // sets member's score. returns whether member is new.
+    bool add(std::string_view member, double score) {
+        if (std::isnan(score)) throw std::invalid_argument("sorted_set: nan score");
+        auto g = lock_within_deadline<std::unique_lock<std::shared_mutex>>(mu_);
+        log(set_op, score, member);
+        bool added = apply_set(member, score);
+        maybe_compact();
+        return added;
+    }
+
+    // adds delta to member's score, starting from 0 if absent, and returns
+    // the new score.
+    double increment(std::string_view member, double delta) {
+        auto g = lock_within_deadline<std::unique_lock<std::shared_mutex>>(mu_);
+        auto it = scores_.find(std::string(member));
+        double score = (it == scores_.end() ? 0 : it->second) + delta;
+        if (std::isnan(score)) throw std::invalid_argument("sorted_set: nan score");
+        log(set_op, score, member);
+        apply_set(member, score);
+        maybe_compact();
+        return score;
+    }
+
+    bool erase(std::string_view member) {
+        auto g = lock_within_deadline<std::unique_lock<std::shared_mutex>>(mu_);
+        auto it = scores_.find(std::string(member));
+        if (it == scores_.end()) return false;
+        log(erase_op, 0, member);
+        unlink(it->second, member);
+        scores_.erase(it);
+        maybe_compact();
+        return true;
+    }
+
+    // removes and returns the lowest-ranked member.
+    std::optional<entry> pop_min() {
+        auto g = lock_within_deadline<std::unique_lock<std::shared_mutex>>(mu_);
+        node* first = head_->next[0].to;
+        if (!first) return std::nullopt;
+        entry e{first->member, first->score};
+        log(erase_op, 0, e.member);
+        unlink(e.score, e.member);
+        scores_.erase(e.member);
+        maybe_compact();
+        return e;
+    }
+
+    std::optional<double> score(std::string_view member) const {
+        std::shared_lock<std::shared_mutex> g(mu_);
+        auto it = scores_.find(std::string(member));
+        if (it == scores_.end()) return std::nullopt;
+        return it->second;
+    }
+
+    // 0-based position of member in ascending order.
+    std::optional<std::uint64_t> rank(std::string_view member) const {
+        std::shared_lock<std::shared_mutex> g(mu_);
+        auto it = scores_.find(std::string(member));
+        if (it == scores_.end()) return std::nullopt;
+        std::uint64_t r = 0;
+        node* x = head_;
+        for (int i = level_ - 1; i >= 0; --i) {
+            while (x->next[i].to && !less(it->second, member, x->next[i].to)) {
+                r += x->next[i].span;
+                x = x->next[i].to;
+            }
+        }
+        return r - 1;
+    }
+
+    // members ranked [first, last), ascending.
+    std::vector<entry> range_by_rank(std::uint64_t first, std::uint64_t last) const {
+        std::shared_lock<std::shared_mutex> g(mu_);
+        std::vector<entry> out;
+        last = std::min<std::uint64_t>(last, scores_.size());
+        if (first >= last) return out;
+        out.reserve(static_cast<std::size_t>(last - first));
+        for (node* x = select(first); x && out.size() < last - first; x = x->next[0].to) out.push_back({x->member, x->score});
+        return out;
+    }
+
+    // members with min <= score <= max, ascending, at most limit of them.
+    std::vector<entry> range_by_score(double min, double max, std::size_t limit = ~std::size_t{0}) const {
+        std::shared_lock<std::shared_mutex> g(mu_);
+        std::vector<entry> out;
+        for (node* x = lower_bound(min); x && x->score <= max && out.size() < limit; x = x->next[0].to)
+            out.push_back({x->member, x->score});
+        return out;
+    }
+
+    // number of members with min <= score <= max, in O(log n).
+    std::uint64_t count(double min, double max) const {
+        std::shared_lock<std::shared_mutex> g(mu_);
+        if (min > max) return 0;
+        return rank_below(max, true) - rank_below(min, false);
+    }
+
+    std::uint64_t size() const {
+        std::shared_lock<std::shared_mutex> g(mu_);
+        return scores_.size();
+    }
+
+    void sync() {
+        std::unique_lock<std::shared_mutex> g(mu_);
+        journal_->sync();
+    }
+
+    // rewrites the journal as a snapshot of the current set.
+    void compact() {
+        std::unique_lock<std::shared_mutex> g(mu_);
+        rewrite();
+    }
+
+    sorted_set_stats stats() const {
+        std::shared_lock<std::shared_mutex> g(mu_);
+        sorted_set_stats s;
+        s.members = scores_.size();
+        s.levels = static_cast<std::uint64_t>(level_);
+        s.journal_bytes = journal_->size();
+        s.compactions = compactions_;
+        return s;
+    }
+
+private:
+    static constexpr int max_level = 32;
+    static constexpr char set_op = 1, erase_op = 2;
+    static constexpr std::size_t record_header = 17;
+
+    struct node;
+
+    struct link {
+        node* to;
+        std::uint64_t span; // rank distance to `to`
+    };
+
+    struct node {
+        double score;
+        std::string member;
+        link* next; // one per level, allocated right after the node
+    };
+
+    static node* make_node(int levels, double score, std::string_view member) {
+        void* p = ::operator new(sizeof(node) + sizeof(link) * static_cast<std::size_t>(levels));
+        node* n = new (p) node{score, std::string(member), nullptr};
+        n->next = reinterpret_cast<link*>(static_cast<char*>(p) + sizeof(node));
+        for (int i = 0; i < levels; ++i) new (&n->next[i]) link{nullptr, 0};
+        return n;
+    }
+
+    static void free_node(node* n) {
+        n->~node();
+        ::operator delete(n);
+    }
+
+    // whether (score, member) orders before n.
+    static bool less(double score, std::string_view member, const node* n) {
+        return score < n->score || (score == n->score && member < n->member);
+    }
+
+    // whether n orders before (score, member).
+    static bool before(const node* n, double score, std::string_view member) {
+        return n->score < score || (n->score == score && n->member < member);
+    }
+
+    int random_level() {
+        int l = 1;
+        while (l < max_level) {
+            rng_ ^= rng_ << 13;
+            rng_ ^= rng_ >> 7;
+            rng_ ^= rng_ << 17;
+            if ((rng_ & 3) != 0) break;
+            ++l;
+        }
+        return l;
+    }
+
+    bool apply_set(std::string_view member, double score) {
+        auto [it, added] = scores_.try_emplace(std::string(member), score);
+        if (!added) {
+            if (it->second == score) return false;
+            unlink(it->second, member);
+            it->second = score;
+        }
+        insert(score, it->first);
+        return added;
+    }
+
+    void insert(double score, std::string_view member) {
+        node* update[max_level];
+        std::uint64_t rank[max_level];
+        node* x = head_;
+        for (int i = level_ - 1; i >= 0; --i) {
+            rank[i] = i == level_ - 1 ? 0 : rank[i + 1];
+            while (x->next[i].to && before(x->next[i].to, score, member)) {
+                rank[i] += x->next[i].span;
+                x = x->next[i].to;
+            }
+            update[i] = x;
+        }
+        int l = random_level();
+        if (l > level_) {
+            for (int i = level_; i < l; ++i) {
+                rank[i] = 0;
+                update[i] = head_;
+                update[i]->next[i].span = scores_.size() - 1;
+            }
+            level_ = l;
+        }
+        node* n = make_node(l, score, member);
+        for (int i = 0; i < l; ++i) {
+            n->next[i].to = update[i]->next[i].to;
+            update[i]->next[i].to = n;
+            n->next[i].span = update[i]->next[i].span - (rank[0] - rank[i]);
+            update[i]->next[i].span = rank[0] - rank[i] + 1;
+        }
+        for (int i = l; i < level_; ++i) ++update[i]->next[i].span;
+    }
+
+    // removes the node for (score, member), which must exist.
+    void unlink(double score, std::string_view member) {
+        node* update[max_level];
+        node* x = head_;
+        for (int i = level_ - 1; i >= 0; --i) {
+            while (x->next[i].to && before(x->next[i].to, score, member)) x = x->next[i].to;
+            update[i] = x;
+        }
+        x = x->next[0].to;
+        for (int i = 0; i < level_; ++i) {
+            if (update[i]->next[i].to == x) {
+                update[i]->next[i].span += x->next[i].span - 1;
+                update[i]->next[i].to = x->next[i].to;
+            } else {
+                --update[i]->next[i].span;
+            }
+        }
+        while (level_ > 1 && !head_->next[level_ - 1].to) --level_;
+        free_node(x);
+    }
+
+    // node at 0-based rank r.
+    node* select(std::uint64_t r) const {
+        std::uint64_t traversed = 0;
+        node* x = head_;
+        ++r;
+        for (int i = level_ - 1; i >= 0; --i) {
+            while (x->next[i].to && traversed + x->next[i].span <= r) {
+                traversed += x->next[i].span;
+                x = x->next[i].to;
+            }
+            if (traversed == r) return x;
+        }
+        return nullptr;
+    }
+
+    // first node with score >= min.
+    node* lower_bound(double min) const {
+        node* x = head_;
+        for (int i = level_ - 1; i >= 0; --i)
+            while (x->next[i].to && x->next[i].to->score < min) x = x->next[i].to;
+        return x->next[0].to;
+    }
+
+    // number of members with score < s, or <= s if inclusive.
+    std::uint64_t rank_below(double s, bool inclusive) const {
+        std::uint64_t r = 0;
+        node* x = head_;
+        for (int i = level_ - 1; i >= 0; --i) {
+            while (x->next[i].to && (x->next[i].to->score < s || (inclusive && x->next[i].to->score == s))) {
+                r += x->next[i].span;
+                x = x->next[i].to;
+            }
+        }
+        return r;
+    }
+
+    static void encode(std::string& out, char op, double score, std::string_view member) {
+        std::size_t at = out.size();
+        out.append(4, '\0');
+        out += op;
+        std::uint64_t bits;
+        std::memcpy(&bits, &score, 8);
+        put_u64(out, bits);
+        put_u32(out, static_cast<std::uint32_t>(member.size()));
+        out.append(member);
+        std::uint32_t crc = crc32c(std::string_view(out).substr(at + 4));
+        for (int i = 0; i < 4; ++i) out[at + i] = static_cast<char>(crc >> (8 * i));
+    }
+
+    // caller holds mu_ exclusively.
+    void log(char op, double score, std::string_view member) {
+        record_.clear();
+        encode(record_, op, score, member);
+        journal_->append(record_);
+        if (opts_.sync_writes) journal_->sync();
+    }
+
+    // caller holds mu_ exclusively and has applied every logged update.
+    void maybe_compact() {
+        std::uint64_t snapshot = (record_header + 16) * scores_.size();
+        if (journal_->size() >= opts_.compact_min_bytes && static_cast<double>(journal_->size()) > opts_.compact_ratio * static_cast<double>(snapshot))
+            rewrite();
+    }
+
+    // caller holds mu_ exclusively.
+    void rewrite() {
+        std::string out;
+        for (node* x = head_->next[0].to; x; x = x->next[0].to) encode(out, set_op, x->score, x->member);
+        std::string tmp = join_path(dir_, "journal.tmp");
+        auto f = env_.open(tmp, open_mode::truncate);
+        f->append(out);
+        f->sync();
+        journal_.reset();
+        env_.rename(tmp, join_path(dir_, "journal"));
+        journal_ = env_.open(join_path(dir_, "journal"), open_mode::read_write);
+        ++compactions_;
+    }
+
+    void recover() {
+        if (env_.exists(join_path(dir_, "journal.tmp"))) env_.remove(join_path(dir_, "journal.tmp"));
+        journal_ = env_.open(join_path(dir_, "journal"), open_mode::create);
+        sequential_reader in(*journal_);
+        std::uint64_t off = 0, end = journal_->size();
+        while (off < end) {
+            std::string_view h = in.read(off, record_header);
+            bool ok = h.size() == record_header;
+            std::uint64_t n = ok ? record_header + get_u32(h.data() + 13) : 0;
+            std::string_view rec = ok ? in.read(off, n) : std::string_view();
+            if (!ok || rec.size() != n || get_u32(rec.data()) != crc32c(rec.substr(4))) {
+                journal_->truncate(off);
+                break;
+            }
+            std::string_view member = rec.substr(record_header);
+            if (rec[4] == set_op) {
+                std::uint64_t bits = get_u64(rec.data() + 5);
+                double score;
+                std::memcpy(&score, &bits, 8);
+                apply_set(member, score);
+            } else if (auto it = scores_.find(std::string(member)); it != scores_.end()) {
+                unlink(it->second, member);
+                scores_.erase(it);
+            }
+            off += n;
+        }
+    }
+
+    env& env_;
+    std::string dir_;
+    sorted_set_options opts_;
+
+    mutable std::shared_mutex mu_;
+    node* head_;
+    int level_ = 1;
+    std::unordered_map<std::string, double> scores_;
+    std::uint64_t rng_ = 0x9e3779b97f4a7c15ull;
+
+    std::unique_ptr<file> journal_;
+    std::string record_;
+    std::uint64_t compactions_ = 0;
+};
+
+} // namespace dsa
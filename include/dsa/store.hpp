@@ -0,0 +1,61 @@
+#pragma once
+
+// the key-value interface every backend implements. keys and values are
+// arbitrary byte strings.
+//
+// a value can also be read into a std::pmr::string, so that it comes from
+// the caller's memory resource (e.g. a per-request monotonic arena) rather
+// than the global heap. backends that override get should also bring the
+// pmr overload into scope (using store::get) or override it.
+//
+// sample draws random keys from the backend's index (hash buckets, tree
+// pages) rather than reading every key; see sample.hpp. hlog cannot: its
+// index chains hold every version of a key, in memory and on disk alike,
+// so a draw would read and deduplicate a whole chain, and it keeps no count
+// of its keys to weigh draws by.
+
+#include <cstdint>
+#include <memory_resource>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace dsa {
+
+class store {
+public:
+    virtual ~store() = default;
+
+    virtual void put(std::string_view key, std::string_view value) = 0;
+    // returns false if key is absent, leaving value untouched.
+    virtual bool get(std::string_view key, std::string& value) = 0;
+    // the same, allocating value from its own memory resource. by default
+    // it copies out of a per-thread buffer that is reused across calls, so
+    // the heap is not touched once that buffer has grown; backends copy
+    // straight into value instead where they can.
+    virtual bool get(std::string_view key, std::pmr::string& value) {
+        thread_local std::string buf;
+        if (!get(key, buf)) return false;
+        value.assign(buf);
+        return true;
+    }
+    // returns whether key was present.
+    virtual bool erase(std::string_view key) = 0;
+    // makes every completed write durable. no-op for volatile backends.
+    virtual void sync() {}
+    // n keys drawn uniformly at random, with replacement, from those
+    // present; fewer if the store is or becomes empty. the same seed draws
+    // the same keys from an unchanged store. backends without a way to
+    // sample short of a full scan throw std::logic_error.
+    virtual std::vector<std::string> sample(std::size_t n, std::uint64_t seed) {
+        (void)n;
+        (void)seed;
+        throw std::logic_error("store: this backend cannot sample keys");
+    }
+    // how many keys are present, for backends that keep count; others throw
+    // std::logic_error. a store over several weighs its samples by it.
+    virtual std::uint64_t key_count() { throw std::logic_error("store: this backend does not count its keys"); }
+};
+
+} // namespace dsa
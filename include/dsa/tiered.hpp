@@ -0,0 +1,702 @@
+#pragma once
+
+// tiered store: places each key range in one of three tiers by how often it
+// is accessed, and moves ranges between them in the background.
+//
+//   warm: a bptree_store in dir/warm, the durable home of every key that is
+//         not cold.
+//   hot:  a mem_store holding a copy of the hottest warm ranges, up to
+//         hot_fraction of the data. writes go through to both.
+//   cold: ranges nobody has touched for cold_after rounds, each moved out
+//         of the tree into one compressed block file.
+//
+// the key space is cut into contiguous ranges. every access bumps its
+// range's hit counter; each rebalance round decays those into a heat, splits
+// ranges grown past max_range_keys, picks the ranges with the most heat per
+// byte for the hot tier, freezes idle ones and thaws cold ones read often
+// enough. a write to a cold range thaws it first.
+//
+// block:    crc32c:4 compress((key_size:varint key value_size:varint value)*)
+// manifest: (start_size:varint start end_size:varint end block:varint
+//           keys:varint bytes:varint)* crc32c:4
+//
+// the manifest lists the cold ranges, with an empty end meaning no upper
+// bound; everything else is warm. a range is frozen by writing and syncing
+// its block, publishing a manifest naming it and only then erasing it from
+// the tree, and thawed in the opposite order, so after a crash recovery
+// deletes blocks no manifest names and drops tree copies of cold keys.
+
+#include "bptree.hpp"
+#include "coding.hpp"
+#include "compress.hpp"
+#include "crc32c.hpp"
+#include "deadline.hpp"
+#include "env.hpp"
+#include "lock.hpp"
+#include "mem_store.hpp"
+#include "sample.hpp"
+#include "store.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+namespace dsa {
+
+struct tiered_options {
+    // share of the logical bytes kept in memory.
+    double hot_fraction = 0.05;
+    // split ranges holding more keys than this.
+    std::uint64_t max_range_keys = 4096;
+    // freeze a range after this many rounds without an access ...
+    std::uint32_t cold_after = 4;
+    // ... and thaw it once it is read this often in one round.
+    std::uint64_t thaw_hits = 64;
+    // run a rebalance round this often on a background thread. 0 leaves it
+    // to the caller.
+    std::uint64_t rebalance_interval_ms = 1000;
+    // decompressed cold blocks kept for reads.
+    std::uint32_t block_cache = 8;
+    bptree_options tree;
+};
+
+enum class tier : std::uint8_t { hot, warm, cold };
+
+struct tiered_stats {
+    std::uint64_t hot_ranges = 0;
+    std::uint64_t warm_ranges = 0;
+    std::uint64_t cold_ranges = 0;
+    std::uint64_t hot_bytes = 0;       // memory held by the hot copy
+    std::uint64_t warm_bytes = 0;      // estimated key and value bytes in the tree
+    std::uint64_t warm_file_bytes = 0; // tree pages in use
+    std::uint64_t cold_bytes = 0;      // key and value bytes in blocks
+    std::uint64_t cold_file_bytes = 0;
+    std::uint64_t hot_reads = 0;
+    std::uint64_t warm_reads = 0;
+    std::uint64_t cold_reads = 0;
+    std::uint64_t rebalances = 0;
+    std::uint64_t splits = 0;
+    std::uint64_t freezes = 0;
+    std::uint64_t thaws = 0;
+    std::uint64_t errors = 0; // background rounds that failed
+    lock_stats cache_lock;    // the cold block cache
+};
+
+class tiered_store : public store {
+public:
+    tiered_store(env& e, std::string dir, tiered_options opts = {})
+        : env_(e), dir_(std::move(dir)), opts_(opts), cache_size_(std::max<std::uint32_t>(opts.block_cache, 1)) {
+        if (opts_.hot_fraction < 0 || opts_.hot_fraction > 1) throw std::invalid_argument("tiered: hot_fraction must be in [0, 1]");
+        if (opts_.max_range_keys < 2) throw std::invalid_argument("tiered: max_range_keys must be at least 2");
+        env_.create_dir(dir_);
+        tree_ = std::make_unique<bptree_store>(env_, join_path(dir_, "warm"), opts_.tree);
+        recover();
+        if (opts_.rebalance_interval_ms) rebalancer_ = std::thread([this] { rebalance_loop(); });
+    }
+
+    ~tiered_store() override {
+        if (rebalancer_.joinable()) {
+            {
+                std::lock_guard<std::mutex> g(bg_mu_);
+                stop_ = true;
+            }
+            bg_cv_.notify_one();
+            rebalancer_.join();
+        }
+    }
+
+    tiered_store(const tiered_store&) = delete;
+    tiered_store& operator=(const tiered_store&) = delete;
+
+    void put(std::string_view key, std::string_view value) override {
+        {
+            auto g = lock_within_deadline<std::shared_lock<std::shared_mutex>>(mu_);
+            auto it = find(key);
+            if (it->second.where != tier::cold) {
+                write(it->second, key, &value);
+                return;
+            }
+        }
+        auto g = lock_within_deadline<std::unique_lock<std::shared_mutex>>(mu_);
+        auto it = find(key);
+        if (it->second.where == tier::cold) thaw(it);
+        write(it->second, key, &value);
+    }
+
+    bool get(std::string_view key, std::string& value) override {
+        tier from;
+        return get(key, value, from);
+    }
+
+    bool get(std::string_view key, std::pmr::string& value) override {
+        tier from;
+        return get(key, value, from);
+    }
+
+    // also reports which tier answered. String is std::string or
+    // std::pmr::string.
+    template <class String>
+    bool get(std::string_view key, String& value, tier& from) {
+        auto g = lock_within_deadline<std::shared_lock<std::shared_mutex>>(mu_);
+        range& r = find(key)->second;
+        r.hits.fetch_add(1, std::memory_order_relaxed);
+        from = r.where;
+        switch (r.where) {
+        case tier::hot:
+            hot_reads_.fetch_add(1, std::memory_order_relaxed);
+            return hot_.get(key, value);
+        case tier::warm:
+            warm_reads_.fetch_add(1, std::memory_order_relaxed);
+            return tree_->get(key, value);
+        case tier::cold:
+            break;
+        }
+        cold_reads_.fetch_add(1, std::memory_order_relaxed);
+        std::shared_ptr<const block> b = cached_block(r.block);
+        auto v = b->find(key);
+        if (!v) return false;
+        value.assign(*v);
+        return true;
+    }
+
+    bool erase(std::string_view key) override {
+        {
+            auto g = lock_within_deadline<std::shared_lock<std::shared_mutex>>(mu_);
+            auto it = find(key);
+            if (it->second.where != tier::cold) return write(it->second, key, nullptr);
+            // nothing to thaw for a key the block does not hold.
+            if (!cached_block(it->second.block)->find(key)) return false;
+        }
+        auto g = lock_within_deadline<std::unique_lock<std::shared_mutex>>(mu_);
+        auto it = find(key);
+        if (it->second.where == tier::cold) thaw(it);
+        return write(it->second, key, nullptr);
+    }
+
+    void sync() override { tree_->sync(); }
+
+    // the tree's keys and the cold blocks' are drawn from as one: each draw
+    // goes to the tree or to a cold range by the keys each holds, the
+    // tree's share is sampled from a snapshot of it, and a cold range's
+    // draws are read from its block, loaded once however many land there.
+    // the hot tier only copies tree ranges, so it is not drawn from. runs
+    // under the read lock, so no range changes tier meanwhile.
+    std::vector<std::string> sample(std::size_t n, std::uint64_t seed) override {
+        auto g = lock_within_deadline<std::shared_lock<std::shared_mutex>>(mu_);
+        bptree_store::read_txn t = tree_->begin_read();
+        // ends[0] is the tree's count, ends[i] that and the keys of colds
+        // up to colds[i - 1].
+        std::vector<range_map::const_iterator> colds;
+        std::vector<std::uint64_t> ends{t.entries()};
+        for (auto it = ranges_.cbegin(); it != ranges_.cend(); ++it) {
+            if (it->second.where != tier::cold) continue;
+            colds.push_back(it);
+            ends.push_back(ends.back() + it->second.keys);
+        }
+        std::vector<std::string> out;
+        if (!ends.back()) return out;
+        sample_rng r(seed);
+        std::vector<std::size_t> from(n); // 0 for the tree, else 1 + the index into colds
+        std::size_t tree_draws = 0;
+        for (std::size_t& w : from) {
+            w = static_cast<std::size_t>(std::upper_bound(ends.begin(), ends.end(), r.uniform(ends.back())) - ends.begin());
+            tree_draws += !w;
+        }
+        std::vector<std::string> tree_keys;
+        if (tree_draws) tree_keys = t.sample(tree_draws, r.next());
+        if (tree_keys.size() != tree_draws) throw io_error("tiered: tree sampled short");
+        std::vector<std::size_t> order(n);
+        for (std::size_t k = 0; k < n; ++k) order[k] = k;
+        std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return from[a] < from[b]; });
+        out.resize(n);
+        std::shared_ptr<const block> b;
+        std::size_t loaded = 0; // from[] value of b
+        for (std::size_t k : order) {
+            if (!from[k]) {
+                out[k] = std::move(tree_keys[--tree_draws]);
+                continue;
+            }
+            if (from[k] != loaded) {
+                b = cached_block(colds[from[k] - 1]->second.block);
+                loaded = from[k];
+            }
+            out[k] = std::string(b->entries[r.uniform(b->entries.size())].first);
+        }
+        return out;
+    }
+
+    std::uint64_t key_count() override {
+        auto g = lock_within_deadline<std::shared_lock<std::shared_mutex>>(mu_);
+        std::uint64_t n = tree_->begin_read().entries();
+        for (const auto& [start, r] : ranges_)
+            if (r.where == tier::cold) n += r.keys;
+        return n;
+    }
+
+    // one round of placement: decay heat, split large ranges, thaw busy
+    // cold ranges, freeze idle ones and refill the hot tier. runs on the
+    // background thread unless rebalance_interval_ms is 0.
+    void rebalance() {
+        deadline_exempt whole;
+        std::unique_lock<std::shared_mutex> g(mu_);
+        for (auto& [start, r] : ranges_) {
+            r.round_hits = r.hits.exchange(0, std::memory_order_relaxed);
+            r.heat = r.heat / 2 + static_cast<double>(r.round_hits);
+            r.idle = r.round_hits ? 0 : r.idle + 1;
+        }
+        for (auto it = ranges_.begin(); it != ranges_.end(); ++it) {
+            range& r = it->second;
+            if (r.where == tier::cold && r.round_hits >= opts_.thaw_hits) thaw(it);
+        }
+        split_and_merge();
+        for (auto it = ranges_.begin(); it != ranges_.end(); ++it) {
+            if (it->second.where == tier::cold || it->second.idle < opts_.cold_after) continue;
+            if (it->second.where == tier::hot) set_hot(it, false);
+            freeze(it);
+        }
+        place_hot();
+        ++rebalances_;
+    }
+
+    tiered_stats stats() const {
+        std::shared_lock<std::shared_mutex> g(mu_);
+        tiered_stats s;
+        for (const auto& [start, r] : ranges_) {
+            if (r.where == tier::cold) {
+                ++s.cold_ranges;
+                s.cold_bytes += r.bytes;
+            } else {
+                ++(r.where == tier::hot ? s.hot_ranges : s.warm_ranges);
+                s.warm_bytes += r.bytes;
+            }
+        }
+        s.hot_bytes = hot_.stats().bytes;
+        bptree_stats t = tree_->stats();
+        s.warm_file_bytes = (t.pages - t.free_pages) * opts_.tree.page_size;
+        s.cold_file_bytes = cold_file_bytes_;
+        s.hot_reads = hot_reads_.load(std::memory_order_relaxed);
+        s.warm_reads = warm_reads_.load(std::memory_order_relaxed);
+        s.cold_reads = cold_reads_.load(std::memory_order_relaxed);
+        s.rebalances = rebalances_;
+        s.splits = splits_;
+        s.freezes = freezes_;
+        s.thaws = thaws_;
+        s.errors = errors_.load(std::memory_order_relaxed);
+        s.cache_lock = cache_mu_.stats();
+        return s;
+    }
+
+private:
+    struct range {
+        std::string end; // exclusive; empty for no bound
+        tier where = tier::warm;
+        std::atomic<std::uint64_t> hits{0}; // since the last round
+        std::uint64_t round_hits = 0;
+        double heat = 0;
+        std::uint32_t idle = 0; // rounds without a hit
+        std::uint64_t keys = 0;
+        std::uint64_t bytes = 0;
+        std::uint32_t block = 0; // cold only
+        std::uint64_t file_bytes = 0;
+    };
+    using range_map = std::map<std::string, range, std::less<>>;
+
+    // a decompressed block, sorted by key.
+    struct block {
+        std::string data;
+        std::vector<std::pair<std::string_view, std::string_view>> entries;
+
+        std::optional<std::string_view> find(std::string_view key) const {
+            auto it = std::lower_bound(entries.begin(), entries.end(), key, [](const auto& e, std::string_view k) { return e.first < k; });
+            if (it == entries.end() || it->first != key) return std::nullopt;
+            return it->second;
+        }
+    };
+
+    // the range holding key. the first range always starts at "".
+    range_map::iterator find(std::string_view key) { return std::prev(ranges_.upper_bound(key)); }
+
+    // a put, or an erase if value is null, on a range that is not cold.
+    // the hot copy changes inside the tree's write transaction, so
+    // concurrent writers apply both in the same order. if the commit
+    // throws, the hot copy is put back from the tree before the
+    // transaction lets go of the writer lock.
+    bool write(range& r, std::string_view key, const std::string_view* value) {
+        r.hits.fetch_add(1, std::memory_order_relaxed);
+        bptree_store::write_txn t = tree_->begin_write();
+        if (value) {
+            t.put(key, *value);
+            if (r.where == tier::hot) hot_.put(key, *value);
+        } else {
+            if (!t.erase(key)) return false;
+            if (r.where == tier::hot) hot_.erase(key);
+        }
+        try {
+            t.commit();
+        } catch (...) {
+            if (r.where == tier::hot) {
+                std::string old;
+                if (tree_->get(key, old)) hot_.put(key, old);
+                else hot_.erase(key);
+            }
+            throw;
+        }
+        return true;
+    }
+
+    // the placement steps from here to cached_block run with mu_ held
+    // exclusively.
+    void measure(range_map::iterator it) {
+        bptree_store::read_txn t = tree_->begin_read();
+        it->second.keys = t.approximate_count(it->first, it->second.end);
+        it->second.bytes = t.approximate_size(it->first, it->second.end);
+    }
+
+    // splits ranges past max_range_keys at keys the tree picks, and joins
+    // neighbouring warm ranges that have shrunk to a quarter of it, so
+    // deletes do not leave a trail of empty ranges.
+    void split_and_merge() {
+        for (auto it = ranges_.begin(); it != ranges_.end(); ++it) {
+            if (it->second.where == tier::cold) continue;
+            measure(it);
+            if (it->second.keys <= opts_.max_range_keys) continue;
+            unsigned n = static_cast<unsigned>(std::min<std::uint64_t>(2 * it->second.keys / opts_.max_range_keys, 1024));
+            std::vector<std::string> cuts = tree_->begin_read().split(it->first, it->second.end, n);
+            if (cuts.size() < 3) continue;
+            range& first = it->second;
+            double heat = first.heat / static_cast<double>(cuts.size() - 1);
+            first.heat = heat;
+            for (std::size_t k = 1; k + 1 < cuts.size(); ++k) {
+                range& r = ranges_.try_emplace(cuts[k]).first->second;
+                r.end = cuts[k + 1];
+                r.where = first.where;
+                r.heat = heat;
+                r.idle = first.idle;
+            }
+            first.end = cuts[1];
+            measure(it);
+            // step over the new pieces, measuring each.
+            for (std::size_t k = 2; k < cuts.size(); ++k) measure(++it);
+            ++splits_;
+        }
+        for (auto it = ranges_.begin(); it != ranges_.end();) {
+            auto next = std::next(it);
+            if (next == ranges_.end()) break;
+            range &a = it->second, &b = next->second;
+            if (a.where == tier::warm && b.where == tier::warm && a.keys + b.keys <= opts_.max_range_keys / 4) {
+                a.end = b.end;
+                a.keys += b.keys;
+                a.bytes += b.bytes;
+                a.heat += b.heat;
+                a.idle = std::min(a.idle, b.idle);
+                a.hits.fetch_add(b.hits.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                ranges_.erase(next);
+            } else {
+                it = next;
+            }
+        }
+    }
+
+    // the ranges with the most heat per byte go hot until hot_fraction of
+    // all bytes is spoken for; the rest are evicted.
+    void place_hot() {
+        std::uint64_t total = 0;
+        std::vector<range_map::iterator> order;
+        for (auto it = ranges_.begin(); it != ranges_.end(); ++it) {
+            total += it->second.bytes;
+            if (it->second.where != tier::cold && it->second.heat > 0) order.push_back(it);
+        }
+        auto density = [](range_map::iterator it) { return it->second.heat / static_cast<double>(std::max<std::uint64_t>(it->second.bytes, 1)); };
+        std::sort(order.begin(), order.end(), [&](auto a, auto b) { return density(a) > density(b); });
+        double budget = opts_.hot_fraction * static_cast<double>(total);
+        std::vector<range_map::iterator> hot;
+        for (auto it : order) {
+            if (static_cast<double>(it->second.bytes) > budget) continue;
+            budget -= static_cast<double>(it->second.bytes);
+            hot.push_back(it);
+        }
+        for (auto it = ranges_.begin(); it != ranges_.end(); ++it)
+            if (it->second.where != tier::cold) set_hot(it, std::find(hot.begin(), hot.end(), it) != hot.end());
+    }
+
+    // loads a warm range into the hot tier, or evicts a hot one.
+    void set_hot(range_map::iterator it, bool hot) {
+        range& r = it->second;
+        if (hot == (r.where == tier::hot)) return;
+        bptree_store::read_txn t = tree_->begin_read();
+        for (auto c = t.range(it->first, r.end); c.valid(); c.next()) {
+            if (hot) hot_.put(c.key(), c.value());
+            else hot_.erase(c.key());
+        }
+        r.where = hot ? tier::hot : tier::warm;
+    }
+
+    // moves a warm range into a block of its own. an empty range stays warm.
+    void freeze(range_map::iterator it) {
+        range& r = it->second;
+        std::string raw;
+        std::uint64_t keys = 0;
+        {
+            bptree_store::read_txn t = tree_->begin_read();
+            for (auto c = t.range(it->first, r.end); c.valid(); c.next()) {
+                put_varint(raw, c.key().size());
+                raw.append(c.key());
+                put_varint(raw, c.value().size());
+                raw.append(c.value());
+                ++keys;
+            }
+        }
+        if (!keys) return;
+        std::string z = compress(raw);
+        std::string out;
+        put_u32(out, crc32c(z));
+        out += z;
+        std::uint32_t id = next_block_;
+        {
+            auto f = env_.open(block_path(id), open_mode::truncate);
+            f->append(out);
+            f->sync();
+        }
+        ++next_block_;
+        r.where = tier::cold;
+        r.block = id;
+        r.keys = keys;
+        r.bytes = raw.size();
+        r.file_bytes = out.size();
+        try {
+            write_manifest();
+        } catch (const io_error&) {
+            r.where = tier::warm;
+            r.block = 0;
+            r.file_bytes = 0;
+            env_.remove(block_path(id));
+            throw;
+        }
+        cold_file_bytes_ += out.size();
+        erase_from_tree(it->first, r.end);
+        ++freezes_;
+    }
+
+    // moves a cold range back into the tree.
+    void thaw(range_map::iterator it) {
+        deadline_exempt whole;
+        range& r = it->second;
+        std::shared_ptr<const block> b = cached_block(r.block);
+        {
+            bptree_store::write_txn t = tree_->begin_write();
+            for (const auto& [k, v] : b->entries) t.put(k, v);
+            t.commit();
+        }
+        // the manifest must not drop the block before the tree has it.
+        tree_->sync();
+        std::uint32_t id = r.block;
+        r.where = tier::warm;
+        r.idle = 0;
+        try {
+            write_manifest();
+        } catch (const io_error&) {
+            r.where = tier::cold;
+            throw;
+        }
+        cold_file_bytes_ -= r.file_bytes;
+        r.block = 0;
+        r.file_bytes = 0;
+        env_.remove(block_path(id));
+        {
+            std::lock_guard<adaptive_mutex> g(cache_mu_);
+            cache_.remove_if([&](const auto& e) { return e.first == id; });
+        }
+        ++thaws_;
+    }
+
+    void erase_from_tree(std::string_view lo, std::string_view hi) {
+        std::vector<std::string> keys;
+        {
+            bptree_store::read_txn t = tree_->begin_read();
+            for (auto c = t.range(lo, hi); c.valid(); c.next()) keys.emplace_back(c.key());
+        }
+        if (keys.empty()) return;
+        bptree_store::write_txn t = tree_->begin_write();
+        for (const std::string& k : keys) t.erase(k);
+        t.commit();
+    }
+
+    // a miss is charged to the cache stage, with the read and the
+    // decompression inside it to theirs; a hit is too quick to time.
+    std::shared_ptr<const block> cached_block(std::uint32_t id) {
+        {
+            std::lock_guard<adaptive_mutex> g(cache_mu_);
+            for (auto e = cache_.begin(); e != cache_.end(); ++e) {
+                if (e->first != id) continue;
+                cache_.splice(cache_.begin(), cache_, e);
+                return e->second;
+            }
+        }
+        stage_scope fill(stage::cache);
+        std::shared_ptr<const block> b = load_block(id);
+        std::lock_guard<adaptive_mutex> g(cache_mu_);
+        for (const auto& e : cache_)
+            if (e.first == id) return e.second;
+        cache_.emplace_front(id, b);
+        if (cache_.size() > cache_size_) cache_.pop_back();
+        return b;
+    }
+
+    std::shared_ptr<const block> load_block(std::uint32_t id) {
+        auto f = env_.open(block_path(id), open_mode::read_only);
+        std::string buf(static_cast<std::size_t>(f->size()), '\0');
+        read_exact(*f, 0, buf.data(), buf.size());
+        if (buf.size() < 4 || get_u32(buf.data()) != crc32c(std::string_view(buf).substr(4)))
+            throw io_error("tiered: corrupt block " + block_path(id));
+        auto b = std::make_shared<block>();
+        b->data = decompress(std::string_view(buf).substr(4));
+        std::string_view in = b->data;
+        while (!in.empty()) {
+            std::uint64_t n;
+            std::string_view k, v;
+            if (!get_varint(in, n) || n > in.size()) throw io_error("tiered: corrupt block " + block_path(id));
+            k = in.substr(0, n);
+            in.remove_prefix(n);
+            if (!get_varint(in, n) || n > in.size()) throw io_error("tiered: corrupt block " + block_path(id));
+            v = in.substr(0, n);
+            in.remove_prefix(n);
+            b->entries.emplace_back(k, v);
+        }
+        return b;
+    }
+
+    std::string block_path(std::uint32_t id) const {
+        char name[32];
+        std::snprintf(name, sizeof name, "%010u.blk", id);
+        return join_path(dir_, name);
+    }
+
+    void write_manifest() {
+        std::string out;
+        for (const auto& [start, r] : ranges_) {
+            if (r.where != tier::cold) continue;
+            put_varint(out, start.size());
+            out += start;
+            put_varint(out, r.end.size());
+            out += r.end;
+            put_varint(out, r.block);
+            put_varint(out, r.keys);
+            put_varint(out, r.bytes);
+        }
+        put_u32(out, crc32c(out));
+        std::string tmp = join_path(dir_, "manifest.tmp");
+        auto f = env_.open(tmp, open_mode::truncate);
+        f->append(out);
+        f->sync();
+        f.reset();
+        env_.rename(tmp, join_path(dir_, "manifest"));
+    }
+
+    void recover() {
+        if (env_.exists(join_path(dir_, "manifest.tmp"))) env_.remove(join_path(dir_, "manifest.tmp"));
+        struct cold {
+            std::string start, end;
+            std::uint64_t block, keys, bytes;
+        };
+        std::vector<cold> colds;
+        if (env_.exists(join_path(dir_, "manifest"))) {
+            auto f = env_.open(join_path(dir_, "manifest"), open_mode::read_only);
+            std::string buf(static_cast<std::size_t>(f->size()), '\0');
+            read_exact(*f, 0, buf.data(), buf.size());
+            if (buf.size() < 4 || get_u32(buf.data() + buf.size() - 4) != crc32c(std::string_view(buf).substr(0, buf.size() - 4)))
+                throw io_error("tiered: corrupt manifest");
+            std::string_view in = std::string_view(buf).substr(0, buf.size() - 4);
+            auto bytes = [&](std::string& s) {
+                std::uint64_t n;
+                if (!get_varint(in, n) || n > in.size()) throw io_error("tiered: corrupt manifest");
+                s.assign(in.substr(0, n));
+                in.remove_prefix(n);
+            };
+            while (!in.empty()) {
+                cold c;
+                bytes(c.start);
+                bytes(c.end);
+                if (!get_varint(in, c.block) || !get_varint(in, c.keys) || !get_varint(in, c.bytes)) throw io_error("tiered: corrupt manifest");
+                colds.push_back(std::move(c));
+            }
+        }
+        // blocks of unfinished freezes and finished thaws.
+        for (const std::string& name : env_.list(dir_)) {
+            unsigned id;
+            char ext[8];
+            if (std::sscanf(name.c_str(), "%10u.%7s", &id, ext) != 2 || std::string_view(ext) != "blk") continue;
+            next_block_ = std::max(next_block_, id + 1);
+            if (std::none_of(colds.begin(), colds.end(), [&](const cold& c) { return c.block == id; })) env_.remove(block_path(id));
+        }
+        // tree copies of cold keys are left by an unfinished freeze or thaw.
+        // warm ranges fill the gaps between cold ones. at is where the next
+        // gap would start.
+        std::string at;
+        for (const cold& c : colds) {
+            erase_from_tree(c.start, c.end);
+            if (c.start != at) ranges_.try_emplace(at).first->second.end = c.start;
+            range& r = ranges_.try_emplace(c.start).first->second;
+            r.end = c.end;
+            r.where = tier::cold;
+            r.block = static_cast<std::uint32_t>(c.block);
+            r.keys = c.keys;
+            r.bytes = c.bytes;
+            r.file_bytes = env_.open(block_path(r.block), open_mode::read_only)->size();
+            cold_file_bytes_ += r.file_bytes;
+            at = c.end;
+        }
+        if (colds.empty() || !at.empty()) ranges_.try_emplace(at);
+        for (auto it = ranges_.begin(); it != ranges_.end(); ++it)
+            if (it->second.where != tier::cold) measure(it);
+    }
+
+    void rebalance_loop() {
+        std::unique_lock<std::mutex> l(bg_mu_);
+        while (!bg_cv_.wait_for(l, std::chrono::milliseconds(opts_.rebalance_interval_ms), [&] { return stop_; })) {
+            l.unlock();
+            try {
+                rebalance();
+            } catch (const io_error&) {
+                errors_.fetch_add(1, std::memory_order_relaxed);
+            }
+            l.lock();
+        }
+    }
+
+    env& env_;
+    std::string dir_;
+    tiered_options opts_;
+    std::size_t cache_size_;
+
+    std::unique_ptr<bptree_store> tree_;
+    mem_store hot_;
+
+    // the range map and every range's tier. readers and writers of ranges
+    // that are not cold share it; placement takes it exclusively.
+    mutable std::shared_mutex mu_;
+    range_map ranges_;
+    std::uint32_t next_block_ = 0;
+    std::uint64_t cold_file_bytes_ = 0;
+    std::uint64_t rebalances_ = 0, splits_ = 0, freezes_ = 0, thaws_ = 0;
+    std::atomic<std::uint64_t> hot_reads_{0}, warm_reads_{0}, cold_reads_{0}, errors_{0};
+
+    adaptive_mutex cache_mu_;
+    std::list<std::pair<std::uint32_t, std::shared_ptr<const block>>> cache_;
+
+    std::mutex bg_mu_;
+    std::condition_variable bg_cv_;
+    bool stop_ = false;
+    std::thread rebalancer_;
+};
+
+} // namespace dsa
@@ -0,0 +1,103 @@
+#pragma once
+
+// per-operation stage accounting. while an op_trace is active on a thread,
+// the places where an operation can lose time mark themselves with a
+// stage_scope, and the trace splits the operation's wall time between the
+// stages: whatever no scope claims counts as memory, the in-memory index
+// and table work every operation does. scopes nest, and time inside an
+// inner scope is the inner stage's only.
+//
+// without an active trace a stage_scope is one thread-local load and a
+// branch, so engines and envs mark stages unconditionally. with one it
+// reads the clock twice, so only work that takes microseconds anyway is
+// marked: device i/o, lock waits, cache fills, decompression. times come
+// from the host's steady clock, not an env's, like lock profiles, and
+// include any time the thread was descheduled.
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+namespace dsa {
+
+enum class stage : unsigned {
+    memory,     // everything not claimed below
+    lock_wait,  // waiting for a contended engine lock
+    cache,      // filling a block cache on a miss
+    io,         // file reads, writes and syncs on a posix or simulated device
+    decompress, // expanding cold data
+};
+
+inline constexpr unsigned stage_count = 5;
+
+inline const char* stage_name(stage s) {
+    static const char* names[stage_count] = {"memory", "lock_wait", "cache", "io", "decompress"};
+    return names[static_cast<unsigned>(s)];
+}
+
+class op_trace {
+public:
+    op_trace() : start_(now()), since_(start_), outer_(current()) { current() = this; }
+    ~op_trace() { current() = outer_; }
+
+    op_trace(const op_trace&) = delete;
+    op_trace& operator=(const op_trace&) = delete;
+
+    static op_trace* active() { return current(); }
+
+    std::uint64_t start() const { return start_; }
+
+    static std::uint64_t now() {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    // charges the time since the last switch to the current stage and makes
+    // s current. returns the stage it replaced.
+    stage enter(stage s) { return switch_at(now(), s); }
+
+    // closes the trace at t and returns ns per stage.
+    std::array<std::uint64_t, stage_count> finish(std::uint64_t t) {
+        switch_at(t, cur_);
+        return ns_;
+    }
+
+private:
+    stage switch_at(std::uint64_t t, stage s) {
+        ns_[static_cast<unsigned>(cur_)] += t - since_;
+        since_ = t;
+        stage prev = cur_;
+        cur_ = s;
+        return prev;
+    }
+
+    static op_trace*& current() {
+        thread_local op_trace* t = nullptr;
+        return t;
+    }
+
+    std::array<std::uint64_t, stage_count> ns_{};
+    stage cur_ = stage::memory;
+    std::uint64_t start_, since_;
+    op_trace* outer_;
+};
+
+// time until the end of the scope belongs to s.
+class stage_scope {
+public:
+    explicit stage_scope(stage s) : t_(op_trace::active()) {
+        if (t_) prev_ = t_->enter(s);
+    }
+    ~stage_scope() {
+        if (t_) t_->enter(prev_);
+    }
+
+    stage_scope(const stage_scope&) = delete;
+    stage_scope& operator=(const stage_scope&) = delete;
+
+private:
+    op_trace* t_;
+    stage prev_ = stage::memory;
+};
+
+} // namespace dsa